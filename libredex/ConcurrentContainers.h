@@ -156,6 +156,32 @@ class ConcurrentMap final
                                  Hash,
                                  n_slots> {
  public:
+  /*
+   * Returns a copy of the value associated with `key`, or `default_value` if
+   * there is no such entry. This operation is always thread-safe.
+   */
+  Value get(const Key& key, Value default_value) {
+    size_t slot = Hash()(key) % n_slots;
+    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    const auto& map = this->get_container(slot);
+    const auto& it = map.find(key);
+    if (it == map.end()) {
+      return default_value;
+    }
+    return it->second;
+  }
+
+  /*
+   * Inserts the entry, overwriting any existing value for the same key.
+   * This operation is always thread-safe.
+   */
+  void insert_or_assign(const std::pair<Key, Value>& entry) {
+    size_t slot = Hash()(entry.first) % n_slots;
+    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    auto& map = this->get_container(slot);
+    map[entry.first] = entry.second;
+  }
+
   /*
    * The Boolean return value denotes whether the insertion took place.
    * This operation is always thread-safe.
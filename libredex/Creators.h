@@ -480,10 +480,10 @@ struct MethodCreator {
  * Once create is called this creator should not be used any longer.
  */
 struct ClassCreator {
-  explicit ClassCreator(DexType* type) {
+  explicit ClassCreator(DexType* type, const std::string& dex_location = "") {
     always_assert_log(type_class(type) == nullptr,
         "class already exists for %s\n", SHOW(type));
-    m_cls = new DexClass();
+    m_cls = new DexClass(dex_location);
     m_cls->m_self = type;
     m_cls->m_access_flags = (DexAccessFlags)0;
     m_cls->m_super_class = nullptr;
@@ -530,7 +530,7 @@ struct ClassCreator {
    * Set the external bit for the DexClass.
    */
   void set_external() {
-    m_cls->m_deobfuscated_name = show(m_cls);
+    m_cls->set_deobfuscated_name(m_cls->get_type()->get_name());
     m_cls->m_external = true;
   }
 
@@ -239,17 +239,43 @@ void DexEncodedValue::encode(DexOutputIdx* dodx, uint8_t*& encdata) {
     return;
   }
 }
-#define MAX_BUFFER_SIZE (4096)
+size_t DexEncodedValue::encoded_size_bound() const {
+  // The type byte and up to eight bytes of value.
+  return 1 + sizeof(uint64_t);
+}
+
+size_t DexEncodedValueArray::encoded_size_bound() const {
+  // The type byte, the uleb128 size, and the elements.
+  size_t bound = 1 + 5;
+  for (auto const& ev : *m_evalues) {
+    bound += ev->encoded_size_bound();
+  }
+  return bound;
+}
+
+size_t DexEncodedValueAnnotation::encoded_size_bound() const {
+  // The type byte, the uleb128 type and size, and the uleb128 name of each
+  // element with its value.
+  size_t bound = 1 + 5 + 5;
+  for (auto const& dae : *m_annotations) {
+    bound += 5 + dae.encoded_value->encoded_size_bound();
+  }
+  return bound;
+}
+
 void DexEncodedValue::vencode(DexOutputIdx* dodx, std::vector<uint8_t>& bytes) {
-  uint8_t buffer[MAX_BUFFER_SIZE];
-  uint8_t* pend = buffer;
+  // Encode straight into the end of bytes, which is grown by the bound first,
+  // so that arbitrarily large arrays fit.
+  auto start = bytes.size();
+  auto bound = encoded_size_bound();
+  bytes.resize(start + bound);
+  uint8_t* begin = bytes.data() + start;
+  uint8_t* pend = begin;
   encode(dodx, pend);
-  always_assert_log(pend - buffer <= MAX_BUFFER_SIZE,
+  always_assert_log((size_t)(pend - begin) <= bound,
                     "DexEncodedValue::vencode overflow, size %d\n",
-                    (int)(pend - buffer));
-  for (uint8_t* p = buffer; p < pend; p++) {
-    bytes.push_back(*p);
-  }
+                    (int)(pend - begin));
+  bytes.resize(start + (pend - begin));
 }
 
 void DexEncodedValueBit::encode(DexOutputIdx* dodx, uint8_t*& encdata) {
@@ -638,7 +664,7 @@ void DexAnnotationDirectory::vencode(
     always_assert_log(asetmap.count(m_class) != 0,
                       "Uninitialized aset %p '%s'",
                       m_class, show(m_class).c_str());
-    classoff = asetmap[m_class];
+    classoff = asetmap.at(m_class);
   }
   if (m_field) {
     cntaf = (uint32_t) m_field->size();
@@ -665,7 +691,7 @@ void DexAnnotationDirectory::vencode(
       always_assert_log(asetmap.count(das) != 0,
                         "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method) {
@@ -678,7 +704,7 @@ void DexAnnotationDirectory::vencode(
       always_assert_log(asetmap.count(das) != 0,
                         "Uninitialized aset %p '%s'",
                         das, show(das).c_str());
-      annodirout.push_back(asetmap[das]);
+      annodirout.push_back(asetmap.at(das));
     }
   }
   if (m_method_param) {
@@ -690,7 +716,7 @@ void DexAnnotationDirectory::vencode(
       annodirout.push_back(dodx->methodidx(p.first));
       always_assert_log(
           xrefmap.count(pa) != 0, "Uninitialized ParamAnnotations %p", pa);
-      annodirout.push_back(xrefmap[pa]);
+      annodirout.push_back(xrefmap.at(pa));
     }
   }
 }
@@ -712,7 +738,7 @@ void DexAnnotationSet::vencode(DexOutputIdx* dodx,
                       "Uninitialized annotation %p '%s', bailing\n",
                       anno,
                       show(anno).c_str());
-    asetout.push_back(annoout[anno]);
+    asetout.push_back(annoout.at(anno));
   }
 }
 
@@ -72,6 +72,8 @@ class DexEncodedValue : public Gatherable {
                                             const uint8_t*& encdata);
   DexEncodedValueTypes evtype() { return m_evtype; }
   virtual void encode(DexOutputIdx* dodx, uint8_t*& encdata);
+  // An upper bound on the number of bytes that encode writes.
+  virtual size_t encoded_size_bound() const;
   void vencode(DexOutputIdx* dodx, std::vector<uint8_t>& bytes);
 
   virtual std::string show() const;
@@ -250,6 +252,7 @@ class DexEncodedValueArray : public DexEncodedValue {
   void gather_methods(std::vector<DexMethodRef*>& lmethod) const override;
   void gather_strings(std::vector<DexString*>& lstring) const override;
   void encode(DexOutputIdx* dodx, uint8_t*& encdata) override;
+  size_t encoded_size_bound() const override;
 
   std::string show() const override;
   std::string show_deobfuscated() const override;
@@ -324,6 +327,7 @@ class DexEncodedValueAnnotation : public DexEncodedValue {
   void gather_methods(std::vector<DexMethodRef*>& lmethod) const override;
   void gather_strings(std::vector<DexString*>& lstring) const override;
   void encode(DexOutputIdx* dodx, uint8_t*& encdata) override;
+  size_t encoded_size_bound() const override;
 
   std::string show() const override;
   std::string show_deobfuscated() const override;
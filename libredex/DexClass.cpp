@@ -23,6 +23,7 @@
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
+#include "Resolver.h"
 #include "Util.h"
 #include "Warning.h"
 #include "Walkers.h"
@@ -274,10 +275,24 @@ std::vector<std::unique_ptr<DexDebugInstruction>> generate_debug_instructions(
 
 int DexDebugItem::encode(DexOutputIdx* dodx, PositionMapper* pos_mapper,
     uint8_t* output) {
-  uint8_t* encdata = output;
   uint32_t line_start{0};
-  auto dbgops =
-      generate_debug_instructions(this, dodx, pos_mapper, &line_start);
+  auto dbgops = generate_instructions(dodx, pos_mapper, &line_start);
+  return encode_instructions(dodx, line_start, dbgops, output);
+}
+
+std::vector<std::unique_ptr<DexDebugInstruction>>
+DexDebugItem::generate_instructions(DexOutputIdx* dodx,
+                                    PositionMapper* pos_mapper,
+                                    uint32_t* line_start) {
+  return generate_debug_instructions(this, dodx, pos_mapper, line_start);
+}
+
+int DexDebugItem::encode_instructions(
+    DexOutputIdx* dodx,
+    uint32_t line_start,
+    const std::vector<std::unique_ptr<DexDebugInstruction>>& dbgops,
+    uint8_t* output) {
+  uint8_t* encdata = output;
   encdata = write_uleb128(encdata, line_start);
   encdata = write_uleb128(encdata, (uint32_t) m_param_names.size());
   for (auto s : m_param_names) {
@@ -560,6 +575,36 @@ void DexClass::remove_method(const DexMethod* m) {
     meths.erase(it);
   }
   assert(erased);
+  invalidate_resolver_cache();
+}
+
+// Callers move members between the vectors of their class according to these
+// flags, so changing them invalidates the resolver cache.
+void DexField::set_access(DexAccessFlags access) {
+  always_assert_log(!m_external,
+      "Unexpected external field %s\n", SHOW(this));
+  if (access != m_access) {
+    m_access = access;
+    invalidate_resolver_cache();
+  }
+}
+
+void DexMethod::set_access(DexAccessFlags access) {
+  always_assert_log(!m_external,
+      "Unexpected external method %s\n", SHOW(this));
+  if (access != m_access) {
+    m_access = access;
+    invalidate_resolver_cache();
+  }
+}
+
+void DexMethod::set_virtual(bool is_virtual) {
+  always_assert_log(!m_external,
+      "Unexpected external method %s\n", SHOW(this));
+  if (is_virtual != m_virtual) {
+    m_virtual = is_virtual;
+    invalidate_resolver_cache();
+  }
 }
 
 void DexMethod::become_virtual() {
@@ -570,6 +615,7 @@ void DexMethod::become_virtual() {
   m_virtual = true;
   auto& vmethods = cls->get_vmethods();
   insert_sorted(vmethods, this, compare_dexmethods);
+  invalidate_resolver_cache();
 }
 
 void DexMethod::make_concrete(DexAccessFlags access,
@@ -682,6 +728,7 @@ void DexClass::add_method(DexMethod* m) {
   } else {
     insert_sorted(m_dmethods, m, compare_dexmethods);
   }
+  invalidate_resolver_cache();
 }
 
 void DexClass::add_field(DexField* f) {
@@ -695,6 +742,7 @@ void DexClass::add_field(DexField* f) {
   } else {
     insert_sorted(m_ifields, f, compare_dexfields);
   }
+  invalidate_resolver_cache();
 }
 
 void DexClass::remove_field(const DexField* f) {
@@ -707,6 +755,30 @@ void DexClass::remove_field(const DexField* f) {
     fields.erase(it);
   }
   assert(erase);
+  invalidate_resolver_cache();
+}
+
+void DexClass::set_access(DexAccessFlags access) {
+  always_assert_log(!m_external,
+      "Unexpected external class %s\n", SHOW(m_self));
+  if (access != m_access_flags) {
+    m_access_flags = access;
+    invalidate_resolver_cache();
+  }
+}
+
+void DexClass::set_super_class(DexType* super_class) {
+  always_assert_log(
+      !m_external, "Unexpected external class %s\n", SHOW(m_self));
+  m_super_class = super_class;
+  invalidate_resolver_cache();
+}
+
+void DexClass::set_interfaces(DexTypeList* intfs) {
+  always_assert_log(!m_external,
+      "Unexpected external class %s\n", SHOW(m_self));
+  m_interfaces = intfs;
+  invalidate_resolver_cache();
 }
 
 
@@ -126,6 +126,16 @@ class DexString {
   }
 };
 
+/**
+ * Deobfuscated names of classes and members are interned as DexStrings, so
+ * that all the names loaded from a ProGuard map are stored once. Classes and
+ * members that have none report an empty name.
+ */
+inline const std::string& deobfuscated_name_str(const DexString* name) {
+  static const std::string empty;
+  return name == nullptr ? empty : name->str();
+}
+
 /* Non-optimizing DexSpec compliant ordering */
 inline bool compare_dexstrings(const DexString* a, const DexString* b) {
   if (a == nullptr) {
@@ -296,7 +306,7 @@ class DexField : public DexFieldRef {
   DexAccessFlags m_access;
   DexAnnotationSet* m_anno;
   DexEncodedValue* m_value; /* Static Only */
-  std::string m_deobfuscated_name;
+  const DexString* m_deobfuscated_name{nullptr};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexField(DexType* container, DexString* name, DexType* type) :
@@ -344,16 +354,12 @@ class DexField : public DexFieldRef {
     return m_access;
   }
 
-  void set_access(DexAccessFlags access) {
-    always_assert_log(!m_external,
-        "Unexpected external field %s\n", SHOW(this));
-    m_access = access;
-  }
+  void set_access(DexAccessFlags access);
 
   void set_external() {
     always_assert_log(!m_concrete,
         "Unexpected concrete field %s\n", SHOW(this));
-    m_deobfuscated_name = show(this);
+    set_deobfuscated_name(show(this));
     m_external = true;
   }
 
@@ -372,9 +378,14 @@ class DexField : public DexFieldRef {
     return full_name.substr(dot_pos + 1, colon_pos-dot_pos - 1);
   }
 
-  void set_deobfuscated_name(std::string name) { m_deobfuscated_name = name; }
+  void set_deobfuscated_name(const std::string& name) {
+    m_deobfuscated_name = DexString::make_string(name);
+  }
+  void set_deobfuscated_name(const DexString* name) {
+    m_deobfuscated_name = name;
+  }
   const std::string& get_deobfuscated_name() const {
-    return m_deobfuscated_name;
+    return deobfuscated_name_str(m_deobfuscated_name);
   }
 
   void make_concrete(DexAccessFlags access_flags, DexEncodedValue* v = nullptr);
@@ -614,6 +625,19 @@ class DexDebugItem {
   /* Returns number of bytes encoded, *output has no alignment requirements */
   int encode(DexOutputIdx* dodx, PositionMapper* pos_mapper, uint8_t* output);
 
+  /*
+   * encode() in two steps. The PositionMapper numbers positions in the order
+   * in which it sees them, so generate_instructions() has to be called on the
+   * debug items in emit order; encode_instructions() can run concurrently.
+   */
+  std::vector<std::unique_ptr<DexDebugInstruction>> generate_instructions(
+      DexOutputIdx* dodx, PositionMapper* pos_mapper, uint32_t* line_start);
+  int encode_instructions(
+      DexOutputIdx* dodx,
+      uint32_t line_start,
+      const std::vector<std::unique_ptr<DexDebugInstruction>>& dbgops,
+      uint8_t* output);
+
   void gather_types(std::vector<DexType*>& ltype) const;
   void gather_strings(std::vector<DexString*>& lstring) const;
 };
@@ -784,7 +808,7 @@ class DexMethod : public DexMethodRef {
   DexAccessFlags m_access;
   bool m_virtual;
   ParamAnnotations m_param_anno;
-  std::string m_deobfuscated_name;
+  const DexString* m_deobfuscated_name{nullptr};
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexMethod(DexType* type, DexString* name, DexProto* proto);
@@ -879,9 +903,14 @@ class DexMethod : public DexMethodRef {
     return &m_param_anno;
   }
 
-  void set_deobfuscated_name(std::string name) { m_deobfuscated_name = name; }
+  void set_deobfuscated_name(const std::string& name) {
+    m_deobfuscated_name = DexString::make_string(name);
+  }
+  void set_deobfuscated_name(const DexString* name) {
+    m_deobfuscated_name = name;
+  }
   const std::string& get_deobfuscated_name() const {
-    return m_deobfuscated_name;
+    return deobfuscated_name_str(m_deobfuscated_name);
   }
 
   /** return just the name of the method */
@@ -899,22 +928,14 @@ class DexMethod : public DexMethodRef {
     return full_name.substr(dot_pos + 1, colon_pos-dot_pos - 1);
   }
 
-  void set_access(DexAccessFlags access) {
-    always_assert_log(!m_external,
-        "Unexpected external method %s\n", SHOW(this));
-    m_access = access;
-  }
+  void set_access(DexAccessFlags access);
 
-  void set_virtual(bool is_virtual) {
-    always_assert_log(!m_external,
-        "Unexpected external method %s\n", SHOW(this));
-    m_virtual = is_virtual;
-  }
+  void set_virtual(bool is_virtual);
 
   void set_external() {
     always_assert_log(!m_concrete,
         "Unexpected concrete method %s\n", SHOW(this));
-    m_deobfuscated_name = show(this);
+    set_deobfuscated_name(show(this));
     m_external = true;
   }
   void set_dex_code(std::unique_ptr<DexCode> code) {
@@ -979,14 +1000,15 @@ class DexClass {
   DexString* m_source_file;
   DexAnnotationSet* m_anno;
   bool m_external;
-  std::string m_deobfuscated_name;
+  const DexString* m_deobfuscated_name{nullptr};
   const std::string m_dex_location; // TODO: string interning
   std::vector<DexField*> m_sfields;
   std::vector<DexField*> m_ifields;
   std::vector<DexMethod*> m_dmethods;
   std::vector<DexMethod*> m_vmethods;
 
-  DexClass(){};
+  explicit DexClass(const std::string& dex_location = "")
+      : m_dex_location(dex_location){};
   void load_class_annotations(DexIdx* idx, uint32_t anno_off);
   void load_class_data_item(DexIdx* idx,
                             uint32_t cdi_off,
@@ -1002,6 +1024,9 @@ class DexClass {
 
  public:
   const std::vector<DexMethod*>& get_dmethods() const { return m_dmethods; }
+  // Callers adding or removing methods through the mutable accessors must
+  // call invalidate_resolver_cache() (see Resolver.h); prefer add_method and
+  // remove_method, which take care of it.
   std::vector<DexMethod*>& get_dmethods() {
     always_assert_log(!m_external,
         "Unexpected external class %s\n", SHOW(m_self));
@@ -1067,31 +1092,24 @@ class DexClass {
   DexAnnotationSet* get_anno_set() { return m_anno; }
   void attach_annotation_set(DexAnnotationSet* anno) { m_anno = anno; }
   void set_source_file(DexString* source_file) { m_source_file = source_file; }
-  void set_deobfuscated_name(std::string name) { m_deobfuscated_name = name; }
+  void set_deobfuscated_name(const std::string& name) {
+    m_deobfuscated_name = DexString::make_string(name);
+  }
+  void set_deobfuscated_name(const DexString* name) {
+    m_deobfuscated_name = name;
+  }
   const std::string& get_deobfuscated_name() const {
-    return m_deobfuscated_name;
+    return deobfuscated_name_str(m_deobfuscated_name);
   }
   const std::string& get_dex_location() const {
     return m_dex_location;
   }
 
-  void set_access(DexAccessFlags access) {
-    always_assert_log(!m_external,
-        "Unexpected external class %s\n", SHOW(m_self));
-    m_access_flags = access;
-  }
+  void set_access(DexAccessFlags access);
 
-  void set_super_class(DexType* super_class) {
-    always_assert_log(
-        !m_external, "Unexpected external class %s\n", SHOW(m_self));
-    m_super_class = super_class;
-  }
+  void set_super_class(DexType* super_class);
 
-  void set_interfaces(DexTypeList* intfs) {
-    always_assert_log(!m_external,
-        "Unexpected external class %s\n", SHOW(m_self));
-    m_interfaces = intfs;
-  }
+  void set_interfaces(DexTypeList* intfs);
 
   void clear_annotations() {
     delete m_anno;
@@ -15,6 +15,7 @@
 #include <functional>
 #include <exception>
 #include <assert.h>
+#include <boost/optional.hpp>
 
 #ifdef _MSC_VER
 // TODO: Rewrite open/write/close with C/C++ standards. But it works for now.
@@ -29,9 +30,11 @@
 #define O_WRONLY _O_WRONLY
 #endif
 
+#include "Adler32.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexOutput.h"
+#include "DexOutputBuffer.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "Pass.h"
@@ -114,6 +117,26 @@ std::vector<DexString*> GatheredTypes::keep_cls_strings_together_emitlist() {
         compare_dexstrings));
 }
 
+std::vector<DexString*> GatheredTypes::get_coldstart_order_dexstring_emitlist() {
+  return get_dexstring_emitlist(CustomSort<DexString, cmp_dstring>(
+        m_coldstart_strings,
+        compare_dexstrings));
+}
+
+std::vector<DexClass*> GatheredTypes::get_coldstart_order_class_emitlist() {
+  std::vector<DexClass*> classes(m_classes->begin(), m_classes->end());
+  std::stable_sort(classes.begin(), classes.end(),
+    [this](const DexClass* a, const DexClass* b) {
+      auto a_it = m_coldstart_classes.find(a);
+      auto b_it = m_coldstart_classes.find(b);
+      if (b_it == m_coldstart_classes.end()) {
+        return a_it != m_coldstart_classes.end();
+      }
+      return a_it != m_coldstart_classes.end() && a_it->second < b_it->second;
+    });
+  return classes;
+}
+
 std::vector<DexMethod*> GatheredTypes::get_dexmethod_emitlist() {
   std::vector<DexMethod*> methlist;
   for (auto cls : *m_classes) {
@@ -137,6 +160,19 @@ void GatheredTypes::sort_dexmethod_emitlist_cls_order(
   );
 }
 
+void GatheredTypes::sort_dexmethod_emitlist_coldstart_order(
+    std::vector<DexMethod*>& lmeth) {
+  std::stable_sort(lmeth.begin(), lmeth.end(),
+    [this](const DexMethod* a, const DexMethod* b) {
+      auto a_it = m_coldstart_methods.find(a);
+      auto b_it = m_coldstart_methods.find(b);
+      if (b_it == m_coldstart_methods.end()) {
+        return a_it != m_coldstart_methods.end();
+      }
+      return a_it != m_coldstart_methods.end() && a_it->second < b_it->second;
+    });
+}
+
 void GatheredTypes::sort_dexmethod_emitlist_clinit_order(
     std::vector<DexMethod*>& lmeth) {
   std::stable_sort(lmeth.begin(), lmeth.end(),
@@ -307,6 +343,42 @@ void GatheredTypes::build_method_map() {
   }
 }
 
+void GatheredTypes::build_coldstart_maps(
+    const std::vector<std::string>& method_trace) {
+  std::unordered_set<const DexClass*> classes(m_classes->begin(),
+                                              m_classes->end());
+  for (const auto& name : method_trace) {
+    auto ref = DexMethod::get_method(name);
+    if (ref == nullptr || !ref->is_def()) continue;
+    auto m = static_cast<DexMethod*>(ref);
+    auto cls = type_class(m->get_class());
+    if (!classes.count(cls) || m_coldstart_methods.count(m)) continue;
+    m_coldstart_methods.emplace(m, m_coldstart_methods.size());
+    m_coldstart_classes.emplace(cls, m_coldstart_classes.size());
+
+    // Loading the class reads the names of its type and supertype, and
+    // running the method those of everything it refers to.
+    std::vector<DexType*> types{cls->get_type()};
+    if (cls->get_super_class() != nullptr) {
+      types.push_back(cls->get_super_class());
+    }
+    m->gather_types(types);
+    std::vector<DexString*> strings;
+    for (auto t : types) {
+      strings.push_back(t->get_name());
+    }
+    m->gather_strings(strings);
+    for (auto str : strings) {
+      m_coldstart_strings.emplace(str, m_coldstart_strings.size());
+    }
+  }
+  TRACE(CUSTOMSORT, 1,
+        "cold-start trace: %lu methods, %lu classes, %lu strings in this dex\n",
+        m_coldstart_methods.size(),
+        m_coldstart_classes.size(),
+        m_coldstart_strings.size());
+}
+
 void GatheredTypes::gather_components() {
   // Gather references reachable from each class.
   for (auto const& cls : *m_classes) {
@@ -355,6 +427,7 @@ public:
   DexClasses* m_classes;
   DexOutputIdx* dodx;
   GatheredTypes* m_gtypes;
+  std::unique_ptr<DexOutputBuffer> m_buffer;
   uint8_t* m_output;
   uint32_t m_offset;
   const char* m_filename;
@@ -373,6 +446,7 @@ public:
   std::vector<dex_map_item> m_map_items;
   LocatorIndex* m_locator_index;
   ConfigFiles& m_config_files;
+  unsigned m_num_threads;
 
   void insert_map_item(uint16_t typeidx, uint32_t size, uint32_t offset);
   void generate_string_data(SortMode mode = SortMode::DEFAULT);
@@ -381,7 +455,7 @@ public:
   void generate_field_data();
   void generate_method_data();
   void generate_class_data();
-  void generate_class_data_items();
+  void generate_class_data_items(const std::vector<SortMode>& modes);
 
   // Sort code according to a sequence of sorting modes, ordered by precedence.
   // e.g. passing {SortMode::CLINIT_FIRST, SortMode::CLASS_ORDER} means that
@@ -409,8 +483,15 @@ public:
   void init_header_offsets();
   void write_symbol_files();
   void align_output() { m_offset = (m_offset + 3) & ~3; }
-  void emit_locator(Locator locator);
-  std::unique_ptr<Locator> locator_for_descriptor(
+  // Where to write the `size` bytes of the next item, checked against the
+  // capacity of the buffer.
+  uint8_t* output(size_t size, const char* what) {
+    return m_buffer->at(m_offset, size, what);
+  }
+  void record_section_bytes();
+  std::vector<std::string> encode_locators(
+    const std::vector<DexString*>& string_order);
+  boost::optional<Locator> locator_for_descriptor(
     const std::unordered_set<DexString*>& type_names,
     DexString* descriptor);
 
@@ -425,7 +506,9 @@ public:
     const std::string& method_mapping_path,
     const std::string& class_mapping_path,
     const std::string& pg_mapping_path,
-    const std::string& bytecode_offset_path);
+    const std::string& bytecode_offset_path,
+    unsigned num_threads =
+        std::max(1u, boost::thread::hardware_concurrency()));
   ~DexOutput();
   void prepare(SortMode string_mode, const std::vector<SortMode>& code_mode);
   void write();
@@ -441,12 +524,13 @@ DexOutput::DexOutput(
   const std::string& method_mapping_filename,
   const std::string& class_mapping_filename,
   const std::string& pg_mapping_filename,
-  const std::string& bytecode_offset_filename)
-    : m_config_files(config_files)
+  const std::string& bytecode_offset_filename,
+  unsigned num_threads)
+    : m_config_files(config_files), m_num_threads(num_threads)
 {
   m_classes = classes;
-  m_output = (uint8_t*)malloc(k_max_dex_size);
-  memset(m_output, 0, k_max_dex_size);
+  m_buffer.reset(new DexOutputBuffer(k_max_dex_size));
+  m_output = m_buffer->data();
   m_offset = 0;
   m_gtypes = new GatheredTypes(classes);
   dodx = m_gtypes->get_dodx(m_output);
@@ -463,7 +547,6 @@ DexOutput::DexOutput(
 DexOutput::~DexOutput() {
   delete m_gtypes;
   delete dodx;
-  free(m_output);
 }
 
 void DexOutput::insert_map_item(uint16_t maptype,
@@ -477,16 +560,62 @@ void DexOutput::insert_map_item(uint16_t maptype,
   m_map_items.emplace_back(item);
 }
 
-void DexOutput::emit_locator(Locator locator) {
-  char buf[Locator::encoded_max];
-  size_t locator_length = locator.encode(buf);
-  write_uleb128(m_output + m_offset, (uint32_t) locator_length);
-  m_offset += uleb128_encoding_size((uint32_t) locator_length);
-  memcpy(m_output + m_offset, buf, locator_length + 1);
-  m_offset += locator_length + 1;
+/*
+ * Run fn on the indices [0, n). Most of the sections below are written in two
+ * phases: their items are encoded in parallel into scratch buffers, and then
+ * copied into the output at the offsets computed from the encoded sizes.
+ */
+static void parallel_for(size_t n,
+                         unsigned num_threads,
+                         const std::function<void(size_t)>& fn) {
+  if (num_threads <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  auto wq = workqueue_foreach<size_t>(fn, num_threads);
+  for (size_t i = 0; i < n; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+}
+
+/*
+ * The string data item of the locator string to emit before each of the
+ * strings, or an empty string for those that have none. The locators are
+ * looked up once, in parallel, and then used both to count the strings and to
+ * emit them.
+ */
+std::vector<std::string> DexOutput::encode_locators(
+  const std::vector<DexString*>& string_order)
+{
+  std::vector<std::string> locators(string_order.size());
+  if (m_locator_index == nullptr) {
+    return locators;
+  }
+  std::unordered_set<DexString*> type_names = m_gtypes->index_type_names();
+  constexpr size_t kChunkSize = 1024;
+  size_t num_chunks = (string_order.size() + kChunkSize - 1) / kChunkSize;
+  parallel_for(num_chunks, m_num_threads, [&](size_t chunk) {
+    auto end = std::min(string_order.size(), (chunk + 1) * kChunkSize);
+    for (size_t i = chunk * kChunkSize; i < end; ++i) {
+      auto locator = locator_for_descriptor(type_names, string_order[i]);
+      if (!locator) {
+        continue;
+      }
+      char buf[Locator::encoded_max];
+      uint32_t locator_length = locator->encode(buf);
+      auto& item = locators[i];
+      item.resize(uleb128_encoding_size(locator_length));
+      write_uleb128((uint8_t*)&item[0], locator_length);
+      item.append(buf, locator_length + 1);
+    }
+  });
+  return locators;
 }
 
-std::unique_ptr<Locator>
+boost::optional<Locator>
 DexOutput::locator_for_descriptor(
   const std::unordered_set<DexString*>& type_names,
   DexString* descriptor)
@@ -497,7 +626,7 @@ DexOutput::locator_for_descriptor(
     if (locator_it != locator_index->end()) {
       // This string is the name of a type we define in one of our
       // dex files.
-      return std::unique_ptr<Locator>(new Locator(locator_it->second));
+      return locator_it->second;
     }
 
     if (type_names.count(descriptor)) {
@@ -510,7 +639,7 @@ DexOutput::locator_for_descriptor(
         if (elementDescriptor != nullptr) {
           locator_it = locator_index->find(elementDescriptor);
           if (locator_it != locator_index->end()) {
-            return std::unique_ptr<Locator>(new Locator(locator_it->second));
+            return locator_it->second;
           }
         }
       }
@@ -518,11 +647,27 @@ DexOutput::locator_for_descriptor(
       // We have the name of a type, but it's not a type we define.
       // Emit the special locator that indicates we should look in the
       // system classloader.
-      return std::unique_ptr<Locator>(new Locator(Locator::make(0, 0, 0)));
+      return Locator::make(0, 0, 0);
     }
   }
 
-  return nullptr;
+  return boost::none;
+}
+
+/*
+ * The number of 4K pages that the given (offset, size) ranges touch.
+ */
+static int count_pages(const std::vector<std::pair<uint32_t, uint32_t>>& ranges) {
+  constexpr uint32_t kPageSize = 4096;
+  std::unordered_set<uint32_t> pages;
+  for (const auto& range : ranges) {
+    if (range.second == 0) continue;
+    auto last = (range.first + range.second - 1) / kPageSize;
+    for (auto page = range.first / kPageSize; page <= last; ++page) {
+      pages.insert(page);
+    }
+  }
+  return pages.size();
 }
 
 void DexOutput::generate_string_data(SortMode mode) {
@@ -541,39 +686,46 @@ void DexOutput::generate_string_data(SortMode mode) {
   } else if (mode == SortMode::CLASS_STRINGS) {
     TRACE(CUSTOMSORT, 2, "using class names pack for string pool sorting\n");
     string_order = m_gtypes->keep_cls_strings_together_emitlist();
+  } else if (mode == SortMode::COLDSTART_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using cold-start order for string pool sorting\n");
+    string_order = m_gtypes->get_coldstart_order_dexstring_emitlist();
   } else {
     TRACE(CUSTOMSORT, 2, "using default string pool sorting\n");
     string_order = m_gtypes->get_dexstring_emitlist();
   }
   dex_string_id* stringids = (dex_string_id*)(m_output + hdr.string_ids_off);
 
-  std::unordered_set<DexString*> type_names = m_gtypes->index_type_names();
+  std::vector<std::string> locators = encode_locators(string_order);
   unsigned locator_size = 0;
 
   // If we're generating locator strings, we need to include them in
   // the total count of strings in this section.
   size_t nrstr = string_order.size();
-  for (DexString* str : string_order) {
-    if (locator_for_descriptor(type_names, str)) {
+  for (const auto& locator : locators) {
+    if (!locator.empty()) {
       nrstr += 1;
     }
   }
 
+  uint32_t str_start = m_offset;
   insert_map_item(TYPE_STRING_DATA_ITEM, (uint32_t) nrstr, m_offset);
-  for (DexString* str : string_order) {
+  for (size_t i = 0; i < string_order.size(); ++i) {
+    DexString* str = string_order[i];
     // Emit lookup acceleration string if requested
-    std::unique_ptr<Locator> locator = locator_for_descriptor(type_names, str);
-    if (locator) {
-      unsigned orig_offset = m_offset;
-      emit_locator(*locator);
-      locator_size += m_offset - orig_offset;
+    const auto& locator = locators[i];
+    if (!locator.empty()) {
+      memcpy(output(locator.size(), "locator string"),
+             locator.data(),
+             locator.size());
+      m_offset += locator.size();
+      locator_size += locator.size();
     }
 
     // Emit the string itself
     uint32_t idx = dodx->stringidx(str);
     TRACE(CUSTOMSORT, 3, "str emit %s\n", SHOW(str));
     stringids[idx].offset = m_offset;
-    str->encode(m_output + m_offset);
+    str->encode(output(str->get_entry_size(), "string data"));
     m_offset += str->get_entry_size();
     m_stats.num_strings++;
   }
@@ -581,6 +733,27 @@ void DexOutput::generate_string_data(SortMode mode) {
   if (m_locator_index != nullptr) {
     TRACE(LOC, 1, "Used %u bytes for locator strings\n", locator_size);
   }
+
+  if (mode == SortMode::COLDSTART_ORDER) {
+    // Compare against the default order, leaving out the locator strings.
+    std::vector<std::pair<uint32_t, uint32_t>> before;
+    std::vector<std::pair<uint32_t, uint32_t>> after;
+    uint32_t offset = str_start;
+    for (DexString* str : m_gtypes->get_dexstring_emitlist()) {
+      if (m_gtypes->is_coldstart(str)) {
+        before.emplace_back(offset, str->get_entry_size());
+        after.emplace_back((uint32_t)stringids[dodx->stringidx(str)].offset,
+                           str->get_entry_size());
+      }
+      offset += str->get_entry_size();
+    }
+    m_stats.num_coldstart_string_pages_default = count_pages(before);
+    m_stats.num_coldstart_string_pages = count_pages(after);
+    TRACE(CUSTOMSORT, 1,
+          "cold-start strings touch %d pages, %d in the default order\n",
+          m_stats.num_coldstart_string_pages,
+          m_stats.num_coldstart_string_pages_default);
+  }
 }
 
 void DexOutput::generate_type_data() {
@@ -615,7 +788,10 @@ void DexOutput::generate_typelist_data() {
     ++num_tls;
     align_output();
     m_tl_emit_offsets[tl] = m_offset;
-    int size = tl->encode(dodx, (uint32_t*)(m_output + m_offset));
+    auto out = output(
+        sizeof(uint32_t) + tl->get_type_list().size() * sizeof(uint16_t),
+        "type list");
+    int size = tl->encode(dodx, (uint32_t*)out);
     m_offset += size;
     m_stats.num_type_lists++;
   }
@@ -715,7 +891,7 @@ void DexOutput::generate_class_data() {
   }
 }
 
-void DexOutput::generate_class_data_items() {
+void DexOutput::generate_class_data_items(const std::vector<SortMode>& modes) {
   /*
    * First generate a dexcode_to_offset needed for the encoding
    * of class_data_items
@@ -726,17 +902,51 @@ void DexOutput::generate_class_data_items() {
     uint32_t offset = (uint32_t) (((uint8_t*)it.second) - m_output);
     dco[it.first] = offset;
   }
-  for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
-    DexClass* clz = m_classes->at(i);
+  // The class data of the classes that run at cold start is read when they
+  // are loaded, so put it together in the order they are.
+  std::vector<DexClass*> classes;
+  if (std::find(modes.begin(), modes.end(), SortMode::COLDSTART_ORDER) !=
+      modes.end()) {
+    classes = m_gtypes->get_coldstart_order_class_emitlist();
+  } else {
+    classes.assign(m_classes->begin(), m_classes->end());
+  }
+  for (DexClass* clz : classes) {
     if (!clz->has_class_data()) continue;
     /* No alignment constraints for this data */
-    int size = clz->encode(dodx, dco, m_output + m_offset);
+    // The counts, plus the index delta and access flags of every field and
+    // those and the code offset of every method, as leb128s of up to 5 bytes.
+    size_t bound = 5 * (4 +
+                        2 * (clz->get_sfields().size() +
+                             clz->get_ifields().size()) +
+                        3 * (clz->get_dmethods().size() +
+                             clz->get_vmethods().size()));
+    int size = clz->encode(dodx, dco, output(bound, "class data item"));
     m_cdi_offsets[clz] = m_offset;
     m_offset += size;
   }
   insert_map_item(TYPE_CLASS_DATA_ITEM, (uint32_t) m_cdi_offsets.size(), cdi_start);
 }
 
+/*
+ * An upper bound on the size of the code item that DexCode::encode writes.
+ */
+static size_t code_item_size_bound(const DexCode* code) {
+  size_t size = sizeof(dex_code_item);
+  for (const auto& insn : code->get_instructions()) {
+    size += insn->size() * sizeof(uint16_t);
+  }
+  const auto& tries = code->get_tries();
+  if (!tries.empty()) {
+    // Padding, the tries, and the handlers, with at most 5 bytes per leb128.
+    size += sizeof(uint16_t) + 5;
+    for (const auto& dextry : tries) {
+      size += sizeof(dex_tries_item) + 5 + dextry->m_catches.size() * 10;
+    }
+  }
+  return size;
+}
+
 static void sync_all(const Scope& scope) {
   constexpr bool serial = false; // for debugging
   auto wq = workqueue_foreach<DexMethod*>([](DexMethod* m){m->sync();});
@@ -767,6 +977,7 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
 
   // Repeatedly perform stable sorts starting with the last (least important)
   // sorting method specified.
+  bool coldstart_order = false;
   for (auto it = mode.rbegin(); it != mode.rend(); ++it) {
     switch (*it) {
       case SortMode::CLASS_ORDER:
@@ -778,6 +989,11 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         m_gtypes->sort_dexmethod_emitlist_clinit_order(lmeth);
         break;
 
+      case SortMode::COLDSTART_ORDER:
+        TRACE(CUSTOMSORT, 2, "using cold-start order for bytecode sorting\n");
+        m_gtypes->sort_dexmethod_emitlist_coldstart_order(lmeth);
+        coldstart_order = true;
+        break;
       case SortMode::CLASS_STRINGS:
         TRACE(CUSTOMSORT, 2, "Unsupport bytecode sorting method SortMode::CLASS_STRINGS");
         break;
@@ -787,24 +1003,73 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         break;
     }
   }
+  std::vector<DexMethod*> emitted;
+  emitted.reserve(lmeth.size());
   for (DexMethod* meth : lmeth) {
     if (meth->get_access() & (ACC_ABSTRACT | ACC_NATIVE)) {
       // There is no code item for ABSTRACT or NATIVE methods.
       continue;
     }
-    TRACE(CUSTOMSORT, 3, "method emit %s %s\n", SHOW(meth->get_class()), SHOW(meth));
-    DexCode* code = meth->get_dex_code();
     always_assert_log(
-        meth->is_concrete() && code != nullptr,
+        meth->is_concrete() && meth->get_dex_code() != nullptr,
         "Undefined method in generate_code_items()\n\t prototype: %s\n", SHOW(meth));
+    emitted.push_back(meth);
+  }
+
+  std::vector<std::vector<uint32_t>> encoded(emitted.size());
+  std::vector<uint32_t> sizes(emitted.size());
+  parallel_for(emitted.size(), m_num_threads, [&](size_t i) {
+    DexCode* code = emitted[i]->get_dex_code();
+    auto bound = code_item_size_bound(code);
+    encoded[i].resize((bound + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    sizes[i] = code->encode(dodx, encoded[i].data());
+    always_assert(sizes[i] <= bound);
+  });
+
+  std::vector<uint32_t> offsets(emitted.size());
+  for (size_t i = 0; i < emitted.size(); ++i) {
+    DexMethod* meth = emitted[i];
+    DexCode* code = meth->get_dex_code();
+    TRACE(CUSTOMSORT, 3, "method emit %s %s\n", SHOW(meth->get_class()), SHOW(meth));
     align_output();
-    int size = code->encode(dodx, (uint32_t*)(m_output + m_offset));
+    offsets[i] = m_offset;
     m_method_bytecode_offsets.emplace_back(meth->get_name()->c_str(), m_offset);
-    m_code_item_emits.emplace_back(code,
-                                   (dex_code_item*)(m_output + m_offset));
-    m_offset += size;
+    m_code_item_emits.emplace_back(
+        code, (dex_code_item*)output(sizes[i], "code item"));
+    m_offset += sizes[i];
     m_stats.num_instructions += code->get_instructions().size();
   }
+  parallel_for(emitted.size(), m_num_threads, [&](size_t i) {
+    memcpy(m_output + offsets[i], encoded[i].data(), sizes[i]);
+  });
+
+  if (coldstart_order) {
+    // Compare against the default order.
+    std::vector<size_t> order(emitted.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return compare_dexmethods(emitted[a], emitted[b]);
+    });
+    std::vector<std::pair<uint32_t, uint32_t>> before;
+    std::vector<std::pair<uint32_t, uint32_t>> after;
+    uint32_t offset = ci_start;
+    for (auto i : order) {
+      offset = (offset + 3) & ~3;
+      if (m_gtypes->is_coldstart(emitted[i])) {
+        before.emplace_back(offset, sizes[i]);
+        after.emplace_back(offsets[i], sizes[i]);
+      }
+      offset += sizes[i];
+    }
+    m_stats.num_coldstart_code_pages_default = count_pages(before);
+    m_stats.num_coldstart_code_pages = count_pages(after);
+    TRACE(CUSTOMSORT, 1,
+          "cold-start code items touch %d pages, %d in the default order\n",
+          m_stats.num_coldstart_code_pages,
+          m_stats.num_coldstart_code_pages_default);
+  }
   insert_map_item(TYPE_CODE_ITEM, (uint32_t) m_code_item_emits.size(), ci_start);
 }
 
@@ -826,13 +1091,13 @@ void DexOutput::generate_static_values() {
     if (enc_arrays.count(*deva)) {
       m_static_values[clz] = enc_arrays.at(*deva);
     } else {
-      uint8_t* output = m_output + m_offset;
-      uint8_t* outputsv = output;
+      std::vector<uint8_t> bytes;
+      deva->vencode(dodx, bytes);
       /* No alignment requirements */
-      deva->encode(dodx, output);
+      memcpy(output(bytes.size(), "static values"), bytes.data(), bytes.size());
       enc_arrays.emplace(std::move(*deva.release()), m_offset);
       m_static_values[clz] = m_offset;
-      m_offset += output - outputsv;
+      m_offset += bytes.size();
       m_stats.num_static_values++;
     }
   }
@@ -846,15 +1111,42 @@ static bool annotation_cmp(const DexAnnotationDirectory* a,
   return (a->viz_score() < b->viz_score());
 }
 
+/*
+ * Encode the items of `list` that are not yet in `emitted` in parallel, each
+ * of them once even if it appears several times in the list.
+ */
+template <typename Bytes, typename T, typename Encode>
+static std::unordered_map<T*, Bytes> encode_unique(
+    const std::map<T*, uint32_t>& emitted,
+    const std::vector<T*>& list,
+    const Encode& encode,
+    unsigned num_threads) {
+  std::unordered_map<T*, Bytes> encoded;
+  std::vector<T*> items;
+  for (auto item : list) {
+    if (emitted.count(item) || encoded.count(item)) continue;
+    encoded[item];
+    items.push_back(item);
+  }
+  parallel_for(items.size(), num_threads, [&](size_t i) {
+    encode(items[i], encoded.at(items[i]));
+  });
+  return encoded;
+}
+
 void DexOutput::unique_annotations(annomap_t& annomap,
                                    std::vector<DexAnnotation*>& annolist) {
   int annocnt = 0;
   uint32_t mentry_offset = m_offset;
   std::map<std::vector<uint8_t>, uint32_t> annotation_byte_offsets;
+  auto encoded = encode_unique<std::vector<uint8_t>>(
+      annomap, annolist, [&](DexAnnotation* anno, std::vector<uint8_t>& bytes) {
+        anno->vencode(dodx, bytes);
+      },
+      m_num_threads);
   for (auto anno : annolist) {
     if (annomap.count(anno)) continue;
-    std::vector<uint8_t> annotation_bytes;
-    anno->vencode(dodx, annotation_bytes);
+    const auto& annotation_bytes = encoded.at(anno);
     if (annotation_byte_offsets.count(annotation_bytes)) {
       annomap[anno] = annotation_byte_offsets[annotation_bytes];
       continue;
@@ -863,7 +1155,7 @@ void DexOutput::unique_annotations(annomap_t& annomap,
     annotation_byte_offsets[annotation_bytes] = m_offset;
     annomap[anno] = m_offset;
     /* Not a dupe, encode... */
-    uint8_t* annoout = (uint8_t*)(m_output + m_offset);
+    uint8_t* annoout = output(annotation_bytes.size(), "annotation item");
     memcpy(annoout, &annotation_bytes[0], annotation_bytes.size());
     m_offset += annotation_bytes.size();
     annocnt++;
@@ -880,10 +1172,16 @@ void DexOutput::unique_asets(annomap_t& annomap,
   int asetcnt = 0;
   uint32_t mentry_offset = m_offset;
   std::map<std::vector<uint32_t>, uint32_t> aset_offsets;
+  auto encoded = encode_unique<std::vector<uint32_t>>(
+      asetmap,
+      asetlist,
+      [&](DexAnnotationSet* aset, std::vector<uint32_t>& bytes) {
+        aset->vencode(dodx, bytes, annomap);
+      },
+      m_num_threads);
   for (auto aset : asetlist) {
     if (asetmap.count(aset)) continue;
-    std::vector<uint32_t> aset_bytes;
-    aset->vencode(dodx, aset_bytes, annomap);
+    const auto& aset_bytes = encoded.at(aset);
     if (aset_offsets.count(aset_bytes)) {
       asetmap[aset] = aset_offsets[aset_bytes];
       continue;
@@ -892,7 +1190,8 @@ void DexOutput::unique_asets(annomap_t& annomap,
     aset_offsets[aset_bytes] = m_offset;
     asetmap[aset] = m_offset;
     /* Not a dupe, encode... */
-    uint8_t* asetout = (uint8_t*)(m_output + m_offset);
+    uint8_t* asetout =
+        output(aset_bytes.size() * sizeof(uint32_t), "annotation set");
     memcpy(asetout, &aset_bytes[0], aset_bytes.size() * sizeof(uint32_t));
     m_offset += aset_bytes.size() * sizeof(uint32_t);
     asetcnt++;
@@ -926,7 +1225,8 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
     xref_offsets[xref_bytes] = m_offset;
     xrefmap[xref] = m_offset;
     /* Not a dupe, encode... */
-    uint8_t* xrefout = (uint8_t*)(m_output + m_offset);
+    uint8_t* xrefout =
+        output(xref_bytes.size() * sizeof(uint32_t), "annotation set ref list");
     memcpy(xrefout, &xref_bytes[0], xref_bytes.size() * sizeof(uint32_t));
     m_offset += xref_bytes.size() * sizeof(uint32_t);
     xrefcnt++;
@@ -943,10 +1243,16 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
   int adircnt = 0;
   uint32_t mentry_offset = m_offset;
   std::map<std::vector<uint32_t>, uint32_t> adir_offsets;
+  auto encoded = encode_unique<std::vector<uint32_t>>(
+      adirmap,
+      adirlist,
+      [&](DexAnnotationDirectory* adir, std::vector<uint32_t>& bytes) {
+        adir->vencode(dodx, bytes, xrefmap, asetmap);
+      },
+      m_num_threads);
   for (auto adir : adirlist) {
     if (adirmap.count(adir)) continue;
-    std::vector<uint32_t> adir_bytes;
-    adir->vencode(dodx, adir_bytes, xrefmap, asetmap);
+    const auto& adir_bytes = encoded.at(adir);
     if (adir_offsets.count(adir_bytes)) {
       adirmap[adir] = adir_offsets[adir_bytes];
       continue;
@@ -955,7 +1261,8 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
     adir_offsets[adir_bytes] = m_offset;
     adirmap[adir] = m_offset;
     /* Not a dupe, encode... */
-    uint8_t* adirout = (uint8_t*)(m_output + m_offset);
+    uint8_t* adirout =
+        output(adir_bytes.size() * sizeof(uint32_t), "annotations directory");
     memcpy(adirout, &adir_bytes[0], adir_bytes.size() * sizeof(uint32_t));
     m_offset += adir_bytes.size() * sizeof(uint32_t);
     adircnt++;
@@ -1019,24 +1326,105 @@ void DexOutput::generate_annotations() {
 
 void DexOutput::generate_debug_items() {
   uint32_t dbg_start = m_offset;
-  int dbgcount = 0;
+  struct DebugItemEmit {
+    DexDebugItem* dbg;
+    dex_code_item* dci;
+    uint32_t line_start{0};
+    std::vector<std::unique_ptr<DexDebugInstruction>> dbgops;
+    std::vector<uint8_t> encoded;
+  };
+  std::vector<DebugItemEmit> emits;
   for (auto& it : m_code_item_emits) {
     DexCode* dc = it.first;
-    dex_code_item* dci = it.second;
     auto dbg = dc->get_debug_item();
     if (dbg == nullptr) continue;
-    dbgcount++;
+    emits.emplace_back();
+    auto& emit = emits.back();
+    emit.dbg = dbg;
+    emit.dci = it.second;
+    // Positions are mapped in emit order.
+    emit.dbgops =
+        dbg->generate_instructions(dodx, m_pos_mapper, &emit.line_start);
+  }
+
+  parallel_for(emits.size(), m_num_threads, [&](size_t i) {
+    auto& emit = emits[i];
+    // The header, the parameter names, and the opcodes with up to four
+    // leb128 operands each.
+    size_t bound = 2 * 5 + emit.dbg->get_param_names().size() * 5 +
+                   emit.dbgops.size() * (1 + 4 * 5) + 1;
+    emit.encoded.resize(bound);
+    auto size = emit.dbg->encode_instructions(
+        dodx, emit.line_start, emit.dbgops, emit.encoded.data());
+    always_assert((size_t)size <= bound);
+    emit.encoded.resize(size);
+  });
+
+  std::vector<uint32_t> offsets(emits.size());
+  for (size_t i = 0; i < emits.size(); ++i) {
     // No align requirement for debug items.
-    int size = dbg->encode(dodx, m_pos_mapper, m_output + m_offset);
-    dci->debug_info_off = m_offset;
-    m_offset += size;
+    offsets[i] = m_offset;
+    output(emits[i].encoded.size(), "debug info item");
+    emits[i].dci->debug_info_off = m_offset;
+    m_offset += emits[i].encoded.size();
+  }
+  parallel_for(emits.size(), m_num_threads, [&](size_t i) {
+    memcpy(m_output + offsets[i],
+           emits[i].encoded.data(),
+           emits[i].encoded.size());
+  });
+  insert_map_item(TYPE_DEBUG_INFO_ITEM, emits.size(), dbg_start);
+}
+
+static const char* map_item_name(uint16_t type) {
+  switch (type) {
+  case TYPE_HEADER_ITEM: return "header_item";
+  case TYPE_STRING_ID_ITEM: return "string_id_item";
+  case TYPE_TYPE_ID_ITEM: return "type_id_item";
+  case TYPE_PROTO_ID_ITEM: return "proto_id_item";
+  case TYPE_FIELD_ID_ITEM: return "field_id_item";
+  case TYPE_METHOD_ID_ITEM: return "method_id_item";
+  case TYPE_CLASS_DEF_ITEM: return "class_def_item";
+  case TYPE_MAP_LIST: return "map_list";
+  case TYPE_TYPE_LIST: return "type_list";
+  case TYPE_ANNOTATION_SET_REF_LIST: return "annotation_set_ref_list";
+  case TYPE_ANNOTATION_SET_ITEM: return "annotation_set_item";
+  case TYPE_CLASS_DATA_ITEM: return "class_data_item";
+  case TYPE_CODE_ITEM: return "code_item";
+  case TYPE_STRING_DATA_ITEM: return "string_data_item";
+  case TYPE_DEBUG_INFO_ITEM: return "debug_info_item";
+  case TYPE_ANNOTATION_ITEM: return "annotation_item";
+  case TYPE_ENCODED_ARRAY_ITEM: return "encoded_array_item";
+  case TYPE_ANNOTATIONS_DIR_ITEM: return "annotations_directory_item";
+  }
+  always_assert_log(false, "Unknown map item type 0x%04x", type);
+  not_reached();
+}
+
+/*
+ * Every section runs from its map item's offset to the next one's, so the
+ * bytes of a section include the alignment padding that follows it.
+ */
+void DexOutput::record_section_bytes() {
+  auto items = m_map_items;
+  std::sort(items.begin(),
+            items.end(),
+            [](const dex_map_item& a, const dex_map_item& b) {
+              return a.offset < b.offset;
+            });
+  for (size_t i = 0; i < items.size(); ++i) {
+    uint32_t end = i + 1 < items.size() ? items[i + 1].offset : m_offset;
+    auto name = map_item_name(items[i].type);
+    m_stats.section_bytes[name] += end - items[i].offset;
+    TRACE(MAIN, 2, "%s: %u bytes\n", name, end - items[i].offset);
   }
-  insert_map_item(TYPE_DEBUG_INFO_ITEM, dbgcount, dbg_start);
 }
 
 void DexOutput::generate_map() {
   align_output();
-  uint32_t* mapout = (uint32_t*)(m_output + m_offset);
+  uint32_t* mapout = (uint32_t*)output(
+      sizeof(uint32_t) + (m_map_items.size() + 1) * sizeof(dex_map_item),
+      "map list");
   hdr.map_off = m_offset;
   insert_map_item(TYPE_MAP_LIST, 1, m_offset);
   *mapout = (uint32_t) m_map_items.size();
@@ -1121,6 +1509,7 @@ void DexOutput::init_header_offsets() {
   insert_map_item(TYPE_CLASS_DEF_ITEM, (uint32_t) m_classes->size(), m_offset);
 
   m_offset += m_classes->size() * sizeof(dex_class_def);
+  m_buffer->at(0, m_offset, "header and id tables");
   hdr.data_off = m_offset;
   /* Todo... */
   hdr.map_off = 0;
@@ -1131,18 +1520,30 @@ void DexOutput::init_header_offsets() {
 void DexOutput::finalize_header() {
   hdr.data_size = m_offset - hdr.data_off;
   hdr.file_size = m_offset;
-  int skip;
-  skip = sizeof(hdr.magic) + sizeof(hdr.checksum) + sizeof(hdr.signature);
   memcpy(m_output, &hdr, sizeof(hdr));
+  /*
+   * The signature covers everything after itself, and the checksum
+   * everything after itself, signature included. Both go over the data after
+   * the signature in a single pass of cache-sized chunks, and the checksum of
+   * the signature is prepended with adler32_combine once it is known.
+   */
+  constexpr size_t kChunkSize = 64 * 1024;
+  size_t data_offset =
+      sizeof(hdr.magic) + sizeof(hdr.checksum) + sizeof(hdr.signature);
   Sha1Context context;
   sha1_init(&context);
-  sha1_update(&context, m_output + skip, hdr.file_size - skip);
+  uint32_t data_adler = (uint32_t)adler32(0L, Z_NULL, 0);
+  for (size_t offset = data_offset; offset < hdr.file_size;
+       offset += kChunkSize) {
+    auto size = std::min<size_t>(kChunkSize, hdr.file_size - offset);
+    sha1_update(&context, m_output + offset, size);
+    data_adler = adler32_update(data_adler, m_output + offset, size);
+  }
   sha1_final(hdr.signature, &context);
-  memcpy(m_output, &hdr, sizeof(hdr));
-  uint32_t adler = (uint32_t)adler32(0L, Z_NULL, 0);
-  skip = sizeof(hdr.magic) + sizeof(hdr.checksum);
-  adler = (uint32_t) adler32(adler, (const Bytef*)(m_output + skip), hdr.file_size - skip);
-  hdr.checksum = adler;
+  uint32_t sig_adler = adler32_update(
+      (uint32_t)adler32(0L, Z_NULL, 0), hdr.signature, sizeof(hdr.signature));
+  hdr.checksum = (uint32_t)adler32_combine(
+      sig_adler, data_adler, hdr.file_size - data_offset);
   memcpy(m_output, &hdr, sizeof(hdr));
 }
 
@@ -1151,16 +1552,26 @@ namespace {
 void write_method_mapping(
   const std::string& filename,
   const DexOutputIdx* dodx,
-  uint8_t* dex_signature
+  uint8_t* dex_signature,
+  unsigned num_threads
 ) {
   if (filename.empty()) return;
   FILE* fd = fopen(filename.c_str(), "a");
   assert_log(fd, "Can't open method mapping file %s: %s\n",
              filename.c_str(),
              strerror(errno));
-  for (auto& it : dodx->method_to_idx()) {
-    auto method = it.first;
-    auto idx = it.second;
+  //
+  // Turns out, the checksum can change on-device. (damn you dexopt)
+  // The signature, however, is never recomputed. Let's log the top 4 bytes,
+  // in little-endian (since that's faster to compute on-device).
+  //
+  auto signature =
+      std::to_string(*reinterpret_cast<uint32_t*>(dex_signature));
+  std::vector<std::pair<DexMethodRef*, uint32_t>> methods(
+      dodx->method_to_idx().begin(), dodx->method_to_idx().end());
+  auto format = [&](size_t i, std::string& out) {
+    auto method = methods[i].first;
+    auto idx = methods[i].second;
 
     // Types (and methods) internal to our app have a cached deobfuscated name
     // that comes from the proguard map.  If we don't have one, it's a
@@ -1201,20 +1612,19 @@ void write_method_mapping(
     // We only want the name here.
     auto begin = deobf_method.find('.') + 1;
     auto end = deobf_method.rfind(':');
-    auto deobf_method_name = deobf_method.substr(begin, end-begin);
-
-    //
-    // Turns out, the checksum can change on-device. (damn you dexopt)
-    // The signature, however, is never recomputed. Let's log the top 4 bytes,
-    // in little-endian (since that's faster to compute on-device).
-    //
-    uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
 
-    fprintf(fd, "%u %u %s %s\n",
-            idx,
-            signature,
-            deobf_method_name.c_str(),
-            deobf_class.c_str());
+    out += std::to_string(idx);
+    out += ' ';
+    out += signature;
+    out += ' ';
+    out.append(deobf_method, begin, end - begin);
+    out += ' ';
+    out += deobf_class;
+    out += '\n';
+  };
+  for (const auto& chunk :
+       workqueue_chunks<std::string>(methods.size(), format, num_threads)) {
+    fwrite(chunk.data(), 1, chunk.size(), fd);
   }
   fclose(fd);
 }
@@ -1227,7 +1637,15 @@ void write_class_mapping(
 ) {
   if (filename.empty()) return;
   FILE* fd = fopen(filename.c_str(), "a");
-
+  assert_log(fd, "Can't open class mapping file %s: %s\n",
+             filename.c_str(),
+             strerror(errno));
+  //
+  // See write_method_mapping above for why checksum is insufficient.
+  //
+  auto signature =
+      std::to_string(*reinterpret_cast<uint32_t*>(dex_signature));
+  std::string out;
   for (uint32_t idx = 0; idx < class_defs_size; idx++) {
 
     DexClass* cls = classes->at(idx);
@@ -1239,13 +1657,14 @@ void write_class_mapping(
       return show(cls);
     }();
 
-    //
-    // See write_method_mapping above for why checksum is insufficient.
-    //
-    uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
-    fprintf(fd, "%u %u %s\n", idx, signature, deobf_class.c_str());
+    out += std::to_string(idx);
+    out += ' ';
+    out += signature;
+    out += ' ';
+    out += deobf_class;
+    out += '\n';
   }
-
+  fwrite(out.data(), 1, out.size(), fd);
   fclose(fd);
 }
 
@@ -1275,7 +1694,9 @@ const char* deobf_primitive(char type) {
   }
 }
 
-void write_pg_mapping(const std::string& filename, DexClasses* classes) {
+void write_pg_mapping(const std::string& filename,
+                      DexClasses* classes,
+                      unsigned num_threads) {
   if (filename.empty()) return;
 
   auto deobf_class = [&](DexClass* cls) {
@@ -1326,7 +1747,7 @@ void write_pg_mapping(const std::string& filename, DexClasses* classes) {
     if (method) {
       // Example: 672:672:boolean customShouldDelayInitMessage(android.os.Handler,android.os.Message)
       auto* proto = method->get_proto();
-      std::ostringstream ss;
+      std::string ss;
       auto* code = method->get_dex_code();
       auto* dbg = code ? code->get_debug_item() : nullptr;
       if (dbg) {
@@ -1346,62 +1767,76 @@ void write_pg_mapping(const std::string& filename, DexClasses* classes) {
         if (line_end > static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
           line_end = 0;
         }
-        ss << line_start << ":" << line_end << ":";
+        ss += std::to_string(line_start);
+        ss += ':';
+        ss += std::to_string(line_end);
+        ss += ':';
       }
       auto* rtype = proto->get_rtype();
       auto rtype_str = deobf_type(rtype);
-      ss << rtype_str;
-      ss << " " << method->get_simple_deobfuscated_name() << "(";
+      ss += rtype_str;
+      ss += ' ';
+      ss += method->get_simple_deobfuscated_name();
+      ss += '(';
       auto args = proto->get_args()->get_type_list();
       for (auto iter = args.begin() ; iter != args.end() ; ++iter) {
         auto* atype = *iter;
         auto atype_str = deobf_type(atype);
-        ss << atype_str;
+        ss += atype_str;
         if (iter + 1 != args.end()) {
-          ss << ",";
+          ss += ',';
         }
       }
-      ss << ")";
-      return ss.str();
+      ss += ')';
+      return ss;
     }
     return show(method);
   };
 
   auto deobf_field = [&](DexField* field) {
     if (field) {
-      std::ostringstream ss;
-      ss << deobf_type(field->get_type())
-      << " "
-      << field->get_simple_deobfuscated_name();
-      return ss.str();
+      return deobf_type(field->get_type()) + " " +
+             field->get_simple_deobfuscated_name();
     }
     return show(field);
   };
 
-  std::ofstream ofs(filename.c_str(), std::ofstream::out | std::ofstream::app);
-
-  for (auto cls : *classes) {
+  FILE* fd = fopen(filename.c_str(), "a");
+  assert_log(fd, "Can't open proguard mapping file %s: %s\n",
+             filename.c_str(),
+             strerror(errno));
+  auto format = [&](size_t i, std::string& out) {
+    auto cls = classes->at(i);
     auto deobf_cls = deobf_class(cls);
-    ofs << JavaNameUtil::internal_to_external(deobf_cls) << " -> "
-        << JavaNameUtil::internal_to_external(cls->get_type()->c_str())
-        << ":" << std::endl;
+    auto member = [&](const std::string& deobf, const char* name) {
+      out += "    ";
+      out += deobf;
+      out += " -> ";
+      out += name;
+      out += '\n';
+    };
+    out += JavaNameUtil::internal_to_external(deobf_cls);
+    out += " -> ";
+    out += JavaNameUtil::internal_to_external(cls->get_type()->c_str());
+    out += ":\n";
     for (auto field : cls->get_ifields()) {
-      auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      member(deobf_field(field), field->c_str());
     }
     for (auto field : cls->get_sfields()) {
-      auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      member(deobf_field(field), field->c_str());
     }
     for (auto meth : cls->get_dmethods()) {
-      auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      member(deobf_meth(meth), meth->c_str());
     }
     for (auto meth : cls->get_vmethods()) {
-      auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      member(deobf_meth(meth), meth->c_str());
     }
+  };
+  for (const auto& chunk :
+       workqueue_chunks<std::string>(classes->size(), format, num_threads)) {
+    fwrite(chunk.data(), 1, chunk.size(), fd);
   }
+  fclose(fd);
 }
 
 void write_bytecode_offset_mapping(
@@ -1428,7 +1863,8 @@ void DexOutput::write_symbol_files() {
   write_method_mapping(
     m_method_mapping_filename,
     dodx,
-    hdr.signature
+    hdr.signature,
+    m_num_threads
   );
   write_class_mapping(
     m_class_mapping_filename,
@@ -1438,7 +1874,8 @@ void DexOutput::write_symbol_files() {
   );
   write_pg_mapping(
     m_pg_mapping_filename,
-    m_classes
+    m_classes,
+    m_num_threads
   );
   write_bytecode_offset_mapping(
     m_bytecode_offset_filename,
@@ -1447,13 +1884,18 @@ void DexOutput::write_symbol_files() {
 }
 
 void DexOutput::prepare(SortMode string_mode, const std::vector<SortMode>& code_mode) {
+  if (string_mode == SortMode::COLDSTART_ORDER ||
+      std::find(code_mode.begin(), code_mode.end(),
+                SortMode::COLDSTART_ORDER) != code_mode.end()) {
+    m_gtypes->build_coldstart_maps(m_config_files.get_coldstart_methods());
+  }
   fix_jumbos(m_classes, dodx);
   init_header_offsets();
   generate_static_values();
   generate_typelist_data();
   generate_string_data(string_mode);
   generate_code_items(code_mode);
-  generate_class_data_items();
+  generate_class_data_items(code_mode);
   generate_type_data();
   generate_proto_data();
   generate_field_data();
@@ -1463,17 +1905,21 @@ void DexOutput::prepare(SortMode string_mode, const std::vector<SortMode>& code_
   generate_debug_items();
   generate_map();
   align_output();
+  record_section_bytes();
   finalize_header();
 }
 
 void DexOutput::write() {
   struct stat st;
   int fd = open(m_filename, O_CREAT | O_TRUNC | O_WRONLY, 0660);
-  if (fd == -1) {
-    perror("Error writing dex");
-    return;
+  always_assert_log(
+      fd != -1, "Error opening dex %s: %s\n", m_filename, strerror(errno));
+  if (!m_buffer->write_to(fd, m_offset)) {
+    auto error = errno;
+    close(fd);
+    always_assert_log(
+        false, "Error writing dex %s: %s\n", m_filename, strerror(error));
   }
-  ::write(fd, m_output, m_offset);
   if (0 == fstat(fd, &st)) {
     m_stats.num_bytes = st.st_size;
   }
@@ -1487,6 +1933,8 @@ static SortMode make_sort_bytecode(const std::string& sort_bytecode) {
     return SortMode::CLASS_ORDER;
   } else if (sort_bytecode == "clinit_order") {
     return SortMode::CLINIT_FIRST;
+  } else if (sort_bytecode == "coldstart_order") {
+    return SortMode::COLDSTART_ORDER;
   } else {
     return SortMode::DEFAULT;
   }
@@ -1517,6 +1965,8 @@ write_classes_to_dex(
     string_sort_mode = SortMode::CLASS_STRINGS;
   } else if (sort_strings == "class_order") {
     string_sort_mode = SortMode::CLASS_ORDER;
+  } else if (sort_strings == "coldstart_order") {
+    string_sort_mode = SortMode::COLDSTART_ORDER;
   }
 
   auto sort_bytecode_cfg = json_cfg.get("bytecode_sort_mode", Json::Value());
@@ -1533,7 +1983,12 @@ write_classes_to_dex(
     code_sort_mode.push_back(SortMode::DEFAULT);
   }
 
-  DexOutput dout = DexOutput(
+  auto num_threads = json_cfg.get("dex_output_threads", 0).asUInt();
+  if (num_threads == 0) {
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+
+  DexOutput dout(
     filename.c_str(),
     classes,
     locator_index,
@@ -1543,7 +1998,8 @@ write_classes_to_dex(
     method_mapping_filename,
     class_mapping_filename,
     pg_mapping_filename,
-    bytecode_offset_filename);
+    bytecode_offset_filename,
+    num_threads);
 
   dout.prepare(string_sort_mode, code_sort_mode);
   dout.write();
@@ -32,6 +32,8 @@ enum class SortMode {
   CLASS_ORDER,
   CLASS_STRINGS,
   CLINIT_FIRST,
+  // Order by first access in the cold-start method trace.
+  COLDSTART_ORDER,
   DEFAULT
 };
 
@@ -143,6 +145,9 @@ class GatheredTypes {
   std::unordered_map<const DexString*, unsigned int> m_cls_load_strings;
   std::unordered_map<const DexString*, unsigned int> m_cls_strings;
   std::unordered_map<const DexMethod*, unsigned int> m_methods_in_cls_order;
+  std::unordered_map<const DexString*, unsigned int> m_coldstart_strings;
+  std::unordered_map<const DexMethod*, unsigned int> m_coldstart_methods;
+  std::unordered_map<const DexClass*, unsigned int> m_coldstart_classes;
 
   void gather_components();
   dexstring_to_idx* get_string_index(cmp_dstring cmp = compare_dexstrings);
@@ -162,13 +167,28 @@ class GatheredTypes {
   std::vector<DexString*> get_dexstring_emitlist(T cmp = compare_dexstrings);
   std::vector<DexString*> get_cls_order_dexstring_emitlist();
   std::vector<DexString*> keep_cls_strings_together_emitlist();
+  std::vector<DexString*> get_coldstart_order_dexstring_emitlist();
   std::vector<DexMethod*> get_dexmethod_emitlist();
+  std::vector<DexClass*> get_coldstart_order_class_emitlist();
+
+  /*
+   * Number the methods of the cold-start trace that are defined in this dex,
+   * and their classes and the strings they use, in order of first access.
+   */
+  void build_coldstart_maps(const std::vector<std::string>& method_trace);
+  bool is_coldstart(const DexMethod* m) const {
+    return m_coldstart_methods.count(m);
+  }
+  bool is_coldstart(const DexString* s) const {
+    return m_coldstart_strings.count(s);
+  }
 
   void gather_class(int num);
 
   void sort_dexmethod_emitlist_default_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_cls_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_clinit_order(std::vector<DexMethod*>& lmeth);
+  void sort_dexmethod_emitlist_coldstart_order(std::vector<DexMethod*>& lmeth);
 
   std::unordered_set<DexString*> index_type_names();
 };
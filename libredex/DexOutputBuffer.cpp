@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DexOutputBuffer.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef _MSC_VER
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
+#include "Debug.h"
+
+DexOutputBuffer::DexOutputBuffer(size_t capacity) : m_capacity(capacity) {
+  m_data = (uint8_t*)calloc(capacity, 1);
+  always_assert_log(m_data != nullptr,
+                    "Could not allocate %zu bytes of dex output\n",
+                    capacity);
+}
+
+DexOutputBuffer::~DexOutputBuffer() { free(m_data); }
+
+uint8_t* DexOutputBuffer::at(size_t offset, size_t size, const char* what) {
+  always_assert_log(offset <= m_capacity && size <= m_capacity - offset,
+                    "Dex output overflow: %zu bytes of %s at offset %zu do "
+                    "not fit in %zu bytes\n",
+                    size,
+                    what,
+                    offset,
+                    m_capacity);
+  return m_data + offset;
+}
+
+bool DexOutputBuffer::write_to(int fd, size_t size) const {
+  always_assert(size <= m_capacity);
+  const uint8_t* p = m_data;
+  while (size > 0) {
+    auto written = ::write(fd, p, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += written;
+    size -= written;
+  }
+  return true;
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/*
+ * The memory a dex is laid out in before it is written to its file.
+ *
+ * The items of a dex point at each other by offset and DexOutput keeps
+ * pointers into the items it has written, so the buffer never moves: its
+ * whole capacity is reserved up front. It is allocated with calloc, which
+ * for a buffer this size hands out fresh zero pages from the OS, so the
+ * memory is only committed as the dex is written into it.
+ *
+ * Every write goes through at(), which asserts that it fits.
+ */
+class DexOutputBuffer {
+ public:
+  explicit DexOutputBuffer(size_t capacity);
+  ~DexOutputBuffer();
+
+  DexOutputBuffer(const DexOutputBuffer&) = delete;
+  DexOutputBuffer& operator=(const DexOutputBuffer&) = delete;
+
+  uint8_t* data() { return m_data; }
+  const uint8_t* data() const { return m_data; }
+  size_t capacity() const { return m_capacity; }
+
+  /*
+   * Return a pointer to the `size` bytes at `offset`. `what` names the item
+   * being written in the error message if they do not fit.
+   */
+  uint8_t* at(size_t offset, size_t size, const char* what);
+
+  /*
+   * Write the first `size` bytes of the buffer to the file descriptor,
+   * retrying partial writes. Returns false on error.
+   */
+  bool write_to(int fd, size_t size) const;
+
+ private:
+  uint8_t* m_data;
+  size_t m_capacity;
+};
@@ -44,15 +44,6 @@ uint32_t RealPositionMapper::position_to_line(DexPosition* pos) {
 }
 
 void RealPositionMapper::write_map() {
-  if (m_filename != "") {
-    write_map_v1();
-  }
-  if (m_filename_v2 != "") {
-    write_map_v2();
-  }
-}
-
-void RealPositionMapper::write_map_v1() {
   // to ensure that the line numbers in the Dex are as compact as possible,
   // we put the emitted positions at the start of the list and rest at the end
   for (auto item : m_pos_line_map) {
@@ -63,6 +54,38 @@ void RealPositionMapper::write_map_v1() {
       m_pos_line_map[item.first] = idx;
     }
   }
+  if (m_filename != "") {
+    write_map_v1();
+  }
+  if (m_filename_v2 != "" || m_filename_v3 != "") {
+    auto pool = build_string_pool_and_records();
+    if (m_filename_v2 != "") {
+      write_map_v2(pool);
+    }
+    if (m_filename_v3 != "") {
+      write_map_v3(pool);
+    }
+  }
+}
+
+namespace {
+
+template <typename T>
+void append(std::string& out, const T& value) {
+  out.append((const char*)&value, sizeof(value));
+}
+
+// The maps are assembled in memory and written out with a single call.
+void write_file(const std::string& filename, const std::string& contents) {
+  std::ofstream ofs(filename.c_str(),
+                    std::ofstream::out | std::ofstream::trunc |
+                        std::ofstream::binary);
+  ofs.write(contents.data(), contents.size());
+}
+
+} // namespace
+
+void RealPositionMapper::write_map_v1() {
   /*
    * Map file layout:
    * 0xfaceb000 (magic number)
@@ -76,7 +99,7 @@ void RealPositionMapper::write_map_v1() {
    * string_length (4 bytes)
    * char[string_length]
    */
-  std::ostringstream pos_out;
+  std::string pos_out;
   std::unordered_map<DexString*, uint32_t> string_ids;
   std::vector<DexString*> string_pool;
 
@@ -93,65 +116,43 @@ void RealPositionMapper::write_map_v1() {
       string_pool.push_back(pos->file);
     }
     auto string_id = string_ids[pos->file];
-    pos_out.write((const char*)&string_id, sizeof(string_id));
-    pos_out.write((const char*)&pos->line, sizeof(pos->line));
-    pos_out.write((const char*)&parent_line, sizeof(parent_line));
+    append(pos_out, string_id);
+    append(pos_out, pos->line);
+    append(pos_out, parent_line);
   }
 
-  std::ofstream ofs(m_filename.c_str(),
-                    std::ofstream::out | std::ofstream::trunc);
+  std::string out;
   uint32_t magic = 0xfaceb000; // serves as endianess check
-  ofs.write((const char*)&magic, sizeof(magic));
+  append(out, magic);
   uint32_t version = 1;
-  ofs.write((const char*)&version, sizeof(version));
+  append(out, version);
   uint32_t spool_count = string_pool.size();
-  ofs.write((const char*)&spool_count, sizeof(spool_count));
+  append(out, spool_count);
   for (auto s : string_pool) {
     uint32_t ssize = s->size();
-    ofs.write((const char*)&ssize, sizeof(ssize));
-    ofs << s->c_str();
+    append(out, ssize);
+    out += s->c_str();
   }
   uint32_t pos_count = m_positions.size();
-  ofs.write((const char*)&pos_count, sizeof(pos_count));
-  ofs << pos_out.str();
+  append(out, pos_count);
+  out += pos_out;
+  write_file(m_filename, out);
 }
 
-void RealPositionMapper::write_map_v2() {
-  // to ensure that the line numbers in the Dex are as compact as possible,
-  // we put the emitted positions at the start of the list and rest at the end
-  for (auto item : m_pos_line_map) {
-    auto line = item.second;
-    if (line == -1) {
-      auto idx = m_positions.size();
-      m_positions.emplace_back(item.first);
-      m_pos_line_map[item.first] = idx;
-    }
-  }
-  /*
-   * Map file layout:
-   * 0xfaceb000 (magic number)
-   * version (4 bytes)
-   * string_pool_size (4 bytes)
-   * string_pool[string_pool_size]
-   * positions_size (4 bytes)
-   * positions[positions_size]
-   *
-   * Each member of the string pool is encoded as follows:
-   * string_length (4 bytes)
-   * char[string_length]
-   */
-  std::ostringstream pos_out;
+RealPositionMapper::StringPoolAndRecords
+RealPositionMapper::build_string_pool_and_records() {
+  StringPoolAndRecords pool;
   std::unordered_map<std::string, uint32_t> string_ids;
-  std::vector<std::string> string_pool;
 
   auto id_of_string = [&](const std::string& s) -> uint32_t {
     if (string_ids.find(s) == string_ids.end()) {
-      string_ids[s] = string_pool.size();
-      string_pool.push_back(s);
+      string_ids[s] = pool.strings.size();
+      pool.strings.push_back(s);
     }
     return string_ids.at(s);
   };
 
+  pool.records.reserve(m_positions.size());
   for (auto pos : m_positions) {
     uint32_t parent_line = 0;
     try {
@@ -172,40 +173,97 @@ void RealPositionMapper::write_map_v2() {
     auto class_id = id_of_string(class_name);
     auto method_id = id_of_string(method_name);
     auto file_id = id_of_string(pos->file->c_str());
-    pos_out.write((const char*)&class_id, sizeof(class_id));
-    pos_out.write((const char*)&method_id, sizeof(method_id));
-    pos_out.write((const char*)&file_id, sizeof(file_id));
-    pos_out.write((const char*)&pos->line, sizeof(pos->line));
-    pos_out.write((const char*)&parent_line, sizeof(parent_line));
+    pool.records.push_back(
+        {class_id, method_id, file_id, pos->line, parent_line});
   }
+  return pool;
+}
 
-  std::ofstream ofs(m_filename_v2.c_str(),
-                    std::ofstream::out | std::ofstream::trunc);
+void RealPositionMapper::write_map_v2(const StringPoolAndRecords& pool) {
+  /*
+   * Map file layout:
+   * 0xfaceb000 (magic number)
+   * version (4 bytes)
+   * string_pool_size (4 bytes)
+   * string_pool[string_pool_size]
+   * positions_size (4 bytes)
+   * positions[positions_size]
+   *
+   * Each member of the string pool is encoded as follows:
+   * string_length (4 bytes)
+   * char[string_length]
+   */
+  std::string out;
   uint32_t magic = 0xfaceb000; // serves as endianess check
-  ofs.write((const char*)&magic, sizeof(magic));
+  append(out, magic);
   uint32_t version = 2;
-  ofs.write((const char*)&version, sizeof(version));
-  uint32_t spool_count = string_pool.size();
-  ofs.write((const char*)&spool_count, sizeof(spool_count));
-  for (auto s : string_pool) {
+  append(out, version);
+  uint32_t spool_count = pool.strings.size();
+  append(out, spool_count);
+  for (const auto& s : pool.strings) {
     uint32_t ssize = s.size();
-    ofs.write((const char*)&ssize, sizeof(ssize));
-    ofs << s;
+    append(out, ssize);
+    out += s;
   }
-  uint32_t pos_count = m_positions.size();
-  ofs.write((const char*)&pos_count, sizeof(pos_count));
-  ofs << pos_out.str();
+  uint32_t pos_count = pool.records.size();
+  append(out, pos_count);
+  out.append((const char*)pool.records.data(),
+             pool.records.size() * sizeof(PositionRecord));
+  write_file(m_filename_v2, out);
+}
+
+void RealPositionMapper::write_map_v3(const StringPoolAndRecords& pool) {
+  /*
+   * The same content as version 2, laid out to be used in place once mapped
+   * into memory: every section starts at a 4-byte aligned offset that follows
+   * from the header, and string i is found through the offsets table rather
+   * than by walking the pool.
+   *
+   * Map file layout:
+   * 0xfaceb000 (magic number)
+   * version (4 bytes)
+   * string_pool_size (4 bytes)
+   * positions_size (4 bytes)
+   * string_offsets[string_pool_size + 1] (4 bytes each)
+   * positions[positions_size]
+   * string_data
+   *
+   * String i is string_data[string_offsets[i], string_offsets[i + 1]).
+   */
+  std::string out;
+  uint32_t magic = 0xfaceb000; // serves as endianess check
+  append(out, magic);
+  uint32_t version = 3;
+  append(out, version);
+  uint32_t spool_count = pool.strings.size();
+  append(out, spool_count);
+  uint32_t pos_count = pool.records.size();
+  append(out, pos_count);
+  uint32_t offset = 0;
+  append(out, offset);
+  for (const auto& s : pool.strings) {
+    offset += s.size();
+    append(out, offset);
+  }
+  out.append((const char*)pool.records.data(),
+             pool.records.size() * sizeof(PositionRecord));
+  for (const auto& s : pool.strings) {
+    out += s;
+  }
+  write_file(m_filename_v3, out);
 }
 
 PositionMapper* PositionMapper::make(const std::string& map_filename,
-                                     const std::string& map_filename_v2) {
-  if (map_filename == "" && map_filename_v2 == "") {
+                                     const std::string& map_filename_v2,
+                                     const std::string& map_filename_v3) {
+  if (map_filename == "" && map_filename_v2 == "" && map_filename_v3 == "") {
     // If no path is provided for the map, just pass the original line numbers
     // through to the output. This does mean that the line numbers will be
     // incorrect for inlined code.
     return new NoopPositionMapper();
   } else {
-    return new RealPositionMapper(map_filename, map_filename_v2);
+    return new RealPositionMapper(
+        map_filename, map_filename_v2, map_filename_v3);
   }
 }
 
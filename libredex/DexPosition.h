@@ -38,7 +38,8 @@ class PositionMapper {
   virtual void register_position(DexPosition* pos) = 0;
   virtual void write_map() = 0;
   static PositionMapper* make(const std::string& map_filename,
-                              const std::string& map_filename_v2);
+                              const std::string& map_filename_v2,
+                              const std::string& map_filename_v3 = "");
 };
 
 /*
@@ -51,16 +52,35 @@ class PositionMapper {
 class RealPositionMapper : public PositionMapper {
   std::string m_filename;
   std::string m_filename_v2;
+  std::string m_filename_v3;
   std::vector<DexPosition*> m_positions;
   std::unordered_map<DexPosition*, int64_t> m_pos_line_map;
  protected:
+  struct PositionRecord {
+    uint32_t class_id;
+    uint32_t method_id;
+    uint32_t file_id;
+    uint32_t line;
+    uint32_t parent;
+  };
+  static_assert(sizeof(PositionRecord) == 20, "written to the maps as is");
+  // What the v2 and v3 maps hold; they differ only in how it is laid out.
+  struct StringPoolAndRecords {
+    std::vector<std::string> strings;
+    std::vector<PositionRecord> records;
+  };
   uint32_t get_line(DexPosition*);
+  StringPoolAndRecords build_string_pool_and_records();
   void write_map_v1();
-  void write_map_v2();
+  void write_map_v2(const StringPoolAndRecords&);
+  void write_map_v3(const StringPoolAndRecords&);
  public:
   RealPositionMapper(const std::string& filename,
-                     const std::string& filename_v2)
-      : m_filename(filename), m_filename_v2(filename_v2) {}
+                     const std::string& filename_v2,
+                     const std::string& filename_v3 = "")
+      : m_filename(filename),
+        m_filename_v2(filename_v2),
+        m_filename_v3(filename_v3) {}
   virtual DexString* get_source_file(const DexClass*);
   virtual uint32_t position_to_line(DexPosition*);
   virtual void register_position(DexPosition* pos);
@@ -415,6 +415,14 @@ dex_stats_t&
   lhs.num_type_lists += rhs.num_type_lists;
   lhs.num_bytes += rhs.num_bytes;
   lhs.num_instructions += rhs.num_instructions;
+  lhs.num_coldstart_code_pages += rhs.num_coldstart_code_pages;
+  lhs.num_coldstart_code_pages_default += rhs.num_coldstart_code_pages_default;
+  lhs.num_coldstart_string_pages += rhs.num_coldstart_string_pages;
+  lhs.num_coldstart_string_pages_default +=
+      rhs.num_coldstart_string_pages_default;
+  for (const auto& it : rhs.section_bytes) {
+    lhs.section_bytes[it.first] += it.second;
+  }
   return lhs;
 }
 
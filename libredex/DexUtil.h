@@ -9,6 +9,8 @@
 
 #include <algorithm>
 #include <functional>
+#include <map>
+#include <string>
 #include <vector>
 
 #include "DexClass.h"
@@ -366,6 +368,14 @@ struct dex_stats_t {
   int num_type_lists = 0;
   int num_bytes = 0;
   int num_instructions = 0;
+  // Pages holding the items used at cold start, with the cold-start sort
+  // modes and with the default order.
+  int num_coldstart_code_pages = 0;
+  int num_coldstart_code_pages_default = 0;
+  int num_coldstart_string_pages = 0;
+  int num_coldstart_string_pages_default = 0;
+  // Bytes per section of the output, keyed by map item type name.
+  std::map<std::string, int> section_bytes;
 };
 
 dex_stats_t&
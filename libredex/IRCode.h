@@ -148,6 +148,8 @@ class IRCode {
 
   const cfg::ControlFlowGraph& cfg() const { return *m_cfg; }
 
+  bool cfg_built() const { return m_cfg != nullptr; }
+
   // Build a Control Flow Graph
   //  * A non editable CFG's blocks have begin and end pointers into the big
   //    linear IRList in IRCode
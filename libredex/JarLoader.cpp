@@ -7,7 +7,14 @@
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
+#include <atomic>
+#include <boost/filesystem.hpp>
 #include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <zlib.h>
 
@@ -21,7 +28,9 @@
 #include "Creators.h"
 #include "DexClass.h"
 #include "JarLoader.h"
+#include "Trace.h"
 #include "Util.h"
+#include "WorkQueue.h"
 
 /******************
  * Begin Class Loading code.
@@ -67,15 +76,24 @@ struct cp_entry {
   };
 };
 
-struct cp_field_info {
-  uint16_t aflags;
-  uint16_t nameNdx;
-  uint16_t descNdx;
+/*
+ * What a class file says about the class, before any of it is made. Types
+ * are held as the DexStrings of their descriptors.
+ */
+struct member_def {
+  uint16_t access;
+  DexString* name;
+  DexString* desc;
+  std::vector<std::pair<std::string, uint8_t*>> attributes;
 };
-struct cp_method_info {
-  uint16_t aflags;
-  uint16_t nameNdx;
-  uint16_t descNdx;
+
+struct class_def {
+  DexString* type;
+  DexString* super;
+  uint16_t access;
+  std::vector<DexString*> interfaces;
+  std::vector<member_def> fields;
+  std::vector<member_def> methods;
 };
 }
 
@@ -146,8 +164,8 @@ static void skip_attributes(uint8_t* &buffer) {
   }
 }
 #define MAX_CLASS_NAMELEN (8 * 1024)
-static DexType *make_dextype_from_cref(std::vector<cp_entry> &cpool,
-                                       uint16_t cref) {
+static DexString *make_typename_from_cref(std::vector<cp_entry> &cpool,
+                                          uint16_t cref) {
   char nbuffer[MAX_CLASS_NAMELEN];
   if (cpool[cref].tag != CP_CONST_CLASS) {
     fprintf(stderr, "Non-class ref in get_class_name, Bailing\n");
@@ -167,7 +185,7 @@ static DexType *make_dextype_from_cref(std::vector<cp_entry> &cpool,
   memcpy(nbuffer+1, utf8cpe.data, utf8cpe.len);
   nbuffer[1+utf8cpe.len] = ';';
   nbuffer[2+utf8cpe.len] = '\0';
-  return DexType::make_type(nbuffer);
+  return DexString::make_string(nbuffer);
 }
 
 static bool extract_utf8(std::vector<cp_entry> &cpool, uint16_t utf8ref,
@@ -186,19 +204,11 @@ static bool extract_utf8(std::vector<cp_entry> &cpool, uint16_t utf8ref,
   return true;
 }
 
-static DexField *make_dexfield(std::vector<cp_entry> &cpool,
-                               DexType *self, cp_field_info &finfo) {
-  char dbuffer[MAX_CLASS_NAMELEN];
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (!extract_utf8(cpool, finfo.nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
-     !extract_utf8(cpool, finfo.descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
-    return nullptr;
-  }
-  DexString *name = DexString::make_string(nbuffer);
-  DexType *desc = DexType::make_type(dbuffer);
+static DexField *make_dexfield(DexType *self, const member_def &finfo) {
+  DexType *desc = DexType::make_type(finfo.desc);
   DexField *field =
-      static_cast<DexField*>(DexField::make_field(self, name, desc));
-  field->set_access((DexAccessFlags)finfo.aflags);
+      static_cast<DexField*>(DexField::make_field(self, finfo.name, desc));
+  field->set_access((DexAccessFlags)finfo.access);
   field->set_external();
   return field;
 }
@@ -303,16 +313,8 @@ static DexTypeList *extract_arguments(const char* &buf) {
   return DexTypeList::make_type_list(std::move(args));
 }
 
-static DexMethod *make_dexmethod(std::vector<cp_entry> &cpool,
-                               DexType *self, cp_method_info &finfo) {
-  char dbuffer[MAX_CLASS_NAMELEN];
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (!extract_utf8(cpool, finfo.nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
-     !extract_utf8(cpool, finfo.descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
-    return nullptr;
-  }
-  DexString *name = DexString::make_string(nbuffer);
-  const char *ptr = dbuffer;
+static DexMethod *make_dexmethod(DexType *self, const member_def &finfo) {
+  const char *ptr = finfo.desc->c_str();
   DexTypeList *tlist = extract_arguments(ptr);
   if (tlist == nullptr)
     return nullptr;
@@ -321,17 +323,18 @@ static DexMethod *make_dexmethod(std::vector<cp_entry> &cpool,
     return nullptr;
   DexProto *proto = DexProto::make_proto(rtype, tlist);
   DexMethod *method = static_cast<DexMethod*>(
-      DexMethod::make_method(self, name, proto));
+      DexMethod::make_method(self, finfo.name, proto));
   if (method->is_concrete()) {
     fprintf(stderr, "Pre-concrete method attempted to load '%s', bailing\n",
         SHOW(method));
     return nullptr;
   }
-  uint32_t access = finfo.aflags;
+  uint32_t access = finfo.access;
   bool is_virt = true;
-  if (nbuffer[0] == '<') {
+  const char *name = finfo.name->c_str();
+  if (name[0] == '<') {
     is_virt = false;
-    if (nbuffer[1] == 'i') {
+    if (name[1] == 'i') {
       access |= ACC_CONSTRUCTOR;
     }
   } else if (access & (ACC_PRIVATE | ACC_STATIC))
@@ -342,9 +345,8 @@ static DexMethod *make_dexmethod(std::vector<cp_entry> &cpool,
   return method;
 }
 
-static bool parse_class(uint8_t* buffer,
-                        Scope* classes,
-                        attribute_hook_t attr_hook) {
+static bool parse_constant_pool(uint8_t*& buffer,
+                                std::vector<cp_entry>& cpool) {
   uint32_t magic = read32(buffer);
   uint16_t vminor DEBUG_ONLY = read16(buffer);
   uint16_t vmajor DEBUG_ONLY = read16(buffer);
@@ -353,7 +355,6 @@ static bool parse_class(uint8_t* buffer,
     fprintf(stderr, "Bad class magic %08x, Bailing\n", magic);
     return false;
   }
-  std::vector<cp_entry> cpool;
   cpool.resize(cp_count);
   /* The zero'th entry is always empty.  Java is annoying. */
   for (int i=1; i<cp_count; i++) {
@@ -365,88 +366,120 @@ static bool parse_class(uint8_t* buffer,
       i++;
     }
   }
-  uint16_t aflags = read16(buffer);
+  return true;
+}
+
+/*
+ * Reads the class file into :def. The attributes of the members are only
+ * kept when :keep_attributes is set, and then point into :buffer.
+ */
+static bool parse_class_def(uint8_t* buffer,
+                            class_def& def,
+                            bool keep_attributes) {
+  std::vector<cp_entry> cpool;
+  if (!parse_constant_pool(buffer, cpool)) {
+    return false;
+  }
+  def.access = read16(buffer);
   uint16_t clazz = read16(buffer);
   uint16_t super = read16(buffer);
   uint16_t ifcount = read16(buffer);
-  DexType *self = make_dextype_from_cref(cpool, clazz);
-  if (type_class(self)) {
-    return true;
+  def.type = make_typename_from_cref(cpool, clazz);
+  if (def.type == nullptr) {
+    return false;
   }
-  ClassCreator cc(self);
-  cc.set_external();
+  def.super = nullptr;
   if (super != 0) {
-    DexType *sclazz = make_dextype_from_cref(cpool, super);
-    cc.set_super(sclazz);
+    def.super = make_typename_from_cref(cpool, super);
+    if (def.super == nullptr) {
+      return false;
+    }
   }
-  cc.set_access((DexAccessFlags)aflags);
-  if (ifcount) {
-    for (int i=0; i < ifcount; i++) {
-      uint16_t iface = read16(buffer);
-      DexType *iftype = make_dextype_from_cref(cpool, iface);
-      cc.add_interface(iftype);
+  def.interfaces.resize(ifcount);
+  for (auto& iface : def.interfaces) {
+    iface = make_typename_from_cref(cpool, read16(buffer));
+    if (iface == nullptr) {
+      return false;
     }
   }
-  uint16_t fcount = read16(buffer);
 
-  auto invoke_attr_hook = [&](
-      boost::variant<DexField*, DexMethod*> field_or_method, uint8_t* attrPtr) {
-    if (attr_hook == nullptr) {
-      return;
-    }
-    uint16_t attributes_count = read16(attrPtr);
-    for (uint16_t j = 0; j < attributes_count; j++) {
-      uint16_t attribute_name_index = read16(attrPtr);
-      uint32_t attribute_length = read32(attrPtr);
-      char attribute_name[MAX_CLASS_NAMELEN];
-      if (extract_utf8(
-              cpool, attribute_name_index, attribute_name, MAX_CLASS_NAMELEN)) {
-        attr_hook(field_or_method, attribute_name, attrPtr);
-      } else {
+  auto read_members = [&](std::vector<member_def>& members) {
+    members.resize(read16(buffer));
+    for (auto& member : members) {
+      member.access = read16(buffer);
+      uint16_t nameNdx = read16(buffer);
+      uint16_t descNdx = read16(buffer);
+      char dbuffer[MAX_CLASS_NAMELEN];
+      char nbuffer[MAX_CLASS_NAMELEN];
+      if (!extract_utf8(cpool, nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
+          !extract_utf8(cpool, descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
+        return false;
+      }
+      member.name = DexString::make_string(nbuffer);
+      member.desc = DexString::make_string(dbuffer);
+      if (!keep_attributes) {
+        skip_attributes(buffer);
+        continue;
+      }
+      uint16_t attributes_count = read16(buffer);
+      for (uint16_t j = 0; j < attributes_count; j++) {
+        uint16_t attribute_name_index = read16(buffer);
+        uint32_t attribute_length = read32(buffer);
+        char attribute_name[MAX_CLASS_NAMELEN];
         always_assert_log(
-            false,
+            extract_utf8(cpool, attribute_name_index, attribute_name,
+                         MAX_CLASS_NAMELEN),
             "attribute hook was specified, but failed to load the "
             "attribute name due to insufficient name buffer");
+        member.attributes.emplace_back(attribute_name, buffer);
+        buffer += attribute_length;
       }
-      attrPtr += attribute_length;
     }
+    return true;
   };
+  return read_members(def.fields) && read_members(def.methods);
+}
 
-  for (int i=0; i < fcount; i++) {
-    cp_field_info cpfield;
-    cpfield.aflags = read16(buffer);
-    cpfield.nameNdx = read16(buffer);
-    cpfield.descNdx = read16(buffer);
-    uint8_t* attrPtr = buffer;
-    skip_attributes(buffer);
-    DexField *field = make_dexfield(cpool, self, cpfield);
-    if (field == nullptr)
-      return false;
-    cc.add_field(field);
-    invoke_attr_hook({field}, attrPtr);
+/*
+ * Creates the external class that :def describes, or returns nullptr if it
+ * is malformed.
+ */
+static DexClass* make_class(const class_def& def, attribute_hook_t attr_hook) {
+  DexType *self = DexType::make_type(def.type);
+  ClassCreator cc(self);
+  cc.set_external();
+  if (def.super != nullptr) {
+    cc.set_super(DexType::make_type(def.super));
+  }
+  cc.set_access((DexAccessFlags)def.access);
+  for (const auto& iface : def.interfaces) {
+    cc.add_interface(DexType::make_type(iface));
   }
 
-  uint16_t mcount = read16(buffer);
-  if (mcount) {
-    for (int i=0; i < mcount; i++) {
-      cp_method_info cpmethod;
-      cpmethod.aflags = read16(buffer);
-      cpmethod.nameNdx = read16(buffer);
-      cpmethod.descNdx = read16(buffer);
-
-      uint8_t* attrPtr = buffer;
-      skip_attributes(buffer);
-      DexMethod *method = make_dexmethod(cpool, self, cpmethod);
-      if (method == nullptr)
-        return false;
-      cc.add_method(method);
-      invoke_attr_hook({method}, attrPtr);
+  auto invoke_attr_hook = [&](
+      boost::variant<DexField*, DexMethod*> field_or_method,
+      const member_def& member) {
+    if (attr_hook == nullptr) {
+      return;
+    }
+    for (const auto& attribute : member.attributes) {
+      attr_hook(field_or_method, attribute.first.c_str(), attribute.second);
     }
+  };
+
+  for (const auto& finfo : def.fields) {
+    DexField *field = make_dexfield(self, finfo);
+    cc.add_field(field);
+    invoke_attr_hook({field}, finfo);
   }
-  DexClass *dc = cc.create();
-  if (classes != nullptr) {
-    classes->emplace_back(dc);
+  for (const auto& minfo : def.methods) {
+    DexMethod *method = make_dexmethod(self, minfo);
+    if (method == nullptr)
+      return nullptr;
+    cc.add_method(method);
+    invoke_attr_hook({method}, minfo);
   }
+  DexClass *dc = cc.create();
   //#define DEBUG_PRINT
 #ifdef DEBUG_PRINT
   fprintf(stderr, "DexClass constructed from jar:\n%s\n", SHOW(dc));
@@ -476,6 +509,26 @@ static bool parse_class(uint8_t* buffer,
   }
 
 #endif
+  return dc;
+}
+
+static bool parse_class(uint8_t* buffer,
+                        Scope* classes,
+                        attribute_hook_t attr_hook) {
+  class_def def;
+  if (!parse_class_def(buffer, def, attr_hook != nullptr)) {
+    return false;
+  }
+  if (type_class(DexType::make_type(def.type))) {
+    return true;
+  }
+  DexClass *dc = make_class(def, attr_hook);
+  if (dc == nullptr) {
+    return false;
+  }
+  if (classes != nullptr) {
+    classes->emplace_back(dc);
+  }
   return true;
 }
 
@@ -642,33 +695,51 @@ static bool get_jar_entries(const uint8_t *mapping, pk_cdir_end &pce,
   return true;
 }
 
-static int jar_uncompress(Bytef *dest, uLongf *destLen, const Bytef *source,
-                   uLong sourceLen) {
-  z_stream stream;
-  int err;
+/*
+ * A raw inflate stream, reset for each entry rather than set up again. Each
+ * thread that decompresses entries has its own.
+ */
+class Inflater {
+ public:
+  Inflater() {
+    memset(&m_stream, 0, sizeof(m_stream));
+    m_init = inflateInit2(&m_stream, -MAX_WBITS);
+  }
+
+  ~Inflater() {
+    if (m_init == Z_OK) {
+      inflateEnd(&m_stream);
+    }
+  }
 
-  stream.next_in = (Bytef *)source;
-  stream.avail_in = (uInt)sourceLen;
-  stream.next_out = dest;
-  stream.avail_out = (uInt)*destLen;
-  stream.zalloc = (alloc_func)0;
-  stream.zfree = (free_func)0;
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
 
-  err = inflateInit2(&stream, -MAX_WBITS);
-  if (err != Z_OK) return err;
+  int uncompress(Bytef* dest,
+                 uLongf* destLen,
+                 const Bytef* source,
+                 uLong sourceLen) {
+    if (m_init != Z_OK) return m_init;
+    int err = inflateReset(&m_stream);
+    if (err != Z_OK) return err;
 
-  err = inflate(&stream, Z_FINISH);
-  if (err != Z_STREAM_END) {
-    inflateEnd(&stream);
-    return err;
+    m_stream.next_in = (Bytef*)source;
+    m_stream.avail_in = (uInt)sourceLen;
+    m_stream.next_out = dest;
+    m_stream.avail_out = (uInt)*destLen;
+    err = inflate(&m_stream, Z_FINISH);
+    if (err != Z_STREAM_END) return err;
+    *destLen = m_stream.total_out;
+    return Z_OK;
   }
-  *destLen = stream.total_out;
 
-  err = inflateEnd(&stream);
-  return err;
-}
+ private:
+  z_stream m_stream;
+  int m_init;
+};
 
-static bool decompress_class(jar_entry &file, const uint8_t *mapping,
+static bool decompress_class(const jar_entry &file, const uint8_t *mapping,
+                             Inflater &inflater,
                              uint8_t *outbuffer, ssize_t bufsize) {
   if (file.cd_entry.comp_method != kCompMethodDeflate) {
     fprintf(stderr, "Unknown compression method %d, Bailing\n",
@@ -703,7 +774,7 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
   lfile += pkf.fname_len;
   lfile += pkf.extra_len;
   uLongf dlen = bufsize;
-  int zlibrv = jar_uncompress(outbuffer, &dlen, lfile, pkf.comp_size);
+  int zlibrv = inflater.uncompress(outbuffer, &dlen, lfile, pkf.comp_size);
   if (zlibrv != Z_OK) {
     fprintf(stderr, "uncompress failed with code %d, Bailing\n", zlibrv);
     return false;
@@ -715,85 +786,420 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
   return true;
 }
 
-static const int kStartBufferSize = 128 * 1024;
+static bool is_class_entry(const jar_entry& file) {
+  static const char classEndString[] = ".class";
+  static const size_t classEndStringLen = strlen(classEndString);
+  if (file.cd_entry.ucomp_size == 0)
+    return false;
+  if (file.cd_entry.fname_len < (classEndStringLen + 1))
+    return false;
+  const uint8_t* endcomp =
+      file.filename + (file.cd_entry.fname_len - classEndStringLen);
+  return memcmp(endcomp, classEndString, classEndStringLen) == 0;
+}
 
-static bool process_jar_entries(std::vector<jar_entry>& files,
-                                const uint8_t* mapping,
-                                Scope* classes,
-                                attribute_hook_t attr_hook) {
-  ssize_t bufsize = kStartBufferSize;
-  uint8_t *outbuffer = (uint8_t*)malloc(bufsize);
-  static char classEndString[] = ".class";
-  static size_t classEndStringLen = strlen(classEndString);
-  init_basic_types();
-  for (auto &file : files) {
-    if (file.cd_entry.ucomp_size == 0)
-      continue;
-    if (file.cd_entry.fname_len < (classEndStringLen  + 1))
-      continue;
+static bool process_jar(const uint8_t* mapping,
+                        ssize_t size,
+                        std::vector<jar_entry>& files) {
+  pk_cdir_end pce;
+  if (!find_central_directory(mapping, size, pce))
+    return false;
+  if (!validate_pce(pce, size))
+    return false;
+  if (!get_jar_entries(mapping, pce, files))
+    return false;
+  return true;
+}
 
-    // Skip non-class files
-    uint8_t *endcomp = file.filename +
-      (file.cd_entry.fname_len - classEndStringLen);
-    if (memcmp(endcomp, classEndString, classEndStringLen) != 0)
-      continue;
+/******************
+ * Begin Jar Cache code.
+ *
+ * The class_defs of all the classes of a jar, written with the strings they
+ * refer to in a table at the start:
+ *
+ *   "RDXJ" <version>
+ *   <string count> (<length> <bytes>)*
+ *   <class count> (<type> <super> <access> <interface count> <interface>*
+ *                  <field count> (<access> <name> <desc>)*
+ *                  <method count> (<access> <name> <desc>)*)*
+ *
+ * Every number is uleb128 encoded, and a string is referred to by its index
+ * in the table + 1, or 0 for nullptr.
+ */
 
-    // Resize output if necessary.
-    if (bufsize < file.cd_entry.ucomp_size) {
-      while(bufsize < file.cd_entry.ucomp_size)
-        bufsize *= 2;
-      free(outbuffer);
-      outbuffer = (uint8_t*)malloc(bufsize);
-    }
+namespace {
 
-    if (!decompress_class(file, mapping, outbuffer, bufsize)) {
-      free(outbuffer);
-      return false;
+constexpr char kCacheMagic[] = {'R', 'D', 'X', 'J'};
+constexpr uint32_t kCacheVersion = 1;
+
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+std::string jar_cache_path(const std::string& cache_dir,
+                           const uint8_t* mapping,
+                           size_t size) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= mapping[i];
+    hash *= FNV_PRIME;
+  }
+  std::ostringstream path;
+  path << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << hash << ".jarcache";
+  return path.str();
+}
+
+void put(std::string& out, uint64_t v) {
+  do {
+    uint8_t byte = v & 0x7f;
+    v >>= 7;
+    out.push_back(static_cast<char>(byte | (v ? 0x80 : 0)));
+  } while (v);
+}
+
+bool write_jar_cache(const std::string& path,
+                     const std::vector<class_def>& defs) {
+  std::unordered_map<const DexString*, uint64_t> ids;
+  std::string strings;
+  std::string body;
+  auto string_id = [&](const DexString* s) -> uint64_t {
+    if (s == nullptr) return 0;
+    auto it = ids.find(s);
+    if (it != ids.end()) return it->second;
+    auto id = ids.size() + 1;
+    ids.emplace(s, id);
+    put(strings, s->str().size());
+    strings.append(s->str());
+    return id;
+  };
+  put(body, defs.size());
+  for (const auto& def : defs) {
+    put(body, string_id(def.type));
+    put(body, string_id(def.super));
+    put(body, def.access);
+    put(body, def.interfaces.size());
+    for (const auto& iface : def.interfaces) {
+      put(body, string_id(iface));
+    }
+    for (const auto* members : {&def.fields, &def.methods}) {
+      put(body, members->size());
+      for (const auto& member : *members) {
+        put(body, member.access);
+        put(body, string_id(member.name));
+        put(body, string_id(member.desc));
+      }
     }
+  }
 
-    if (!parse_class(outbuffer, classes, attr_hook)) {
-      free(outbuffer);
-      return false;
+  // Runs that share the cache may write the same entry at the same time, so
+  // it only appears under its name once complete.
+  auto tmp_path =
+      path + "." + boost::filesystem::unique_path().string() + ".tmp";
+  std::ofstream out(tmp_path, std::ios::binary);
+  std::string header(kCacheMagic, sizeof(kCacheMagic));
+  put(header, kCacheVersion);
+  put(header, ids.size());
+  out << header << strings << body;
+  // Closing flushes, which can fail too.
+  out.close();
+  boost::system::error_code ec;
+  if (out) {
+    boost::filesystem::rename(tmp_path, path, ec);
+    if (!ec) {
+      return true;
     }
   }
-  free(outbuffer);
-  return true;
+  boost::filesystem::remove(tmp_path, ec);
+  return false;
 }
 
-static bool process_jar(const uint8_t* mapping,
-                        ssize_t size,
-                        Scope* classes,
-                        attribute_hook_t attr_hook) {
-  pk_cdir_end pce;
-  std::vector<jar_entry> files;
-  if (!find_central_directory(mapping, size, pce))
+/*
+ * Reads the class_defs from the cache entry, or returns false if it does not
+ * exist or can't be read.
+ */
+bool read_jar_cache(const std::string& path, std::vector<class_def>& defs) {
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(path);
+  } catch (const std::exception&) {
     return false;
-  if (!validate_pce(pce, size))
+  }
+  const char* cur = file.data();
+  const char* end = cur + file.size();
+  bool ok = true;
+  auto get = [&]() -> uint64_t {
+    uint64_t v = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+      if (cur == end || shift >= 64) {
+        ok = false;
+        return 0;
+      }
+      byte = static_cast<uint8_t>(*cur++);
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    return v;
+  };
+  // A count of entries that take at least :min_size bytes each, which a
+  // corrupt entry could otherwise make us allocate far more than it holds for.
+  auto get_count = [&](uint64_t min_size) -> uint64_t {
+    auto count = get();
+    if (count > (uint64_t)(end - cur) / min_size) {
+      ok = false;
+      return 0;
+    }
+    return count;
+  };
+  if (file.size() < sizeof(kCacheMagic) ||
+      memcmp(cur, kCacheMagic, sizeof(kCacheMagic)) != 0) {
     return false;
-  if (!get_jar_entries(mapping, pce, files))
+  }
+  cur += sizeof(kCacheMagic);
+  if (get() != kCacheVersion) {
     return false;
-  if (!process_jar_entries(files, mapping, classes, attr_hook)) {
+  }
+
+  // Each string is at least its size, each class_def at least its type,
+  // super, access and three counts, and each member its access, name and
+  // descriptor.
+  std::vector<DexString*> strings(get_count(1));
+  if (!ok) {
     return false;
   }
-  return true;
+  for (auto& str : strings) {
+    auto size = get();
+    if (!ok || size > (uint64_t)(end - cur)) {
+      return false;
+    }
+    str = DexString::make_string(std::string(cur, size));
+    cur += size;
+  }
+  auto string = [&](uint64_t id) -> DexString* {
+    if (id == 0 || id > strings.size()) {
+      ok = ok && id == 0;
+      return nullptr;
+    }
+    return strings[id - 1];
+  };
+
+  defs.resize(get_count(6));
+  for (auto& def : defs) {
+    if (!ok) {
+      return false;
+    }
+    def.type = string(get());
+    def.super = string(get());
+    def.access = get();
+    def.interfaces.resize(get_count(1));
+    for (auto& iface : def.interfaces) {
+      iface = string(get());
+    }
+    for (auto* members : {&def.fields, &def.methods}) {
+      members->resize(get_count(3));
+      for (auto& member : *members) {
+        member.access = get();
+        member.name = string(get());
+        member.desc = string(get());
+      }
+    }
+  }
+  return ok && cur == end;
 }
 
-bool load_jar_file(const char* location,
-                   Scope* classes,
-                   attribute_hook_t attr_hook) {
+struct jar_file {
   boost::iostreams::mapped_file file;
-  file.open(location, boost::iostreams::mapped_file::readonly);
-  if (!file.is_open()) {
-    fprintf(stderr, "error: cannot open jar file: %s\n", location);
-    return false;
+  std::vector<jar_entry> files;
+  std::atomic<bool> ok;
+  std::string cache_path;
+  bool cached{false};
+  // The class entries of the jar and what they hold, in the order of the
+  // central directory.
+  std::vector<const jar_entry*> class_files;
+  std::vector<std::unique_ptr<uint8_t[]>> bytes;
+  std::vector<class_def> defs;
+  std::vector<DexClass*> classes;
+};
+
+/*
+ * Runs :fn(data, i) for i in [0, size) on the worker threads, where :data is
+ * the state of the thread.
+ */
+template <typename Data, typename Fn>
+void parallel_for(size_t size, unsigned num_threads, const Fn& fn) {
+  std::vector<Data> data(num_threads);
+  WorkQueue<size_t, unsigned, std::nullptr_t> wq(
+      [&](unsigned& thread, size_t i) -> std::nullptr_t {
+        fn(data[thread], i);
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned thread) { return thread; },
+      num_threads);
+  for (size_t i = 0; i < size; ++i) {
+    wq.add_item(i);
   }
+  wq.run_all();
+}
 
-  auto mapping = reinterpret_cast<const uint8_t*>(file.const_data());
-  if (!process_jar(mapping, file.size(), classes, attr_hook)) {
-    fprintf(stderr, "error: cannot process jar: %s\n", location);
-    return false;
+} // namespace
+
+bool load_jar_files(const std::vector<std::string>& locations,
+                    Scope* classes,
+                    attribute_hook_t attr_hook,
+                    std::vector<std::string>* failed,
+                    const std::string& cache_dir) {
+  if (attr_hook != nullptr && locations.size() > 1) {
+    // The attributes handed to the hook point into the inflated class files,
+    // so load the jars one at a time to only hold those of one jar at once.
+    bool all_ok = true;
+    for (const auto& location : locations) {
+      all_ok &=
+          load_jar_files({location}, classes, attr_hook, failed, cache_dir);
+    }
+    return all_ok;
   }
-  return true;
+  init_basic_types();
+  std::vector<jar_file> jars(locations.size());
+  // The (jar, class) pairs of the classes that are not in the cache.
+  std::vector<std::pair<jar_file*, size_t>> to_decompress;
+  for (size_t i = 0; i < locations.size(); ++i) {
+    auto& jar = jars[i];
+    try {
+      jar.file.open(locations[i], boost::iostreams::mapped_file::readonly);
+    } catch (const std::exception&) {
+      // Reported below, like any other jar that fails to open.
+    }
+    if (!jar.file.is_open()) {
+      fprintf(stderr, "error: cannot open jar file: %s\n",
+              locations[i].c_str());
+      jar.ok = false;
+      continue;
+    }
+    jar.ok = true;
+    auto mapping = reinterpret_cast<const uint8_t*>(jar.file.const_data());
+    // The attributes that the hook is handed are not in the cache.
+    if (!cache_dir.empty() && attr_hook == nullptr) {
+      jar.cache_path = jar_cache_path(cache_dir, mapping, jar.file.size());
+      jar.cached = read_jar_cache(jar.cache_path, jar.defs);
+      if (jar.cached) {
+        TRACE(MAIN, 2, "Read %s from %s\n", locations[i].c_str(),
+              jar.cache_path.c_str());
+        continue;
+      }
+      jar.defs.clear();
+    }
+    jar.ok = process_jar(mapping, jar.file.size(), jar.files);
+    if (!jar.ok) {
+      continue;
+    }
+    for (const auto& file : jar.files) {
+      if (is_class_entry(file)) {
+        jar.class_files.push_back(&file);
+      }
+    }
+    jar.bytes.resize(jar.class_files.size());
+    jar.defs.resize(jar.class_files.size());
+    for (size_t j = 0; j < jar.class_files.size(); ++j) {
+      to_decompress.emplace_back(&jar, j);
+    }
+  }
+
+  // Decompress the classes and read what they define.
+  auto num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  parallel_for<Inflater>(
+      to_decompress.size(), num_threads, [&](Inflater& inflater, size_t i) {
+        auto& jar = *to_decompress[i].first;
+        auto j = to_decompress[i].second;
+        auto& file = *jar.class_files[j];
+        auto size = file.cd_entry.ucomp_size;
+        jar.bytes[j].reset(new uint8_t[size]);
+        auto mapping = reinterpret_cast<const uint8_t*>(jar.file.const_data());
+        if (!decompress_class(file, mapping, inflater, jar.bytes[j].get(),
+                              size) ||
+            !parse_class_def(jar.bytes[j].get(), jar.defs[j],
+                             attr_hook != nullptr)) {
+          // The other classes of the jar are still loaded.
+          jar.defs[j] = class_def();
+          jar.ok = false;
+        }
+        // Only the attributes handed to the hook point into the class file.
+        if (attr_hook == nullptr) {
+          jar.bytes[j].reset();
+        }
+      });
+
+  for (auto& jar : jars) {
+    if (jar.ok && !jar.cached && !jar.cache_path.empty() &&
+        !write_jar_cache(jar.cache_path, jar.defs)) {
+      fprintf(stderr, "warning: cannot write jar cache %s\n",
+              jar.cache_path.c_str());
+    }
+  }
+
+  // As when loading the jars one after the other, the first class of a type
+  // wins, and classes that already exist are left alone.
+  std::unordered_set<DexString*> seen;
+  std::vector<std::pair<jar_file*, size_t>> to_make;
+  for (auto& jar : jars) {
+    jar.classes.resize(jar.defs.size());
+    for (size_t j = 0; j < jar.defs.size(); ++j) {
+      auto type = jar.defs[j].type;
+      if (type != nullptr && !type_class(DexType::get_type(type)) &&
+          seen.insert(type).second) {
+        to_make.emplace_back(&jar, j);
+      }
+    }
+  }
+
+  // The attribute hook may not be thread-safe, so it is always called from
+  // the same thread.
+  parallel_for<std::nullptr_t>(
+      to_make.size(), attr_hook == nullptr ? num_threads : 1,
+      [&](std::nullptr_t, size_t i) {
+        auto& jar = *to_make[i].first;
+        auto j = to_make[i].second;
+        jar.classes[j] = make_class(jar.defs[j], attr_hook);
+        if (jar.classes[j] == nullptr) {
+          jar.ok = false;
+        }
+        if (attr_hook != nullptr) {
+          jar.bytes[j].reset();
+        }
+      });
+
+  bool all_ok = true;
+  size_t num_classes = 0;
+  for (size_t i = 0; i < jars.size(); ++i) {
+    for (const auto& cls : jars[i].classes) {
+      if (cls != nullptr) {
+        if (classes != nullptr) {
+          classes->emplace_back(cls);
+        }
+        ++num_classes;
+      }
+    }
+    if (!jars[i].ok) {
+      if (jars[i].file.is_open()) {
+        fprintf(stderr, "error: cannot process jar: %s\n",
+                locations[i].c_str());
+      }
+      if (failed != nullptr) {
+        failed->push_back(locations[i]);
+      }
+      all_ok = false;
+    }
+  }
+  TRACE(MAIN, 1, "Loaded %zu classes from %zu jar files\n", num_classes,
+        locations.size());
+  return all_ok;
+}
+
+bool load_jar_file(const char* location,
+                   Scope* classes,
+                   attribute_hook_t attr_hook) {
+  return load_jar_files({location}, classes, attr_hook);
 }
 
 //#define LOCAL_MAIN
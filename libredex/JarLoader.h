@@ -13,6 +13,8 @@ class DexMethod;
 #include "boost/variant.hpp"
 
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace JarLoaderUtil {
 uint32_t read32(uint8_t*& buffer);
@@ -28,4 +30,21 @@ bool load_jar_file(const char* location,
                    Scope* classes = nullptr,
                    attribute_hook_t = nullptr);
 
+// Loads the jars together, decompressing and parsing their classes in
+// parallel. When several of them have a class of the same type, the one of the
+// first jar is kept, as when loading them one after the other. The locations
+// of the jars that could not be loaded are added to :failed; the classes of
+// such a jar that could be read are loaded all the same. With an attribute
+// hook the jars are loaded one at a time.
+//
+// With a :cache_dir, what each jar defines is read from a cache entry there
+// instead, keyed by a hash of the contents of the jar, or parsed and written
+// to one if there is none yet. Jars are not cached when there is an attribute
+// hook, which needs the class files.
+bool load_jar_files(const std::vector<std::string>& locations,
+                    Scope* classes = nullptr,
+                    attribute_hook_t = nullptr,
+                    std::vector<std::string>* failed = nullptr,
+                    const std::string& cache_dir = "");
+
 bool load_class_file(const std::string& filename, Scope* classes = nullptr);
@@ -158,12 +158,12 @@ std::vector<DexMethod*> get_devirtualizable_vmethods(
     const std::vector<DexClass*>& scope,
     const std::vector<DexMethod*>& targets) {
   ClassHierarchy class_hierarchy = build_type_hierarchy(scope);
-  auto signature_map = build_signature_map(class_hierarchy);
+  auto signature_map = get_cached_signature_map(class_hierarchy);
 
   std::vector<DexMethod*> res;
   for (const auto m : targets) {
     always_assert(!is_static(m) && !is_private(m) && !is_any_init(m));
-    if (can_devirtualize(signature_map, m)) {
+    if (can_devirtualize(*signature_map, m)) {
       res.push_back(m);
     }
   }
@@ -24,10 +24,13 @@
 #include "IRTypeChecker.h"
 #include "JemallocUtil.h"
 #include "PrintSeeds.h"
+#include "ProgramSnapshot.h"
 #include "ProguardMatcher.h"
 #include "ProguardPrintConfiguration.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
+#include "RedexContext.h"
+#include "Resolver.h"
 #include "Timer.h"
 #include "Walkers.h"
 
@@ -121,30 +124,83 @@ void PassManager::run_type_checker(const Scope& scope,
 }
 
 const std::string PASS_ORDER_KEY = "pass_order";
+const std::string RESOLVER_CACHE_HITS_KEY = "resolver_cache_hits";
+const std::string RESOLVER_CACHE_MISSES_KEY = "resolver_cache_misses";
+
+Json::Value PassManager::snapshot_state(size_t last_pass, ConfigFiles& cfg) {
+  Json::Value state;
+  Json::Value metrics(Json::arrayValue);
+  for (size_t i = 0; i <= last_pass; ++i) {
+    Json::Value pass_metrics(Json::objectValue);
+    for (const auto& metric : m_pass_info[i].metrics) {
+      pass_metrics[metric.first] = metric.second;
+    }
+    metrics.append(pass_metrics);
+  }
+  state["metrics"] = metrics;
+  Json::Value moved_methods(Json::arrayValue);
+  for (const auto& it : cfg.get_moved_methods_map()) {
+    Json::Value moved(Json::arrayValue);
+    moved.append(std::get<0>(it.first)->str());
+    moved.append(std::get<1>(it.first)->str());
+    auto src_file = std::get<2>(it.first);
+    moved.append(src_file != nullptr ? Json::Value(src_file->str())
+                                     : Json::Value());
+    moved.append(it.second->get_type()->get_name()->str());
+    moved_methods.append(moved);
+  }
+  state["moved_methods"] = moved_methods;
+  return state;
+}
+
+void PassManager::restore_snapshot_state(size_t first_pass, ConfigFiles& cfg) {
+  const auto& metrics = m_resume_state["metrics"];
+  for (size_t i = 0; i < first_pass && i < metrics.size(); ++i) {
+    for (const auto& key : metrics[Json::ArrayIndex(i)].getMemberNames()) {
+      m_pass_info[i].metrics[key] = metrics[Json::ArrayIndex(i)][key].asInt();
+    }
+  }
+  for (const auto& moved : m_resume_state["moved_methods"]) {
+    auto cls = type_class(DexType::get_type(moved[3].asString()));
+    always_assert_log(cls != nullptr,
+                      "Moved methods target %s is not in the snapshot",
+                      moved[3].asString().c_str());
+    cfg.add_moved_methods(
+        MethodTuple(DexString::make_string(moved[0].asString()),
+                    DexString::make_string(moved[1].asString()),
+                    moved[2].isNull()
+                        ? nullptr
+                        : DexString::make_string(moved[2].asString())),
+        cls);
+  }
+}
 
 void PassManager::run_passes(DexStoresVector& stores,
                              const Scope& external_classes,
                              ConfigFiles& cfg) {
   DexStoreClassesIterator it(stores);
   Scope scope = build_class_scope(it);
-  {
+  // When resuming from a snapshot, the ReferencedState of the program comes
+  // from the snapshot and the seeds have been printed by the original run.
+  bool resuming = !m_resume_pass.empty();
+  if (!resuming) {
     Timer t("Initializing reachable classes");
     init_reachable_classes(
         scope, m_config, m_pg_config, cfg.get_no_optimizations_annos());
   }
-  {
+  if (!resuming) {
     Timer t("Processing proguard rules");
     process_proguard_rules(
         cfg.get_proguard_map(), scope, external_classes, &m_pg_config);
   }
   char* seeds_output_file = std::getenv("REDEX_SEEDS_FILE");
-  if (seeds_output_file) {
+  if (seeds_output_file && !resuming) {
     std::string seed_filename = seeds_output_file;
     Timer t("Writing seeds file " + seed_filename);
     std::ofstream seeds_file(seed_filename);
     redex::print_seeds(seeds_file, cfg.get_proguard_map(), scope, false, false);
   }
-  if (!cfg.get_printseeds().empty()) {
+  if (!cfg.get_printseeds().empty() && !resuming) {
     Timer t("Writing seeds to file " + cfg.get_printseeds());
     std::ofstream seeds_file(cfg.get_printseeds());
     redex::print_seeds(seeds_file, cfg.get_proguard_map(), scope);
@@ -173,8 +229,6 @@ void PassManager::run_passes(DexStoresVector& stores,
   m_pass_info.resize(m_activated_passes.size());
   for (size_t i = 0; i < m_activated_passes.size(); ++i) {
     Pass* pass = m_activated_passes[i];
-    TRACE(PM, 1, "Evaluating %s...\n", pass->name().c_str());
-    Timer t(pass->name() + " (eval)");
     const size_t count = pass_counters[pass]++;
     m_pass_info[i].pass = pass;
     m_pass_info[i].order = i;
@@ -182,6 +236,26 @@ void PassManager::run_passes(DexStoresVector& stores,
     m_pass_info[i].total_repeat = pass_repeats.at(pass);
     m_pass_info[i].name = pass->name() + "#" + std::to_string(count + 1);
     m_pass_info[i].metrics[PASS_ORDER_KEY] = i;
+  }
+
+  // The passes before first_pass have already run on the resumed state.
+  size_t first_pass = resuming ? find_pass_info(m_resume_pass) + 1 : 0;
+  if (resuming) {
+    restore_snapshot_state(first_pass, cfg);
+  }
+  size_t snapshot_pass = m_snapshot_pass.empty()
+                             ? m_activated_passes.size()
+                             : find_pass_info(m_snapshot_pass);
+  for (size_t i = 0; i < first_pass; ++i) {
+    if (m_activated_passes[i]->name() == "RegAllocPass") {
+      record_running_regalloc();
+    }
+  }
+
+  for (size_t i = first_pass; i < m_activated_passes.size(); ++i) {
+    Pass* pass = m_activated_passes[i];
+    TRACE(PM, 1, "Evaluating %s...\n", pass->name().c_str());
+    Timer t(pass->name() + " (eval)");
     m_current_pass_info = &m_pass_info[i];
     pass->eval_pass(stores, cfg, *this);
     m_current_pass_info = nullptr;
@@ -202,11 +276,13 @@ void PassManager::run_passes(DexStoresVector& stores,
     trigger_passes.insert(trigger_pass.asString());
   }
 
-  for (size_t i = 0; i < m_activated_passes.size(); ++i) {
+  invalidate_resolver_cache();
+  for (size_t i = first_pass; i < m_activated_passes.size(); ++i) {
     Pass* pass = m_activated_passes[i];
     TRACE(PM, 1, "Running %s...\n", pass->name().c_str());
     Timer t(pass->name() + " (run)");
     m_current_pass_info = &m_pass_info[i];
+    auto resolver_stats_before = g_redex->resolver_cache().get_stats();
 
     {
       ScopedCommandProfiling cmd_prof(
@@ -216,12 +292,40 @@ void PassManager::run_passes(DexStoresVector& stores,
       jemalloc_util::ScopedProfiling malloc_prof(m_malloc_profile_pass == pass);
       pass->run_pass(stores, cfg, *this);
     }
+    // Passes may edit member vectors in place, behind the back of the
+    // DexClass API, so no resolution survives a pass boundary.
+    invalidate_resolver_cache();
+
+    auto resolver_stats_after = g_redex->resolver_cache().get_stats();
+    set_metric(RESOLVER_CACHE_HITS_KEY,
+               resolver_stats_after.hits - resolver_stats_before.hits);
+    set_metric(RESOLVER_CACHE_MISSES_KEY,
+               resolver_stats_after.misses - resolver_stats_before.misses);
 
     if (run_after_each_pass || trigger_passes.count(pass->name()) > 0) {
       scope = build_class_scope(it);
       run_type_checker(scope, polymorphic_constants, verify_moves);
     }
     m_current_pass_info = nullptr;
+
+    if (i == snapshot_pass) {
+      Timer t("Writing program snapshot " + m_snapshot_path);
+      // Write to a temporary file first so that an interrupted run never
+      // leaves a truncated snapshot to be resumed from.
+      auto tmp_path = m_snapshot_path + ".tmp";
+      std::ofstream snapshot(tmp_path, std::ios::binary);
+      auto metadata = m_snapshot_metadata;
+      metadata["pass_manager"] = snapshot_state(i, cfg);
+      write_program_snapshot(
+          stores, Json::FastWriter().write(metadata), snapshot);
+      snapshot.close();
+      if (!snapshot ||
+          std::rename(tmp_path.c_str(), m_snapshot_path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        always_assert_log(false, "Could not write program snapshot %s",
+                          m_snapshot_path.c_str());
+      }
+    }
   }
 
   // Always run the type checker before generating the optimized dex code.
@@ -265,6 +369,16 @@ Pass* PassManager::find_pass(const std::string& pass_name) const {
   return pass_it != m_activated_passes.end() ? *pass_it : nullptr;
 }
 
+size_t PassManager::find_pass_info(const std::string& name) const {
+  for (size_t i = 0; i < m_pass_info.size(); ++i) {
+    if (m_pass_info[i].name == name || m_pass_info[i].pass->name() == name) {
+      return i;
+    }
+  }
+  always_assert_log(false, "No pass named %s", name.c_str());
+  not_reached();
+}
+
 void PassManager::incr_metric(const std::string& key, int value) {
   always_assert_log(m_current_pass_info != nullptr, "No current pass!");
   (m_current_pass_info->metrics)[key] += value;
@@ -75,13 +75,45 @@ class PassManager {
     return m_regalloc_has_run;
   }
 
+  // Write a ProgramSnapshot of the stores to `path` right after running
+  // `after_pass`, named with or without its "#<n>" suffix. Its metadata is
+  // `metadata` with the state of the PassManager under "pass_manager": the
+  // metrics of the passes run so far and the moved methods of the
+  // ConfigFiles.
+  void snapshot_after(const std::string& after_pass,
+                      const std::string& path,
+                      const Json::Value& metadata) {
+    m_snapshot_pass = after_pass;
+    m_snapshot_path = path;
+    m_snapshot_metadata = metadata;
+  }
+
+  // The stores were read from a ProgramSnapshot taken after `after_pass`:
+  // skip the initialization of the program state and all passes up to and
+  // including `after_pass`, and restore the "pass_manager" state of its
+  // metadata.
+  void resume_after(const std::string& after_pass,
+                    const Json::Value& snapshot_metadata) {
+    m_resume_pass = after_pass;
+    m_resume_state = snapshot_metadata["pass_manager"];
+  }
+
  private:
   void activate_pass(const char* name, const Json::Value& cfg);
 
   Pass* find_pass(const std::string& pass_name) const;
 
+  // The index in m_pass_info of the first pass named `name`, with or without
+  // its "#<n>" suffix.
+  size_t find_pass_info(const std::string& name) const;
+
   void init(const Json::Value& config);
 
+  // The state outside of the program that the passes up to and including
+  // `last_pass` left, and its restoration when resuming before `first_pass`.
+  Json::Value snapshot_state(size_t last_pass, ConfigFiles& cfg);
+  void restore_snapshot_state(size_t first_pass, ConfigFiles& cfg);
+
   static void run_type_checker(const Scope& scope,
                                bool polymorphic_constants,
                                bool verify_moves);
@@ -101,6 +133,12 @@ class PassManager {
   bool m_art_build;
   bool m_regalloc_has_run = false;
 
+  std::string m_snapshot_pass;
+  std::string m_snapshot_path;
+  Json::Value m_snapshot_metadata;
+  std::string m_resume_pass;
+  Json::Value m_resume_state;
+
   struct ProfilerInfo {
     std::string command;
     const Pass* pass;
@@ -11,7 +11,7 @@
 #include "ReferencedState.h"
 
 template <class Container>
-void print_method_seeds(std::ostream& output,
+void print_method_seeds(std::string& output,
                         const ProguardMap& pg_map,
                         const std::string& class_name,
                         const Container& methods,
@@ -30,7 +30,7 @@ void print_method_seeds(std::ostream& output,
 }
 
 template <class Container>
-void print_field_seeds(std::ostream& output,
+void print_field_seeds(std::string& output,
                        const ProguardMap& pg_map,
                        const std::string& class_name,
                        const Container& fields,
@@ -47,24 +47,27 @@ void print_field_seeds(std::ostream& output,
   };
 }
 
-void show_class(std::ostream& output,
+void show_class(std::string& output,
                 const DexClass* cls,
                 const std::string& name,
                 const bool allowshrinking_filter,
                 const bool allowobfuscation_filter) {
   if (allowshrinking_filter) {
     if (allowshrinking(cls)) {
-      output << name << std::endl;
+      output += name;
+      output += "\n";
     }
     return;
   }
   if (allowobfuscation_filter) {
     if (allowobfuscation(cls)) {
-      output << name << std::endl;
+      output += name;
+      output += "\n";
     }
     return;
   }
-  output << name << std::endl;
+  output += name;
+  output += "\n";
 }
 
 // Print out the seeds computed in classes by Redex to the specified ostream.
@@ -74,41 +77,43 @@ void redex::print_seeds(std::ostream& output,
                         const Scope& classes,
                         const bool allowshrinking_filter,
                         const bool allowobfuscation_filter) {
-  for (const auto& cls : classes) {
-    auto deob = cls->get_deobfuscated_name();
-    if (deob.empty()) {
-      std::cerr << "WARNING: this class has no deobu name: "
-                << cls->get_name()->c_str() << std::endl;
-      deob = cls->get_name()->c_str();
-    }
-    std::string name = redex::dexdump_name_to_dot_name(deob);
-    if (keep(cls)) {
-      show_class(
-          output, cls, name, allowshrinking_filter, allowobfuscation_filter);
-    }
-    print_field_seeds(output,
-                      pg_map,
-                      name,
-                      cls->get_ifields(),
-                      allowshrinking_filter,
-                      allowobfuscation_filter);
-    print_field_seeds(output,
-                      pg_map,
-                      name,
-                      cls->get_sfields(),
-                      allowshrinking_filter,
-                      allowobfuscation_filter);
-    print_method_seeds(output,
-                       pg_map,
-                       name,
-                       cls->get_dmethods(),
-                       allowshrinking_filter,
-                       allowobfuscation_filter);
-    print_method_seeds(output,
-                       pg_map,
-                       name,
-                       cls->get_vmethods(),
-                       allowshrinking_filter,
-                       allowobfuscation_filter);
-  }
+  print_in_parallel(
+      output, classes, [&](const DexClass* cls, std::string& out) {
+        auto deob = cls->get_deobfuscated_name();
+        if (deob.empty()) {
+          redex::print_warning(
+              std::string("WARNING: this class has no deobu name: ") +
+              cls->get_name()->c_str());
+          deob = cls->get_name()->c_str();
+        }
+        std::string name = redex::dexdump_name_to_dot_name(deob);
+        if (keep(cls)) {
+          show_class(
+              out, cls, name, allowshrinking_filter, allowobfuscation_filter);
+        }
+        print_field_seeds(out,
+                          pg_map,
+                          name,
+                          cls->get_ifields(),
+                          allowshrinking_filter,
+                          allowobfuscation_filter);
+        print_field_seeds(out,
+                          pg_map,
+                          name,
+                          cls->get_sfields(),
+                          allowshrinking_filter,
+                          allowobfuscation_filter);
+        print_method_seeds(out,
+                           pg_map,
+                           name,
+                           cls->get_dmethods(),
+                           allowshrinking_filter,
+                           allowobfuscation_filter);
+        print_method_seeds(out,
+                           pg_map,
+                           name,
+                           cls->get_vmethods(),
+                           allowshrinking_filter,
+                           allowobfuscation_filter);
+      });
 }
@@ -0,0 +1,1099 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ProgramSnapshot.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "Debug.h"
+#include "DexAnnotation.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "Resolver.h"
+#include "Trace.h"
+
+/*
+ * Layout of a snapshot:
+ *
+ *   "RDXS" <version>
+ *   <string table> <type table> <proto table> <field table> <method table>
+ *   <body>
+ *
+ * Every number is uleb128 encoded. References into the tables are written as
+ * 0 for nullptr and index + 1 otherwise. The tables are filled in the order
+ * in which the writer first encounters each entry, so that an entry only
+ * ever refers to entries of the same or of earlier tables that precede it.
+ */
+
+namespace {
+
+constexpr char MAGIC[] = {'R', 'D', 'X', 'S'};
+constexpr uint32_t VERSION = 1;
+
+// How a DexPosition refers to its parent.
+enum ParentKind : uint8_t {
+  NO_PARENT = 0,
+  // A position in the IRCode of one of the methods of the snapshot, by its
+  // index among all of those positions.
+  CODE_PARENT = 1,
+  // A position outside of any code of the snapshot (e.g. the callsite of an
+  // inlined method that has since been removed), written out in full the
+  // first time it is referred to...
+  NEW_EXTERNAL_PARENT = 2,
+  // ... and by index among those positions afterwards.
+  EXTERNAL_PARENT = 3,
+};
+
+void write_uleb(std::string& out, uint64_t v) {
+  do {
+    uint8_t byte = v & 0x7f;
+    v >>= 7;
+    if (v != 0) byte |= 0x80;
+    out.push_back(static_cast<char>(byte));
+  } while (v != 0);
+}
+
+void write_bytes(std::string& out, const std::string& s) {
+  write_uleb(out, s.size());
+  out.append(s);
+}
+
+template <typename Fn>
+void for_each_method(const DexStoresVector& stores, const Fn& fn) {
+  for (const auto& store : stores) {
+    for (const auto& dex : store.get_dexen()) {
+      for (const auto& cls : dex) {
+        for (const auto& m : cls->get_dmethods()) fn(m);
+        for (const auto& m : cls->get_vmethods()) fn(m);
+      }
+    }
+  }
+}
+
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(const DexStoresVector& stores) {
+    for_each_method(stores, [&](const DexMethod* method) {
+      auto code = method->get_code();
+      if (code == nullptr) return;
+      for (const auto& mie : *code) {
+        if (mie.type == MFLOW_POSITION) {
+          auto id = m_code_positions.size();
+          m_code_positions.emplace(mie.pos.get(), id);
+        }
+      }
+    });
+  }
+
+  void write_stores(const DexStoresVector& stores) {
+    write_uleb(m_body, stores.size());
+    for (const auto& store : stores) {
+      write_bytes(m_body, store.get_name());
+      const auto& deps = store.get_dependencies();
+      write_uleb(m_body, deps.size());
+      for (const auto& dep : deps) {
+        write_bytes(m_body, dep);
+      }
+      write_uleb(m_body, store.get_dexen().size());
+      for (const auto& dex : store.get_dexen()) {
+        write_uleb(m_body, dex.size());
+        for (const auto& cls : dex) {
+          write_class(cls);
+        }
+      }
+    }
+  }
+
+  std::string& body() { return m_body; }
+
+  void finish(std::ostream& out) {
+    out.write(MAGIC, sizeof(MAGIC));
+    std::string header;
+    write_uleb(header, VERSION);
+    write_uleb(header, m_strings.size());
+    out << header << m_string_table;
+    header.clear();
+    write_uleb(header, m_types.size());
+    out << header << m_type_table;
+    header.clear();
+    write_uleb(header, m_protos.size());
+    out << header << m_proto_table;
+    header.clear();
+    write_uleb(header, m_fields.size());
+    out << header << m_field_table;
+    header.clear();
+    write_uleb(header, m_methods.size());
+    out << header << m_method_table;
+    out << m_body;
+  }
+
+ private:
+  template <typename T>
+  static uint64_t lookup(std::unordered_map<const T*, uint64_t>& ids,
+                         const T* item,
+                         bool* is_new) {
+    auto it = ids.find(item);
+    if (it != ids.end()) {
+      *is_new = false;
+      return it->second;
+    }
+    *is_new = true;
+    auto id = ids.size() + 1;
+    ids.emplace(item, id);
+    return id;
+  }
+
+  uint64_t string_id(const DexString* s) {
+    if (s == nullptr) return 0;
+    bool is_new;
+    auto id = lookup(m_strings, s, &is_new);
+    if (is_new) write_bytes(m_string_table, s->str());
+    return id;
+  }
+
+  uint64_t type_id(const DexType* t) {
+    if (t == nullptr) return 0;
+    auto it = m_types.find(t);
+    if (it != m_types.end()) return it->second;
+    auto name = string_id(t->get_name());
+    bool is_new;
+    auto id = lookup(m_types, t, &is_new);
+    write_uleb(m_type_table, name);
+    return id;
+  }
+
+  uint64_t proto_id(const DexProto* p) {
+    if (p == nullptr) return 0;
+    auto it = m_protos.find(p);
+    if (it != m_protos.end()) return it->second;
+    std::string record;
+    write_uleb(record, type_id(p->get_rtype()));
+    const auto& args = p->get_args()->get_type_list();
+    write_uleb(record, args.size());
+    for (const auto& arg : args) {
+      write_uleb(record, type_id(arg));
+    }
+    bool is_new;
+    auto id = lookup(m_protos, p, &is_new);
+    m_proto_table.append(record);
+    return id;
+  }
+
+  uint64_t field_id(const DexFieldRef* f) {
+    if (f == nullptr) return 0;
+    auto it = m_fields.find(f);
+    if (it != m_fields.end()) return it->second;
+    std::string record;
+    write_uleb(record, type_id(f->get_class()));
+    write_uleb(record, string_id(f->get_name()));
+    write_uleb(record, type_id(f->get_type()));
+    bool is_new;
+    auto id = lookup(m_fields, f, &is_new);
+    m_field_table.append(record);
+    return id;
+  }
+
+  uint64_t method_id(const DexMethodRef* m) {
+    if (m == nullptr) return 0;
+    auto it = m_methods.find(m);
+    if (it != m_methods.end()) return it->second;
+    std::string record;
+    write_uleb(record, type_id(m->get_class()));
+    write_uleb(record, string_id(m->get_name()));
+    write_uleb(record, proto_id(m->get_proto()));
+    bool is_new;
+    auto id = lookup(m_methods, m, &is_new);
+    m_method_table.append(record);
+    return id;
+  }
+
+  void put(uint64_t v) { write_uleb(m_body, v); }
+
+  // Deobfuscated names are written as strings, with the empty name as null.
+  void put_name(const std::string& name) {
+    put(name.empty() ? 0 : string_id(DexString::make_string(name)));
+  }
+
+  void write_class(const DexClass* cls) {
+    put(type_id(cls->get_type()));
+    put(type_id(cls->get_super_class()));
+    const auto& intfs = cls->get_interfaces()->get_type_list();
+    put(intfs.size());
+    for (const auto& intf : intfs) {
+      put(type_id(intf));
+    }
+    put(cls->get_access());
+    put(string_id(cls->get_source_file()));
+    put_name(cls->get_deobfuscated_name());
+    write_bytes(m_body, cls->get_dex_location());
+    put(cls->rstate.pack());
+    write_annotation_set(cls->get_anno_set());
+
+    for (const auto* fields : {&cls->get_sfields(), &cls->get_ifields()}) {
+      put(fields->size());
+      for (const auto& field : *fields) {
+        write_field(field);
+      }
+    }
+    for (const auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      put(methods->size());
+      for (const auto& method : *methods) {
+        write_method(method);
+      }
+    }
+  }
+
+  void write_field(const DexField* field) {
+    put(field_id(field));
+    put(field->get_access());
+    put_name(field->get_deobfuscated_name());
+    put(field->rstate.pack());
+    write_annotation_set(field->get_anno_set());
+    auto value = const_cast<DexField*>(field)->get_static_value();
+    put(value != nullptr);
+    if (value != nullptr) {
+      write_value(value);
+    }
+  }
+
+  void write_method(const DexMethod* method) {
+    put(method_id(method));
+    put(method->get_access());
+    put(method->is_virtual());
+    put_name(method->get_deobfuscated_name());
+    put(method->rstate.pack());
+    write_annotation_set(method->get_anno_set());
+    auto param_annos = method->get_param_anno();
+    put(param_annos == nullptr ? 0 : param_annos->size());
+    if (param_annos != nullptr) {
+      for (const auto& param_anno : *param_annos) {
+        put(param_anno.first);
+        write_annotation_set(param_anno.second);
+      }
+    }
+    auto code = const_cast<DexMethod*>(method)->get_code();
+    put(code != nullptr);
+    if (code != nullptr) {
+      write_code(code);
+    }
+  }
+
+  void write_annotation_set(const DexAnnotationSet* aset) {
+    put(aset != nullptr);
+    if (aset == nullptr) return;
+    put(aset->get_annotations().size());
+    for (const auto& anno : aset->get_annotations()) {
+      put(type_id(anno->type()));
+      put(anno->viz());
+      write_elements(anno->anno_elems());
+    }
+  }
+
+  void write_elements(const EncodedAnnotations& elems) {
+    put(elems.size());
+    for (const auto& elem : elems) {
+      put(string_id(elem.string));
+      write_value(elem.encoded_value);
+    }
+  }
+
+  void write_value(DexEncodedValue* ev) {
+    put(ev->evtype());
+    switch (ev->evtype()) {
+    case DEVT_STRING:
+      put(string_id(static_cast<DexEncodedValueString*>(ev)->string()));
+      break;
+    case DEVT_TYPE:
+      put(type_id(static_cast<DexEncodedValueType*>(ev)->type()));
+      break;
+    case DEVT_FIELD:
+    case DEVT_ENUM:
+      put(field_id(static_cast<DexEncodedValueField*>(ev)->field()));
+      break;
+    case DEVT_METHOD:
+      put(method_id(static_cast<DexEncodedValueMethod*>(ev)->method()));
+      break;
+    case DEVT_ARRAY: {
+      auto array = static_cast<DexEncodedValueArray*>(ev);
+      put(array->is_static_val());
+      put(array->evalues()->size());
+      for (const auto& item : *array->evalues()) {
+        write_value(item);
+      }
+      break;
+    }
+    case DEVT_ANNOTATION: {
+      auto anno = static_cast<DexEncodedValueAnnotation*>(ev);
+      put(type_id(anno->type()));
+      write_elements(*anno->annotations());
+      break;
+    }
+    default:
+      put(ev->value());
+      break;
+    }
+  }
+
+  // Reads `code` without touching it: the program is still being optimised
+  // after the snapshot is taken. A non-editable CFG leaves the IRList intact
+  // apart from the fallthrough markers it adds, which are skipped.
+  void write_code(IRCode* code) {
+    always_assert_log(!code->cfg_built() || !code->cfg().editable(),
+                      "Cannot snapshot a method with an editable CFG");
+    put(code->get_registers_size());
+    auto dbg = code->get_debug_item();
+    put(dbg != nullptr);
+    if (dbg != nullptr) {
+      always_assert_log(dbg->get_entries().empty(),
+                        "Debug entries should have been moved into the IRCode");
+      put(dbg->get_param_names().size());
+      for (const auto& name : dbg->get_param_names()) {
+        put(string_id(name));
+      }
+    }
+
+    // MethodItemEntries refer to each other by their index in the list.
+    std::unordered_map<const MethodItemEntry*, uint64_t> indices;
+    for (const auto& mie : *code) {
+      if (mie.type != MFLOW_FALLTHROUGH) {
+        indices.emplace(&mie, indices.size());
+      }
+    }
+    auto index_of = [&](const MethodItemEntry* mie) {
+      return mie == nullptr ? 0 : indices.at(mie) + 1;
+    };
+
+    put(indices.size());
+    for (const auto& mie : *code) {
+      if (mie.type == MFLOW_FALLTHROUGH) continue;
+      put(mie.type);
+      switch (mie.type) {
+      case MFLOW_TRY:
+        put(mie.tentry->type);
+        put(index_of(mie.tentry->catch_start));
+        break;
+      case MFLOW_CATCH:
+        put(type_id(mie.centry->catch_type));
+        put(index_of(mie.centry->next));
+        break;
+      case MFLOW_OPCODE:
+        write_insn(mie.insn);
+        break;
+      case MFLOW_DEX_OPCODE:
+        always_assert_log(false, "Unexpected DexInstruction in IRCode");
+        break;
+      case MFLOW_TARGET:
+        put(mie.target->type);
+        put(index_of(mie.target->src));
+        put(static_cast<uint32_t>(mie.target->case_key));
+        break;
+      case MFLOW_DEBUG:
+        write_debug(mie.dbgop.get());
+        break;
+      case MFLOW_POSITION:
+        write_position(mie.pos.get());
+        break;
+      case MFLOW_FALLTHROUGH:
+        not_reached();
+      }
+    }
+  }
+
+  void write_insn(IRInstruction* insn) {
+    put(insn->opcode());
+    if (insn->dests_size()) {
+      put(insn->dest());
+    }
+    put(insn->srcs_size());
+    for (const auto& src : insn->srcs()) {
+      put(src);
+    }
+    switch (opcode::ref(insn->opcode())) {
+    case opcode::Ref::None:
+      break;
+    case opcode::Ref::Literal:
+      put(static_cast<uint64_t>(insn->get_literal()));
+      break;
+    case opcode::Ref::String:
+      put(string_id(insn->get_string()));
+      break;
+    case opcode::Ref::Type:
+      put(type_id(insn->get_type()));
+      break;
+    case opcode::Ref::Field:
+      put(field_id(insn->get_field()));
+      break;
+    case opcode::Ref::Method:
+      put(method_id(insn->get_method()));
+      break;
+    case opcode::Ref::Data: {
+      auto data = insn->get_data();
+      put(data->opcode());
+      put(data->data_size());
+      for (size_t i = 0; i < data->data_size(); ++i) {
+        put(data->data()[i]);
+      }
+      break;
+    }
+    }
+  }
+
+  void write_debug(const DexDebugInstruction* dbgop) {
+    put(dbgop->opcode());
+    put(dbgop->uvalue());
+    switch (dbgop->opcode()) {
+    case DBG_START_LOCAL:
+    case DBG_START_LOCAL_EXTENDED: {
+      auto start_local = static_cast<const DexDebugOpcodeStartLocal*>(dbgop);
+      put(string_id(start_local->name()));
+      put(type_id(start_local->type()));
+      put(string_id(start_local->sig()));
+      break;
+    }
+    case DBG_SET_FILE:
+      put(string_id(static_cast<const DexDebugOpcodeSetFile*>(dbgop)->file()));
+      break;
+    default:
+      break;
+    }
+  }
+
+  void write_position(const DexPosition* pos) {
+    put(method_id(pos->method));
+    put(string_id(pos->file));
+    put(pos->line);
+    auto parent = pos->parent;
+    if (parent == nullptr) {
+      put(NO_PARENT);
+      return;
+    }
+    auto code_it = m_code_positions.find(parent);
+    if (code_it != m_code_positions.end()) {
+      put(CODE_PARENT);
+      put(code_it->second);
+      return;
+    }
+    auto ext_it = m_external_positions.find(parent);
+    if (ext_it != m_external_positions.end()) {
+      put(EXTERNAL_PARENT);
+      put(ext_it->second);
+      return;
+    }
+    put(NEW_EXTERNAL_PARENT);
+    auto id = m_external_positions.size();
+    m_external_positions.emplace(parent, id);
+    write_position(parent);
+  }
+
+  std::unordered_map<const DexString*, uint64_t> m_strings;
+  std::unordered_map<const DexType*, uint64_t> m_types;
+  std::unordered_map<const DexProto*, uint64_t> m_protos;
+  std::unordered_map<const DexFieldRef*, uint64_t> m_fields;
+  std::unordered_map<const DexMethodRef*, uint64_t> m_methods;
+  std::string m_string_table;
+  std::string m_type_table;
+  std::string m_proto_table;
+  std::string m_field_table;
+  std::string m_method_table;
+
+  std::unordered_map<const DexPosition*, uint64_t> m_code_positions;
+  std::unordered_map<const DexPosition*, uint64_t> m_external_positions;
+
+  std::string m_body;
+};
+
+// Positions that are referred to as parents but are not part of any code in
+// the snapshot. Like the positions of the code of deleted methods that they
+// stand for, they live until the end of the process.
+std::vector<std::unique_ptr<DexPosition>>& external_positions_pool() {
+  static std::vector<std::unique_ptr<DexPosition>> pool;
+  return pool;
+}
+
+class SnapshotReader {
+ public:
+  SnapshotReader(const char* begin, const char* end)
+      : m_cur(begin), m_end(end) {}
+
+  void read_header() {
+    always_assert_log(m_end - m_cur >= (ptrdiff_t)sizeof(MAGIC) &&
+                          std::equal(MAGIC, MAGIC + sizeof(MAGIC), m_cur),
+                      "Not a program snapshot");
+    m_cur += sizeof(MAGIC);
+    auto version = get();
+    always_assert_log(version == VERSION,
+                      "Unsupported program snapshot version %lu",
+                      (unsigned long)version);
+
+    m_strings.resize(get());
+    for (auto& s : m_strings) {
+      s = DexString::make_string(get_bytes());
+    }
+    m_types.resize(get());
+    for (auto& t : m_types) {
+      t = DexType::make_type(string(get()));
+    }
+    m_protos.resize(get());
+    for (auto& p : m_protos) {
+      auto rtype = type(get());
+      std::deque<DexType*> args(get());
+      for (auto& arg : args) {
+        arg = type(get());
+      }
+      p = DexProto::make_proto(rtype,
+                               DexTypeList::make_type_list(std::move(args)));
+    }
+    m_fields.resize(get());
+    for (auto& f : m_fields) {
+      auto cls = type(get());
+      auto name = string(get());
+      f = DexField::make_field(cls, name, type(get()));
+    }
+    m_methods.resize(get());
+    for (auto& m : m_methods) {
+      auto cls = type(get());
+      auto name = string(get());
+      m = DexMethod::make_method(cls, name, proto(get()));
+    }
+  }
+
+  std::string read_metadata() { return get_bytes(); }
+
+  DexStoresVector read_stores() {
+    DexStoresVector stores;
+    auto num_stores = get();
+    for (size_t i = 0; i < num_stores; ++i) {
+      DexMetadata metadata;
+      metadata.set_id(get_bytes());
+      auto num_deps = get();
+      for (size_t j = 0; j < num_deps; ++j) {
+        metadata.get_dependencies().push_back(get_bytes());
+      }
+      DexStore store(metadata);
+      auto num_dexen = get();
+      for (size_t j = 0; j < num_dexen; ++j) {
+        DexClasses classes(get());
+        for (auto& cls : classes) {
+          cls = read_class();
+        }
+        store.add_classes(std::move(classes));
+      }
+      stores.emplace_back(std::move(store));
+    }
+    always_assert_log(m_cur == m_end, "Trailing data in program snapshot");
+
+    for (const auto& fixup : m_parent_fixups) {
+      fixup.first->parent = m_code_positions.at(fixup.second);
+    }
+    invalidate_resolver_cache();
+    return stores;
+  }
+
+ private:
+  uint64_t get() {
+    uint64_t v = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+      always_assert_log(m_cur < m_end && shift < 64, "Truncated snapshot");
+      byte = static_cast<uint8_t>(*m_cur++);
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    return v;
+  }
+
+  std::string get_bytes() {
+    auto size = get();
+    always_assert_log(size <= (uint64_t)(m_end - m_cur), "Truncated snapshot");
+    std::string s(m_cur, size);
+    m_cur += size;
+    return s;
+  }
+
+  template <typename T>
+  static T* at(const std::vector<T*>& table, uint64_t id) {
+    if (id == 0) return nullptr;
+    always_assert_log(id <= table.size(), "Bad reference in snapshot");
+    return table[id - 1];
+  }
+
+  DexString* string(uint64_t id) { return at(m_strings, id); }
+  DexType* type(uint64_t id) { return at(m_types, id); }
+  DexProto* proto(uint64_t id) { return at(m_protos, id); }
+  DexFieldRef* field(uint64_t id) { return at(m_fields, id); }
+  DexMethodRef* method(uint64_t id) { return at(m_methods, id); }
+
+  void read_name(const std::function<void(const DexString*)>& set) {
+    auto name = string(get());
+    if (name != nullptr) set(name);
+  }
+
+  DexClass* read_class() {
+    auto self = type(get());
+    always_assert_log(type_class(self) == nullptr,
+                      "Class %s of the snapshot already exists", SHOW(self));
+    auto super = type(get());
+    std::deque<DexType*> intfs(get());
+    for (auto& intf : intfs) {
+      intf = type(get());
+    }
+    auto access = static_cast<DexAccessFlags>(get());
+    auto source_file = string(get());
+    auto deobfuscated_name = string(get());
+    ClassCreator cc(self, get_bytes());
+    cc.set_super(super);
+    cc.set_access(access);
+    for (const auto& intf : intfs) {
+      cc.add_interface(intf);
+    }
+    auto cls = cc.get_class();
+    cls->set_source_file(source_file);
+    if (deobfuscated_name != nullptr) {
+      cls->set_deobfuscated_name(deobfuscated_name);
+    }
+    cls->rstate.unpack(get());
+    cls->attach_annotation_set(read_annotation_set());
+
+    for (auto* fields : {&cls->get_sfields(), &cls->get_ifields()}) {
+      fields->resize(get());
+      for (auto& field : *fields) {
+        field = read_field();
+      }
+    }
+    for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      methods->resize(get());
+      for (auto& method : *methods) {
+        method = read_method();
+      }
+    }
+    return cc.create();
+  }
+
+  DexField* read_field() {
+    auto field = static_cast<DexField*>(this->field(get()));
+    auto access = static_cast<DexAccessFlags>(get());
+    read_name([&](const DexString* name) { field->set_deobfuscated_name(name); });
+    field->rstate.unpack(get());
+    auto aset = read_annotation_set();
+    if (aset != nullptr) {
+      field->attach_annotation_set(aset);
+    }
+    DexEncodedValue* value = get() ? read_value() : nullptr;
+    field->make_concrete(access, value);
+    return field;
+  }
+
+  DexMethod* read_method() {
+    auto method = static_cast<DexMethod*>(this->method(get()));
+    auto access = static_cast<DexAccessFlags>(get());
+    bool is_virtual = get();
+    read_name(
+        [&](const DexString* name) { method->set_deobfuscated_name(name); });
+    method->rstate.unpack(get());
+    auto aset = read_annotation_set();
+    if (aset != nullptr) {
+      method->attach_annotation_set(aset);
+    }
+    auto num_param_annos = get();
+    for (size_t i = 0; i < num_param_annos; ++i) {
+      auto paramno = static_cast<int>(get());
+      method->attach_param_annotation_set(paramno, read_annotation_set());
+    }
+    std::unique_ptr<IRCode> code;
+    if (get()) {
+      code = read_code();
+    }
+    method->make_concrete(access, std::move(code), is_virtual);
+    return method;
+  }
+
+  DexAnnotationSet* read_annotation_set() {
+    if (!get()) return nullptr;
+    auto aset = new DexAnnotationSet();
+    auto size = get();
+    for (size_t i = 0; i < size; ++i) {
+      auto anno_type = type(get());
+      auto viz = static_cast<DexAnnotationVisibility>(get());
+      auto anno = new DexAnnotation(anno_type, viz);
+      auto num_elems = get();
+      for (size_t j = 0; j < num_elems; ++j) {
+        auto key = string(get());
+        anno->add_element(key->c_str(), read_value());
+      }
+      aset->add_annotation(anno);
+    }
+    return aset;
+  }
+
+  static DexType* primitive_type(DexEncodedValueTypes evtype) {
+    switch (evtype) {
+    case DEVT_BYTE:
+      return get_byte_type();
+    case DEVT_SHORT:
+      return get_short_type();
+    case DEVT_CHAR:
+      return get_char_type();
+    case DEVT_INT:
+      return get_int_type();
+    case DEVT_LONG:
+      return get_long_type();
+    case DEVT_FLOAT:
+      return get_float_type();
+    case DEVT_DOUBLE:
+      return get_double_type();
+    default:
+      always_assert_log(false, "Bad encoded value type %d in snapshot", evtype);
+      not_reached();
+    }
+  }
+
+  DexEncodedValue* read_value() {
+    auto evtype = static_cast<DexEncodedValueTypes>(get());
+    switch (evtype) {
+    case DEVT_STRING:
+      return new DexEncodedValueString(string(get()));
+    case DEVT_TYPE:
+      return new DexEncodedValueType(type(get()));
+    case DEVT_FIELD:
+    case DEVT_ENUM:
+      return new DexEncodedValueField(evtype, field(get()));
+    case DEVT_METHOD:
+      return new DexEncodedValueMethod(method(get()));
+    case DEVT_ARRAY: {
+      bool static_val = get();
+      auto evalues = new std::deque<DexEncodedValue*>(get());
+      for (auto& item : *evalues) {
+        item = read_value();
+      }
+      return new DexEncodedValueArray(evalues, static_val);
+    }
+    case DEVT_ANNOTATION: {
+      auto anno_type = type(get());
+      auto elems = new EncodedAnnotations();
+      auto num_elems = get();
+      for (size_t i = 0; i < num_elems; ++i) {
+        auto key = string(get());
+        elems->emplace_back(key, read_value());
+      }
+      return new DexEncodedValueAnnotation(anno_type, elems);
+    }
+    case DEVT_NULL:
+    case DEVT_BOOLEAN:
+      return new DexEncodedValueBit(evtype, get());
+    default: {
+      auto ev = DexEncodedValue::zero_for_type(primitive_type(evtype));
+      ev->value(get());
+      return ev;
+    }
+    }
+  }
+
+  std::unique_ptr<IRCode> read_code() {
+    auto code = std::make_unique<IRCode>();
+    code->set_registers_size(get());
+    if (get()) {
+      auto dbg = std::make_unique<DexDebugItem>();
+      dbg->get_param_names().resize(get());
+      for (auto& name : dbg->get_param_names()) {
+        name = string(get());
+      }
+      code->set_debug_item(std::move(dbg));
+    }
+
+    // TRY entries need their catch entry when they are created, and CATCH
+    // and TARGET entries can refer to entries further down the list, so the
+    // references between entries are only resolved once all of them exist.
+    auto size = get();
+    std::vector<MethodItemEntry*> mies(size);
+    std::vector<std::pair<size_t, TryEntryType>> tries;
+    std::vector<uint64_t> refs(size);
+    for (size_t i = 0; i < size; ++i) {
+      auto mie_type = static_cast<MethodItemType>(get());
+      switch (mie_type) {
+      case MFLOW_TRY:
+        tries.emplace_back(i, static_cast<TryEntryType>(get()));
+        refs[i] = get();
+        break;
+      case MFLOW_CATCH:
+        mies[i] = new MethodItemEntry(type(get()));
+        refs[i] = get();
+        break;
+      case MFLOW_OPCODE:
+        mies[i] = new MethodItemEntry(read_insn());
+        break;
+      case MFLOW_TARGET: {
+        auto target = new BranchTarget();
+        target->type = static_cast<BranchTargetType>(get());
+        refs[i] = get();
+        target->case_key = static_cast<int32_t>(get());
+        mies[i] = new MethodItemEntry(target);
+        break;
+      }
+      case MFLOW_DEBUG:
+        mies[i] = new MethodItemEntry(read_debug());
+        break;
+      case MFLOW_POSITION: {
+        auto pos = read_position();
+        m_code_positions.push_back(pos.get());
+        mies[i] = new MethodItemEntry(std::move(pos));
+        break;
+      }
+      case MFLOW_FALLTHROUGH:
+        mies[i] = new MethodItemEntry();
+        break;
+      default:
+        always_assert_log(false, "Bad MethodItemEntry type %d in snapshot",
+                          mie_type);
+      }
+    }
+    auto entry = [&](uint64_t ref) -> MethodItemEntry* {
+      if (ref == 0) return nullptr;
+      always_assert_log(ref <= size, "Bad reference in snapshot");
+      return mies[ref - 1];
+    };
+    for (const auto& t : tries) {
+      mies[t.first] = new MethodItemEntry(t.second, entry(refs[t.first]));
+    }
+    for (size_t i = 0; i < size; ++i) {
+      auto mie = mies[i];
+      if (mie->type == MFLOW_CATCH) {
+        mie->centry->next = entry(refs[i]);
+      } else if (mie->type == MFLOW_TARGET) {
+        mie->target->src = entry(refs[i]);
+      }
+      code->push_back(*mie);
+    }
+    return code;
+  }
+
+  IRInstruction* read_insn() {
+    auto insn = new IRInstruction(static_cast<IROpcode>(get()));
+    if (insn->dests_size()) {
+      insn->set_dest(get());
+    }
+    insn->set_arg_word_count(get());
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      insn->set_src(i, get());
+    }
+    switch (opcode::ref(insn->opcode())) {
+    case opcode::Ref::None:
+      break;
+    case opcode::Ref::Literal:
+      insn->set_literal(static_cast<int64_t>(get()));
+      break;
+    case opcode::Ref::String:
+      insn->set_string(string(get()));
+      break;
+    case opcode::Ref::Type:
+      insn->set_type(type(get()));
+      break;
+    case opcode::Ref::Field:
+      insn->set_field(field(get()));
+      break;
+    case opcode::Ref::Method:
+      insn->set_method(method(get()));
+      break;
+    case opcode::Ref::Data: {
+      auto data_opcode = static_cast<uint16_t>(get());
+      std::vector<uint16_t> words(1 + get());
+      words[0] = data_opcode;
+      for (size_t i = 1; i < words.size(); ++i) {
+        words[i] = get();
+      }
+      insn->set_data(new DexOpcodeData(words.data(), words.size() - 1));
+      break;
+    }
+    }
+    return insn;
+  }
+
+  std::unique_ptr<DexDebugInstruction> read_debug() {
+    auto op = static_cast<DexDebugItemOpcode>(get());
+    auto uvalue = static_cast<uint32_t>(get());
+    switch (op) {
+    case DBG_START_LOCAL:
+    case DBG_START_LOCAL_EXTENDED: {
+      auto name = string(get());
+      auto local_type = type(get());
+      auto sig = string(get());
+      return std::make_unique<DexDebugOpcodeStartLocal>(
+          uvalue, name, local_type, sig);
+    }
+    case DBG_SET_FILE:
+      return std::make_unique<DexDebugOpcodeSetFile>(string(get()));
+    case DBG_ADVANCE_LINE:
+      return std::make_unique<DexDebugInstruction>(
+          op, static_cast<int32_t>(uvalue));
+    default:
+      return std::make_unique<DexDebugInstruction>(op, uvalue);
+    }
+  }
+
+  std::unique_ptr<DexPosition> read_position() {
+    auto pos_method = static_cast<DexMethod*>(method(get()));
+    auto file = string(get());
+    auto pos = std::make_unique<DexPosition>(get());
+    pos->bind(pos_method, file);
+    pos->parent = nullptr;
+    switch (get()) {
+    case NO_PARENT:
+      break;
+    case CODE_PARENT:
+      // The parent may belong to code that has not been read yet.
+      m_parent_fixups.emplace_back(pos.get(), get());
+      break;
+    case NEW_EXTERNAL_PARENT: {
+      // The writer numbers a parent before its own parents, so its id is
+      // taken before they are read.
+      auto id = m_external_positions.size();
+      m_external_positions.push_back(nullptr);
+      auto parent = read_position();
+      pos->parent = parent.get();
+      m_external_positions[id] = pos->parent;
+      external_positions_pool().push_back(std::move(parent));
+      break;
+    }
+    case EXTERNAL_PARENT: {
+      auto id = get();
+      always_assert_log(id < m_external_positions.size() &&
+                            m_external_positions[id] != nullptr,
+                        "Bad reference in snapshot");
+      pos->parent = m_external_positions[id];
+      break;
+    }
+    default:
+      always_assert_log(false, "Bad position parent in snapshot");
+    }
+    return pos;
+  }
+
+  const char* m_cur;
+  const char* m_end;
+
+  std::vector<DexString*> m_strings;
+  std::vector<DexType*> m_types;
+  std::vector<DexProto*> m_protos;
+  std::vector<DexFieldRef*> m_fields;
+  std::vector<DexMethodRef*> m_methods;
+
+  std::vector<DexPosition*> m_code_positions;
+  std::vector<DexPosition*> m_external_positions;
+  std::vector<std::pair<DexPosition*, uint64_t>> m_parent_fixups;
+};
+
+} // namespace
+
+void write_program_snapshot(const DexStoresVector& stores,
+                            const std::string& metadata,
+                            std::ostream& out) {
+  SnapshotWriter writer(stores);
+  write_bytes(writer.body(), metadata);
+  writer.write_stores(stores);
+  writer.finish(out);
+}
+
+DexStoresVector read_program_snapshot(std::istream& in,
+                                      std::string* metadata) {
+  std::string data((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  SnapshotReader reader(data.data(), data.data() + data.size());
+  reader.read_header();
+  auto stored_metadata = reader.read_metadata();
+  if (metadata != nullptr) {
+    *metadata = std::move(stored_metadata);
+  }
+  auto stores = reader.read_stores();
+  TRACE(MAIN, 1, "Read program snapshot of %lu bytes\n", data.size());
+  return stores;
+}
+
+namespace {
+
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+void fnv1a(uint64_t& hash, const char* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= FNV_PRIME;
+  }
+}
+
+void hash_file(uint64_t& hash, const std::string& file) {
+  std::vector<char> buf(1 << 16);
+  fnv1a(hash, file.c_str(), file.size() + 1);
+  std::ifstream in(file, std::ios::binary);
+  while (in) {
+    in.read(buf.data(), buf.size());
+    fnv1a(hash, buf.data(), in.gcount());
+  }
+}
+
+// Side inputs such as proguard maps and coldstart class lists are only named
+// in the config, so hash the contents of every file the config refers to.
+void hash_config_files(uint64_t& hash, const Json::Value& value) {
+  if (value.isString()) {
+    boost::system::error_code ec;
+    if (boost::filesystem::is_regular_file(value.asString(), ec)) {
+      hash_file(hash, value.asString());
+    }
+  } else if (value.isArray() || value.isObject()) {
+    for (const auto& item : value) {
+      hash_config_files(hash, item);
+    }
+  }
+}
+
+} // namespace
+
+std::string program_snapshot_key(const std::vector<std::string>& input_files,
+                                 const Json::Value& config,
+                                 const std::string& after_pass) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (const auto& file : input_files) {
+    hash_file(hash, file);
+  }
+
+  // Passes after the snapshot point do not affect the snapshot, and neither
+  // does the location of the snapshots.
+  Json::Value key_config = config;
+  key_config.removeMember("snapshot");
+  auto& passes = key_config["redex"]["passes"];
+  Json::Value truncated(Json::arrayValue);
+  std::unordered_map<std::string, size_t> counts;
+  bool found = false;
+  for (const auto& pass : passes) {
+    auto name = pass.asString();
+    truncated.append(pass);
+    auto numbered = name + "#" + std::to_string(++counts[name]);
+    if (name == after_pass || numbered == after_pass) {
+      found = true;
+      break;
+    }
+  }
+  always_assert_log(found, "Snapshot pass %s is not in the pass list",
+                    after_pass.c_str());
+  passes = truncated;
+  hash_config_files(hash, key_config);
+  auto config_str = Json::FastWriter().write(key_config);
+  fnv1a(hash, config_str.data(), config_str.size());
+
+  std::ostringstream key;
+  key << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return key.str();
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <iosfwd>
+#include <json/json.h>
+#include <string>
+#include <vector>
+
+#include "DexStore.h"
+
+/**
+ * A program snapshot is a binary image of the state of the program between
+ * two passes, from which redex-all can resume instead of loading the input
+ * dexes and rerunning the passes that produced it.
+ *
+ * It records the DexStores and their dex partitioning and, for every class
+ * and member in them, everything the passes can change: access flags,
+ * hierarchy, annotations, static values, IRCode, deobfuscated names and
+ * ReferencedState flags. The DexStrings, types, protos, field refs and
+ * method refs that they refer to are written once each in tables at the
+ * start of the snapshot and re-interned in the RedexContext when it is read
+ * back, so the rest of the snapshot refers to them by index.
+ *
+ * Classes outside of the stores (e.g. library classes loaded from jars) are
+ * not part of the snapshot and must be loaded separately.
+ */
+
+/**
+ * Write a snapshot of `stores` to `out`. `metadata` is an arbitrary string
+ * that is stored along with the program and handed back by
+ * read_program_snapshot.
+ */
+void write_program_snapshot(const DexStoresVector& stores,
+                            const std::string& metadata,
+                            std::ostream& out);
+
+/**
+ * Recreate the classes of a snapshot in g_redex, which must not already
+ * contain any of them, and return the stores they belong to.
+ */
+DexStoresVector read_program_snapshot(std::istream& in,
+                                      std::string* metadata = nullptr);
+
+/**
+ * Return a key identifying the program state right after running
+ * `after_pass` on the given input files with the given config: a hash of
+ * the contents of the files, of the config, in which the pass list is
+ * truncated after the first occurrence of `after_pass`, and of every file
+ * the config names. Passes can be named with or without their "#<n>" suffix.
+ */
+std::string program_snapshot_key(const std::vector<std::string>& input_files,
+                                 const Json::Value& config,
+                                 const std::string& after_pass);
@@ -7,20 +7,16 @@
 
 #include "ProguardMap.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <iterator>
+
 #include "DexUtil.h"
 #include "Timer.h"
 #include "WorkQueue.h"
 
 namespace {
 
-std::string find_or_same(
-    const std::string& key,
-    const std::unordered_map<std::string, std::string>& map) {
-  auto it = map.find(key);
-  if (it == map.end()) return key;
-  return it->second;
-}
-
 std::string convert_scalar_type(std::string type) {
   static const std::unordered_map<std::string, std::string> prim_map =
     {{"void",    "V"},
@@ -42,9 +38,10 @@ std::string convert_scalar_type(std::string type) {
 std::string convert_field(const std::string &cls,
     const std::string &type,
     const std::string &name) {
-  std::ostringstream ss;
-  ss << cls << "." << name << ":" << type;
-  return ss.str();
+  std::string res;
+  res.reserve(cls.size() + name.size() + type.size() + 2);
+  res.append(cls).append(".").append(name).append(":").append(type);
+  return res;
 }
 
 std::string convert_method(
@@ -53,9 +50,12 @@ std::string convert_method(
   const std::string &methodname,
   const std::string &args
 ) {
-  std::ostringstream ss;
-  ss << cls << "." << methodname << ":(" << args << ")" << rtype;
-  return ss.str();
+  std::string res;
+  res.reserve(cls.size() + methodname.size() + args.size() + rtype.size() +
+              4);
+  res.append(cls).append(".").append(methodname).append(":(");
+  res.append(args).append(")").append(rtype);
+  return res;
 }
 
 std::string translate_type(const std::string& type, const ProguardMap& pm) {
@@ -67,7 +67,7 @@ std::string translate_type(const std::string& type, const ProguardMap& pm) {
 }
 
 void whitespace(const char*& p) {
-  while (isspace(*p)) {
+  while (isspace(static_cast<unsigned char>(*p))) {
     ++p;
   }
 }
@@ -122,12 +122,61 @@ bool literal(const char*& p, char s) {
 ProguardMap::ProguardMap(const std::string& filename) {
   if (!filename.empty()) {
     Timer t("Parsing proguard map");
-    std::ifstream fp(filename);
-    always_assert_log(fp, "Can't open proguard map: %s\n", filename.c_str());
-    parse_proguard_map(fp);
+    // Mapping files can be hundreds of MB: read the lines straight out of
+    // the mapped file rather than copying it through a stream.
+    // Empty files and non-regular files such as /dev/null can't be mapped,
+    // so those are read instead.
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_regular_file(filename, ec) ||
+        boost::filesystem::file_size(filename, ec) == 0) {
+      std::ifstream in(filename, std::ios::binary);
+      always_assert_log(
+          in.good(), "Can't open proguard map: %s\n", filename.c_str());
+      std::string contents((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+      parse_proguard_map(contents.data(), contents.data() + contents.size());
+      return;
+    }
+    boost::iostreams::mapped_file_source file;
+    try {
+      file.open(filename);
+    } catch (const std::exception& e) {
+      always_assert_log(
+          false, "Can't open proguard map: %s\n", filename.c_str());
+    }
+    parse_proguard_map(file.data(), file.data() + file.size());
   }
 }
 
+ProguardMap::ProguardMap(std::istream& is) {
+  std::string contents{std::istreambuf_iterator<char>(is),
+                       std::istreambuf_iterator<char>()};
+  parse_proguard_map(contents.data(), contents.data() + contents.size());
+}
+
+const std::string* ProguardMap::intern(std::string name) {
+  return &*m_names.emplace(std::move(name)).first;
+}
+
+void ProguardMap::add_mapping(NameMap& map,
+                              NameMap& obf_map,
+                              std::string name,
+                              std::string new_name) {
+  auto name_ptr = intern(std::move(name));
+  auto new_name_ptr = intern(std::move(new_name));
+  map[name_ptr] = new_name_ptr;
+  obf_map[new_name_ptr] = name_ptr;
+}
+
+std::string ProguardMap::find_or_same(const std::string& key,
+                                      const NameMap& map) const {
+  auto name = m_names.find(key);
+  if (name == m_names.end()) return key;
+  auto it = map.find(&*name);
+  if (it == map.end()) return key;
+  return *it->second;
+}
+
 std::string ProguardMap::translate_class(const std::string& cls) const {
   return find_or_same(cls, m_classMap);
 }
@@ -152,28 +201,58 @@ std::string ProguardMap::deobfuscate_method(const std::string& method) const {
   return find_or_same(method, m_obfMethodMap);
 }
 
-void ProguardMap::parse_proguard_map(std::istream& fp) {
+void ProguardMap::parse_proguard_map(const char* begin, const char* end) {
+  // Lines are parsed one at a time out of a single reused buffer, so the
+  // parsers below see NUL-terminated lines without allocating per line.
   std::string line;
-  while (std::getline(fp, line)) {
-    parse_class(line);
-  }
-  fp.clear();
-  fp.seekg(0);
-  assert_log(!fp.fail(), "Can't use ProguardMap with non-seekable stream");
-  while (std::getline(fp, line)) {
+  auto for_each_line = [&](const std::function<void()>& parse_line) {
+    for (auto p = begin; p < end;) {
+      auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (eol == nullptr) eol = end;
+      line.assign(p, eol);
+      parse_line();
+      p = eol + 1;
+    }
+  };
+
+  // Members refer to classes that may be declared later in the file, so
+  // collect all the classes first. Only class lines start with an id.
+  for_each_line([&]() {
+    if (!line.empty() && !isspace(static_cast<unsigned char>(line[0]))) {
+      parse_class(line);
+    }
+  });
+  m_currClass = nullptr;
+  m_currNewClass = nullptr;
+  for_each_line([&]() {
     if (parse_class(line)) {
-      continue;
+      return;
     }
     if (parse_field(line)) {
-      continue;
+      return;
     }
     if (parse_method(line)) {
-      continue;
+      return;
     }
+    always_assert_log(
+        m_currClass != nullptr || line.empty() ||
+            !isspace(static_cast<unsigned char>(line[0])),
+        "Member line before any class in proguard map: %s\n",
+        line.c_str());
     always_assert_log(false,
                       "Bogus line encountered in proguard map: %s\n",
                       line.c_str());
+  });
+
+  size_t names_size = 0;
+  for (const auto& name : m_names) {
+    names_size += name.size();
   }
+  TRACE(PGR, 1,
+        "Proguard map: %lu classes, %lu fields, %lu methods, "
+        "%lu unique names (%lu bytes)\n",
+        m_classMap.size(), m_fieldMap.size(), m_methodMap.size(),
+        m_names.size(), names_size);
 }
 
 bool ProguardMap::parse_class(const std::string& line) {
@@ -183,14 +262,17 @@ bool ProguardMap::parse_class(const std::string& line) {
   if (!id(p, classname)) return false;
   if (!literal(p, " -> ")) return false;
   if (!id(p, newname)) return false;
-  m_currClass = convert_type(classname);
-  m_currNewClass = convert_type(newname);
-  m_classMap[m_currClass] = m_currNewClass;
-  m_obfClassMap[m_currNewClass] = m_currClass;
+  auto cls = intern(convert_type(classname));
+  auto new_cls = intern(convert_type(newname));
+  m_currClass = cls;
+  m_currNewClass = new_cls;
+  m_classMap[cls] = new_cls;
+  m_obfClassMap[new_cls] = cls;
   return true;
 }
 
 bool ProguardMap::parse_field(const std::string& line) {
+  if (m_currClass == nullptr) return false;
   std::string type;
   std::string fieldname;
   std::string newname;
@@ -205,14 +287,14 @@ bool ProguardMap::parse_field(const std::string& line) {
 
   auto ctype = convert_type(type);
   auto xtype = translate_type(ctype, *this);
-  auto pgnew = convert_field(m_currNewClass, xtype, newname);
-  auto pgold = convert_field(m_currClass, ctype, fieldname);
-  m_fieldMap[pgold] = pgnew;
-  m_obfFieldMap[pgnew] = pgold;
+  auto pgnew = convert_field(*m_currNewClass, xtype, newname);
+  auto pgold = convert_field(*m_currClass, ctype, fieldname);
+  add_mapping(m_fieldMap, m_obfFieldMap, std::move(pgold), std::move(pgnew));
   return true;
 }
 
 bool ProguardMap::parse_method(const std::string& line) {
+  if (m_currClass == nullptr) return false;
   std::string type;
   std::string methodname;
   std::string old_args;
@@ -253,17 +335,17 @@ bool ProguardMap::parse_method(const std::string& line) {
 
   auto old_rtype = convert_type(type);
   auto new_rtype = translate_type(old_rtype, *this);
-  auto pgold = convert_method(m_currClass, old_rtype, methodname, old_args);
-  auto pgnew = convert_method(m_currNewClass, new_rtype, newname, new_args);
-  m_methodMap[pgold] = pgnew;
-  m_obfMethodMap[pgnew] = pgold;
+  auto pgold = convert_method(*m_currClass, old_rtype, methodname, old_args);
+  auto pgnew = convert_method(*m_currNewClass, new_rtype, newname, new_args);
+  add_mapping(
+      m_methodMap, m_obfMethodMap, std::move(pgold), std::move(pgnew));
   return true;
 }
 
 void apply_deobfuscated_names(const std::vector<DexClasses>& dexen,
                               const ProguardMap& pm) {
   std::function<void(DexClass*)> worker_empty_pg_map = [&](DexClass* cls) {
-    cls->set_deobfuscated_name(show(cls));
+    cls->set_deobfuscated_name(cls->get_type()->get_name());
     for (const auto& m : cls->get_dmethods()) {
       m->set_deobfuscated_name(show(m));
     }
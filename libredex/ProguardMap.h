@@ -10,6 +10,7 @@
 #include <cstddef>
 #include <fstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 
 #include "DexClass.h"
@@ -45,9 +46,7 @@ struct ProguardMap {
   /**
    * Construct map from a given stream.
    */
-  explicit ProguardMap(std::istream& is) {
-    parse_proguard_map(is);
-  }
+  explicit ProguardMap(std::istream& is);
 
   /**
    * Translate un-obfuscated class name to obfuscated name.
@@ -83,25 +82,38 @@ struct ProguardMap {
                               m_methodMap.empty() ; }
 
  private:
-  void parse_proguard_map(std::istream& fp);
+  // Every class and member name in the map is stored once in m_names; the
+  // tables below map between those interned copies.
+  using NameMap = std::unordered_map<const std::string*, const std::string*>;
+
+  void parse_proguard_map(const char* begin, const char* end);
 
   bool parse_class(const std::string& line);
   bool parse_field(const std::string& line);
   bool parse_method(const std::string& line);
 
+  const std::string* intern(std::string name);
+  void add_mapping(NameMap& map,
+                   NameMap& obf_map,
+                   std::string name,
+                   std::string new_name);
+  std::string find_or_same(const std::string& key, const NameMap& map) const;
+
  private:
+  std::unordered_set<std::string> m_names;
+
   // Unobfuscated to obfuscated maps
-  std::unordered_map<std::string, std::string> m_classMap;
-  std::unordered_map<std::string, std::string> m_fieldMap;
-  std::unordered_map<std::string, std::string> m_methodMap;
+  NameMap m_classMap;
+  NameMap m_fieldMap;
+  NameMap m_methodMap;
 
   // Obfuscated to unobfuscated maps from proguard
-  std::unordered_map<std::string, std::string> m_obfClassMap;
-  std::unordered_map<std::string, std::string> m_obfFieldMap;
-  std::unordered_map<std::string, std::string> m_obfMethodMap;
+  NameMap m_obfClassMap;
+  NameMap m_obfFieldMap;
+  NameMap m_obfMethodMap;
 
-  std::string m_currClass;
-  std::string m_currNewClass;
+  const std::string* m_currClass{nullptr};
+  const std::string* m_currNewClass{nullptr};
 };
 
 /**
@@ -8,6 +8,9 @@
 #include "ProguardReporting.h"
 #include "DexClass.h"
 #include "ReachableClasses.h"
+#include "WorkQueue.h"
+
+#include <algorithm>
 
 std::string extract_suffix(std::string class_name) {
   auto i = class_name.find_last_of(".");
@@ -96,8 +99,8 @@ std::string deobfuscate_type_descriptor(const ProguardMap& pg_map,
       auto class_type = desc.substr(i, colon + 1);
       auto deob_class = pg_map.deobfuscate_class(class_type);
       if (deob_class.empty()) {
-        std::cerr << "Warning: failed to deobfuscate class " << class_type
-                  << std::endl;
+        redex::print_warning("Warning: failed to deobfuscate class " +
+                             class_type);
         deob_class = class_type;
       }
       deob += deob_class;
@@ -133,7 +136,7 @@ std::string java_args(const ProguardMap& pg_map, const std::deque<DexType*>& arg
   return str;
 }
 
-void redex::print_method(std::ostream& output,
+void redex::print_method(std::string& output,
                          const ProguardMap& pg_map,
                          const std::string& class_name,
                          const DexMethod* method) {
@@ -147,8 +150,7 @@ void redex::print_method(std::ostream& output,
   } else {
     auto deob = method->get_deobfuscated_name();
     if (deob.empty()) {
-      std::cerr << "WARNING: method has no deobfu: " << method_name
-                << std::endl;
+      redex::print_warning("WARNING: method has no deobfu: " + method_name);
     } else {
       method_name = extract_member_name(deob);
     }
@@ -156,18 +158,22 @@ void redex::print_method(std::ostream& output,
   auto proto = method->get_proto();
   auto args = proto->get_args()->get_type_list();
   auto return_type = proto->get_rtype();
-  output << class_name << ": ";
+  output += class_name;
+  output += ": ";
   if (!is_constructor) {
     auto return_type_desc = return_type->get_name()->c_str();
     auto deobfu_return_type =
         deobfuscate_type_descriptor(pg_map, return_type_desc);
-    output << type_descriptor_to_java(deobfu_return_type) << " ";
+    output += type_descriptor_to_java(deobfu_return_type);
+    output += " ";
   }
-  output << method_name << java_args(pg_map, args) << std::endl;
+  output += method_name;
+  output += java_args(pg_map, args);
+  output += "\n";
 }
 
 template <class Container>
-void redex::print_methods(std::ostream& output,
+void redex::print_methods(std::string& output,
                           const ProguardMap& pg_map,
                           const std::string& class_name,
                           const Container& methods) {
@@ -176,7 +182,7 @@ void redex::print_methods(std::ostream& output,
   }
 }
 
-void redex::print_field(std::ostream& output,
+void redex::print_field(std::string& output,
                         const ProguardMap& pg_map,
                         const std::string& class_name,
                         const DexField* field) {
@@ -184,13 +190,16 @@ void redex::print_field(std::ostream& output,
   auto field_type = field->get_type()->get_name()->c_str();
   std::string deobfu_field_type =
       deobfuscate_type_descriptor(pg_map, field_type);
-  output << class_name << ": " << type_descriptor_to_java(deobfu_field_type)
-         << " " << extract_member_name(field->get_deobfuscated_name())
-         << std::endl;
+  output += class_name;
+  output += ": ";
+  output += type_descriptor_to_java(deobfu_field_type);
+  output += " ";
+  output += extract_member_name(field_name);
+  output += "\n";
 }
 
 template <class Container>
-void redex::print_fields(std::ostream& output,
+void redex::print_fields(std::string& output,
                          const ProguardMap& pg_map,
                          const std::string& class_name,
                          const Container& fields) {
@@ -199,17 +208,19 @@ void redex::print_fields(std::ostream& output,
   }
 }
 
-void redex::print_class(std::ostream& output,
+void redex::print_class(std::string& output,
                         const ProguardMap& pg_map,
                         const DexClass* cls) {
   auto deob = cls->get_deobfuscated_name();
   if (deob.empty()) {
-    std::cerr << "WARNING: this class has no deobu name: "
-              << cls->get_name()->c_str() << std::endl;
+    redex::print_warning(
+        std::string("WARNING: this class has no deobu name: ") +
+        cls->get_name()->c_str());
     deob = cls->get_name()->c_str();
   }
   std::string name = redex::dexdump_name_to_dot_name(deob);
-  output << name << std::endl;
+  output += name;
+  output += "\n";
   print_fields(output, pg_map, name, cls->get_ifields());
   print_fields(output, pg_map, name, cls->get_sfields());
   print_methods(output, pg_map, name, cls->get_dmethods());
@@ -219,9 +230,47 @@ void redex::print_class(std::ostream& output,
 void redex::print_classes(std::ostream& output,
                           const ProguardMap& pg_map,
                           const Scope& classes) {
-  for (const auto& cls : classes) {
-    if (!cls->is_external()) {
-      redex::print_class(output, pg_map, cls);
-    }
+  print_in_parallel(
+      output, classes, [&](const DexClass* cls, std::string& out) {
+        if (!cls->is_external()) {
+          redex::print_class(out, pg_map, cls);
+        }
+      });
+}
+
+namespace {
+
+// The warnings of the chunk that print_in_parallel is formatting on this
+// thread, if any.
+thread_local std::string* t_chunk_warnings = nullptr;
+
+} // namespace
+
+void redex::print_warning(const std::string& message) {
+  if (t_chunk_warnings == nullptr) {
+    std::cerr << message << std::endl;
+    return;
+  }
+  *t_chunk_warnings += message;
+  *t_chunk_warnings += '\n';
+}
+
+void redex::print_in_parallel(
+    std::ostream& output,
+    const Scope& classes,
+    const std::function<void(const DexClass*, std::string&)>& format) {
+  struct Chunk {
+    std::string output;
+    std::string warnings;
+  };
+  auto chunks = workqueue_chunks<Chunk>(
+      classes.size(), [&](size_t i, Chunk& chunk) {
+        t_chunk_warnings = &chunk.warnings;
+        format(classes[i], chunk.output);
+        t_chunk_warnings = nullptr;
+      });
+  for (const auto& chunk : chunks) {
+    std::cerr << chunk.warnings;
+    output.write(chunk.output.data(), chunk.output.size());
   }
 }
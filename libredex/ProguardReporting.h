@@ -10,6 +10,7 @@
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "ProguardMap.h"
+#include <functional>
 #include <iostream>
 
 namespace redex {
@@ -17,32 +18,44 @@ namespace redex {
 std::string dexdump_name_to_dot_name(const std::string& dexdump_name);
 
 template <class Container>
-void print_methods(std::ostream& output,
-                          const ProguardMap& pg_map,
-                          const std::string& class_name,
-                          const Container& methods);
+void print_methods(std::string& output,
+                   const ProguardMap& pg_map,
+                   const std::string& class_name,
+                   const Container& methods);
 
-void print_method(std::ostream& output,
+void print_method(std::string& output,
                   const ProguardMap& pg_map,
                   const std::string& class_name,
                   const DexMethod* methods);
 
 template <class Container>
-void print_fields(std::ostream& output,
-                         const ProguardMap& pg_map,
-                         const std::string& class_name,
-                         const Container& fields);
+void print_fields(std::string& output,
+                  const ProguardMap& pg_map,
+                  const std::string& class_name,
+                  const Container& fields);
 
-void print_field(std::ostream& output,
+void print_field(std::string& output,
                  const ProguardMap& pg_map,
                  const std::string& class_name,
                  const DexField* field);
 
-void print_class(std::ostream& output,
+void print_class(std::string& output,
                  const ProguardMap& pg_map,
                  const DexClass* cls);
 
 void print_classes(std::ostream& output,
                    const ProguardMap& pg_map,
                    const Scope& classes);
+
+// Prints a warning line to std::cerr, or, while print_in_parallel runs on
+// this thread, along with the output of the current class.
+void print_warning(const std::string& message);
+
+// Runs format on the classes in parallel and writes what it appended for each
+// class to output, in scope order. The warnings format prints with
+// print_warning go to std::cerr in scope order too.
+void print_in_parallel(
+    std::ostream& output,
+    const Scope& classes,
+    const std::function<void(const DexClass*, std::string&)>& format);
 }
@@ -13,10 +13,14 @@
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "Resolver.h"
+#include "VirtualScope.h"
 
 RedexContext* g_redex;
 
-RedexContext::RedexContext() {}
+RedexContext::RedexContext()
+    : m_resolver_cache(new ResolverCache()),
+      m_signature_map_cache(new SignatureMapCache()) {}
 
 RedexContext::~RedexContext() {
   // Delete DexStrings.
@@ -159,12 +163,14 @@ DexFieldRef* RedexContext::get_field(const DexType* container,
 
 void RedexContext::erase_field(DexFieldRef* field) {
   std::lock_guard<std::mutex> lock(s_field_lock);
+  m_resolver_cache->invalidate();
   s_field_map.erase(field->m_spec);
 }
 
 void RedexContext::mutate_field(
     DexFieldRef* field, const DexFieldSpec& ref, bool rename_on_collision) {
   std::lock_guard<std::mutex> lock(s_field_lock);
+  m_resolver_cache->invalidate();
   DexFieldSpec& r = field->m_spec;
   s_field_map.erase(r);
   r.cls = ref.cls != nullptr ? ref.cls : field->m_spec.cls;
@@ -269,6 +275,7 @@ DexMethodRef* RedexContext::get_method(DexType* type,
 
 void RedexContext::erase_method(DexMethodRef* method) {
   std::lock_guard<std::mutex> lock(s_method_lock);
+  m_resolver_cache->invalidate();
   s_method_map.erase(method->m_spec);
 }
 
@@ -276,6 +283,7 @@ void RedexContext::mutate_method(DexMethodRef* method,
                                  const DexMethodSpec& ref,
                                  bool rename_on_collision /* = false */) {
   std::lock_guard<std::mutex> lock(s_method_lock);
+  m_resolver_cache->invalidate();
   DexMethodSpec& r = method->m_spec;
   s_method_map.erase(r);
 
@@ -323,6 +331,7 @@ void RedexContext::publish_class(DexClass* cls) {
     }
   }
   m_type_to_class.emplace(type, cls);
+  m_resolver_cache->invalidate();
 }
 
 DexClass* RedexContext::type_class(const DexType* t) {
@@ -13,6 +13,7 @@
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <unordered_map>
@@ -32,6 +33,8 @@ struct DexFieldSpec;
 struct DexDebugEntry;
 struct DexPosition;
 struct RedexContext;
+class ResolverCache;
+struct SignatureMapCache;
 
 extern RedexContext* g_redex;
 
@@ -89,6 +92,17 @@ struct RedexContext {
     }
   }
 
+  /*
+   * Memoized method and field resolution shared by all passes. See
+   * Resolver.h.
+   */
+  ResolverCache& resolver_cache() { return *m_resolver_cache; }
+
+  /*
+   * The SignatureMap shared by consecutive passes. See VirtualScope.h.
+   */
+  SignatureMapCache& signature_map_cache() { return *m_signature_map_cache; }
+
   /*
    * This returns true if we want to enable features that will only go out
    * in the next quarterly release.
@@ -136,6 +150,9 @@ struct RedexContext {
 
   const std::vector<const DexType*> m_empty_types;
 
+  std::unique_ptr<ResolverCache> m_resolver_cache;
+  std::unique_ptr<SignatureMapCache> m_signature_map_cache;
+
   bool m_next_release_gate{false};
 };
 
@@ -11,6 +11,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "androidfw/ResourceTypes.h"
 
@@ -40,6 +41,15 @@ std::unordered_set<std::string> get_manifest_classes(
     const std::string& filename);
 std::unordered_set<std::string> get_native_classes(
     const std::string& apk_directory);
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const std::string& lib_contents);
+// extract_classes_from_native_lib classifies the bytes with AVX2 or SSE4.2
+// when the CPU has them. These list the instruction sets it can use, best
+// last, and scan with one of them, or "" for the scalar loop, e.g. to compare
+// their results.
+std::vector<std::string> native_lib_scan_simd_supported();
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const std::string& lib_contents, const std::string& isa);
 std::unordered_set<std::string> get_layout_classes(
     const std::string& apk_directory);
 std::unordered_set<std::string> get_xml_files(
@@ -50,12 +60,22 @@ std::unordered_set<uint32_t> get_xml_reference_attributes(
 // for resource remapping, class name extraction, etc. These files don't follow
 // binary XML format, and thus are out of scope for many optimizations.
 bool is_raw_resource(const std::string& filename);
+// These patch the attribute values and resource ids of the compiled XML
+// files in place, without copying or re-serializing them. A malformed file is
+// left as it is and throws std::runtime_error. The overloads for many files
+// process them in parallel, and only throw once the other files are patched.
 int inline_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, android::Res_value>& id_to_inline_value);
+int inline_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value);
 void remap_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
+void remap_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
 
 // Iterates through all layouts in the given directory. Adds all class names to
 // the output set, and allows for any specified attribute values to be returned
@@ -103,7 +123,8 @@ int rename_classes_in_layout(
 
 /**
  * Follows the reference links for a resource for all configurations.
- * Returns all the nodes visited, as well as all the string values seen.
+ * Returns all the nodes visited, as well as all the string values seen,
+ * each looked up in the package of the resource that holds it.
  */
 void walk_references_for_resource(
    uint32_t resID,
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <string>
 
 class ReferencedState {
@@ -145,4 +146,46 @@ class ReferencedState {
 
   bool has_mix_mode() const { return m_mix_mode; }
   void set_mix_mode() { m_mix_mode = true; }
+
+  // All of the above as a single word, for writing to a ProgramSnapshot.
+  uint64_t pack() const {
+    const bool flags[] = {m_bytype,
+                          m_bystring,
+                          m_byresources,
+                          m_mix_mode,
+                          m_keep,
+                          m_assumenosideeffects,
+                          m_blanket_keepnames,
+                          m_whyareyoukeeping,
+                          m_set_allowshrinking,
+                          m_unset_allowshrinking,
+                          m_set_allowobfuscation,
+                          m_unset_allowobfuscation,
+                          m_keep_name};
+    uint64_t bits = static_cast<uint64_t>(m_keep_count.load()) << 32;
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+      bits |= static_cast<uint64_t>(flags[i]) << i;
+    }
+    return bits;
+  }
+
+  void unpack(uint64_t bits) {
+    bool* flags[] = {&m_bytype,
+                     &m_bystring,
+                     &m_byresources,
+                     &m_mix_mode,
+                     &m_keep,
+                     &m_assumenosideeffects,
+                     &m_blanket_keepnames,
+                     &m_whyareyoukeeping,
+                     &m_set_allowshrinking,
+                     &m_unset_allowshrinking,
+                     &m_set_allowobfuscation,
+                     &m_unset_allowobfuscation,
+                     &m_keep_name};
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+      *flags[i] = (bits >> i) & 1;
+    }
+    m_keep_count = static_cast<unsigned int>(bits >> 32);
+  }
 };
@@ -97,6 +97,82 @@ DexMethod* resolve_method_ref(
   return nullptr;
 }
 
+DexMethod* resolve_method(DexMethodRef* method, MethodSearch search) {
+  if (method->is_def()) return static_cast<DexMethod*>(method);
+  return g_redex->resolver_cache().resolve_method(method, search);
+}
+
+DexField* resolve_field(DexFieldRef* field, FieldSearch search) {
+  if (field->is_def()) {
+    return static_cast<DexField*>(field);
+  }
+  return g_redex->resolver_cache().resolve_field(field, search);
+}
+
+std::atomic<uint64_t> ResolverCache::s_last_generation{0};
+
+ResolverCache::Counters& ResolverCache::counters() {
+  // Threads take the stripes in turn, so those of a work queue don't share.
+  static std::atomic<size_t> s_next_stripe{0};
+  thread_local size_t t_stripe = s_next_stripe++ % kCounterStripes;
+  return m_counters[t_stripe];
+}
+
+ResolverCache::Stats ResolverCache::get_stats() const {
+  Stats stats;
+  for (const auto& counters : m_counters) {
+    stats.hits += counters.hits.load(std::memory_order_relaxed);
+    stats.misses += counters.misses.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+template <typename Ref, typename Def, typename Search, typename Resolver>
+Def* ResolverCache::lookup(
+    ConcurrentMap<Key<Ref, Search>, Entry<Def>, 31, KeyHash<Ref, Search>>& map,
+    Ref* ref,
+    Search search,
+    const Resolver& resolver) {
+  auto key = std::make_pair(ref, search);
+  // Read the generation before resolving, so that an invalidation racing with
+  // the resolution below leaves a stale entry rather than a wrong one.
+  uint64_t generation = m_generation.load();
+  auto entry = map.get(key, Entry<Def>{nullptr, 0});
+  auto& stripe = counters();
+  if (entry.generation == generation) {
+    stripe.hits.fetch_add(1, std::memory_order_relaxed);
+    return entry.def;
+  }
+  stripe.misses.fetch_add(1, std::memory_order_relaxed);
+  Def* def = resolver();
+  map.insert_or_assign(std::make_pair(key, Entry<Def>{def, generation}));
+  return def;
+}
+
+DexMethod* ResolverCache::resolve_method(DexMethodRef* method,
+                                         MethodSearch search) {
+  return lookup(m_methods, method, search, [&]() -> DexMethod* {
+    auto cls = type_class(method->get_class());
+    if (cls == nullptr) return nullptr;
+    return resolve_method_ref(
+        cls, method->get_name(), method->get_proto(), search);
+  });
+}
+
+DexField* ResolverCache::resolve_field(DexFieldRef* field,
+                                       FieldSearch search) {
+  return lookup(m_fields, field, search, [&]() {
+    return ::resolve_field(
+        field->get_class(), field->get_name(), field->get_type(), search);
+  });
+}
+
+void ResolverCache::clear() {
+  m_methods.clear();
+  m_fields.clear();
+  invalidate();
+}
+
 DexField* resolve_field(
     const DexType* owner,
     const DexString* name,
@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRInstruction.h"
+#include "RedexContext.h"
 
+#include <atomic>
+#include <boost/functional/hash.hpp>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -121,13 +125,9 @@ DexMethod* resolve_method_ref(
  * Resolve a method to its definition.
  * If the method is already a definition return itself.
  * If the type the method belongs to is unknown return nullptr.
+ * Results are memoized in the global ResolverCache.
  */
-inline DexMethod* resolve_method(DexMethodRef* method, MethodSearch search) {
-  if (method->is_def()) return static_cast<DexMethod*>(method);
-  auto cls = type_class(method->get_class());
-  if (cls == nullptr) return nullptr;
-  return resolve_method_ref(cls, method->get_name(), method->get_proto(), search);
-}
+DexMethod* resolve_method(DexMethodRef* method, MethodSearch search);
 
 /**
  * Resolve a method and cache the mapping.
@@ -192,11 +192,111 @@ DexField* resolve_field(
  * If the field is a definition already the field is returned otherwise a
  * lookup in the class hierarchy is performed looking for the definition.
  */
-inline DexField* resolve_field(
-    DexFieldRef* field, FieldSearch search = FieldSearch::Any) {
-  if (field->is_def()) {
-    return static_cast<DexField*>(field);
+DexField* resolve_field(DexFieldRef* field,
+                        FieldSearch search = FieldSearch::Any);
+
+/**
+ * Program-wide memoization of resolve_method(DexMethodRef*, MethodSearch) and
+ * resolve_field(DexFieldRef*, FieldSearch), keyed by (ref, search).
+ *
+ * The cache lives in the RedexContext and is shared by all passes. Rather than
+ * erasing entries, invalidate() bumps a generation counter, and entries
+ * recorded under an older generation are treated as misses. The hierarchy
+ * mutators (DexClass::add_method, remove_method, add_field, remove_field,
+ * set_super_class, set_interfaces, the set_access of classes and members,
+ * DexMethod::become_virtual and set_virtual, class publication and ref
+ * renaming/erasure in RedexContext) invalidate it, and
+ * PassManager invalidates it before and after every pass, so edits made to
+ * the member vectors returned by get_vmethods() and friends never outlive the
+ * pass that made them. Within a pass, such edits must still be followed by
+ * invalidate_resolver_cache() before resolving again.
+ *
+ * All operations are thread-safe.
+ */
+class ResolverCache {
+ public:
+  DexMethod* resolve_method(DexMethodRef* method, MethodSearch search);
+  DexField* resolve_field(DexFieldRef* field, FieldSearch search);
+
+  void invalidate() { m_generation = ++s_last_generation; }
+
+  /**
+   * The current generation. Generations are drawn from a process-wide
+   * counter and never repeat, even across RedexContexts, so other
+   * program-wide caches can key on it to detect hierarchy changes.
+   */
+  uint64_t generation() const { return m_generation.load(); }
+
+  // Drops all entries, reclaiming memory. Not thread-safe.
+  void clear();
+
+  struct Stats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+  };
+  Stats get_stats() const;
+
+ private:
+  template <typename Ref, typename Search>
+  using Key = std::pair<Ref*, Search>;
+
+  template <typename Ref, typename Search>
+  struct KeyHash {
+    size_t operator()(const Key<Ref, Search>& key) const {
+      // Mixed, not multiplied: the map picks its slot modulo a prime.
+      size_t seed = 0;
+      boost::hash_combine(seed, key.first);
+      boost::hash_combine(seed, static_cast<size_t>(key.second));
+      return seed;
+    }
+  };
+
+  template <typename Def>
+  struct Entry {
+    Def* def;
+    uint64_t generation;
+  };
+
+  template <typename Ref, typename Def, typename Search, typename Resolver>
+  Def* lookup(ConcurrentMap<Key<Ref, Search>,
+                            Entry<Def>,
+                            31,
+                            KeyHash<Ref, Search>>& map,
+              Ref* ref,
+              Search search,
+              const Resolver& resolver);
+
+  ConcurrentMap<Key<DexMethodRef, MethodSearch>,
+                Entry<DexMethod>,
+                31,
+                KeyHash<DexMethodRef, MethodSearch>>
+      m_methods;
+  ConcurrentMap<Key<DexFieldRef, FieldSearch>,
+                Entry<DexField>,
+                31,
+                KeyHash<DexFieldRef, FieldSearch>>
+      m_fields;
+  static std::atomic<uint64_t> s_last_generation;
+  // Never 0, so that value-initialized entries are never current.
+  std::atomic<uint64_t> m_generation{++s_last_generation};
+  // Hits and misses are counted in stripes, each thread on its own, padded
+  // to a cache line, so that counting doesn't contend between lookups.
+  struct Counters {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    char padding[64 - 2 * sizeof(std::atomic<uint64_t>)];
+  };
+  static constexpr size_t kCounterStripes = 16;
+  Counters& counters();
+  Counters m_counters[kCounterStripes];
+};
+
+/**
+ * Invalidate the global ResolverCache after mutating the class hierarchy
+ * or the members of a class behind the back of the DexClass API.
+ */
+inline void invalidate_resolver_cache() {
+  if (g_redex != nullptr) {
+    g_redex->resolver_cache().invalidate();
   }
-  return resolve_field(
-      field->get_class(), field->get_name(), field->get_type(), search);
 }
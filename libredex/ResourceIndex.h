@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "androidfw/ResourceTypes.h"
+
+/**
+ * An index over the resources of a ResTable, built in one pass over the table
+ * so that queries don't have to walk its packages, types and configs again.
+ * For every resource id it holds, in flat arrays:
+ *
+ * - its type and entry name;
+ * - its values across all configs, as ResTable::getAllValuesForResource
+ *   returns them (so including the virtual parent and key values of bags);
+ * - the ids it references through reference and attribute values, and the
+ *   resources that reference it.
+ *
+ * Reachability over resources is then a traversal of that graph. The index
+ * doesn't follow later changes to the table, so it has to be rebuilt after
+ * resources are deleted, remapped or inlined.
+ */
+class ResourceIndex {
+ public:
+  template <typename T>
+  class Range {
+   public:
+    Range(const T* begin, const T* end) : m_begin(begin), m_end(end) {}
+    const T* begin() const { return m_begin; }
+    const T* end() const { return m_end; }
+    size_t size() const { return m_end - m_begin; }
+    bool empty() const { return m_begin == m_end; }
+
+   private:
+    const T* m_begin;
+    const T* m_end;
+  };
+
+  explicit ResourceIndex(const android::ResTable& table);
+
+  // All the resource ids in the table, sorted.
+  const std::vector<uint32_t>& ids() const { return m_ids; }
+  bool contains(uint32_t id) const { return index_of(id) != kNotFound; }
+
+  // The type (e.g. "drawable") and entry name of a resource, or "" if the id
+  // isn't in the table.
+  const std::string& type(uint32_t id) const;
+  const std::string& name(uint32_t id) const;
+
+  // The ids of the resources with each entry name, across types.
+  std::map<std::string, std::vector<uint32_t>> name_to_ids() const;
+
+  // The values of a resource across all configs.
+  Range<android::Res_value> values(uint32_t id) const;
+
+  // The distinct ids that a resource references, sorted. These can be
+  // outside of the table, e.g. framework resources.
+  Range<uint32_t> references(uint32_t id) const;
+
+  // The resources in the table that reference a resource, sorted.
+  Range<uint32_t> referenced_by(uint32_t id) const;
+
+  // Same as walk_references_for_resource: adds the resources reachable from
+  // resID, including itself, to nodes_visited, and the string values of all
+  // of them, looked up in their own package, to leaf_string_values.
+  // Resources that are already in nodes_visited are not walked again.
+  void walk_references(uint32_t resID,
+                       std::unordered_set<uint32_t>& nodes_visited,
+                       std::unordered_set<std::string>& leaf_string_values) const;
+
+  // All the resources reachable from the roots, including the roots.
+  std::unordered_set<uint32_t> reachable_from(
+      const std::vector<uint32_t>& roots) const;
+
+ private:
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+  size_t index_of(uint32_t id) const;
+  Range<uint32_t> references_at(size_t index) const;
+
+  const android::ResTable& m_table;
+  std::vector<uint32_t> m_ids;
+  std::vector<ssize_t> m_package_indices;
+  std::vector<uint16_t> m_type_indices;
+  std::vector<std::string> m_type_names;
+  std::vector<std::string> m_names;
+
+  // For the resource at index i, its values are
+  // m_values[m_value_offsets[i], m_value_offsets[i + 1]), and likewise for
+  // its references and the resources referencing it.
+  std::vector<uint32_t> m_value_offsets;
+  std::vector<android::Res_value> m_values;
+  std::vector<uint32_t> m_reference_offsets;
+  std::vector<uint32_t> m_references;
+  std::vector<uint32_t> m_referenced_by_offsets;
+  std::vector<uint32_t> m_referenced_by;
+};
@@ -73,6 +73,7 @@
   TM(REG)                \
   TM(RELO)               \
   TM(RENAME)             \
+  TM(RES)                \
   TM(RME)                \
   TM(RMGOTO)             \
   TM(RMU)                \
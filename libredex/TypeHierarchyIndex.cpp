@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TypeHierarchyIndex.h"
+
+#include <algorithm>
+
+#include "DexUtil.h"
+
+void TypeHierarchyIndex::rebuild(const ClassHierarchy& hierarchy,
+                                 const InterfaceMap& interfaces) {
+  m_ranges.clear();
+  m_ranges.reserve(hierarchy.size());
+  m_next = 0;
+
+  // The roots are the types without a DexClass (unknown parents) and
+  // java.lang.Object, as in TypeSystem.
+  for (const auto& children_it : hierarchy) {
+    const auto parent = children_it.first;
+    if (type_class(parent) != nullptr) continue;
+    number(hierarchy, parent);
+  }
+  if (m_ranges.count(get_object_type()) == 0) {
+    number(hierarchy, get_object_type());
+  }
+
+  m_implementors.clear();
+  m_implementors.reserve(interfaces.size());
+  for (const auto& intf_it : interfaces) {
+    refresh_implementors(intf_it.first, intf_it.second);
+  }
+}
+
+void TypeHierarchyIndex::number(const ClassHierarchy& hierarchy,
+                                const DexType* type) {
+  auto begin = m_next++;
+  const auto& children = hierarchy.find(type);
+  if (children != hierarchy.end()) {
+    for (const auto& child : children->second) {
+      number(hierarchy, child);
+    }
+  }
+  m_ranges[type] = Range{begin, m_next};
+}
+
+void TypeHierarchyIndex::refresh_implementors(const DexType* intf,
+                                              const TypeSet& implementors) {
+  std::vector<uint32_t> numbers;
+  numbers.reserve(implementors.size());
+  for (const auto& cls : implementors) {
+    const auto& range = m_ranges.find(cls);
+    if (range == m_ranges.end()) continue;
+    numbers.push_back(range->second.begin);
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  // Coalesce consecutive numbers into ranges. Implementors are closed under
+  // subclassing so every implementing subtree collapses into a single range.
+  auto& ranges = m_implementors[intf];
+  ranges.clear();
+  for (const auto n : numbers) {
+    if (!ranges.empty() && ranges.back().end == n) {
+      ranges.back().end = n + 1;
+    } else {
+      ranges.push_back(Range{n, n + 1});
+    }
+  }
+  ranges.shrink_to_fit();
+}
+
+bool TypeHierarchyIndex::implements(const DexType* cls,
+                                    const DexType* intf) const {
+  const auto& ranges_it = m_implementors.find(intf);
+  if (ranges_it == m_implementors.end()) return false;
+  const auto& cls_it = m_ranges.find(cls);
+  if (cls_it == m_ranges.end()) return false;
+  const auto n = cls_it->second.begin;
+  const auto& ranges = ranges_it->second;
+  // Find the last range starting at or before n.
+  auto it = std::upper_bound(
+      ranges.begin(), ranges.end(), n, [](uint32_t n, const Range& range) {
+        return n < range.begin;
+      });
+  if (it == ranges.begin()) return false;
+  return (--it)->contains(n);
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A flat encoding of a ClassHierarchy and its InterfaceMap that answers
+ * subtype and implements queries in constant (resp. logarithmic) time,
+ * without walking TypeSets.
+ *
+ * Every class reachable from a hierarchy root is numbered in DFS pre-order,
+ * and records the half-open range [begin, end) covering its own number and
+ * those of all its descendants. `child` is then a subtype of `parent` iff
+ * the number of `child` falls within the range of `parent`.
+ *
+ * Because the implementors of an interface are closed under subclassing,
+ * the set of implementors of each interface is stored as a short sorted list
+ * of disjoint ranges over the same numbering, and implements() is a binary
+ * search over that list.
+ *
+ * The index is a snapshot. Removing classes never invalidates the numbering
+ * of the remaining ones, so remove_class() is O(1); when a pass changes the
+ * interfaces of some classes, refresh_implementors() re-encodes a single
+ * interface. Adding or re-parenting classes requires a rebuild(), which
+ * is linear in the size of the hierarchy and reuses the existing storage.
+ */
+class TypeHierarchyIndex {
+ public:
+  TypeHierarchyIndex() = default;
+
+  TypeHierarchyIndex(const ClassHierarchy& hierarchy,
+                     const InterfaceMap& interfaces) {
+    rebuild(hierarchy, interfaces);
+  }
+
+  /**
+   * Renumber the hierarchy from scratch.
+   */
+  void rebuild(const ClassHierarchy& hierarchy,
+               const InterfaceMap& interfaces);
+
+  /**
+   * Return true if child is a subclass of or equal to parent.
+   * Both types must be classes (not interfaces) known to the index.
+   */
+  bool is_subtype(const DexType* parent, const DexType* child) const {
+    const auto& parent_it = m_ranges.find(parent);
+    if (parent_it == m_ranges.end()) return false;
+    const auto& child_it = m_ranges.find(child);
+    if (child_it == m_ranges.end()) return false;
+    return parent_it->second.contains(child_it->second.begin);
+  }
+
+  /**
+   * Return true if the given class implements the given interface, either
+   * directly, via one of its parents or via an interface DAG.
+   */
+  bool implements(const DexType* cls, const DexType* intf) const;
+
+  /**
+   * Forget about a class that has been removed from the hierarchy.
+   */
+  void remove_class(const DexType* cls) { m_ranges.erase(cls); }
+
+  /**
+   * Re-encode the implementors of a single interface. `implementors` must
+   * only contain classes known to the index.
+   */
+  void refresh_implementors(const DexType* intf, const TypeSet& implementors);
+
+  size_t size() const { return m_ranges.size(); }
+
+ private:
+  struct Range {
+    uint32_t begin;
+    uint32_t end;
+
+    bool contains(uint32_t n) const { return begin <= n && n < end; }
+  };
+
+  void number(const ClassHierarchy& hierarchy, const DexType* type);
+
+  std::unordered_map<const DexType*, Range> m_ranges;
+  std::unordered_map<const DexType*, std::vector<Range>> m_implementors;
+  uint32_t m_next{0};
+};
@@ -74,6 +74,8 @@ const TypeVector TypeSystem::empty_vec = TypeVector();
 TypeSystem::TypeSystem(const Scope& scope) : m_class_scopes(scope) {
   load_interface_children(scope, m_intf_children);
   make_instanceof_interfaces_table();
+  m_index.rebuild(m_class_scopes.get_class_hierarchy(),
+                  m_class_scopes.get_interface_map());
 }
 
 void TypeSystem::get_all_super_interfaces(
@@ -9,6 +9,7 @@
 
 #include "DexClass.h"
 #include "ClassHierarchy.h"
+#include "TypeHierarchyIndex.h"
 #include "VirtualScope.h"
 
 #include <unordered_map>
@@ -36,6 +37,7 @@ class TypeSystem {
   ClassHierarchy m_intf_children;
   InstanceOfTable m_instanceof_table;
   TypeToTypeSet m_interfaces;
+  TypeHierarchyIndex m_index;
 
  public:
   explicit TypeSystem(const Scope& scope);
@@ -103,16 +105,7 @@ class TypeSystem {
    * The type must be a class (not an interface).
    */
   bool is_subtype(const DexType* parent, const DexType* child) const {
-    const auto& parent_it = m_instanceof_table.find(parent);
-    const auto& child_it = m_instanceof_table.find(child);
-    if (parent_it == m_instanceof_table.end() ||
-        child_it == m_instanceof_table.end()) {
-      return false;
-    }
-    const auto& p_chain = parent_it->second;
-    const auto& c_chain = child_it->second;
-    if (p_chain.size() > c_chain.size()) return false;
-    return c_chain.at(p_chain.size() - 1) == parent;
+    return m_index.is_subtype(parent, child);
   }
 
   /**
@@ -121,11 +114,14 @@ class TypeSystem {
    * or an interface DAG.
    */
   bool implements(const DexType* cls, const DexType* intf) const {
-    const auto& implementors = m_class_scopes.get_interface_map().find(intf);
-    if (implementors == m_class_scopes.get_interface_map().end()) return false;
-    return implementors->second.count(cls) > 0;
+    return m_index.implements(cls, intf);
   }
 
+  /**
+   * Return the interval-encoded index backing is_subtype() and implements().
+   */
+  const TypeHierarchyIndex& get_hierarchy_index() const { return m_index; }
+
   /**
    * Return all classes that implement an interface.
    * The interface may be implemented via some parent of the class
@@ -10,11 +10,16 @@
 #include "DexAccess.h"
 #include "DexUtil.h"
 #include "ReachableClasses.h"
+#include "Resolver.h"
 #include "Timer.h"
 #include "Trace.h"
+#include "WorkQueue.h"
 
+#include <boost/thread/thread.hpp>
 #include <map>
+#include <mutex>
 #include <set>
+#include <unordered_set>
 
 namespace {
 
@@ -170,22 +175,27 @@ void create_object_class() {
   }
 }
 
+// Hashed counterparts of ProtoMap and SignatureMap used while walking the
+// hierarchy. Every (name, proto) entry is built independently of the others,
+// so the iteration order of these maps does not affect the result, which is
+// moved into an ordered SignatureMap once complete.
+using ProtoScopes = std::unordered_map<const DexProto*, VirtualScopes>;
+using SigScopes = std::unordered_map<const DexString*, ProtoScopes>;
+
 // map from a proto to the set of interface implementing that sig
-using IntfProtoMap = std::map<const DexProto*, TypeSet, dexprotos_comparator>;
+using IntfProtoMap = std::unordered_map<const DexProto*, TypeSet>;
 
 // a map from name to signatures for a set of interfaces
-using BaseIntfSigs =
-    std::map<const DexString*, IntfProtoMap, dexstrings_comparator>;
+using BaseIntfSigs = std::unordered_map<const DexString*, IntfProtoMap>;
 
 // map to track signatures as (name, sig)
-using BaseSigs = std::map<const DexString*,
-                          std::set<const DexProto*, dexprotos_comparator>,
-                          dexstrings_comparator>;
+using BaseSigs =
+    std::unordered_map<const DexString*, std::unordered_set<const DexProto*>>;
 
 /**
  * Create a BaseSig which is the set of method definitions in a type.
  */
-BaseSigs load_base_sigs(SignatureMap& sig_map) {
+BaseSigs load_base_sigs(SigScopes& sig_map) {
   BaseSigs base_sigs;
   for (const auto& proto_it : sig_map) {
     for (const auto& scope : proto_it.second) {
@@ -231,7 +241,7 @@ void escape_all(VirtualScopes& scopes) {
  * if an interface at the class level is marked ESCAPED
  * everything defined in base and children escapes as well.
  */
-void escape_all(SignatureMap& sig_map) {
+void escape_all(SigScopes& sig_map) {
   for (auto& protos_it : sig_map) {
     for (auto& scopes_it : protos_it.second) {
       escape_all(scopes_it.second);
@@ -244,7 +254,7 @@ void escape_all(SignatureMap& sig_map) {
  * Walk through all the method definitions in base.
  */
 void mark_methods(const DexType* type,
-                  SignatureMap& sig_map,
+                  SigScopes& sig_map,
                   const BaseSigs& base_sigs,
                   bool escape) {
   for (const auto& protos_it : base_sigs) {
@@ -291,7 +301,7 @@ void mark_methods(const DexType* type,
  * in the VirtualScope for A.m().
  */
 void build_interface_scope(const DexType* type,
-                           SignatureMap& sig_map,
+                           SigScopes& sig_map,
                            const BaseIntfSigs& intf_sig_map) {
   for (const auto& proto_it : intf_sig_map) {
     for (const auto& intfs_it : proto_it.second) {
@@ -327,8 +337,8 @@ void build_interface_scope(const DexType* type,
  */
 void merge(const BaseSigs& base_sigs,
            const BaseIntfSigs& base_intf_sig_map,
-           SignatureMap& base_sig_map,
-           const SignatureMap& derived_sig_map) {
+           SigScopes& base_sig_map,
+           const SigScopes& derived_sig_map) {
 
   // Helpers
 
@@ -547,7 +557,7 @@ bool get_interface_methods(const DexType* type, BaseIntfSigs& intf_methods) {
  * even though the method did not exist. It will not be a def (!is_def()).
  */
 bool load_interfaces(const DexType* type,
-                     SignatureMap& sig_map,
+                     SigScopes& sig_map,
                      BaseIntfSigs& intf_sig_map) {
   bool escaped = get_interface_methods(type, intf_sig_map);
   const auto intf_flags = MIRANDA | IMPL;
@@ -592,7 +602,7 @@ bool load_interfaces(const DexType* type,
  * Those should be the only entries in the SignatureMap in input.
  * They are all TOP_DEF until a parent proves otherwise.
  */
-void load_methods(const DexType* type, SignatureMap& sig_map) {
+void load_methods(const DexType* type, SigScopes& sig_map) {
   auto const& vmethods = get_vmethods(type);
   // add each virtual method to the SignatureMap
   for (auto& vmeth : vmethods) {
@@ -606,6 +616,15 @@ void load_methods(const DexType* type, SignatureMap& sig_map) {
   }
 }
 
+// The SigScopes of a subtree of the hierarchy built ahead of time, and
+// whether any of its interfaces escapes.
+struct SubtreeScopes {
+  SigScopes sig_map;
+  bool escape{false};
+};
+
+using PrebuiltSubtrees = std::unordered_map<const DexType*, SubtreeScopes>;
+
 /**
  * Compute VirtualScopes and virtual method flags.
  * Starting from java.lang.Object recursively walk the type hierarchy down
@@ -646,7 +665,8 @@ void load_methods(const DexType* type, SignatureMap& sig_map) {
  */
 bool build_signature_map(const ClassHierarchy& hierarchy,
                          const DexType* type,
-                         SignatureMap& sig_map) {
+                         SigScopes& sig_map,
+                         PrebuiltSubtrees* prebuilt = nullptr) {
   always_assert_log(sig_map.size() == 0,
                     "intf_methods and children_methods are out params");
   const TypeSet& children = hierarchy.at(type);
@@ -663,9 +683,16 @@ bool build_signature_map(const ClassHierarchy& hierarchy,
   // and interface methods under type
   bool escape_up = false;
   for (const auto& child : children) {
-    SignatureMap child_sig_map;
-    escape_up =
-        build_signature_map(hierarchy, child, child_sig_map) || escape_up;
+    SigScopes child_sig_map;
+    if (prebuilt != nullptr && prebuilt->count(child) > 0) {
+      auto& subtree = prebuilt->at(child);
+      child_sig_map = std::move(subtree.sig_map);
+      escape_up = subtree.escape || escape_up;
+    } else {
+      escape_up =
+          build_signature_map(hierarchy, child, child_sig_map, prebuilt) ||
+          escape_up;
+    }
     TRACE(VIRT,
           3,
           "* Merging sig map of %s with child %s\n",
@@ -685,6 +712,38 @@ bool build_signature_map(const ClassHierarchy& hierarchy,
   return escape_up | escape_down;
 }
 
+size_t count_subtree(const ClassHierarchy& hierarchy,
+                     const DexType* type,
+                     std::unordered_map<const DexType*, size_t>& sizes) {
+  size_t size = 1;
+  const auto& children = hierarchy.find(type);
+  if (children != hierarchy.end()) {
+    for (const auto& child : children->second) {
+      size += count_subtree(hierarchy, child, sizes);
+    }
+  }
+  sizes[type] = size;
+  return size;
+}
+
+/**
+ * Cut the hierarchy under `type` into subtrees of at most `max_size` types.
+ * Only the types on the path to those subtrees are left to the serial walk.
+ */
+void select_subtrees(const ClassHierarchy& hierarchy,
+                     const DexType* type,
+                     const std::unordered_map<const DexType*, size_t>& sizes,
+                     size_t max_size,
+                     std::vector<const DexType*>& subtrees) {
+  for (const auto& child : hierarchy.at(type)) {
+    if (sizes.at(child) <= max_size) {
+      subtrees.push_back(child);
+    } else {
+      select_subtrees(hierarchy, child, sizes, max_size, subtrees);
+    }
+  }
+}
+
 /**
  * Subclass check.
  * We can make this much faster in time.
@@ -785,12 +844,118 @@ void get_root_scopes(const SignatureMap& sig_map,
 
 } // namespace
 
-SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy) {
+SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy,
+                                 unsigned int num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+  const auto root = get_object_type();
+  // Subtrees of the hierarchy are independent of each other until they get
+  // merged into their parent. Build the sig maps of small enough subtrees
+  // in parallel, then walk the remaining top of the hierarchy serially,
+  // merging children in the same order as a fully serial walk would.
+  PrebuiltSubtrees prebuilt;
+  if (num_threads > 1 && class_hierarchy.count(root) > 0) {
+    std::unordered_map<const DexType*, size_t> sizes;
+    auto total = count_subtree(class_hierarchy, root, sizes);
+    std::vector<const DexType*> subtrees;
+    select_subtrees(class_hierarchy, root, sizes,
+                    std::max<size_t>(total / (num_threads * 8), 1), subtrees);
+    for (const auto& type : subtrees) {
+      prebuilt[type];
+    }
+    auto wq = workqueue_foreach<const DexType*>(
+        [&](const DexType* type) {
+          auto& subtree = prebuilt.at(type);
+          subtree.escape =
+              build_signature_map(class_hierarchy, type, subtree.sig_map);
+        },
+        num_threads);
+    for (const auto& type : subtrees) {
+      wq.add_item(type);
+    }
+    wq.run_all();
+  }
+
+  SigScopes sig_scopes;
+  build_signature_map(class_hierarchy, root, sig_scopes, &prebuilt);
+
   SignatureMap signature_map;
-  build_signature_map(class_hierarchy, get_object_type(), signature_map);
+  for (auto& protos_it : sig_scopes) {
+    auto& proto_map = signature_map[protos_it.first];
+    for (auto& scopes_it : protos_it.second) {
+      proto_map[scopes_it.first] = std::move(scopes_it.second);
+    }
+  }
   return signature_map;
 }
 
+namespace {
+
+// Everything build_signature_map reads off the classes of a hierarchy: the
+// classes themselves, their super types, interfaces and access, and the
+// identity, name, proto and access of every virtual method. Two equal
+// fingerprints yield the same SignatureMap however the classes were edited
+// in between, through the DexClass API or not.
+std::vector<const void*> hierarchy_fingerprint(
+    const ClassHierarchy& class_hierarchy) {
+  std::vector<const DexType*> types;
+  std::unordered_set<const DexType*> seen;
+  auto visit = [&](const DexType* type) {
+    if (seen.insert(type).second) types.push_back(type);
+  };
+  visit(get_object_type());
+  for (const auto& it : class_hierarchy) {
+    visit(it.first);
+    for (const auto& child : it.second) {
+      visit(child);
+    }
+  }
+  std::vector<const void*> fingerprint;
+  for (size_t i = 0; i < types.size(); i++) {
+    const auto type = types[i];
+    const DexClass* cls = type_class(type);
+    fingerprint.push_back(type);
+    fingerprint.push_back(cls);
+    if (cls == nullptr) continue;
+    fingerprint.push_back(cls->get_super_class());
+    fingerprint.push_back(cls->get_interfaces());
+    fingerprint.push_back(reinterpret_cast<const void*>(
+        static_cast<uintptr_t>(cls->get_access())));
+    for (const auto& intf : cls->get_interfaces()->get_type_list()) {
+      visit(intf);
+    }
+    fingerprint.push_back(reinterpret_cast<const void*>(
+        static_cast<uintptr_t>(cls->get_vmethods().size())));
+    for (const auto& vmeth : cls->get_vmethods()) {
+      fingerprint.push_back(vmeth);
+      fingerprint.push_back(vmeth->get_name());
+      fingerprint.push_back(vmeth->get_proto());
+      fingerprint.push_back(reinterpret_cast<const void*>(
+          static_cast<uintptr_t>(vmeth->get_access())));
+    }
+  }
+  return fingerprint;
+}
+
+} // namespace
+
+std::shared_ptr<const SignatureMap> get_cached_signature_map(
+    const ClassHierarchy& class_hierarchy) {
+  auto& cache = g_redex->signature_map_cache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  if (cache.sig_map != nullptr && cache.hierarchy == class_hierarchy &&
+      cache.fingerprint == hierarchy_fingerprint(class_hierarchy)) {
+    return cache.sig_map;
+  }
+  cache.sig_map =
+      std::make_shared<const SignatureMap>(build_signature_map(class_hierarchy));
+  cache.hierarchy = class_hierarchy;
+  // Taken after building: the walk may create java.lang.Object.
+  cache.fingerprint = hierarchy_fingerprint(class_hierarchy);
+  return cache.sig_map;
+}
+
 const std::vector<DexMethod*>& get_vmethods(const DexType* type) {
   const DexClass* cls = type_class(type);
   if (cls == nullptr) {
@@ -863,7 +1028,7 @@ const std::vector<std::vector<const VirtualScope*>>
 ClassScopes::ClassScopes(const Scope& scope) {
   m_hierarchy = build_type_hierarchy(scope);
   m_interface_map = build_interface_map(m_hierarchy);
-  m_sig_map = build_signature_map(m_hierarchy);
+  m_sig_map = get_cached_signature_map(m_hierarchy);
   build_class_scopes(get_object_type());
   build_interface_scopes();
 }
@@ -876,7 +1041,7 @@ ClassScopes::ClassScopes(const Scope& scope) {
 void ClassScopes::build_class_scopes(const DexType* type) {
   auto cls = type_class(type);
   always_assert(cls != nullptr || type == get_object_type());
-  get_root_scopes(m_sig_map, type, m_scopes);
+  get_root_scopes(*m_sig_map, type, m_scopes);
 
   const auto& children_it = m_hierarchy.find(type);
   if (children_it != m_hierarchy.end()) {
@@ -894,7 +1059,8 @@ void ClassScopes::build_interface_scopes() {
       continue;
     }
     for (const auto& meth : intf_cls->get_vmethods()) {
-      const auto& scopes = m_sig_map[meth->get_name()][meth->get_proto()];
+      const auto& scopes =
+          m_sig_map->at(meth->get_name()).at(meth->get_proto());
       always_assert(scopes.size() > 0); // at least the method itself
       auto& intf_scope = m_interface_scopes[intf_it.first];
       intf_scope.push_back({});
@@ -910,7 +1076,7 @@ void ClassScopes::build_interface_scopes() {
 InterfaceScope ClassScopes::find_interface_scope(const DexMethod* meth) const {
   InterfaceScope  intf_scope;
   DexType* intf = meth->get_class();
-  const auto& scopes = m_sig_map.at(meth->get_name()).at(meth->get_proto());
+  const auto& scopes = m_sig_map->at(meth->get_name()).at(meth->get_proto());
   always_assert(scopes.size() > 0); // at least the method itself
   for (const auto& scope : scopes) {
     if (scope.interfaces.count(intf) == 0) continue;
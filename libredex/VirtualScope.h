@@ -11,9 +11,11 @@
 #include "DexUtil.h"
 #include "ClassHierarchy.h"
 #include "Timer.h"
-#include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 
 /**
@@ -195,8 +197,32 @@ using SignatureMap =
 /**
  * Given a ClassHierarchy walk the java.lang.Object hierarchy building
  * all VirtualScope known.
+ * Independent subtrees of the hierarchy are walked in parallel; the result
+ * does not depend on the number of threads; 0 uses every hardware thread.
+ */
+SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy,
+                                 unsigned int num_threads = 0);
+
+/**
+ * The SignatureMap last built by get_cached_signature_map, and what it was
+ * built from. It lives in the RedexContext, as it points into its classes.
+ */
+struct SignatureMapCache {
+  std::mutex mutex;
+  std::shared_ptr<const SignatureMap> sig_map;
+  ClassHierarchy hierarchy;
+  std::vector<const void*> fingerprint;
+};
+
+/**
+ * Like build_signature_map, but returns the SignatureMap built by the last
+ * call in this RedexContext if it was for the same ClassHierarchy and no
+ * class or virtual method has been added, removed, re-parented or renamed
+ * since. The classes are compared directly, so edits that bypass the DexClass
+ * API are seen too. This lets consecutive passes share one build.
  */
-SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy);
+std::shared_ptr<const SignatureMap> get_cached_signature_map(
+    const ClassHierarchy& class_hierarchy);
 
 /**
  * Given a DexMethod return the scope the method is in.
@@ -246,7 +272,7 @@ class ClassScopes {
   InterfaceScopes m_interface_scopes;
   ClassHierarchy m_hierarchy;
   InterfaceMap m_interface_map;
-  SignatureMap m_sig_map;
+  std::shared_ptr<const SignatureMap> m_sig_map;
 
  public:
   explicit ClassScopes(const Scope& scope);
@@ -290,7 +316,7 @@ class ClassScopes {
           const std::vector<const VirtualScope*>&,
           const TypeSet&)>
   void walk_all_intf_scopes(AllInterfaceScopesWalkerFn walker) const {
-    for (const auto& names_it : m_sig_map) {
+    for (const auto& names_it : *m_sig_map) {
       for (const auto sig_it : names_it.second) {
         std::vector<const VirtualScope*> intf_scopes;
         TypeSet intfs;
@@ -379,7 +405,7 @@ class ClassScopes {
    * Given a DexMethod return the scope the method is in.
    */
   const VirtualScope& find_virtual_scope(const DexMethod* meth) const {
-    return ::find_virtual_scope(m_sig_map, meth);
+    return ::find_virtual_scope(*m_sig_map, meth);
   }
 
   /**
@@ -411,7 +437,7 @@ class ClassScopes {
    * such it should not exceed it.
    */
   const SignatureMap& get_signature_map() const {
-    return m_sig_map;
+    return *m_sig_map;
   }
 
  private:
@@ -490,10 +516,13 @@ inline std::unordered_set<const DexMethod*> find_non_overridden_virtuals(
   return find_non_overridden_virtuals(signature_map);
 }
 
-inline bool can_devirtualize(SignatureMap& sig_map, DexMethod* meth) {
+inline bool can_devirtualize(const SignatureMap& sig_map, DexMethod* meth) {
   always_assert(meth->is_virtual());
-  auto& proto_map = sig_map[meth->get_name()];
-  auto& scopes = proto_map[meth->get_proto()];
+  const auto& proto_map = sig_map.find(meth->get_name());
+  if (proto_map == sig_map.end()) return false;
+  const auto& scopes_it = proto_map->second.find(meth->get_proto());
+  if (scopes_it == proto_map->second.end()) return false;
+  const auto& scopes = scopes_it->second;
   for (const auto& scope : scopes) {
     if (scope.type != meth->get_class()) {
       continue;
@@ -7,6 +7,7 @@
 
 #include "Warning.h"
 
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 
@@ -18,8 +19,9 @@ const char* s_warning_text[] = {
 #undef OPT_WARN
 };
 
-size_t s_warning_counts[] = {
-#define OPT_WARN(...) 0,
+// opt_warn is called while dex code items are encoded in parallel.
+std::atomic<size_t> s_warning_counts[] = {
+#define OPT_WARN(...) {0},
     OPT_WARNINGS
 #undef OPT_WARN
 };
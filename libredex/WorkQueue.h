@@ -151,6 +151,36 @@ WorkQueue<Input, std::nullptr_t /*Data*/, Output> workqueue_mapreduce(
       num_threads);
 }
 
+/**
+ * Runs func(i, chunk) for every i in [0, n), where chunk is the state of the
+ * run of chunk_size consecutive indices that i is in. The chunks are processed
+ * in parallel and returned in order, so that e.g. concatenating the strings
+ * that func appends to them gives the same text as a serial loop. Chunking
+ * keeps the number of those strings, and of the writes of them, well below n.
+ */
+template <class Chunk>
+std::vector<Chunk> workqueue_chunks(
+    size_t n,
+    const std::function<void(size_t, Chunk&)>& func,
+    unsigned int num_threads =
+        std::max(1u, boost::thread::hardware_concurrency()),
+    size_t chunk_size = 256) {
+  std::vector<Chunk> chunks((n + chunk_size - 1) / chunk_size);
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t chunk) {
+        auto end = std::min(n, (chunk + 1) * chunk_size);
+        for (size_t i = chunk * chunk_size; i < end; ++i) {
+          func(i, chunks[chunk]);
+        }
+      },
+      num_threads);
+  for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+    wq.add_item(chunk);
+  }
+  wq.run_all();
+  return chunks;
+}
+
 template <class Input, class Data, class Output>
 void WorkQueue<Input, Data, Output>::add_item(Input task) {
   if (m_currently_running) {
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
@@ -12,9 +13,13 @@
 #include <cstdlib>
 #include <fcntl.h>
 #include <fstream>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <boost/regex.hpp>
+#include <chrono>
 #include <sstream>
+#include <stack>
 #include <string>
 
 #ifdef _MSC_VER
@@ -32,6 +37,13 @@
 #include "CompatWindows.h"
 #endif
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NATIVE_LIB_SCAN_SIMD 1
+#include <immintrin.h>
+#else
+#define NATIVE_LIB_SCAN_SIMD 0
+#endif
+
 #include "androidfw/ResourceTypes.h"
 #include "utils/ByteOrder.h"
 #include "utils/Errors.h"
@@ -41,7 +53,10 @@
 #include "utils/Serialize.h"
 #include "utils/TypeHelpers.h"
 
+#include "RedexResources.h"
 #include "StringUtil.h"
+#include "Trace.h"
+#include "WorkQueue.h"
 
 constexpr size_t MIN_CLASSNAME_LENGTH = 10;
 constexpr size_t MAX_CLASSNAME_LENGTH = 500;
@@ -52,6 +67,92 @@ using path_t = boost::filesystem::path;
 using dir_iterator = boost::filesystem::directory_iterator;
 using rdir_iterator = boost::filesystem::recursive_directory_iterator;
 
+namespace {
+
+/*
+ * A read-only mapping of a whole file. Empty if the file can't be read or has
+ * no contents, like read_entire_file.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        m_data = static_cast<const char*>(data);
+        m_size = st.st_size;
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (m_data != nullptr) {
+      munmap(const_cast<char*>(m_data), m_size);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+ private:
+  const char* m_data{nullptr};
+  size_t m_size{0};
+};
+
+/*
+ * Maps each of the files and hands it to :scan on one of the worker threads,
+ * along with that thread's result. Returns the results of all the threads,
+ * for the caller to merge.
+ */
+template <typename Result>
+std::vector<Result> scan_files(
+    const char* what,
+    const std::vector<std::string>& files,
+    const std::function<void(const std::string&, const MappedFile&, Result&)>&
+        scan) {
+  auto start = std::chrono::steady_clock::now();
+  auto num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  std::vector<Result> results(num_threads);
+  std::vector<size_t> bytes(num_threads);
+  WorkQueue<size_t, unsigned, std::nullptr_t> wq(
+      [&](unsigned& thread, size_t i) -> std::nullptr_t {
+        MappedFile file(files[i]);
+        scan(files[i], file, results[thread]);
+        bytes[thread] += file.size();
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned thread) { return thread; },
+      num_threads);
+  for (size_t i = 0; i < files.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  auto total_bytes = std::accumulate(bytes.begin(), bytes.end(), size_t(0));
+  TRACE(RES, 1,
+        "Scanned %zu %s files (%zu bytes) in %.3lfs: %.0lf files/s, "
+        "%.1lf MB/s\n",
+        files.size(), what, total_bytes, seconds,
+        seconds > 0 ? files.size() / seconds : 0.0,
+        seconds > 0 ? total_bytes / seconds / (1024 * 1024) : 0.0);
+  return results;
+}
+
+} // namespace
+
 std::string convert_from_string16(const android::String16& string16) {
   android::String8 string8(string16);
   std::string converted(string8.string());
@@ -110,42 +211,45 @@ std::string dotname_to_dexname(const std::string& classname) {
 }
 
 void extract_by_pattern(
-    const std::string& string_to_search,
-    boost::regex regex,
+    const char* begin,
+    const char* end,
+    const boost::regex& regex,
     std::unordered_set<std::string>& result) {
-  boost::smatch m;
-  std::string s = string_to_search;
-  while (boost::regex_search (s, m, regex)) {
+  boost::cmatch m;
+  while (boost::regex_search(begin, end, m, regex)) {
     if (m.size() > 1) {
         result.insert(m[1].str());
     }
-    s = m.suffix().str();
+    begin = m[0].second;
   }
 }
 
 void extract_js_sounds(
-    const std::string& file_contents,
+    const char* begin,
+    const char* end,
     std::unordered_set<std::string>& result) {
   static boost::regex sound_regex("\"([^\\\"]+)\\.(m4a|ogg)\"");
-  extract_by_pattern(file_contents, sound_regex, result);
+  extract_by_pattern(begin, end, sound_regex, result);
 }
 
 void extract_js_uris(
-    const std::string& file_contents,
+    const char* begin,
+    const char* end,
     std::unordered_set<std::string>& result) {
   static boost::regex uri_regex("\\buri:\\s*\"([^\\\"]+)\"");
-  extract_by_pattern(file_contents, uri_regex, result);
+  extract_by_pattern(begin, end, uri_regex, result);
 }
 
 void extract_js_asset_registrations(
-    const std::string& file_contents,
+    const char* begin,
+    const char* end,
     std::unordered_set<std::string>& result) {
   static boost::regex register_regex("registerAsset\\((.+?)\\)");
   static boost::regex name_regex("name:\\\"(.+?)\\\"");
   static boost::regex location_regex("httpServerLocation:\\\"/assets/(.+?)\\\"");
   static boost::regex special_char_regex("[^a-z0-9_]");
   std::unordered_set<std::string> registrations;
-  extract_by_pattern(file_contents, register_regex, registrations);
+  extract_by_pattern(begin, end, register_regex, registrations);
   for (std::string registration : registrations) {
     boost::smatch m;
     if (!boost::regex_search (registration, m, location_regex) || m.size() == 0) {
@@ -170,11 +274,18 @@ void extract_js_asset_registrations(
   }
 }
 
+void extract_js_resources(
+    const char* data,
+    size_t size,
+    std::unordered_set<std::string>& result) {
+  extract_js_sounds(data, data + size, result);
+  extract_js_uris(data, data + size, result);
+  extract_js_asset_registrations(data, data + size, result);
+}
+
 std::unordered_set<std::string> extract_js_resources(const std::string& file_contents) {
   std::unordered_set<std::string> result;
-  extract_js_sounds(file_contents, result);
-  extract_js_uris(file_contents, result);
-  extract_js_asset_registrations(file_contents, result);
+  extract_js_resources(file_contents.data(), file_contents.size(), result);
   return result;
 }
 
@@ -213,6 +324,8 @@ std::unordered_set<uint32_t> extract_xml_reference_attributes(
 /**
  * Follows the reference links for a resource for all configurations.
  * Returns all the nodes visited, as well as all the string values seen.
+ * String values are looked up in the package of the resource holding them,
+ * which for a reference into another package is not that of resID.
  */
 void walk_references_for_resource(
     uint32_t resID,
@@ -224,18 +337,21 @@ void walk_references_for_resource(
   }
   nodes_visited.emplace(resID);
 
-  ssize_t pkg_index = table->getResourcePackageIndex(resID);
-
-  android::Vector<android::Res_value> initial_values;
-  table->getAllValuesForResource(resID, initial_values);
-
-  std::stack<android::Res_value> nodes_to_explore;
-  for (size_t index = 0; index < initial_values.size(); ++index) {
-    nodes_to_explore.push(initial_values[index]);
-  }
+  // Each value along with the package index of the resource it belongs to.
+  std::stack<std::pair<ssize_t, android::Res_value>> nodes_to_explore;
+  auto push_values = [&](uint32_t id) {
+    ssize_t pkg_index = table->getResourcePackageIndex(id);
+    android::Vector<android::Res_value> values;
+    table->getAllValuesForResource(id, values);
+    for (size_t index = 0; index < values.size(); ++index) {
+      nodes_to_explore.emplace(pkg_index, values[index]);
+    }
+  };
+  push_values(resID);
 
   while (!nodes_to_explore.empty()) {
-    android::Res_value r = nodes_to_explore.top();
+    ssize_t pkg_index = nodes_to_explore.top().first;
+    android::Res_value r = nodes_to_explore.top().second;
     nodes_to_explore.pop();
 
     if (r.dataType == android::Res_value::TYPE_STRING) {
@@ -253,11 +369,7 @@ void walk_references_for_resource(
     }
 
     nodes_visited.insert(r.data);
-    android::Vector<android::Res_value> inner_values;
-    table->getAllValuesForResource(r.data, inner_values);
-    for (size_t index = 0; index < inner_values.size(); ++index) {
-      nodes_to_explore.push(inner_values[index]);
-    }
+    push_values(r.data);
   }
 }
 
@@ -350,13 +462,14 @@ std::string read_attribute_name_at_idx(
 }
 
 void extract_classes_from_layout(
-    const std::string& layout_contents,
+    const char* data,
+    size_t size,
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
 
   android::ResXMLTree parser;
-  parser.setTo(layout_contents.data(), layout_contents.size());
+  parser.setTo(data, size);
 
   android::String16 name("name");
   android::String16 klazz("class");
@@ -417,20 +530,16 @@ void extract_classes_from_layout(
            type != android::ResXMLParser::END_DOCUMENT);
 }
 
-/*
- * Returns all strings that look like java class names from a native library.
- *
- * Return values will be formatted the way that the dex spec formats class names:
- *
- *   "Ljava/lang/String;"
- *
- */
-std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
-  std::unordered_set<std::string> classes;
+namespace {
+
+void extract_classes_from_native_lib_scalar(
+    const char* data,
+    size_t size,
+    std::unordered_set<std::string>& classes) {
   char buffer[MAX_CLASSNAME_LENGTH + 2]; // +2 for the trailing ";\0"
-  const char* inptr = lib_contents.data();
+  const char* inptr = data;
   char* outptr = buffer;
-  const char* end = inptr + lib_contents.size();
+  const char* end = inptr + size;
 
   size_t length = 0;
 
@@ -447,7 +556,7 @@ std::unordered_set<std::string> extract_classes_from_native_lib(const std::strin
         length++;
       }
 
-      while (( // This loop is safe since lib_contents.data() ends with a \0
+      while (inptr < end && (
                  (*inptr >= 'a' && *inptr <= 'z') ||
                  (*inptr >= 'A' && *inptr <= 'Z') ||
                  (*inptr >= '0' && *inptr <= '9') ||
@@ -465,6 +574,244 @@ std::unordered_set<std::string> extract_classes_from_native_lib(const std::strin
     }
     inptr++;
   }
+}
+
+#if NATIVE_LIB_SCAN_SIMD
+/*
+ * The vectorized scanners classify 64 bytes at a time into two bitmasks: the
+ * bytes that can start a class name ([a-z] or 'L') and the bytes that can be
+ * part of one ([A-Za-z0-9/_$]). The scan then jumps from the start of a name
+ * to the end of its run of name bytes, and from there to the next start, and
+ * finds exactly the names that the scalar loop above does:
+ *
+ * - a name is at most MAX_CLASSNAME_LENGTH long, counting the 'L' that is
+ *   prepended to names that don't start with one;
+ * - the byte after a name is skipped, even if the name was cut short.
+ */
+struct ChunkMasks {
+  uint64_t start;
+  uint64_t name;
+};
+
+__attribute__((target("avx2"))) inline __m256i in_range(__m256i v,
+                                                        char lo,
+                                                        char hi) {
+  auto offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(hi - lo)),
+                           offset);
+}
+
+__attribute__((target("avx2"))) ChunkMasks classify_avx2(const char* p) {
+  ChunkMasks masks{0, 0};
+  for (int i = 0; i < 2; i++) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+    auto lower = in_range(v, 'a', 'z');
+    auto start = _mm256_or_si256(lower,
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('L')));
+    // Setting 0x20 lowercases the letters and moves nothing else into a-z.
+    auto alpha = in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    // '/' comes right before '0'.
+    auto name = _mm256_or_si256(
+        _mm256_or_si256(alpha, in_range(v, '/', '9')),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$'))));
+    masks.start |= uint64_t(uint32_t(_mm256_movemask_epi8(start))) << (32 * i);
+    masks.name |= uint64_t(uint32_t(_mm256_movemask_epi8(name))) << (32 * i);
+  }
+  return masks;
+}
+
+__attribute__((target("sse4.2"))) ChunkMasks classify_sse42(const char* p) {
+  constexpr int kMode = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK;
+  const auto start_ranges = _mm_setr_epi8(
+      'a', 'z', 'L', 'L', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  const auto name_ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', '/', '9', '_',
+                                         '_', '$', '$', 0, 0, 0, 0, 0, 0);
+  ChunkMasks masks{0, 0};
+  for (int i = 0; i < 4; i++) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+    auto start = _mm_cmpestrm(start_ranges, 4, v, 16, kMode);
+    auto name = _mm_cmpestrm(name_ranges, 10, v, 16, kMode);
+    masks.start |= uint64_t(uint16_t(_mm_cvtsi128_si32(start))) << (16 * i);
+    masks.name |= uint64_t(uint16_t(_mm_cvtsi128_si32(name))) << (16 * i);
+  }
+  return masks;
+}
+
+/*
+ * The masks of the 64-byte chunks of a buffer, computed as the scan reaches
+ * them. The last chunk is padded with zeros, which are neither.
+ */
+template <ChunkMasks (*classify)(const char*)>
+class ChunkClassifier {
+ public:
+  ChunkClassifier(const char* data, size_t size)
+      : m_data(data), m_end(data + size) {}
+
+  // The masks from p to the end of its chunk, with p at bit 0. The bits
+  // past the end of the chunk are clear in the start mask and set in the name
+  // mask, so that searches for either go on to the next chunk.
+  ChunkMasks at(const char* p) {
+    size_t chunk = (p - m_data) / 64;
+    if (chunk != m_chunk) {
+      const char* chunk_data = m_data + chunk * 64;
+      if (m_end - chunk_data >= 64) {
+        m_masks = classify(chunk_data);
+      } else {
+        char padded[64] = {};
+        std::copy(chunk_data, m_end, padded);
+        m_masks = classify(padded);
+      }
+      m_chunk = chunk;
+    }
+    auto offset = (p - m_data) % 64;
+    uint64_t past_chunk = offset ? ~uint64_t(0) << (64 - offset) : 0;
+    return {m_masks.start >> offset, m_masks.name >> offset | past_chunk};
+  }
+
+  // The start of the next chunk after p's.
+  const char* next_chunk(const char* p) const {
+    return m_data + ((p - m_data) / 64 + 1) * 64;
+  }
+
+ private:
+  const char* m_data;
+  const char* m_end;
+  size_t m_chunk{std::numeric_limits<size_t>::max()};
+  ChunkMasks m_masks;
+};
+
+template <ChunkMasks (*classify)(const char*)>
+void extract_classes_from_native_lib_simd(
+    const char* data,
+    size_t size,
+    std::unordered_set<std::string>& classes) {
+  ChunkClassifier<classify> chunks(data, size);
+  const char* end = data + size;
+  const char* p = data;
+  while (p < end) {
+    // Find the start of the next name.
+    auto start = chunks.at(p).start;
+    if (!start) {
+      p = chunks.next_chunk(p);
+      continue;
+    }
+    p += __builtin_ctzll(start);
+
+    // Find the end of its run of name bytes, up to the length limit.
+    size_t prefix = *p != 'L';
+    const char* limit =
+        p + std::min<size_t>(end - p, MAX_CLASSNAME_LENGTH - prefix);
+    const char* q = p;
+    while (q < limit) {
+      auto non_name = ~chunks.at(q).name;
+      if (non_name) {
+        q += __builtin_ctzll(non_name);
+        break;
+      }
+      q = chunks.next_chunk(q);
+    }
+    q = std::min(q, limit);
+
+    if (prefix + (q - p) >= MIN_CLASSNAME_LENGTH) {
+      std::string name;
+      name.reserve(prefix + (q - p) + 1);
+      if (prefix) {
+        name += 'L';
+      }
+      name.append(p, q);
+      name += ';';
+      classes.insert(std::move(name));
+    }
+    p = q + 1;
+  }
+}
+
+#endif
+
+} // namespace
+
+std::vector<std::string> native_lib_scan_simd_supported() {
+  std::vector<std::string> supported;
+#if NATIVE_LIB_SCAN_SIMD
+  if (__builtin_cpu_supports("sse4.2")) {
+    supported.push_back("sse4.2");
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    supported.push_back("avx2");
+  }
+#endif
+  return supported;
+}
+
+namespace {
+
+// The instruction set to classify native library bytes with, which
+// native_lib_scan_simd_supported names in the public interface.
+enum class NativeLibScanner { SCALAR, SSE42, AVX2 };
+
+NativeLibScanner native_lib_scanner(const std::string& isa) {
+#if NATIVE_LIB_SCAN_SIMD
+  if (isa == "avx2" && __builtin_cpu_supports("avx2")) {
+    return NativeLibScanner::AVX2;
+  }
+  if (isa == "sse4.2" && __builtin_cpu_supports("sse4.2")) {
+    return NativeLibScanner::SSE42;
+  }
+#endif
+  return NativeLibScanner::SCALAR;
+}
+
+NativeLibScanner best_native_lib_scanner() {
+  auto supported = native_lib_scan_simd_supported();
+  return native_lib_scanner(supported.empty() ? "" : supported.back());
+}
+
+// Only read after static initialization, so scans on any thread agree.
+const NativeLibScanner s_native_lib_scanner = best_native_lib_scanner();
+
+} // namespace
+
+/*
+ * Returns all strings that look like java class names from a native library.
+ *
+ * Return values will be formatted the way that the dex spec formats class names:
+ *
+ *   "Ljava/lang/String;"
+ *
+ */
+void extract_classes_from_native_lib(
+    const char* data,
+    size_t size,
+    std::unordered_set<std::string>& classes,
+    NativeLibScanner scanner = s_native_lib_scanner) {
+#if NATIVE_LIB_SCAN_SIMD
+  switch (scanner) {
+  case NativeLibScanner::AVX2:
+    extract_classes_from_native_lib_simd<classify_avx2>(data, size, classes);
+    return;
+  case NativeLibScanner::SSE42:
+    extract_classes_from_native_lib_simd<classify_sse42>(data, size, classes);
+    return;
+  case NativeLibScanner::SCALAR:
+    break;
+  }
+#endif
+  extract_classes_from_native_lib_scalar(data, size, classes);
+}
+
+std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
+  std::unordered_set<std::string> classes;
+  extract_classes_from_native_lib(
+      lib_contents.data(), lib_contents.size(), classes);
+  return classes;
+}
+
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const std::string& lib_contents, const std::string& isa) {
+  std::unordered_set<std::string> classes;
+  extract_classes_from_native_lib(lib_contents.data(), lib_contents.size(),
+                                  classes, native_lib_scanner(isa));
   return classes;
 }
 
@@ -533,16 +880,15 @@ std::unordered_set<std::string> get_js_files(const std::string& directory) {
   return get_files_by_suffix(directory, ".js");
 }
 
-std::unordered_set<std::string> get_candidate_js_resources(
-    const std::string& filename) {
-  std::string file_contents = read_entire_file(filename);
-  std::unordered_set<std::string> js_candidate_resources;
-  if (file_contents.size()) {
-    js_candidate_resources = extract_js_resources(file_contents);
+void get_candidate_js_resources(
+    const std::string& filename,
+    const MappedFile& file,
+    std::unordered_set<std::string>& js_candidate_resources) {
+  if (file.size()) {
+    extract_js_resources(file.data(), file.size(), js_candidate_resources);
   } else {
     fprintf(stderr, "Unable to read file: %s\n", filename.data());
   }
-  return js_candidate_resources;
 }
 
 
@@ -553,8 +899,12 @@ std::unordered_set<uint32_t> get_js_resources_by_parsing(
   std::unordered_set<std::string> js_candidate_resources;
   std::unordered_set<uint32_t> js_resources;
 
-  for (auto& f : get_js_files(directory)) {
-    auto c = get_candidate_js_resources(f);
+  auto js_files = get_js_files(directory);
+  auto per_thread = scan_files<std::unordered_set<std::string>>(
+      "js",
+      std::vector<std::string>(js_files.begin(), js_files.end()),
+      get_candidate_js_resources);
+  for (auto& c : per_thread) {
     js_candidate_resources.insert(c.begin(), c.end());
   }
 
@@ -621,80 +971,206 @@ std::unordered_set<uint32_t> get_xml_reference_attributes(
   return extract_xml_reference_attributes(file_contents, filename);
 }
 
-bool is_drawable_attribute(
-    android::ResXMLTree& parser,
-    size_t attr_index) {
-  size_t name_size;
-  const char* attr_name_8 = parser.getAttributeName8(attr_index, &name_size);
-  if (attr_name_8 != nullptr) {
-    std::string name_str = std::string(attr_name_8, name_size);
-    if (name_str.compare("drawable") == 0) {
-      return true;
-    }
+namespace {
+
+/*
+ * Walks the chunks of a compiled XML document in place, handing the resource
+ * id map to :visit_ids and each attribute of each element to :visit_attribute,
+ * both of which may modify them. Unlike ResXMLTree, nothing is copied and
+ * only the bytes that change are written to, so patching a writable mapping
+ * of the file only touches the pages that hold them. The whole document is
+ * checked before anything is visited, and a malformed one, which ResXMLTree
+ * would report as a BAD_DOCUMENT, is left untouched and throws.
+ */
+void patch_xml_in_place(
+    char* data,
+    size_t size,
+    const std::string& filename,
+    const std::function<void(uint32_t*, size_t)>& visit_ids,
+    const std::function<void(const android::ResStringPool&,
+                             android::ResXMLTree_attribute*)>&
+        visit_attribute) {
+  using namespace android;
+  auto malformed = [&]() {
+    return std::runtime_error("Malformed XML file: " + filename);
+  };
+  auto header = reinterpret_cast<const ResChunk_header*>(data);
+  if (size < sizeof(ResXMLTree_header) ||
+      dtohs(header->type) != RES_XML_TYPE ||
+      dtohs(header->headerSize) < sizeof(ResXMLTree_header) ||
+      dtohl(header->size) > size ||
+      dtohs(header->headerSize) > dtohl(header->size)) {
+    throw std::runtime_error("Unable to read file: " + filename);
   }
 
-  const char16_t* attr_name_16 = parser.getAttributeName(attr_index, &name_size);
-  if (attr_name_16 != nullptr) {
-    android::String8 name_str_8 = android::String8(attr_name_16, name_size);
-    std::string name_str = std::string(name_str_8.string(), name_size);
-    if (name_str.compare("drawable") == 0) {
-      return true;
+  ResStringPool pool;
+  std::vector<std::pair<uint32_t*, size_t>> id_maps;
+  std::vector<ResXMLTree_attribute*> attributes;
+  char* end = data + dtohl(header->size);
+  char* cur = data + dtohs(header->headerSize);
+  while (end - cur >= (ptrdiff_t)sizeof(ResChunk_header)) {
+    auto chunk = reinterpret_cast<const ResChunk_header*>(cur);
+    size_t header_size = dtohs(chunk->headerSize);
+    size_t chunk_size = dtohl(chunk->size);
+    if (header_size < sizeof(ResChunk_header) || chunk_size < header_size ||
+        chunk_size > (size_t)(end - cur)) {
+      throw malformed();
+    }
+    switch (dtohs(chunk->type)) {
+    case RES_STRING_POOL_TYPE:
+      if (pool.getError() != NO_ERROR) {
+        pool.setTo(cur, chunk_size);
+      }
+      break;
+    case RES_XML_RESOURCE_MAP_TYPE:
+      id_maps.emplace_back(reinterpret_cast<uint32_t*>(cur + header_size),
+                           (chunk_size - header_size) / sizeof(uint32_t));
+      break;
+    case RES_XML_START_ELEMENT_TYPE: {
+      if (header_size < sizeof(ResXMLTree_node) ||
+          chunk_size - header_size < sizeof(ResXMLTree_attrExt)) {
+        throw malformed();
+      }
+      auto ext = reinterpret_cast<const ResXMLTree_attrExt*>(cur + header_size);
+      size_t attr_start = dtohs(ext->attributeStart);
+      size_t attr_size = dtohs(ext->attributeSize);
+      size_t attr_count = dtohs(ext->attributeCount);
+      if (attr_count > 0 &&
+          (attr_size < sizeof(ResXMLTree_attribute) ||
+           attr_start + attr_size * attr_count > chunk_size - header_size)) {
+        throw malformed();
+      }
+      char* attrs = cur + header_size + attr_start;
+      for (size_t i = 0; i < attr_count; ++i) {
+        attributes.push_back(
+            reinterpret_cast<ResXMLTree_attribute*>(attrs + i * attr_size));
+      }
+      break;
+    }
+    default:
+      break;
     }
+    cur += chunk_size;
   }
 
-  return false;
+  for (const auto& id_map : id_maps) {
+    visit_ids(id_map.first, id_map.second);
+  }
+  for (auto attr : attributes) {
+    visit_attribute(pool, attr);
+  }
 }
 
-int inline_xml_reference_attributes(
+bool is_drawable_attribute(const android::ResStringPool& pool,
+                           const android::ResXMLTree_attribute* attr) {
+  auto idx = dtohl(attr->name.index);
+  size_t len;
+  if (pool.isUTF8()) {
+    auto name = pool.string8At(idx, &len);
+    return name != nullptr && std::string(name, len) == "drawable";
+  }
+  auto name = pool.stringAt(idx, &len);
+  return name != nullptr &&
+         std::string(android::String8(name, len).string()) == "drawable";
+}
+
+/*
+ * Maps the file for writing and patches it with patch_xml_in_place. The
+ * changes reach the file when the mapping is released.
+ */
+void patch_xml_file_in_place(
     const std::string& filename,
-    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
-  int num_values_inlined = 0;
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
+    const std::function<void(uint32_t*, size_t)>& visit_ids,
+    const std::function<void(const android::ResStringPool&,
+                             android::ResXMLTree_attribute*)>&
+        visit_attribute) {
+  int file_descriptor;
+  size_t length;
+  void* fp = map_file(filename.c_str(), file_descriptor, length, true);
+  try {
+    patch_xml_in_place(static_cast<char*>(fp), length, filename, visit_ids,
+                       visit_attribute);
+  } catch (...) {
+    unmap_and_close(file_descriptor, fp, length);
+    throw;
+  }
+  unmap_and_close(file_descriptor, fp, length);
+}
 
-  android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
-  if (parser.getError() != android::NO_ERROR) {
-    throw std::runtime_error("Unable to read file: " + filename);
+/*
+ * Runs :patch over all the files on the worker threads. Each file is patched
+ * on its own, so a malformed one is left untouched while the others are
+ * patched, and they are all reported together once the rest are done.
+ */
+void patch_xml_files(const char* what,
+                     const std::vector<std::string>& filenames,
+                     const std::function<void(const std::string&)>& patch) {
+  auto start = std::chrono::steady_clock::now();
+  std::mutex malformed_mutex;
+  std::vector<std::string> malformed;
+  auto wq = workqueue_foreach<std::string>([&](const std::string& filename) {
+    try {
+      patch(filename);
+    } catch (const std::runtime_error& e) {
+      std::lock_guard<std::mutex> lock(malformed_mutex);
+      malformed.push_back(e.what());
+    }
+  });
+  for (const auto& filename : filenames) {
+    wq.add_item(filename);
   }
+  wq.run_all();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  TRACE(RES, 1, "%s %zu xml files in %.3lfs: %.0lf files/s\n", what,
+        filenames.size(), seconds,
+        seconds > 0 ? filenames.size() / seconds : 0.0);
+  if (!malformed.empty()) {
+    std::sort(malformed.begin(), malformed.end());
+    throw std::runtime_error(boost::algorithm::join(malformed, "\n"));
+  }
+}
 
-  android::ResXMLParser::event_code_t type;
-  do {
-    type = parser.next();
-    if (type == android::ResXMLParser::START_TAG) {
-      const size_t attr_count = parser.getAttributeCount();
-      for (size_t i = 0; i < attr_count; ++i) {
+} // namespace
+
+int inline_xml_reference_attributes(
+    const std::string& filename,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  int num_values_inlined = 0;
+  patch_xml_file_in_place(
+      filename,
+      [](uint32_t*, size_t) {},
+      [&](const android::ResStringPool& pool,
+          android::ResXMLTree_attribute* attr) {
+        if (attr->typedValue.dataType != android::Res_value::TYPE_REFERENCE) {
+          return;
+        }
+        auto data = dtohl(attr->typedValue.data);
+        if (data <= PACKAGE_RESID_START) {
+          return;
+        }
+        auto p = id_to_inline_value.find(data);
         // Older versions of Android (below V5) do not allow inlining into
         // android:drawable attributes.
-        if (is_drawable_attribute(parser, i)) {
-          continue;
-        }
-
-        if (parser.getAttributeDataType(i) == android::Res_value::TYPE_REFERENCE) {
-          android::Res_value outValue;
-          parser.getAttributeValue(i, &outValue);
-          if (outValue.data <= PACKAGE_RESID_START) {
-            continue;
-          }
-
-          auto p = id_to_inline_value.find(outValue.data);
-          if (p != id_to_inline_value.end()) {
-            android::Res_value new_value = p->second;
-            parser.setAttribute(i, new_value);
-            ++num_values_inlined;
-            made_change = true;
-          }
+        if (p != id_to_inline_value.end() &&
+            !is_drawable_attribute(pool, attr)) {
+          attr->typedValue = p->second;
+          ++num_values_inlined;
         }
-      }
-    }
-  } while (type != android::ResXMLParser::BAD_DOCUMENT &&
-           type != android::ResXMLParser::END_DOCUMENT);
-
-  if (made_change) {
-    write_entire_file(filename, file_contents);
-  }
+      });
+  return num_values_inlined;
+}
 
+int inline_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
+  std::atomic<int> num_values_inlined{0};
+  patch_xml_files("Inlined references in", filenames,
+                  [&](const std::string& filename) {
+                    num_values_inlined += inline_xml_reference_attributes(
+                        filename, id_to_inline_value);
+                  });
   return num_values_inlined;
 }
 
@@ -704,54 +1180,44 @@ void remap_xml_reference_attributes(
   if (is_raw_resource(filename)) {
     return;
   }
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
-
-  android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
-  if (parser.getError() != android::NO_ERROR) {
-    throw std::runtime_error("Unable to read file: " + filename);
-  }
-
-  // Update embedded resource ID array
-  size_t resIdCount = 0;
-  uint32_t* resourceIds = parser.getResourceIds(&resIdCount);
-  for (size_t i = 0; i < resIdCount; ++i) {
-    auto id_search = kept_to_remapped_ids.find(resourceIds[i]);
-    if (id_search != kept_to_remapped_ids.end()) {
-      resourceIds[i] = id_search->second;
-      made_change = true;
-    }
-  }
-
-  android::ResXMLParser::event_code_t type;
-  do {
-    type = parser.next();
-    if (type == android::ResXMLParser::START_TAG) {
-      const size_t attr_count = parser.getAttributeCount();
-      for (size_t i = 0; i < attr_count; ++i) {
-        if (parser.getAttributeDataType(i) == android::Res_value::TYPE_REFERENCE ||
-            parser.getAttributeDataType(i) == android::Res_value::TYPE_ATTRIBUTE) {
-          android::Res_value outValue;
-          parser.getAttributeValue(i, &outValue);
-          if (outValue.data > PACKAGE_RESID_START &&
-              kept_to_remapped_ids.count(outValue.data)) {
-            uint32_t new_value = kept_to_remapped_ids.at(outValue.data);
-            if (new_value != outValue.data) {
-              parser.setAttributeData(i, new_value);
-              made_change = true;
-            }
+  patch_xml_file_in_place(
+      filename,
+      // Update embedded resource ID array
+      [&](uint32_t* ids, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+          auto id_search = kept_to_remapped_ids.find(dtohl(ids[i]));
+          if (id_search != kept_to_remapped_ids.end() &&
+              id_search->second != dtohl(ids[i])) {
+            ids[i] = htodl(id_search->second);
           }
         }
-      }
-    }
-  } while (type != android::ResXMLParser::BAD_DOCUMENT &&
-           type != android::ResXMLParser::END_DOCUMENT);
+      },
+      [&](const android::ResStringPool&, android::ResXMLTree_attribute* attr) {
+        auto type = attr->typedValue.dataType;
+        if (type != android::Res_value::TYPE_REFERENCE &&
+            type != android::Res_value::TYPE_ATTRIBUTE) {
+          return;
+        }
+        auto data = dtohl(attr->typedValue.data);
+        if (data <= PACKAGE_RESID_START) {
+          return;
+        }
+        auto id_search = kept_to_remapped_ids.find(data);
+        if (id_search != kept_to_remapped_ids.end() &&
+            id_search->second != data) {
+          attr->typedValue.data = htodl(id_search->second);
+        }
+      });
+}
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
-  }
+void remap_xml_reference_attributes(
+    const std::vector<std::string>& filenames,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
+  patch_xml_files("Remapped references in", filenames,
+                  [&](const std::string& filename) {
+                    remap_xml_reference_attributes(filename,
+                                                   kept_to_remapped_ids);
+                  });
 }
 
 std::vector<std::string> find_layout_files(const std::string& apk_directory) {
@@ -786,9 +1252,10 @@ void collect_layout_classes_and_attributes_for_file(
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
-  std::string contents = read_entire_file(file_path);
+  MappedFile file(file_path);
   extract_classes_from_layout(
-    contents,
+    file.data(),
+    file.size(),
     attributes_to_read,
     out_classes,
     out_attributes);
@@ -799,13 +1266,22 @@ void collect_layout_classes_and_attributes(
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
+  using Result = std::pair<std::unordered_set<std::string>,
+                           std::unordered_multimap<std::string, std::string>>;
   std::vector<std::string> files = find_layout_files(apk_directory);
-  for (auto layout_file : files) {
-    collect_layout_classes_and_attributes_for_file(
-      layout_file,
-      attributes_to_read,
-      out_classes,
-      out_attributes);
+  auto per_thread = scan_files<Result>(
+      "layout",
+      files,
+      [&](const std::string&, const MappedFile& file, Result& result) {
+        extract_classes_from_layout(file.data(),
+                                    file.size(),
+                                    attributes_to_read,
+                                    result.first,
+                                    result.second);
+      });
+  for (auto& result : per_thread) {
+    out_classes.insert(result.first.begin(), result.first.end());
+    out_attributes.insert(result.second.begin(), result.second.end());
   }
 }
 
@@ -862,11 +1338,17 @@ std::vector<std::string> find_native_library_files(const std::string& apk_direct
  */
 std::unordered_set<std::string> get_native_classes(const std::string& apk_directory) {
   std::vector<std::string> native_libs = find_native_library_files(apk_directory);
+  auto per_thread = scan_files<std::unordered_set<std::string>>(
+      "native library",
+      native_libs,
+      [](const std::string&,
+         const MappedFile& file,
+         std::unordered_set<std::string>& classes) {
+        extract_classes_from_native_lib(file.data(), file.size(), classes);
+      });
   std::unordered_set<std::string> all_classes;
-  for (auto native_lib : native_libs) {
-    std::string contents = read_entire_file(native_lib);
-    std::unordered_set<std::string> classes_from_layout = extract_classes_from_native_lib(contents);
-    all_classes.insert(classes_from_layout.begin(), classes_from_layout.end());
+  for (auto& classes : per_thread) {
+    all_classes.insert(classes.begin(), classes.end());
   }
   return all_classes;
 }
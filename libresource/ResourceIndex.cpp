@@ -0,0 +1,245 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ResourceIndex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "utils/String8.h"
+#include "utils/TypeHelpers.h"
+
+#include "Trace.h"
+
+namespace {
+
+const uint32_t PACKAGE_RESID_START = 0x7f000000;
+
+std::string to_string(const char* s8, const char16_t* s16, size_t len) {
+  if (s8 != nullptr) {
+    return std::string(s8, len);
+  }
+  if (s16 != nullptr) {
+    return std::string(android::String8(s16, len).string());
+  }
+  return std::string();
+}
+
+bool is_reference(const android::Res_value& value) {
+  return (value.dataType == android::Res_value::TYPE_REFERENCE ||
+          value.dataType == android::Res_value::TYPE_ATTRIBUTE) &&
+         value.data > PACKAGE_RESID_START;
+}
+
+} // namespace
+
+ResourceIndex::ResourceIndex(const android::ResTable& table) : m_table(table) {
+  auto start = std::chrono::steady_clock::now();
+
+  android::SortedVector<uint32_t> ids;
+  table.getResourceIds(&ids);
+  m_ids.reserve(ids.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    m_ids.push_back(ids[i]);
+  }
+
+  std::unordered_map<std::string, uint16_t> type_indices;
+  m_package_indices.reserve(m_ids.size());
+  m_type_indices.reserve(m_ids.size());
+  m_names.reserve(m_ids.size());
+  m_value_offsets.reserve(m_ids.size() + 1);
+  m_reference_offsets.reserve(m_ids.size() + 1);
+  m_value_offsets.push_back(0);
+  m_reference_offsets.push_back(0);
+  android::Vector<android::Res_value> values;
+  for (auto id : m_ids) {
+    m_package_indices.push_back(table.getResourcePackageIndex(id));
+
+    android::ResTable::resource_name res_name;
+    std::string type;
+    std::string name;
+    if (table.getResourceName(id, /* allowUtf8 */ true, &res_name)) {
+      type = to_string(res_name.type8, res_name.type, res_name.typeLen);
+      name = to_string(res_name.name8, res_name.name, res_name.nameLen);
+    }
+    auto it = type_indices.emplace(type, m_type_names.size()).first;
+    if (it->second == m_type_names.size()) {
+      m_type_names.push_back(type);
+    }
+    m_type_indices.push_back(it->second);
+    m_names.push_back(std::move(name));
+
+    values.clear();
+    table.getAllValuesForResource(id, values);
+    auto first_reference = m_references.size();
+    for (size_t i = 0; i < values.size(); i++) {
+      m_values.push_back(values[i]);
+      if (is_reference(values[i])) {
+        m_references.push_back(values[i].data);
+      }
+    }
+    std::sort(m_references.begin() + first_reference, m_references.end());
+    m_references.erase(std::unique(m_references.begin() + first_reference,
+                                   m_references.end()),
+                       m_references.end());
+    m_value_offsets.push_back(m_values.size());
+    m_reference_offsets.push_back(m_references.size());
+  }
+
+  // Invert the references, counting the referencing resources of each
+  // resource first so that they can be laid out in place.
+  m_referenced_by_offsets.assign(m_ids.size() + 1, 0);
+  for (auto target : m_references) {
+    auto index = index_of(target);
+    if (index != kNotFound) {
+      m_referenced_by_offsets[index + 1]++;
+    }
+  }
+  for (size_t i = 0; i < m_ids.size(); i++) {
+    m_referenced_by_offsets[i + 1] += m_referenced_by_offsets[i];
+  }
+  m_referenced_by.resize(m_referenced_by_offsets.back());
+  auto next = m_referenced_by_offsets;
+  for (size_t i = 0; i < m_ids.size(); i++) {
+    for (auto target : references_at(i)) {
+      auto index = index_of(target);
+      if (index != kNotFound) {
+        m_referenced_by[next[index]++] = m_ids[i];
+      }
+    }
+  }
+
+  TRACE(RES, 1,
+        "Indexed %zu resources with %zu values and %zu references in %.3lfs\n",
+        m_ids.size(), m_values.size(), m_references.size(),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      start)
+            .count());
+}
+
+size_t ResourceIndex::index_of(uint32_t id) const {
+  auto it = std::lower_bound(m_ids.begin(), m_ids.end(), id);
+  if (it == m_ids.end() || *it != id) {
+    return kNotFound;
+  }
+  return it - m_ids.begin();
+}
+
+const std::string& ResourceIndex::type(uint32_t id) const {
+  static const std::string empty;
+  auto index = index_of(id);
+  return index == kNotFound ? empty : m_type_names[m_type_indices[index]];
+}
+
+const std::string& ResourceIndex::name(uint32_t id) const {
+  static const std::string empty;
+  auto index = index_of(id);
+  return index == kNotFound ? empty : m_names[index];
+}
+
+std::map<std::string, std::vector<uint32_t>> ResourceIndex::name_to_ids()
+    const {
+  std::map<std::string, std::vector<uint32_t>> result;
+  for (size_t i = 0; i < m_ids.size(); i++) {
+    result[m_names[i]].push_back(m_ids[i]);
+  }
+  return result;
+}
+
+ResourceIndex::Range<android::Res_value> ResourceIndex::values(
+    uint32_t id) const {
+  auto index = index_of(id);
+  if (index == kNotFound) {
+    return {nullptr, nullptr};
+  }
+  return {m_values.data() + m_value_offsets[index],
+          m_values.data() + m_value_offsets[index + 1]};
+}
+
+ResourceIndex::Range<uint32_t> ResourceIndex::references(uint32_t id) const {
+  auto index = index_of(id);
+  if (index == kNotFound) {
+    return {nullptr, nullptr};
+  }
+  return references_at(index);
+}
+
+ResourceIndex::Range<uint32_t> ResourceIndex::references_at(
+    size_t index) const {
+  return {m_references.data() + m_reference_offsets[index],
+          m_references.data() + m_reference_offsets[index + 1]};
+}
+
+ResourceIndex::Range<uint32_t> ResourceIndex::referenced_by(
+    uint32_t id) const {
+  auto index = index_of(id);
+  if (index == kNotFound) {
+    return {nullptr, nullptr};
+  }
+  return {m_referenced_by.data() + m_referenced_by_offsets[index],
+          m_referenced_by.data() + m_referenced_by_offsets[index + 1]};
+}
+
+void ResourceIndex::walk_references(
+    uint32_t resID,
+    std::unordered_set<uint32_t>& nodes_visited,
+    std::unordered_set<std::string>& leaf_string_values) const {
+  if (!nodes_visited.insert(resID).second) {
+    return;
+  }
+  std::vector<uint32_t> to_visit{resID};
+  while (!to_visit.empty()) {
+    auto id = to_visit.back();
+    to_visit.pop_back();
+    auto index = index_of(id);
+    if (index == kNotFound) {
+      continue;
+    }
+    for (auto i = m_value_offsets[index]; i < m_value_offsets[index + 1]; i++) {
+      const auto& value = m_values[i];
+      if (value.dataType == android::Res_value::TYPE_STRING) {
+        auto str =
+            m_table.getString8FromIndex(m_package_indices[index], value.data);
+        leaf_string_values.insert(std::string(str.string()));
+      }
+    }
+    for (auto target : references_at(index)) {
+      if (nodes_visited.insert(target).second) {
+        to_visit.push_back(target);
+      }
+    }
+  }
+}
+
+std::unordered_set<uint32_t> ResourceIndex::reachable_from(
+    const std::vector<uint32_t>& roots) const {
+  std::unordered_set<uint32_t> reachable;
+  std::vector<bool> visited(m_ids.size());
+  std::vector<size_t> to_visit;
+  auto visit = [&](uint32_t id) {
+    auto index = index_of(id);
+    if (index == kNotFound) {
+      reachable.insert(id);
+    } else if (!visited[index]) {
+      visited[index] = true;
+      reachable.insert(id);
+      to_visit.push_back(index);
+    }
+  };
+  for (auto root : roots) {
+    visit(root);
+  }
+  while (!to_visit.empty()) {
+    auto index = to_visit.back();
+    to_visit.pop_back();
+    for (auto target : references_at(index)) {
+      visit(target);
+    }
+  }
+  return reachable;
+}
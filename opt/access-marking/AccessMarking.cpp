@@ -135,7 +135,7 @@ void AccessMarkingPass::run_pass(DexStoresVector& stores,
                                  PassManager& pm) {
   auto scope = build_class_scope(stores);
   ClassHierarchy ch = build_type_hierarchy(scope);
-  SignatureMap sm = build_signature_map(ch);
+  auto sm = get_cached_signature_map(ch);
   if (m_finalize_classes) {
     auto n_classes_final = mark_classes_final(scope, ch);
     pm.incr_metric("finalized_classes", n_classes_final);
@@ -146,7 +146,7 @@ void AccessMarkingPass::run_pass(DexStoresVector& stores,
     pm.incr_metric("finalized_methods", n_methods_final);
     TRACE(ACCESS, 1, "Finalized %lu methods\n", n_methods_final);
   }
-  auto candidates = devirtualize(sm);
+  auto candidates = devirtualize(*sm);
   auto dmethods = direct_methods(scope);
   candidates.insert(candidates.end(), dmethods.begin(), dmethods.end());
   if (m_privatize_methods) {
@@ -456,6 +456,8 @@ int DeadRefs::remove_unreachable() {
   }
   del_init_res.deleted_ifields += ifieldcnt;
   TRACE(DELINIT, 2, "Removed %d ifields\n", ifieldcnt);
+  // The members above were erased from the class vectors directly.
+  invalidate_resolver_cache();
 
   int called_dmeths = 0;
   int dont_delete_dmeths = 0;
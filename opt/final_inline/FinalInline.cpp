@@ -148,6 +148,7 @@ class FinalInlineImpl {
                                    }),
                     sfields.end());
     }
+    invalidate_resolver_cache();
     return smallscope.size();
   }
 
@@ -285,6 +285,7 @@ void aggressively_delete_static_finals(const Scope& scope) {
                        }),
         sfields.end());
   }
+  invalidate_resolver_cache();
 }
 
 } // namespace
@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits>
 #include <string>
 #include <vector>
 #include <unordered_set>
@@ -25,12 +26,94 @@
 #include "IRInstruction.h"
 #include "ReachableClasses.h"
 #include "StringUtil.h"
+#include "Timer.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
-typedef std::unordered_set<DexMethodRef*> mrefs_t;
-typedef std::unordered_set<DexFieldRef*> frefs_t;
+/*
+ * Dense ids for the method or field refs of the classes being packed, so that
+ * the refs of a dex fit in a bitset.
+ */
+template <typename Ref>
+class RefIds {
+ public:
+  static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+  uint32_t get_or_add(Ref* ref) {
+    return m_ids.emplace(ref, m_ids.size()).first->second;
+  }
+
+  uint32_t get(Ref* ref) const {
+    auto it = m_ids.find(ref);
+    return it == m_ids.end() ? kNone : it->second;
+  }
+
+  size_t size() const { return m_ids.size(); }
+
+  void clear() { m_ids.clear(); }
+
+ private:
+  std::unordered_map<Ref*, uint32_t> m_ids;
+};
+
+/*
+ * The refs of a dex, as a bitset over their ids.
+ */
+class RefSet {
+ public:
+  size_t size() const { return m_size; }
+
+  bool contains(uint32_t id) const {
+    auto word = id / 64;
+    return word < m_words.size() && (m_words[word] >> (id % 64)) & 1;
+  }
+
+  // The number of the ids, which must be sorted and unique, that are not in
+  // the set yet.
+  size_t count_missing(const std::vector<uint32_t>& ids) const {
+    size_t missing = 0;
+    for (auto id : ids) {
+      missing += !contains(id);
+    }
+    return missing;
+  }
+
+  void insert(const std::vector<uint32_t>& ids) {
+    if (ids.empty()) return;
+    auto words = ids.back() / 64 + 1;
+    if (m_words.size() < words) {
+      m_words.resize(words);
+    }
+    for (auto id : ids) {
+      uint64_t bit = uint64_t(1) << (id % 64);
+      m_size += !(m_words[id / 64] & bit);
+      m_words[id / 64] |= bit;
+    }
+  }
+
+  void clear() {
+    std::fill(m_words.begin(), m_words.end(), 0);
+    m_size = 0;
+  }
+
+ private:
+  std::vector<uint64_t> m_words;
+  size_t m_size{0};
+};
+
+/*
+ * The sorted ids of the method and field refs of a class.
+ */
+struct ClassRefs {
+  std::vector<uint32_t> mrefs;
+  std::vector<uint32_t> frefs;
+};
+
+RefIds<DexMethodRef> method_ref_ids;
+RefIds<DexFieldRef> field_ref_ids;
+std::unordered_map<const DexClass*, ClassRefs> class_refs;
 
 size_t global_dmeth_cnt;
 size_t global_smeth_cnt;
@@ -44,38 +127,83 @@ size_t cold_start_set_dex_count = 1000;
 size_t scroll_set_dex_count = 1000;
 
 bool emit_canaries = false;
+bool min_refs_packing = false;
 int64_t linear_alloc_limit;
 std::unordered_set<DexClass*> mixed_mode_classes;
 
-void gather_refs(InterDexPass* pass,
-                 const DexClass* cls,
-                 mrefs_t* mrefs,
-                 frefs_t* frefs) {
-  std::vector<DexMethodRef*> method_refs;
-  std::vector<DexFieldRef*> field_refs;
-  cls->gather_methods(method_refs);
-  cls->gather_fields(field_refs);
-  for (const auto& plugin : pass->m_plugins) {
-    plugin->gather_mrefs(cls, method_refs, field_refs);
+template <typename Ref>
+std::vector<uint32_t> to_ids(RefIds<Ref>& ids, const std::vector<Ref*>& refs) {
+  std::vector<uint32_t> result;
+  result.reserve(refs.size());
+  for (auto ref : refs) {
+    result.push_back(ids.get_or_add(ref));
   }
-  mrefs->insert(method_refs.begin(), method_refs.end());
-  frefs->insert(field_refs.begin(), field_refs.end());
+  sort_unique(result);
+  return result;
 }
 
 /*
- * Removes the elements of b from a. Runs in O(size(a)), so it works best if
- * size(a) << size(b).
+ * Gather the refs of all the classes up front, in parallel, and number them.
  */
-template <typename T>
-std::unordered_set<T> set_difference(const std::unordered_set<T>& a,
-                                     const std::unordered_set<T>& b) {
-  std::unordered_set<T> result;
-  for (auto& v : a) {
-    if (!b.count(v)) {
-      result.emplace(v);
-    }
+void precompute_class_refs(const Scope& scope) {
+  std::vector<std::vector<DexMethodRef*>> method_refs(scope.size());
+  std::vector<std::vector<DexFieldRef*>> field_refs(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    scope[i]->gather_methods(method_refs[i]);
+    scope[i]->gather_fields(field_refs[i]);
+  });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
   }
-  return result;
+  wq.run_all();
+
+  class_refs.reserve(scope.size());
+  for (size_t i = 0; i < scope.size(); ++i) {
+    auto& refs = class_refs[scope[i]];
+    refs.mrefs = to_ids(method_ref_ids, method_refs[i]);
+    refs.frefs = to_ids(field_ref_ids, field_refs[i]);
+  }
+}
+
+/*
+ * The refs of a class, including those that the plugins add for it. The
+ * plugins are asked at the time the class is emitted, as they were before
+ * the refs were precomputed.
+ */
+ClassRefs gather_refs(InterDexPass* pass, const DexClass* cls) {
+  auto it = class_refs.find(cls);
+  if (it == class_refs.end()) {
+    // E.g. a canary class created while packing.
+    std::vector<DexMethodRef*> method_refs;
+    std::vector<DexFieldRef*> field_refs;
+    cls->gather_methods(method_refs);
+    cls->gather_fields(field_refs);
+    it = class_refs
+             .emplace(cls,
+                      ClassRefs{to_ids(method_ref_ids, method_refs),
+                                to_ids(field_ref_ids, field_refs)})
+             .first;
+  }
+  if (pass->m_plugins.empty()) {
+    return it->second;
+  }
+  std::vector<DexMethodRef*> method_refs;
+  std::vector<DexFieldRef*> field_refs;
+  for (const auto& plugin : pass->m_plugins) {
+    plugin->gather_mrefs(cls, method_refs, field_refs);
+  }
+  ClassRefs refs = it->second;
+  if (!method_refs.empty()) {
+    auto extra = to_ids(method_ref_ids, method_refs);
+    refs.mrefs.insert(refs.mrefs.end(), extra.begin(), extra.end());
+    sort_unique(refs.mrefs);
+  }
+  if (!field_refs.empty()) {
+    auto extra = to_ids(field_ref_ids, field_refs);
+    refs.frefs.insert(refs.frefs.end(), extra.begin(), extra.end());
+    sort_unique(refs.frefs);
+  }
+  return refs;
 }
 
 constexpr int kMaxMethodRefs = ((64 * 1024) - 1);
@@ -87,8 +215,8 @@ constexpr int kMaxDexNum = 99;
 
 struct dex_emit_tracker {
   unsigned la_size{0};
-  mrefs_t mrefs;
-  frefs_t frefs;
+  RefSet mrefs;
+  RefSet frefs;
   std::vector<DexClass*> outs;
   std::unordered_set<DexClass*> emitted;
   std::unordered_map<std::string, DexClass*> clookup;
@@ -131,7 +259,8 @@ void check_refs_count(const dex_emit_tracker& det, const DexClasses& dc) {
   std::unordered_set<DexMethodRef*> mrefs_set(mrefs.begin(), mrefs.end());
   if (mrefs_set.size() > det.mrefs.size()) {
     for (DexMethodRef* mr : mrefs_set) {
-      if (!det.mrefs.count(mr)) {
+      auto id = method_ref_ids.get(mr);
+      if (id == RefIds<DexMethodRef>::kNone || !det.mrefs.contains(id)) {
         TRACE(IDEX, 1,
               "WARNING: Could not find %s in predicted mrefs set\n",
               SHOW(mr));
@@ -146,7 +275,8 @@ void check_refs_count(const dex_emit_tracker& det, const DexClasses& dc) {
   std::unordered_set<DexFieldRef*> frefs_set(frefs.begin(), frefs.end());
   if (frefs_set.size() > det.frefs.size()) {
     for (auto* fr : frefs_set) {
-      if (!det.frefs.count(fr)) {
+      auto id = field_ref_ids.get(fr);
+      if (id == RefIds<DexFieldRef>::kNone || !det.frefs.contains(id)) {
         TRACE(IDEX, 1,
               "WARNING: Could not find %s in predicted frefs set\n",
               SHOW(fr));
@@ -246,6 +376,200 @@ bool is_mixed_mode_class(DexClass* clazz) {
   return mixed_mode_classes.count(clazz);
 }
 
+struct packing_stats {
+  size_t dex_count{0};
+  size_t mrefs{0};
+  size_t frefs{0};
+  size_t duplicate_refs{0};
+};
+
+packing_stats greedy_packing_stats;
+packing_stats min_refs_packing_stats;
+
+/*
+ * Packs classes into dexes under the same limits as InterDex::emit_class,
+ * but only keeps track of the refs and linear alloc size of each dex. It
+ * doesn't know about the classes that the plugins add or the canaries.
+ */
+class PackingSimulator {
+ public:
+  // Start from the dex that is currently being filled.
+  explicit PackingSimulator(const dex_emit_tracker& det)
+      : m_mrefs(det.mrefs),
+        m_frefs(det.frefs),
+        m_la_size(det.la_size),
+        m_classes(det.outs.size()) {}
+
+  const RefSet& mrefs() const { return m_mrefs; }
+  const RefSet& frefs() const { return m_frefs; }
+
+  // Add a class, and return true if it had to go into a new dex.
+  bool add(const ClassRefs& refs, unsigned la_size) {
+    bool new_dex = false;
+    if (m_la_size + la_size > linear_alloc_limit ||
+        m_mrefs.size() + m_mrefs.count_missing(refs.mrefs) >= kMaxMethodRefs ||
+        m_frefs.size() + m_frefs.count_missing(refs.frefs) >= kMaxFieldRefs) {
+      flush();
+      new_dex = true;
+    }
+    m_mrefs.insert(refs.mrefs);
+    m_frefs.insert(refs.frefs);
+    m_la_size += la_size;
+    m_classes++;
+    return new_dex;
+  }
+
+  packing_stats finish(size_t unique_refs) {
+    flush();
+    m_stats.duplicate_refs = m_stats.mrefs + m_stats.frefs - unique_refs;
+    return m_stats;
+  }
+
+ private:
+  void flush() {
+    if (m_classes == 0) {
+      return;
+    }
+    m_stats.dex_count++;
+    m_stats.mrefs += m_mrefs.size();
+    m_stats.frefs += m_frefs.size();
+    m_mrefs.clear();
+    m_frefs.clear();
+    m_la_size = 0;
+    m_classes = 0;
+  }
+
+  RefSet m_mrefs;
+  RefSet m_frefs;
+  unsigned m_la_size;
+  size_t m_classes;
+  packing_stats m_stats;
+};
+
+/*
+ * Order the classes so that each dex is filled with classes that share refs
+ * with what is already in it. Starting from the dex that is currently being
+ * filled, we repeatedly pick the class that would add the fewest new method
+ * and field refs to it. When the pick doesn't fit, it starts the next dex.
+ *
+ * The classes are kept in buckets by their number of missing refs, and an
+ * inverted index from refs to classes lets us update that number as refs
+ * are added to the dex, so picking a class costs no more than adding it.
+ *
+ * Also records the stats of this packing and of the greedy packing in
+ * :classes order, for comparison.
+ */
+std::vector<DexClass*> order_by_shared_refs(
+    const std::vector<DexClass*>& classes, const dex_emit_tracker& det) {
+  std::vector<const ClassRefs*> refs(classes.size());
+  std::vector<unsigned> la_sizes(classes.size());
+  std::vector<std::vector<uint32_t>> mref_classes(method_ref_ids.size());
+  std::vector<std::vector<uint32_t>> fref_classes(field_ref_ids.size());
+  std::unordered_set<uint32_t> unique_mrefs;
+  std::unordered_set<uint32_t> unique_frefs;
+  size_t max_refs = 0;
+  PackingSimulator greedy(det);
+  for (size_t i = 0; i < classes.size(); ++i) {
+    refs[i] = &class_refs.at(classes[i]);
+    la_sizes[i] = estimate_linear_alloc(classes[i]);
+    for (auto id : refs[i]->mrefs) {
+      mref_classes[id].push_back(i);
+    }
+    for (auto id : refs[i]->frefs) {
+      fref_classes[id].push_back(i);
+    }
+    unique_mrefs.insert(refs[i]->mrefs.begin(), refs[i]->mrefs.end());
+    unique_frefs.insert(refs[i]->frefs.begin(), refs[i]->frefs.end());
+    max_refs = std::max(max_refs, refs[i]->mrefs.size() + refs[i]->frefs.size());
+    greedy.add(*refs[i], la_sizes[i]);
+  }
+
+  PackingSimulator sim(det);
+  std::vector<bool> placed(classes.size());
+  std::vector<size_t> missing(classes.size());
+  std::vector<std::vector<uint32_t>> buckets(max_refs + 1);
+  size_t min_bucket = 0;
+
+  auto add_to_bucket = [&](uint32_t i) {
+    buckets[missing[i]].push_back(i);
+    min_bucket = std::min(min_bucket, missing[i]);
+  };
+  auto fill_buckets = [&]() {
+    for (auto& bucket : buckets) {
+      bucket.clear();
+    }
+    min_bucket = buckets.size();
+    for (size_t i = classes.size(); i-- > 0;) {
+      if (!placed[i]) {
+        missing[i] = sim.mrefs().count_missing(refs[i]->mrefs) +
+                     sim.frefs().count_missing(refs[i]->frefs);
+        add_to_bucket(i);
+      }
+    }
+  };
+  // Buckets may contain stale entries for classes that have been placed or
+  // whose missing count has since gone down; those are skipped.
+  auto pop_min = [&]() -> uint32_t {
+    while (true) {
+      auto& bucket = buckets[min_bucket];
+      if (bucket.empty()) {
+        ++min_bucket;
+        continue;
+      }
+      auto i = bucket.back();
+      bucket.pop_back();
+      if (!placed[i] && missing[i] == min_bucket) {
+        return i;
+      }
+    }
+  };
+
+  std::vector<DexClass*> order;
+  order.reserve(classes.size());
+  std::vector<uint32_t> new_mrefs;
+  std::vector<uint32_t> new_frefs;
+  fill_buckets();
+  while (order.size() < classes.size()) {
+    auto i = pop_min();
+    placed[i] = true;
+    order.push_back(classes[i]);
+
+    new_mrefs.clear();
+    new_frefs.clear();
+    for (auto id : refs[i]->mrefs) {
+      if (!sim.mrefs().contains(id)) new_mrefs.push_back(id);
+    }
+    for (auto id : refs[i]->frefs) {
+      if (!sim.frefs().contains(id)) new_frefs.push_back(id);
+    }
+    if (sim.add(*refs[i], la_sizes[i])) {
+      fill_buckets();
+      continue;
+    }
+    for (auto id : new_mrefs) {
+      for (auto j : mref_classes[id]) {
+        if (!placed[j]) {
+          missing[j]--;
+          add_to_bucket(j);
+        }
+      }
+    }
+    for (auto id : new_frefs) {
+      for (auto j : fref_classes[id]) {
+        if (!placed[j]) {
+          missing[j]--;
+          add_to_bucket(j);
+        }
+      }
+    }
+  }
+
+  auto unique_refs = unique_mrefs.size() + unique_frefs.size();
+  greedy_packing_stats = greedy.finish(unique_refs);
+  min_refs_packing_stats = sim.finish(unique_refs);
+  return order;
+}
+
 std::unordered_set<const DexClass*> find_unrefenced_coldstart_classes(
     const Scope& scope,
     dex_emit_tracker& det,
@@ -494,6 +818,13 @@ DexClassesVector InterDex::run() {
   }
 
   auto scope = build_class_scope(m_dexen);
+  {
+    Timer t("Gathering class refs");
+    method_ref_ids.clear();
+    field_ref_ids.clear();
+    class_refs.clear();
+    precompute_class_refs(scope);
+  }
 
   auto unreferenced_classes = find_unrefenced_coldstart_classes(
       scope,
@@ -708,6 +1039,19 @@ DexClassesVector InterDex::run() {
   }
 
   // Now emit the classes that weren't specified in the head or primary list.
+  if (min_refs_packing) {
+    std::vector<DexClass*> remaining;
+    for (auto clazz : scope) {
+      if (!det.emitted.count(clazz) && !is_canary(clazz) &&
+          !should_skip_class(m_pass, clazz) && !is_mixed_mode_class(clazz)) {
+        remaining.push_back(clazz);
+      }
+    }
+    Timer t("Ordering classes by shared refs");
+    for (auto clazz : order_by_shared_refs(remaining, det)) {
+      emit_class(det, outdex, clazz, s_empty_config);
+    }
+  }
   for (auto clazz : scope) {
     emit_class(det, outdex, clazz, s_empty_config);
   }
@@ -892,32 +1236,30 @@ void InterDex::emit_class(dex_emit_tracker& det,
 
   // Calculate the extra method and field refs that we would need to add to
   // the current dex if we defined :clazz in it.
-  mrefs_t clazz_mrefs;
-  frefs_t clazz_frefs;
-  gather_refs(m_pass, clazz, &clazz_mrefs, &clazz_frefs);
-  auto extra_mrefs = set_difference(clazz_mrefs, det.mrefs);
-  auto extra_frefs = set_difference(clazz_frefs, det.frefs);
+  auto clazz_refs = gather_refs(m_pass, clazz);
+  auto extra_mrefs = det.mrefs.count_missing(clazz_refs.mrefs);
+  auto extra_frefs = det.frefs.count_missing(clazz_refs.frefs);
 
   // If those extra refs would cause use to overflow, start a new dex.
   if ((det.la_size + laclazz) > linear_alloc_limit ||
       // XXX(jezng): shouldn't this >= be > instead?
-      det.mrefs.size() + extra_mrefs.size() >= kMaxMethodRefs ||
-      det.frefs.size() + extra_frefs.size() >= kMaxFieldRefs) {
+      det.mrefs.size() + extra_mrefs >= kMaxMethodRefs ||
+      det.frefs.size() + extra_frefs >= kMaxFieldRefs) {
     // Emit out list
     always_assert_log(!is_primary,
                       "would have to do an early flush on the primary dex\n"
                       "la %d:%d , mrefs %lu:%d frefs %lu:%d\n",
                       det.la_size + laclazz,
                       linear_alloc_limit,
-                      det.mrefs.size() + extra_mrefs.size(),
+                      det.mrefs.size() + extra_mrefs,
                       kMaxMethodRefs,
-                      det.frefs.size() + extra_frefs.size(),
+                      det.frefs.size() + extra_frefs,
                       kMaxFieldRefs);
     flush_out_secondary(det, outdex, dconfig);
   }
 
-  det.mrefs.insert(clazz_mrefs.begin(), clazz_mrefs.end());
-  det.frefs.insert(clazz_frefs.begin(), clazz_frefs.end());
+  det.mrefs.insert(clazz_refs.mrefs);
+  det.frefs.insert(clazz_refs.frefs);
   det.la_size += laclazz;
   det.outs.push_back(clazz);
   det.emitted.insert(clazz);
@@ -1041,6 +1383,14 @@ void InterDexPass::configure_pass(const PassConfig& pc) {
   pc.get("emit_scroll_set_marker", false,
            m_emit_scroll_set_marker);
 
+  std::string secondary_packing;
+  pc.get("secondary_packing", "greedy", secondary_packing);
+  always_assert_log(
+      secondary_packing == "greedy" || secondary_packing == "min_refs",
+      "Unknown secondary_packing %s, expected greedy or min_refs\n",
+      secondary_packing.c_str());
+  m_min_refs_packing = secondary_packing == "min_refs";
+
   always_assert_log(
       !m_can_touch_coldstart_cls || m_can_touch_coldstart_extended_cls,
       "can_touch_coldstart_extended_cls needs to be true, when we can touch "
@@ -1063,6 +1413,7 @@ void InterDexPass::run_pass(DexClassesVector& dexen,
     plugin->configure(original_scope, cfg);
   }
   emit_canaries = m_emit_canaries;
+  min_refs_packing = m_min_refs_packing;
   linear_alloc_limit = m_linear_alloc_limit;
 
   InterDex interdex(dexen, m_mixed_mode_classes_file,
@@ -1078,6 +1429,21 @@ void InterDexPass::run_pass(DexClassesVector& dexen,
     plugin->cleanup(original_scope);
   }
   mgr.incr_metric(METRIC_COLD_START_SET_DEX_COUNT, cold_start_set_dex_count);
+  if (m_min_refs_packing) {
+    // Compare the packing of the classes outside of the interdex order with
+    // what the greedy packer would have done. Method and field ids take 8
+    // bytes each in the output.
+    for (const auto& p : {std::make_pair("greedy", greedy_packing_stats),
+                          std::make_pair("min_refs", min_refs_packing_stats)}) {
+      std::string prefix = std::string(p.first) + "_packing_";
+      mgr.incr_metric(prefix + "dex_count", p.second.dex_count);
+      mgr.incr_metric(prefix + "method_refs", p.second.mrefs);
+      mgr.incr_metric(prefix + "field_refs", p.second.frefs);
+      mgr.incr_metric(prefix + "duplicate_refs", p.second.duplicate_refs);
+      mgr.incr_metric(prefix + "id_bytes",
+                      8 * (p.second.mrefs + p.second.frefs));
+    }
+  }
 
   m_plugins.clear();
 }
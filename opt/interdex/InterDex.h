@@ -83,4 +83,5 @@ class InterDexPass : public Pass {
   bool m_can_touch_coldstart_extended_cls;
   std::unordered_set<DexStatus, std::hash<int>> m_mixed_mode_dex_statuses;
   bool m_emit_scroll_set_marker;
+  bool m_min_refs_packing;
 };
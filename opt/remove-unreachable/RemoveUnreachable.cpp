@@ -23,27 +23,50 @@
 namespace {
 
 /*
- * Remove unmarked fields from :fields and erase their definitions from
+ * Remove the unmarked fields of :cls and erase their definitions from
  * g_redex.
  */
 void sweep_fields_if_unmarked(
-    std::vector<DexField*>& fields,
+    DexClass* cls,
+    const std::vector<DexField*>& fields,
     const std::unordered_set<const DexFieldRef*>& marked) {
-  auto p = [&](DexField* f) {
+  std::vector<DexField*> unmarked;
+  for (auto f : fields) {
     if (marked.count(f) == 0) {
-      TRACE(RMU, 2, "Removing %s\n", SHOW(f));
-      DexField::erase_field(f);
-      return true;
+      unmarked.push_back(f);
     }
-    return false;
-  };
-  fields.erase(std::remove_if(fields.begin(), fields.end(), p), fields.end());
+  }
+  for (auto f : unmarked) {
+    TRACE(RMU, 2, "Removing %s\n", SHOW(f));
+    // Through the DexClass API, which keeps the resolver cache consistent.
+    cls->remove_field(f);
+    DexField::erase_field(f);
+  }
+}
+
+/*
+ * Remove the unmarked methods of :cls.
+ */
+void sweep_methods_if_unmarked(
+    DexClass* cls,
+    const std::vector<DexMethod*>& methods,
+    const std::unordered_set<const DexMethodRef*>& marked) {
+  std::vector<DexMethod*> unmarked;
+  for (auto m : methods) {
+    if (marked.count(m) == 0) {
+      unmarked.push_back(m);
+    }
+  }
+  for (auto m : unmarked) {
+    TRACE(RMU, 2, "Removing %s\n", SHOW(m));
+    cls->remove_method(m);
+  }
 }
 
 /*
- * Remove unmarked classes and methods. This should really erase the classes /
- * methods from g_redex as well, but that will probably result in dangling
- * pointers (at least for DexMethods). We should fix that at some point...
+ * Remove unmarked classes. This should really erase the classes / methods
+ * from g_redex as well, but that will probably result in dangling pointers
+ * (at least for DexMethods). We should fix that at some point...
  */
 template <class Container, class Marked>
 void sweep_if_unmarked(Container& c, const std::unordered_set<Marked>& marked) {
@@ -61,12 +84,18 @@ void sweep(DexStoresVector& stores, ReachableObjects& reachables) {
   for (auto& dex : DexStoreClassesIterator(stores)) {
     sweep_if_unmarked(dex, reachables.marked_classes);
     for (auto const& cls : dex) {
-      sweep_fields_if_unmarked(cls->get_ifields(), reachables.marked_fields);
-      sweep_fields_if_unmarked(cls->get_sfields(), reachables.marked_fields);
-      sweep_if_unmarked(cls->get_dmethods(), reachables.marked_methods);
-      sweep_if_unmarked(cls->get_vmethods(), reachables.marked_methods);
+      sweep_fields_if_unmarked(
+          cls, cls->get_ifields(), reachables.marked_fields);
+      sweep_fields_if_unmarked(
+          cls, cls->get_sfields(), reachables.marked_fields);
+      sweep_methods_if_unmarked(
+          cls, cls->get_dmethods(), reachables.marked_methods);
+      sweep_methods_if_unmarked(
+          cls, cls->get_vmethods(), reachables.marked_methods);
     }
   }
+  // The classes were erased from the dex vectors directly.
+  invalidate_resolver_cache();
 }
 } // namespace
 
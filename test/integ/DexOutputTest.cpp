@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "DexStore.h"
+#include "InstructionLowering.h"
+#include "RedexContext.h"
+
+/*
+ * The code, debug and annotation items are encoded in parallel and then laid
+ * out in order, and so are the lines of the mapping files, so the output must
+ * not depend on the number of threads.
+ */
+
+namespace {
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+const char* const kMappingFiles[] = {
+    "method_mapping", "class_mapping", "proguard_map_output"};
+
+// Returns the dex followed by the mapping files written along with it.
+std::vector<std::string> write_dex(DexClasses* classes,
+                                   unsigned num_threads,
+                                   LocatorIndex* locator_index = nullptr) {
+  char dir[] = "/tmp/dex_output_test_XXXXXX";
+  EXPECT_NE(mkdtemp(dir), nullptr);
+  auto path = std::string(dir) + "/classes.dex";
+
+  Json::Value json(Json::objectValue);
+  json["dex_output_threads"] = num_threads;
+  for (auto key : kMappingFiles) {
+    json[key] = std::string(key) + ".txt";
+  }
+  ConfigFiles cfg(json);
+  cfg.outdir = dir;
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+  write_classes_to_dex(path,
+                       classes,
+                       locator_index,
+                       0,
+                       cfg,
+                       json,
+                       pos_mapper.get());
+  std::vector<std::string> outputs{read_file(path)};
+  unlink(path.c_str());
+  for (auto key : kMappingFiles) {
+    auto mapping = cfg.metafile(json[key].asString());
+    outputs.push_back(read_file(mapping));
+    unlink(mapping.c_str());
+  }
+  rmdir(dir);
+  return outputs;
+}
+
+} // namespace
+
+TEST(DexOutputTest, same_output_with_any_number_of_threads) {
+  g_redex = new RedexContext();
+  const char* dexfile = std::getenv("dexfile");
+  ASSERT_NE(nullptr, dexfile);
+
+  DexStore store("classes");
+  store.add_classes(load_classes_from_dex(dexfile));
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  instruction_lowering::run(stores);
+  auto& classes = stores[0].get_dexen()[0];
+
+  auto serial = write_dex(&classes, 1);
+  for (const auto& output : serial) {
+    EXPECT_FALSE(output.empty());
+  }
+  EXPECT_EQ(write_dex(&classes, 4), serial);
+
+  // The locator strings are looked up in parallel too.
+  auto locator_index = make_locator_index(stores);
+  auto with_locators = write_dex(&classes, 1, &locator_index);
+  EXPECT_GT(with_locators[0].size(), serial[0].size());
+  EXPECT_EQ(write_dex(&classes, 4, &locator_index), with_locators);
+  delete g_redex;
+}
+
+/*
+ * Times writing a dex with over 60k type strings, with and without locator
+ * strings. Run with --gtest_also_run_disabled_tests.
+ */
+TEST(DexOutputBenchmark, DISABLED_locator_strings) {
+  g_redex = new RedexContext();
+  // Each class has a field of its own array type, so that there are two type
+  // strings per class, and both get a locator.
+  constexpr int kNumClasses = 30000;
+  DexClasses classes;
+  for (int i = 0; i < kNumClasses; ++i) {
+    auto name = "Lcom/bench/C" + std::to_string(i) + ";";
+    auto type = DexType::make_type(name.c_str());
+    ClassCreator cc(type);
+    cc.set_super(get_object_type());
+    auto field = static_cast<DexField*>(DexField::make_field(
+        type, DexString::make_string("f"), make_array_type(type)));
+    field->make_concrete(ACC_PUBLIC);
+    cc.add_field(field);
+    classes.push_back(cc.create());
+  }
+  DexStore store("classes");
+  store.add_classes(classes);
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  auto locator_index = make_locator_index(stores);
+
+  auto time_ms = [&](unsigned num_threads, LocatorIndex* index) {
+    auto start = std::chrono::steady_clock::now();
+    write_dex(&stores[0].get_dexen()[0], num_threads, index);
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  printf("no locators: %.2fms\n", time_ms(1, nullptr));
+  printf("locators, 1 thread: %.2fms\n", time_ms(1, &locator_index));
+  printf("locators, 4 threads: %.2fms\n", time_ms(4, &locator_index));
+  delete g_redex;
+}
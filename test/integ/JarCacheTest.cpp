@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "DexClass.h"
+#include "JarLoader.h"
+#include "RedexContext.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+/*
+ * Everything that loading a jar says about its classes, in a fresh context.
+ */
+std::string load_and_show(const std::string& jar,
+                          const std::string& cache_dir) {
+  g_redex = new RedexContext();
+  Scope classes;
+  EXPECT_TRUE(load_jar_files({jar}, &classes, nullptr, nullptr, cache_dir));
+  std::ostringstream out;
+  for (const auto* cls : classes) {
+    out << show(cls) << " " << cls->get_access() << " "
+        << show(cls->get_super_class()) << " " << show(cls->get_interfaces())
+        << " " << cls->get_deobfuscated_name() << "\n";
+    for (const auto* fields : {&cls->get_sfields(), &cls->get_ifields()}) {
+      for (const auto* field : *fields) {
+        out << "  " << show(field) << " " << field->get_access() << " "
+            << field->is_external() << "\n";
+      }
+    }
+    for (const auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (const auto* method : *methods) {
+        out << "  " << show(method) << " " << method->get_access() << " "
+            << method->is_virtual() << " " << method->is_external() << "\n";
+      }
+    }
+  }
+  delete g_redex;
+  g_redex = nullptr;
+  return out.str();
+}
+
+size_t num_cache_entries(const fs::path& cache_dir) {
+  return std::distance(fs::directory_iterator(cache_dir),
+                       fs::directory_iterator());
+}
+
+} // namespace
+
+TEST(JarCacheTest, cached_and_uncached_loads_are_the_same) {
+  const char* android_sdk = std::getenv("ANDROID_SDK");
+  ASSERT_NE(nullptr, android_sdk);
+  const char* android_target = std::getenv("android_target");
+  ASSERT_NE(nullptr, android_target);
+  auto jar = std::string(android_sdk) + "/platforms/" + android_target +
+             "/android.jar";
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  auto cache_dir = dir / "cache";
+  fs::create_directories(cache_dir);
+  auto jar_copy = (dir / "library.jar").string();
+  fs::copy_file(jar, jar_copy);
+
+  auto uncached = load_and_show(jar_copy, "");
+  EXPECT_FALSE(uncached.empty());
+  EXPECT_EQ(num_cache_entries(cache_dir), 0);
+
+  // The first load writes the cache entry, the second reads it.
+  EXPECT_EQ(load_and_show(jar_copy, cache_dir.string()), uncached);
+  EXPECT_EQ(num_cache_entries(cache_dir), 1);
+  EXPECT_EQ(load_and_show(jar_copy, cache_dir.string()), uncached);
+  EXPECT_EQ(num_cache_entries(cache_dir), 1);
+
+  // An entry that claims more strings than it has bytes for is a miss, and
+  // gets written again.
+  auto entry = fs::directory_iterator(cache_dir)->path();
+  auto entry_size = fs::file_size(entry);
+  {
+    std::ofstream out(entry.string(), std::ios::binary | std::ios::trunc);
+    // The magic, version 1 and a count of 2^40 strings.
+    out << "RDXJ\x01" << std::string(5, '\x80') << '\x20';
+  }
+  EXPECT_EQ(load_and_show(jar_copy, cache_dir.string()), uncached);
+  EXPECT_EQ(num_cache_entries(cache_dir), 1);
+  EXPECT_EQ(fs::file_size(entry), entry_size);
+
+  // A changed jar gets an entry of its own. Bytes after the end of the
+  // central directory record are a zip comment, so the jar is still valid.
+  {
+    std::ofstream out(jar_copy, std::ios::binary | std::ios::app);
+    out << "changed";
+  }
+  EXPECT_EQ(load_and_show(jar_copy, cache_dir.string()), uncached);
+  EXPECT_EQ(num_cache_entries(cache_dir), 2);
+
+  fs::remove_all(dir);
+}
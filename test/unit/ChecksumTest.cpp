@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "Adler32.h"
+#include "Sha1.h"
+
+namespace {
+
+std::string sha1_hex(const uint8_t* data, size_t len) {
+  Sha1Context context;
+  sha1_init(&context);
+  // Feed the data in uneven pieces to exercise the buffering.
+  size_t piece = 1;
+  while (len > 0) {
+    auto n = std::min(piece, len);
+    sha1_update(&context, data, n);
+    data += n;
+    len -= n;
+    piece = piece * 3 + 1;
+  }
+  unsigned char digest[20];
+  sha1_final(digest, &context);
+  char hex[41];
+  for (int i = 0; i < 20; ++i) {
+    sprintf(hex + 2 * i, "%02x", digest[i]);
+  }
+  return hex;
+}
+
+std::string sha1_hex(const std::string& s) {
+  return sha1_hex((const uint8_t*)s.data(), s.size());
+}
+
+std::vector<uint8_t> random_bytes(size_t len) {
+  std::mt19937 gen(42);
+  std::vector<uint8_t> bytes(len);
+  for (auto& b : bytes) {
+    b = gen();
+  }
+  return bytes;
+}
+
+template <typename Fn>
+double time_ms(const Fn& fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+class ChecksumTest : public ::testing::TestWithParam<bool> {
+ protected:
+  void SetUp() override {
+    sha1_set_hw_accel(GetParam());
+    adler32_set_hw_accel(GetParam());
+  }
+  void TearDown() override {
+    sha1_set_hw_accel(true);
+    adler32_set_hw_accel(true);
+  }
+};
+
+} // namespace
+
+TEST_P(ChecksumTest, sha1) {
+  EXPECT_EQ(sha1_hex(""), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+  EXPECT_EQ(sha1_hex("abc"), "a9993e364706816aba3e25717850c26c9cd0d89d");
+  EXPECT_EQ(
+      sha1_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+  EXPECT_EQ(sha1_hex(std::string(1000000, 'a')),
+            "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+}
+
+TEST_P(ChecksumTest, adler32) {
+  auto bytes = random_bytes(1 << 20);
+  // All the bytes at their maximum is the worst case for the lane sums.
+  std::vector<uint8_t> ones(1 << 16, 0xff);
+  for (const auto* data : {&bytes, &ones}) {
+    for (size_t len : {0, 1, 31, 32, 33, 5552, 5553, 100000, 1 << 16}) {
+      len = std::min(len, data->size());
+      for (uint32_t init : {1u, 0xfff0fff0u}) {
+        EXPECT_EQ(adler32_update(init, data->data(), len),
+                  adler32(init, data->data(), len))
+            << "len " << len;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(HwAccel, ChecksumTest, ::testing::Bool());
+
+/*
+ * Compares the checksums against the portable SHA-1 and zlib's Adler-32 on a
+ * dex-sized input. Run with --gtest_also_run_disabled_tests.
+ */
+TEST(ChecksumBenchmark, DISABLED_dex_sized_input) {
+  auto bytes = random_bytes(10 << 20);
+  unsigned char digest[20];
+  auto sha1 = [&] {
+    Sha1Context context;
+    sha1_init(&context);
+    sha1_update(&context, bytes.data(), bytes.size());
+    sha1_final(digest, &context);
+  };
+  uint32_t checksum = 0;
+  auto adler = [&] {
+    checksum = adler32_update(1, bytes.data(), bytes.size());
+  };
+
+  sha1_set_hw_accel(false);
+  double sha1_portable = time_ms(sha1);
+  sha1_set_hw_accel(true);
+  double sha1_accel = time_ms(sha1);
+  double adler_zlib =
+      time_ms([&] { checksum = adler32(1, bytes.data(), bytes.size()); });
+  double adler_accel = time_ms(adler);
+
+  printf("SHA-1:    portable %.2fms, %s %.2fms\n",
+         sha1_portable,
+         sha1_hw_accel_supported() ? "SHA-NI" : "portable",
+         sha1_accel);
+  printf("Adler-32: zlib %.2fms, %s %.2fms\n",
+         adler_zlib,
+         adler32_hw_accel_supported() ? "SSSE3" : "zlib",
+         adler_accel);
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexLoader.h"
+#include "DexOutput.h"
+#include "DexOutputBuffer.h"
+#include "DexPosition.h"
+#include "RedexContext.h"
+
+TEST(DexOutputBufferTest, starts_zeroed) {
+  DexOutputBuffer buffer(1 << 20);
+  EXPECT_EQ(buffer.capacity(), 1 << 20);
+  for (size_t i = 0; i < buffer.capacity(); i += 4096) {
+    EXPECT_EQ(buffer.data()[i], 0);
+  }
+}
+
+TEST(DexOutputBufferTest, bounds_checks) {
+  DexOutputBuffer buffer(16);
+  EXPECT_EQ(buffer.at(0, 16, "item"), buffer.data());
+  EXPECT_EQ(buffer.at(12, 4, "item"), buffer.data() + 12);
+  EXPECT_EQ(buffer.at(16, 0, "item"), buffer.data() + 16);
+  EXPECT_THROW(buffer.at(12, 5, "item"), std::runtime_error);
+  EXPECT_THROW(buffer.at(17, 0, "item"), std::runtime_error);
+  EXPECT_THROW(buffer.at(8, SIZE_MAX, "item"), std::runtime_error);
+}
+
+TEST(DexOutputBufferTest, write_to) {
+  DexOutputBuffer buffer(64);
+  memcpy(buffer.at(0, 5, "item"), "hello", 5);
+
+  char path[] = "/tmp/dex_output_buffer_test_XXXXXX";
+  auto fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  EXPECT_TRUE(buffer.write_to(fd, 5));
+  close(fd);
+
+  FILE* f = fopen(path, "rb");
+  char contents[16] = {};
+  EXPECT_EQ(fread(contents, 1, sizeof(contents), f), 5);
+  fclose(f);
+  unlink(path);
+  EXPECT_EQ(std::string(contents), "hello");
+}
+
+/*
+ * Static values are encoded into a scratch vector before they are copied into
+ * the buffer, so an array larger than a page must make the round trip.
+ */
+TEST(DexOutputBufferTest, static_values_larger_than_4k) {
+  g_redex = new RedexContext();
+  auto type = DexType::make_type("Lcom/example/R$id;");
+  ClassCreator cc(type);
+  cc.set_super(get_object_type());
+  // Each value takes five bytes, so the array is about 10KB.
+  constexpr int kNumFields = 2000;
+  for (int i = 0; i < kNumFields; ++i) {
+    auto name = "f" + std::to_string(i);
+    auto field = static_cast<DexField*>(DexField::make_field(
+        type, DexString::make_string(name), get_int_type()));
+    auto value = DexEncodedValue::zero_for_type(get_int_type());
+    value->value(0x7f000000 + i);
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL, value);
+    cc.add_field(field);
+  }
+  DexClasses classes{cc.create()};
+
+  char path[] = "/tmp/dex_output_buffer_test_XXXXXX";
+  auto fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  close(fd);
+  Json::Value json(Json::objectValue);
+  ConfigFiles cfg(json);
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make("", ""));
+  write_classes_to_dex(
+      path, &classes, nullptr, 0, cfg, json, pos_mapper.get());
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  auto loaded = load_classes_from_dex(path);
+  unlink(path);
+  ASSERT_EQ(loaded.size(), 1);
+  const auto& sfields = loaded[0]->get_sfields();
+  ASSERT_EQ(sfields.size(), kNumFields);
+  for (auto field : sfields) {
+    auto i = std::stoi(field->get_name()->str().substr(1));
+    ASSERT_NE(field->get_static_value(), nullptr);
+    EXPECT_EQ(field->get_static_value()->value(), 0x7f000000 + i);
+  }
+  delete g_redex;
+}
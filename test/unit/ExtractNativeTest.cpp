@@ -5,16 +5,73 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <chrono>
+#include <random>
 #include <string>
 #include <gtest/gtest.h>
 
 #include "RedexResources.h"
 
-std::unordered_set<std::string> extract_classes_from_native_lib(
-    const std::string& lib_contents);
+namespace {
+
+/*
+ * Binary noise with runs of class name characters of all lengths, including
+ * some that are longer than a class name can be.
+ */
+std::string make_lib(size_t size, unsigned seed, size_t max_noise = 64) {
+  static const char kNameChars[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789/_$L";
+  std::mt19937 rng(seed);
+  std::string lib;
+  lib.reserve(size);
+  while (lib.size() < size) {
+    auto run = rng() % 8 == 0 ? rng() % 1200 : rng() % 40;
+    for (size_t i = 0; i < run; i++) {
+      lib += kNameChars[rng() % (sizeof(kNameChars) - 1)];
+    }
+    auto noise = rng() % max_noise;
+    for (size_t i = 0; i < noise; i++) {
+      lib += char(rng());
+    }
+  }
+  lib.resize(size);
+  return lib;
+}
+
+} // namespace
 
 TEST(ExtractNativeTest, empty) {
   std::string over(700, 'L');
   auto overset = extract_classes_from_native_lib(over);
   EXPECT_EQ(overset.size(), 2);
 }
+
+TEST(ExtractNativeTest, same_result_with_any_isa) {
+  auto isas = native_lib_scan_simd_supported();
+  for (size_t size : {0, 1, 63, 64, 65, 1000, 100003}) {
+    auto lib = make_lib(size, size);
+    auto expected = extract_classes_from_native_lib(lib, "");
+    EXPECT_EQ(extract_classes_from_native_lib(lib), expected);
+    for (const auto& isa : isas) {
+      EXPECT_EQ(extract_classes_from_native_lib(lib, isa), expected)
+          << isa << " on " << size << " bytes";
+    }
+  }
+}
+
+TEST(ExtractNativeTest, DISABLED_large_synthetic_lib) {
+  auto lib = make_lib(256 << 20, 0, 4096);
+  auto isas = native_lib_scan_simd_supported();
+  isas.insert(isas.begin(), "");
+  for (const auto& isa : isas) {
+    auto start = std::chrono::steady_clock::now();
+    auto classes = extract_classes_from_native_lib(lib, isa);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+    printf("%-7s %lu classes in %lldms\n",
+           isa.empty() ? "scalar" : isa.c_str(),
+           classes.size(),
+           (long long)ms);
+  }
+}
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexClass.h"
+#include "IRCode.h"
+#include "InterDex.h"
+#include "PassManager.h"
+#include "PassRegistry.h"
+#include "RedexContext.h"
+
+namespace {
+
+/*
+ * A class with a single static method that calls :callee.
+ */
+DexClass* create_class(const std::string& name, DexMethodRef* callee) {
+  auto type = DexType::make_type(DexString::make_string(name));
+  ClassCreator creator(type);
+  creator.set_super(get_object_type());
+  auto method = static_cast<DexMethod*>(DexMethod::make_method(
+      name + ".f:()V"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  auto code = std::make_unique<IRCode>(method, 0);
+  if (callee != nullptr) {
+    code->push_back((new IRInstruction(OPCODE_INVOKE_STATIC))
+                        ->set_method(callee)
+                        ->set_arg_word_count(0));
+  }
+  code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  method->set_code(std::move(code));
+  creator.add_method(method);
+  return creator.create();
+}
+
+std::vector<std::string> names(const DexClasses& classes) {
+  std::vector<std::string> result;
+  for (const auto* cls : classes) {
+    result.push_back(cls->get_name()->str());
+  }
+  return result;
+}
+
+} // namespace
+
+/*
+ * A and C share m1, and B and D share m2. Each class takes 100 bytes of
+ * linear alloc (the object vtable and one method), so two of them fit in a
+ * dex.
+ */
+TEST(InterDexTest, min_refs_packing) {
+  g_redex = new RedexContext();
+  auto m1 = DexMethod::make_method("LExternal;.m1:()V");
+  auto m2 = DexMethod::make_method("LExternal;.m2:()V");
+  auto primary = create_class("LPrimary;", nullptr);
+  auto a = create_class("LA;", m1);
+  auto b = create_class("LB;", m2);
+  auto c = create_class("LC;", m1);
+  auto d = create_class("LD;", m2);
+
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({primary});
+  store.add_classes({a, b, c, d});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+
+  Json::Value config(Json::objectValue);
+  config["redex"]["passes"].append(INTERDEX_PASS_NAME);
+  config["InterDexPass"]["emit_canaries"] = false;
+  config["InterDexPass"]["linear_alloc_limit"] = 200;
+  config["InterDexPass"]["secondary_packing"] = "min_refs";
+  // The pass registers its plugins when constructed, which only happens once
+  // per process, so use the registered instance.
+  InterDexPass* interdex = nullptr;
+  for (auto pass : PassRegistry::get().get_passes()) {
+    if (auto p = dynamic_cast<InterDexPass*>(pass)) {
+      interdex = p;
+    }
+  }
+  ASSERT_TRUE(interdex != nullptr);
+  PassManager manager({interdex}, config);
+  manager.set_testing_mode();
+  Scope external_classes;
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, external_classes, dummy_config);
+
+  // Packing in scope order would put A and B, then C and D together, with
+  // each dex referencing both m1 and m2. Grouping the classes by shared refs
+  // leaves no ref in more than one dex.
+  const auto& dexen = stores[0].get_dexen();
+  ASSERT_EQ(dexen.size(), 3);
+  EXPECT_EQ(names(dexen[0]), std::vector<std::string>({"LPrimary;"}));
+  EXPECT_EQ(names(dexen[1]), std::vector<std::string>({"LA;", "LC;"}));
+  EXPECT_EQ(names(dexen[2]), std::vector<std::string>({"LB;", "LD;"}));
+
+  // The refs are the methods of the classes and the two external methods,
+  // six in all.
+  auto metrics = manager.get_pass_info()[0].metrics;
+  EXPECT_EQ(metrics["greedy_packing_dex_count"], 2);
+  EXPECT_EQ(metrics["greedy_packing_method_refs"], 8);
+  EXPECT_EQ(metrics["greedy_packing_field_refs"], 0);
+  EXPECT_EQ(metrics["greedy_packing_duplicate_refs"], 2);
+  EXPECT_EQ(metrics["greedy_packing_id_bytes"], 64);
+  EXPECT_EQ(metrics["min_refs_packing_dex_count"], 2);
+  EXPECT_EQ(metrics["min_refs_packing_method_refs"], 6);
+  EXPECT_EQ(metrics["min_refs_packing_field_refs"], 0);
+  EXPECT_EQ(metrics["min_refs_packing_duplicate_refs"], 0);
+  EXPECT_EQ(metrics["min_refs_packing_id_bytes"], 48);
+
+  delete g_redex;
+  g_redex = nullptr;
+}
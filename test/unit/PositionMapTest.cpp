@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <memory>
+
+#include "DexClass.h"
+#include "DexPosition.h"
+#include "PositionMap.h"
+#include "RedexContext.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+std::string read_file(const fs::path& path) {
+  std::ifstream in(path.string(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+void write_file(const fs::path& path, const std::string& contents) {
+  std::ofstream out(path.string(), std::ios::binary | std::ios::trunc);
+  out << contents;
+}
+
+void append(std::string& out, uint32_t value) {
+  out.append((const char*)&value, sizeof(value));
+}
+
+void append_string(std::string& out, const std::string& s) {
+  append(out, s.size());
+  out += s;
+}
+
+DexPosition* make_position(const std::string& method,
+                           const std::string& file,
+                           uint32_t line,
+                           DexPosition* parent) {
+  auto meth = static_cast<DexMethod*>(DexMethod::make_method(method));
+  meth->set_deobfuscated_name(method);
+  auto pos = new DexPosition(line);
+  pos->bind(meth, DexString::make_string(file));
+  pos->parent = parent;
+  return pos;
+}
+
+std::string show_stack(const std::vector<Position>& stack) {
+  std::string out;
+  for (const auto& pos : stack) {
+    out += pos.cls.to_string() + "." + pos.method.to_string() + "(" +
+           pos.filename.to_string() + ":" + std::to_string(pos.line) + ")\n";
+  }
+  return out;
+}
+
+} // namespace
+
+struct PositionMapTest : testing::Test {
+  fs::path dir;
+
+  PositionMapTest() {
+    g_redex = new RedexContext();
+    dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+  }
+
+  ~PositionMapTest() {
+    fs::remove_all(dir);
+    delete g_redex;
+    g_redex = nullptr;
+  }
+};
+
+/*
+ * Main.main calls Baz.qux, which calls Foo.bar, and both calls were inlined.
+ * The two inner positions are emitted; the outermost is only registered, so
+ * it goes at the end of the map.
+ */
+TEST_F(PositionMapTest, round_trip_through_all_versions) {
+  auto outer = make_position("LMain;.main:()V", "Main.java", 30, nullptr);
+  auto mid = make_position("Lcom/Baz;.qux:()V", "Baz.java", 20, outer);
+  auto inner = make_position("LFoo;.bar:()V", "Foo.java", 10, mid);
+
+  auto v1 = dir / "map_v1";
+  auto v2 = dir / "map_v2";
+  auto v3 = dir / "map_v3";
+  std::unique_ptr<PositionMapper> mapper(
+      PositionMapper::make(v1.string(), v2.string(), v3.string()));
+  mapper->register_position(outer);
+  EXPECT_EQ(mapper->position_to_line(inner), 1);
+  EXPECT_EQ(mapper->position_to_line(mid), 2);
+  mapper->write_map();
+
+  // The v1 and v2 layouts are the same as before v3 was added.
+  std::string expected_v1;
+  append(expected_v1, 0xfaceb000);
+  append(expected_v1, 1);
+  append(expected_v1, 3);
+  for (auto file : {"Foo.java", "Baz.java", "Main.java"}) {
+    append_string(expected_v1, file);
+  }
+  append(expected_v1, 3);
+  for (auto item : {std::vector<uint32_t>{0, 10, 2},
+                    std::vector<uint32_t>{1, 20, 3},
+                    std::vector<uint32_t>{2, 30, 0}}) {
+    for (auto value : item) {
+      append(expected_v1, value);
+    }
+  }
+  EXPECT_EQ(read_file(v1), expected_v1);
+
+  std::vector<std::string> strings = {"Foo", "bar", "Foo.java",
+                                      "com.Baz", "qux", "Baz.java",
+                                      "Main", "main", "Main.java"};
+  std::vector<std::vector<uint32_t>> records = {
+      {0, 1, 2, 10, 2}, {3, 4, 5, 20, 3}, {6, 7, 8, 30, 0}};
+  std::string expected_v2;
+  append(expected_v2, 0xfaceb000);
+  append(expected_v2, 2);
+  append(expected_v2, strings.size());
+  for (const auto& s : strings) {
+    append_string(expected_v2, s);
+  }
+  append(expected_v2, records.size());
+  for (const auto& record : records) {
+    for (auto value : record) {
+      append(expected_v2, value);
+    }
+  }
+  EXPECT_EQ(read_file(v2), expected_v2);
+
+  // Both readable versions give the same stacks, following the parents up
+  // to the outermost caller.
+  for (const auto& path : {v2, v3}) {
+    auto map = read_map(path.string().c_str());
+    ASSERT_TRUE(map != nullptr);
+    ASSERT_EQ(map->positions_size(), 3);
+    EXPECT_EQ(show_stack(get_stack(*map, 0)),
+              "Foo.bar(Foo.java:10)\n"
+              "com.Baz.qux(Baz.java:20)\n"
+              "Main.main(Main.java:30)\n");
+    EXPECT_EQ(show_stack(get_stack(*map, 1)),
+              "com.Baz.qux(Baz.java:20)\n"
+              "Main.main(Main.java:30)\n");
+    EXPECT_EQ(show_stack(get_stack(*map, 2)), "Main.main(Main.java:30)\n");
+    // Lines that are not in the map, as symbolicate-trace asks for line 0
+    // with -1, yield no frames.
+    EXPECT_TRUE(get_stack(*map, -1).empty());
+    EXPECT_TRUE(get_stack(*map, 3).empty());
+    EXPECT_EQ(map->string(strings.size()), "");
+  }
+
+  delete inner;
+  delete mid;
+  delete outer;
+}
+
+/*
+ * A v3 map with a parent past the last position and a string id past the
+ * end of the pool.
+ */
+TEST_F(PositionMapTest, out_of_range_ids) {
+  std::string map_v3;
+  append(map_v3, 0xfaceb000);
+  append(map_v3, 3);
+  append(map_v3, 2);
+  append(map_v3, 2);
+  for (auto offset : {0, 3, 11}) {
+    append(map_v3, offset);
+  }
+  for (auto item : {std::vector<uint32_t>{0, 1, 7, 5, 2},
+                    std::vector<uint32_t>{0, 1, 1, 6, 9}}) {
+    for (auto value : item) {
+      append(map_v3, value);
+    }
+  }
+  map_v3 += "Foobar.java";
+  auto path = dir / "map_v3";
+  write_file(path, map_v3);
+
+  auto map = read_map(path.string().c_str());
+  ASSERT_TRUE(map != nullptr);
+  EXPECT_EQ(map->string(1), "bar.java");
+  EXPECT_EQ(show_stack(get_stack(*map, 0)),
+            "Foo.bar.java(:5)\n"
+            "Foo.bar.java(bar.java:6)\n");
+
+  // A truncated map is rejected rather than read past its end.
+  write_file(path, map_v3.substr(0, map_v3.size() - 1));
+  EXPECT_TRUE(read_map(path.string().c_str()) == nullptr);
+}
@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <unistd.h>
+
+#include "Creators.h"
+#include "DexAnnotation.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "ProgramSnapshot.h"
+#include "RedexContext.h"
+
+namespace {
+
+DexField* make_field(const char* descriptor,
+                     DexAccessFlags access,
+                     DexEncodedValue* value = nullptr) {
+  auto field = static_cast<DexField*>(DexField::make_field(descriptor));
+  field->make_concrete(access, value);
+  return field;
+}
+
+DexAnnotationSet* make_annotation_set() {
+  auto anno = new DexAnnotation(DexType::make_type("LAnno;"), DAV_RUNTIME);
+  auto values = new std::deque<DexEncodedValue*>();
+  values->push_back(new DexEncodedValueType(get_int_type()));
+  values->push_back(new DexEncodedValueString(DexString::make_string("v")));
+  anno->add_element("value", new DexEncodedValueArray(values));
+  auto aset = new DexAnnotationSet();
+  aset->add_annotation(anno);
+  return aset;
+}
+
+/*
+ * Builds LFoo; with static values, annotations and a method whose code has
+ * all the kinds of MethodItemEntries, including positions whose parents are
+ * either in the same code or outside of any code.
+ */
+DexStoresVector make_stores(DexPosition* callsite) {
+  auto type = DexType::make_type("LFoo;");
+  ClassCreator cc(type, "foo.dex");
+  cc.set_super(get_object_type());
+  cc.set_access(ACC_PUBLIC);
+
+  auto count = DexEncodedValue::zero_for_type(get_int_type());
+  count->value(42);
+  cc.add_field(make_field("LFoo;.count:I", ACC_PUBLIC | ACC_STATIC, count));
+  cc.add_field(make_field(
+      "LFoo;.name:Ljava/lang/String;",
+      ACC_PUBLIC | ACC_STATIC,
+      new DexEncodedValueString(DexString::make_string("hello"))));
+  cc.add_field(make_field("LFoo;.next:LFoo;", ACC_PRIVATE));
+
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo;.run:(I)I"));
+  method->attach_param_annotation_set(0, make_annotation_set());
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  method->rstate.set_keep();
+  method->rstate.increment_keep_count();
+  method->set_deobfuscated_name("LFoo;.doRun:(I)I");
+
+  auto code = std::make_unique<IRCode>();
+  code->set_registers_size(2);
+  code->push_back((new IRInstruction(IOPCODE_LOAD_PARAM))->set_dest(1));
+
+  auto outer = std::make_unique<DexPosition>(10);
+  outer->bind(method, DexString::make_string("Foo.java"));
+  outer->parent = callsite;
+  auto outer_ptr = outer.get();
+  code->push_back(std::move(outer));
+
+  auto catch_mie = new MethodItemEntry(DexType::make_type("LBar;"));
+  auto catch_all = new MethodItemEntry(static_cast<DexType*>(nullptr));
+  catch_mie->centry->next = catch_all;
+  code->push_back(TRY_START, catch_mie);
+  auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+  invoke->set_method(DexMethod::make_method("LFoo;.helper:(I)V"));
+  invoke->set_arg_word_count(1);
+  invoke->set_src(0, 1);
+  code->push_back(invoke);
+  code->push_back(TRY_END, catch_mie);
+
+  auto inner = std::make_unique<DexPosition>(20);
+  inner->bind(method, DexString::make_string("Foo.java"));
+  inner->parent = outer_ptr;
+  code->push_back(std::move(inner));
+  code->push_back(std::make_unique<DexDebugOpcodeStartLocal>(
+      1, DexString::make_string("x"), get_int_type()));
+  code->push_back(std::make_unique<DexDebugInstruction>(DBG_ADVANCE_LINE, -3));
+
+  const uint16_t array_data[] = {FOPCODE_FILLED_ARRAY, 2, 2, 0, 7, 9};
+  code->push_back((new IRInstruction(OPCODE_NEW_ARRAY))
+                      ->set_type(DexType::make_type("[I"))
+                      ->set_src(0, 1));
+  code->push_back((new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT))
+                      ->set_dest(0));
+  code->push_back((new IRInstruction(OPCODE_FILL_ARRAY_DATA))
+                      ->set_data(new DexOpcodeData(array_data, 5))
+                      ->set_src(0, 0));
+
+  auto switch_mie =
+      new MethodItemEntry((new IRInstruction(OPCODE_PACKED_SWITCH))
+                              ->set_src(0, 1));
+  code->push_back(*switch_mie);
+  code->push_back();
+  code->push_back((new IRInstruction(OPCODE_CONST))->set_literal(-1)
+                      ->set_dest(0));
+  code->push_back((new IRInstruction(OPCODE_RETURN))->set_src(0, 0));
+  code->push_back(new BranchTarget(switch_mie, 3));
+  code->push_back((new IRInstruction(OPCODE_CONST))
+                      ->set_literal(0x123456789LL)
+                      ->set_dest(0));
+  code->push_back((new IRInstruction(OPCODE_RETURN))->set_src(0, 0));
+
+  code->push_back(*catch_mie);
+  code->push_back(*catch_all);
+  code->push_back((new IRInstruction(OPCODE_MOVE_EXCEPTION))->set_dest(0));
+  code->push_back((new IRInstruction(OPCODE_RETURN))->set_src(0, 1));
+  method->set_code(std::move(code));
+  cc.add_method(method);
+
+  auto cls = cc.create();
+  cls->attach_annotation_set(make_annotation_set());
+  cls->set_source_file(DexString::make_string("Foo.java"));
+  cls->rstate.ref_by_string();
+
+  DexMetadata metadata;
+  metadata.set_id("store");
+  metadata.get_dependencies().push_back("classes");
+  DexStore store(metadata);
+  store.add_classes({cls});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+std::string write(const DexStoresVector& stores, const std::string& metadata) {
+  std::ostringstream out;
+  write_program_snapshot(stores, metadata, out);
+  return out.str();
+}
+
+} // namespace
+
+TEST(ProgramSnapshotTest, round_trip) {
+  g_redex = new RedexContext();
+  auto callsite = std::make_unique<DexPosition>(5);
+  callsite->bind(static_cast<DexMethod*>(
+                     DexMethod::make_method("LCaller;.call:()V")),
+                 DexString::make_string("Caller.java"));
+  callsite->parent = nullptr;
+  auto snapshot = write(make_stores(callsite.get()), "metadata");
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  std::istringstream in(snapshot);
+  std::string metadata;
+  auto stores = read_program_snapshot(in, &metadata);
+  EXPECT_EQ(metadata, "metadata");
+  EXPECT_EQ(write(stores, metadata), snapshot);
+
+  ASSERT_EQ(stores.size(), 1);
+  EXPECT_EQ(stores[0].get_name(), "store");
+  EXPECT_EQ(stores[0].get_dependencies(), std::vector<std::string>{"classes"});
+  ASSERT_EQ(stores[0].get_dexen().size(), 1);
+  ASSERT_EQ(stores[0].get_dexen()[0].size(), 1);
+
+  auto cls = type_class(DexType::get_type("LFoo;"));
+  ASSERT_NE(cls, nullptr);
+  EXPECT_EQ(cls, stores[0].get_dexen()[0][0]);
+  EXPECT_EQ(cls->get_dex_location(), "foo.dex");
+  EXPECT_EQ(cls->get_super_class(), get_object_type());
+  EXPECT_TRUE(cls->rstate.is_referenced_by_string());
+  ASSERT_NE(cls->get_anno_set(), nullptr);
+  EXPECT_EQ(cls->get_anno_set()->size(), 1);
+
+  ASSERT_EQ(cls->get_sfields().size(), 2);
+  ASSERT_EQ(cls->get_ifields().size(), 1);
+  EXPECT_EQ(cls->get_sfields()[0]->get_static_value()->value(), 42);
+
+  ASSERT_EQ(cls->get_dmethods().size(), 1);
+  auto method = cls->get_dmethods()[0];
+  EXPECT_EQ(method->get_deobfuscated_name(), "LFoo;.doRun:(I)I");
+  EXPECT_FALSE(method->rstate.can_delete());
+  EXPECT_EQ(method->get_param_anno()->size(), 1);
+
+  std::vector<DexPosition*> positions;
+  for (const auto& mie : *method->get_code()) {
+    if (mie.type == MFLOW_POSITION) {
+      positions.push_back(mie.pos.get());
+    }
+  }
+  ASSERT_EQ(positions.size(), 2);
+  EXPECT_EQ(positions[1]->parent, positions[0]);
+  ASSERT_NE(positions[0]->parent, nullptr);
+  EXPECT_EQ(positions[0]->parent->line, 5);
+  EXPECT_EQ(positions[0]->parent->method,
+            DexMethod::get_method("LCaller;.call:()V"));
+  delete g_redex;
+}
+
+TEST(ProgramSnapshotTest, external_parent_chain) {
+  g_redex = new RedexContext();
+  // Three inlined callsites outside of any code, each the parent of the next.
+  auto caller =
+      static_cast<DexMethod*>(DexMethod::make_method("LCaller;.call:()V"));
+  std::vector<std::unique_ptr<DexPosition>> chain;
+  for (uint32_t line = 1; line <= 3; ++line) {
+    auto callsite = std::make_unique<DexPosition>(line);
+    callsite->bind(caller, DexString::make_string("Caller.java"));
+    callsite->parent = chain.empty() ? nullptr : chain.back().get();
+    chain.push_back(std::move(callsite));
+  }
+
+  auto type = DexType::make_type("LBaz;");
+  ClassCreator cc(type);
+  cc.set_super(get_object_type());
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LBaz;.run:()V"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+  auto code = std::make_unique<IRCode>();
+  code->set_registers_size(0);
+  // The first position brings in the whole chain, the others refer back to
+  // each link of it.
+  for (size_t parent : {2, 1, 0, 2}) {
+    auto pos = std::make_unique<DexPosition>(10 + parent);
+    pos->bind(method, DexString::make_string("Baz.java"));
+    pos->parent = chain[parent].get();
+    code->push_back(std::move(pos));
+  }
+  code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  method->set_code(std::move(code));
+  cc.add_method(method);
+  DexStore store("store");
+  store.add_classes({cc.create()});
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  auto snapshot = write(stores, "");
+  delete g_redex;
+
+  g_redex = new RedexContext();
+  std::istringstream in(snapshot);
+  stores = read_program_snapshot(in, nullptr);
+  EXPECT_EQ(write(stores, ""), snapshot);
+  std::vector<DexPosition*> positions;
+  for (const auto& mie :
+       *type_class(DexType::get_type("LBaz;"))->get_dmethods()[0]->get_code()) {
+    if (mie.type == MFLOW_POSITION) {
+      positions.push_back(mie.pos.get());
+    }
+  }
+  ASSERT_EQ(positions.size(), 4);
+  auto innermost = positions[0]->parent;
+  ASSERT_NE(innermost, nullptr);
+  ASSERT_NE(innermost->parent, nullptr);
+  ASSERT_NE(innermost->parent->parent, nullptr);
+  EXPECT_EQ(innermost->line, 3);
+  EXPECT_EQ(innermost->parent->line, 2);
+  EXPECT_EQ(innermost->parent->parent->line, 1);
+  EXPECT_EQ(innermost->parent->parent->parent, nullptr);
+  EXPECT_EQ(positions[1]->parent, innermost->parent);
+  EXPECT_EQ(positions[2]->parent, innermost->parent->parent);
+  EXPECT_EQ(positions[3]->parent, innermost);
+  delete g_redex;
+}
+
+TEST(ProgramSnapshotTest, key) {
+  Json::Value config;
+  for (const auto& pass : {"PassA", "PassB", "PassA", "PassC"}) {
+    config["redex"]["passes"].append(pass);
+  }
+  auto key = program_snapshot_key({}, config, "PassB");
+  EXPECT_EQ(key.size(), 16);
+
+  // Passes after the snapshot point and the snapshot config are not part of
+  // the key.
+  auto changed = config;
+  changed["redex"]["passes"][3] = "PassD";
+  changed["snapshot"]["dir"] = "/tmp";
+  EXPECT_EQ(program_snapshot_key({}, changed, "PassB"), key);
+  EXPECT_NE(program_snapshot_key({}, changed, "PassA#2"), key);
+  EXPECT_EQ(program_snapshot_key({}, config, "PassA"),
+            program_snapshot_key({}, config, "PassA#1"));
+}
+
+TEST(ProgramSnapshotTest, key_covers_config_files) {
+  char path[] = "/tmp/snapshot_key_XXXXXX";
+  auto fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  close(fd);
+  Json::Value config;
+  config["redex"]["passes"].append("PassA");
+  config["proguard_map"] = path;
+
+  std::ofstream(path) << "LFoo; -> LA;\n";
+  auto key = program_snapshot_key({}, config, "PassA");
+  std::ofstream(path) << "LFoo; -> LB;\n";
+  EXPECT_NE(program_snapshot_key({}, config, "PassA"), key);
+  std::remove(path);
+}
+
+TEST(ProgramSnapshotTest, write_does_not_touch_cfg) {
+  g_redex = new RedexContext();
+  auto stores = make_stores(nullptr);
+  auto expected = write(stores, "");
+
+  auto code = stores[0].get_dexen()[0][0]->get_dmethods()[0]->get_code();
+  code->build_cfg(/* editable */ false);
+  EXPECT_EQ(write(stores, ""), expected);
+  EXPECT_TRUE(code->cfg_built());
+  code->clear_cfg();
+  delete g_redex;
+}
@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <gtest/gtest.h>
 
 #include <sstream>
@@ -39,3 +41,39 @@ TEST(ProguardMapTest, empty) {
   EXPECT_EQ("Landroid/support/v4/app/Fragment;.x:(LA;LA;)LA;", pm.translate_method("Landroid/support/v4/app/Fragment;.stuff:(Lcom/foo/bar;Lcom/foo/bar;)Lcom/foo/bar;"));
   EXPECT_EQ("Lcom/instagram/react/IgNetworkingModule;.translateHeaders:([Lcom/instagram/common/j/a/f;)Lcom/facebook/react/bridge/e;", pm.translate_method("Lcom/instagram/react/IgNetworkingModule;.translateHeaders:([Lcom/instagram/common/api/base/Header;)Lcom/facebook/react/bridge/WritableMap;"));
 }
+
+TEST(ProguardMapTest, from_file) {
+  // No trailing newline, and a member of a class declared further down.
+  const std::string contents =
+      "com.foo.bar -> A:\n"
+      "    com.foo.baz field -> a\n"
+      "    1:1:com.foo.baz method(com.foo.baz[]) -> b\n"
+      "com.foo.baz -> B:";
+  auto path = boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path();
+  {
+    std::ofstream out(path.string());
+    out << contents;
+  }
+  ProguardMap pm(path.string());
+  boost::filesystem::remove(path);
+
+  std::stringstream ss(contents);
+  ProguardMap stream_pm(ss);
+  for (const auto* map : {&pm, &stream_pm}) {
+    EXPECT_EQ("LB;", map->translate_class("Lcom/foo/baz;"));
+    EXPECT_EQ("Lcom/foo/baz;", map->deobfuscate_class("LB;"));
+    EXPECT_EQ("LA;.a:LB;", map->translate_field("Lcom/foo/bar;.field:Lcom/foo/baz;"));
+    EXPECT_EQ("Lcom/foo/bar;.field:Lcom/foo/baz;", map->deobfuscate_field("LA;.a:LB;"));
+    EXPECT_EQ("LA;.b:([LB;)LB;", map->translate_method("Lcom/foo/bar;.method:([Lcom/foo/baz;)Lcom/foo/baz;"));
+    EXPECT_EQ("Lcom/foo/bar;.method:([Lcom/foo/baz;)Lcom/foo/baz;", map->deobfuscate_method("LA;.b:([LB;)LB;"));
+    EXPECT_EQ("LA;.c:I", map->deobfuscate_field("LA;.c:I"));
+  }
+}
+
+TEST(ProguardMapTest, member_before_class) {
+  std::stringstream ss(
+      "    int do1 -> a\n"
+      "com.foo.bar -> A:\n");
+  EXPECT_THROW(ProguardMap pm(ss), std::runtime_error);
+}
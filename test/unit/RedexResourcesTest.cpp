@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/filesystem.hpp>
 #include <map>
 #include <string>
 #include <unordered_map>
@@ -46,3 +47,175 @@ TEST(RedexResources, ReadXmlTagsAndAttributes) {
   auto no_ns_vals = multimap_values_to_set(attribute_values, "onClick");
   EXPECT_EQ(no_ns_vals.size(), 0);
 }
+
+TEST(RedexResources, ScanLayoutsAndNativeLibsInDirectory) {
+  namespace fs = boost::filesystem;
+  auto apk_dir = fs::temp_directory_path() / fs::unique_path();
+  for (const auto& dir : {"res/layout", "res/layout-land", "lib/x86"}) {
+    fs::create_directories(apk_dir / dir);
+  }
+  for (int i = 0; i < 50; i++) {
+    auto name = "example_" + std::to_string(i) + ".xml";
+    fs::copy_file(std::getenv("test_layout_path"),
+                  apk_dir / (i % 2 ? "res/layout" : "res/layout-land") / name);
+  }
+  // The class name runs up to the end of the file, without a terminator.
+  write_entire_file((apk_dir / "lib/x86/libfoo.so").string(),
+                    std::string("\0\0Lcom/example/Native;\0com/example/Last", 39));
+
+  std::unordered_set<std::string> attributes_to_find{"android:onClick"};
+  std::unordered_set<std::string> classes;
+  std::unordered_multimap<std::string, std::string> attribute_values;
+  collect_layout_classes_and_attributes(
+      apk_dir.string(), attributes_to_find, classes, attribute_values);
+
+  std::unordered_set<std::string> file_classes;
+  std::unordered_multimap<std::string, std::string> file_attribute_values;
+  collect_layout_classes_and_attributes_for_file(std::getenv("test_layout_path"),
+                                                 attributes_to_find,
+                                                 file_classes,
+                                                 file_attribute_values);
+  EXPECT_EQ(classes, file_classes);
+  EXPECT_EQ(attribute_values.size(), 50 * file_attribute_values.size());
+  EXPECT_EQ(multimap_values_to_set(attribute_values, "android:onClick"),
+            multimap_values_to_set(file_attribute_values, "android:onClick"));
+
+  auto native_classes = get_native_classes(apk_dir.string());
+  EXPECT_EQ(native_classes.size(), 2);
+  EXPECT_EQ(native_classes.count("Lcom/example/Native;"), 1);
+  EXPECT_EQ(native_classes.count("Lcom/example/Last;"), 1);
+
+  fs::remove_all(apk_dir);
+}
+
+namespace {
+
+// Applies the mapping through ResXMLTree, which is how the files used to be
+// rewritten.
+std::string remap_with_parser(std::string contents,
+                              const std::map<uint32_t, uint32_t>& mapping) {
+  android::ResXMLTree parser;
+  parser.setTo(contents.data(), contents.size());
+  size_t count = 0;
+  uint32_t* ids = parser.getResourceIds(&count);
+  for (size_t i = 0; i < count; ++i) {
+    if (mapping.count(ids[i])) {
+      ids[i] = mapping.at(ids[i]);
+    }
+  }
+  android::ResXMLParser::event_code_t type;
+  do {
+    type = parser.next();
+    if (type == android::ResXMLParser::START_TAG) {
+      for (size_t i = 0; i < parser.getAttributeCount(); ++i) {
+        android::Res_value value;
+        parser.getAttributeValue(i, &value);
+        // Like remap_xml_reference_attributes, only app references and
+        // attributes are remapped.
+        if ((value.dataType == android::Res_value::TYPE_REFERENCE ||
+             value.dataType == android::Res_value::TYPE_ATTRIBUTE) &&
+            value.data > 0x7f000000 && mapping.count(value.data)) {
+          parser.setAttributeData(i, mapping.at(value.data));
+        }
+      }
+    }
+  } while (type != android::ResXMLParser::BAD_DOCUMENT &&
+           type != android::ResXMLParser::END_DOCUMENT);
+  return contents;
+}
+
+} // namespace
+
+TEST(RedexResources, PatchXmlReferencesInPlace) {
+  namespace fs = boost::filesystem;
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(dir);
+  auto original = read_entire_file(std::getenv("test_layout_path"));
+  std::vector<std::string> files;
+  for (int i = 0; i < 20; i++) {
+    files.push_back((dir / ("layout_" + std::to_string(i) + ".xml")).string());
+    write_entire_file(files.back(), original);
+  }
+
+  // The ids of the views, and one of the attribute names.
+  std::map<uint32_t, uint32_t> mapping{{0x7f0b005e, 0x7f0b0001},
+                                       {0x7f0b0060, 0x7f0b0060},
+                                       {0x7f0b0061, 0x7f0b0002},
+                                       {0x010100f4, 0x010100aa}};
+  remap_xml_reference_attributes(files, mapping);
+  auto expected = remap_with_parser(original, mapping);
+  EXPECT_NE(expected, original);
+  for (const auto& file : files) {
+    EXPECT_EQ(read_entire_file(file), expected);
+  }
+
+  android::Res_value inlined;
+  inlined.size = sizeof(android::Res_value);
+  inlined.res0 = 0;
+  inlined.dataType = android::Res_value::TYPE_INT_HEX;
+  inlined.data = 7;
+  EXPECT_EQ(inline_xml_reference_attributes(files, {{0x7f0b0001, inlined}}),
+            files.size());
+
+  android::ResXMLTree parser;
+  auto contents = read_entire_file(files[0]);
+  parser.setTo(contents.data(), contents.size());
+  ASSERT_EQ(parser.getError(), android::NO_ERROR);
+  size_t num_inlined = 0;
+  android::ResXMLParser::event_code_t type;
+  do {
+    type = parser.next();
+    if (type == android::ResXMLParser::START_TAG) {
+      for (size_t i = 0; i < parser.getAttributeCount(); ++i) {
+        android::Res_value value;
+        parser.getAttributeValue(i, &value);
+        if (value.dataType == android::Res_value::TYPE_INT_HEX) {
+          EXPECT_EQ(value.data, 7);
+          ++num_inlined;
+        }
+      }
+    }
+  } while (type != android::ResXMLParser::BAD_DOCUMENT &&
+           type != android::ResXMLParser::END_DOCUMENT);
+  EXPECT_EQ(num_inlined, 1);
+
+  fs::remove_all(dir);
+}
+
+TEST(RedexResources, PatchMalformedXmlThrowsUntouched) {
+  namespace fs = boost::filesystem;
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(dir);
+  auto file = (dir / "malformed.xml").string();
+  auto good_file = (dir / "layout.xml").string();
+  auto original = read_entire_file(std::getenv("test_layout_path"));
+  auto contents = original;
+  // Make the last chunk run past the end of the document, after the resource
+  // map and attributes that would otherwise be remapped.
+  size_t offset = sizeof(android::ResXMLTree_header);
+  size_t last = offset;
+  while (offset < contents.size()) {
+    last = offset;
+    offset += reinterpret_cast<const android::ResChunk_header*>(
+                  contents.data() + offset)
+                  ->size;
+  }
+  reinterpret_cast<android::ResChunk_header*>(&contents[last])->size += 4;
+  write_entire_file(file, contents);
+
+  EXPECT_THROW(
+      remap_xml_reference_attributes(file, {{0x7f0b005e, 0x7f0b0001}}),
+      std::runtime_error);
+  EXPECT_EQ(read_entire_file(file), contents);
+
+  // Patching many files still patches the well formed ones.
+  write_entire_file(good_file, original);
+  std::vector<std::string> files{good_file, file};
+  EXPECT_THROW(
+      remap_xml_reference_attributes(files, {{0x7f0b005e, 0x7f0b0001}}),
+      std::runtime_error);
+  EXPECT_EQ(read_entire_file(file), contents);
+  EXPECT_EQ(read_entire_file(good_file),
+            remap_with_parser(original, {{0x7f0b005e, 0x7f0b0001}}));
+  fs::remove_all(dir);
+}
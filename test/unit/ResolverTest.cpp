@@ -9,6 +9,8 @@
 #include <gtest/gtest.h>
 
 #include "DexClass.h"
+#include "DexUnitTestRunner.h"
+#include "IRInstruction.h"
 #include "Resolver.h"
 #include "Creators.h"
 
@@ -210,3 +212,97 @@ TEST(ResolveField, empty) {
 
   delete g_redex;
 }
+
+TEST(ResolveField, cache_invalidation) {
+  g_redex = new RedexContext();
+  create_scope();
+
+  auto int_t = DexType::get_type("I");
+  DexFieldRef* a_f1 = DexField::get_field(
+      DexType::get_type("A"), DexString::get_string("f1"), int_t);
+  DexFieldRef* fref = make_field_ref(DexType::get_type("C"), "f1", int_t);
+  auto& cache = g_redex->resolver_cache();
+
+  auto before = cache.get_stats();
+  EXPECT_TRUE(resolve_field(fref) == a_f1);
+  EXPECT_TRUE(resolve_field(fref) == a_f1);
+  auto after = cache.get_stats();
+  EXPECT_EQ(after.misses - before.misses, 1u);
+  EXPECT_EQ(after.hits - before.hits, 1u);
+
+  // Shadowing the field in B must be visible through the cache.
+  auto b_f1 = make_field_def(DexType::get_type("B"), "f1", int_t);
+  type_class(DexType::get_type("B"))->add_field(b_f1);
+  EXPECT_TRUE(resolve_field(fref) == b_f1);
+  EXPECT_TRUE(resolve_field(fref, FieldSearch::Instance) == b_f1);
+
+  // Changing the access of a member invalidates, setting it again doesn't.
+  auto generation = cache.generation();
+  b_f1->set_access(b_f1->get_access());
+  EXPECT_EQ(cache.generation(), generation);
+  b_f1->set_access(b_f1->get_access() | ACC_FINAL);
+  EXPECT_NE(cache.generation(), generation);
+
+  // So must re-parenting C.
+  type_class(DexType::get_type("C"))
+      ->set_super_class(DexType::get_type("Ljava/lang/Object;"));
+  EXPECT_TRUE(resolve_field(fref) == nullptr);
+
+  delete g_redex;
+}
+
+namespace {
+
+// Resolves ref, which warms the cache, then erases every virtual method of
+// cls straight from its vector, as passes that bypass DexClass::remove_method
+// do.
+class RawEraseVirtualsPass : public Pass {
+ public:
+  RawEraseVirtualsPass(DexMethodRef* ref, DexClass* cls)
+      : Pass("RawEraseVirtualsPass"), m_ref(ref), m_cls(cls) {}
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {
+    m_resolved = resolve_method(m_ref, MethodSearch::Virtual);
+    m_cls->get_vmethods().clear();
+  }
+  DexMethod* resolved() const { return m_resolved; }
+
+ private:
+  DexMethodRef* m_ref;
+  DexClass* m_cls;
+  DexMethod* m_resolved{nullptr};
+};
+
+} // namespace
+
+TEST(ResolveMethod, raw_erase_invalidated_at_pass_boundary) {
+  g_redex = new RedexContext();
+  DexUnitTestRunner runner;
+  auto foo = runner.create_class("LFoo;");
+  // The type checker runs after the passes and needs well-formed code.
+  for (auto m : foo->get_dmethods()) {
+    m->get_code()->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  }
+  auto void_void =
+      DexProto::make_proto(get_void_type(), DexTypeList::make_type_list({}));
+  auto bar = static_cast<DexMethod*>(DexMethod::make_method(
+      foo->get_type(), DexString::make_string("bar"), void_void));
+  bar->make_concrete(ACC_PUBLIC, true);
+  auto code = std::make_unique<IRCode>(bar, 1);
+  code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  bar->set_code(std::move(code));
+  foo->add_method(bar);
+
+  auto sub_t = DexType::make_type("LSub;");
+  ClassCreator sub_creator(sub_t);
+  sub_creator.set_super(foo->get_type());
+  sub_creator.create();
+  auto ref = DexMethod::make_method(
+      sub_t, DexString::make_string("bar"), void_void);
+
+  RawEraseVirtualsPass pass(ref, foo);
+  runner.run(&pass);
+  EXPECT_EQ(pass.resolved(), bar);
+  EXPECT_EQ(resolve_method(ref, MethodSearch::Virtual), nullptr);
+
+  delete g_redex;
+}
@@ -0,0 +1,327 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <gtest/gtest.h>
+
+#include "Debug.h"
+#include "RedexResources.h"
+#include "ResourceIndex.h"
+#include "androidfw/ResourceTypes.h"
+
+namespace {
+
+struct LoadedTable {
+  explicit LoadedTable(const char* path) {
+    data = map_file(path, file_descriptor, length);
+    always_assert(table.add(data, length) == 0);
+  }
+  ~LoadedTable() { unmap_and_close(file_descriptor, data, length); }
+
+  android::ResTable table;
+  void* data;
+  int file_descriptor;
+  size_t length;
+};
+
+template <typename T>
+size_t append(std::vector<char>& out, const T& value) {
+  auto offset = out.size();
+  out.insert(out.end(), (const char*)&value, (const char*)&value + sizeof(T));
+  return offset;
+}
+
+template <typename T>
+T* at(std::vector<char>& out, size_t offset) {
+  return reinterpret_cast<T*>(out.data() + offset);
+}
+
+void append_string_pool(std::vector<char>& out,
+                        const std::vector<std::string>& strings) {
+  auto start = out.size();
+  android::ResStringPool_header header{};
+  header.header.type = android::RES_STRING_POOL_TYPE;
+  header.header.headerSize = sizeof(header);
+  header.stringCount = strings.size();
+  header.flags = android::ResStringPool_header::UTF8_FLAG;
+  header.stringsStart = sizeof(header) + 4 * strings.size();
+  append(out, header);
+  uint32_t offset = 0;
+  for (const auto& str : strings) {
+    append(out, offset);
+    offset += str.size() + 3;
+  }
+  for (const auto& str : strings) {
+    // The UTF-16 and UTF-8 lengths, which are short here.
+    out.push_back(str.size());
+    out.push_back(str.size());
+    out.insert(out.end(), str.begin(), str.end());
+    out.push_back(0);
+  }
+  out.resize((out.size() + 3) & ~3);
+  at<android::ResChunk_header>(out, start)->size = out.size() - start;
+}
+
+/*
+ * A resource table with one package of num_types types, each with
+ * entries_per_type entries. Every entry is a string, a reference to a random
+ * resource, or a style whose parent and items are random references. The
+ * entries of the last type are all strings. If external_reference is set,
+ * the first entry instead references that id, e.g. in another package.
+ */
+std::vector<char> make_resource_table(size_t num_types,
+                                      size_t entries_per_type,
+                                      uint8_t package_id = 0x7f,
+                                      const std::string& string_value = "value",
+                                      uint32_t external_reference = 0) {
+  std::mt19937 rng(0);
+  size_t t;
+  // Like layouts referencing drawables referencing colors, resources only
+  // reference those of later types, so the graph is shallow.
+  auto random_id = [&]() {
+    auto type = t + 1 + rng() % (num_types - t - 1);
+    return uint32_t(uint32_t(package_id) << 24 | (type + 1) << 16 |
+                    rng() % entries_per_type);
+  };
+  std::vector<char> out;
+  android::ResTable_header table_header{};
+  table_header.header.type = android::RES_TABLE_TYPE;
+  table_header.header.headerSize = sizeof(table_header);
+  table_header.packageCount = 1;
+  append(out, table_header);
+  append_string_pool(out, {string_value});
+
+  auto package_start = out.size();
+  android::ResTable_package package{};
+  package.header.type = android::RES_TABLE_PACKAGE_TYPE;
+  package.header.headerSize = sizeof(package);
+  package.id = package_id;
+  append(out, package);
+  std::vector<std::string> type_names;
+  for (size_t t = 0; t < num_types; t++) {
+    type_names.push_back("type" + std::to_string(t));
+  }
+  at<android::ResTable_package>(out, package_start)->typeStrings =
+      out.size() - package_start;
+  append_string_pool(out, type_names);
+  at<android::ResTable_package>(out, package_start)->keyStrings =
+      out.size() - package_start;
+  std::vector<std::string> keys;
+  for (size_t e = 0; e < entries_per_type; e++) {
+    keys.push_back("res" + std::to_string(e));
+  }
+  append_string_pool(out, keys);
+
+  for (t = 0; t < num_types; t++) {
+    android::ResTable_typeSpec spec{};
+    spec.header.type = android::RES_TABLE_TYPE_SPEC_TYPE;
+    spec.header.headerSize = sizeof(spec);
+    spec.header.size = sizeof(spec) + 4 * entries_per_type;
+    spec.id = t + 1;
+    spec.entryCount = entries_per_type;
+    append(out, spec);
+    out.resize(out.size() + 4 * entries_per_type);
+
+    auto type_start = out.size();
+    android::ResTable_type type{};
+    type.header.type = android::RES_TABLE_TYPE_TYPE;
+    type.header.headerSize = sizeof(type);
+    type.id = t + 1;
+    type.entryCount = entries_per_type;
+    type.entriesStart = sizeof(type) + 4 * entries_per_type;
+    type.config.size = sizeof(type.config);
+    append(out, type);
+    auto offsets_start = out.size();
+    out.resize(out.size() + 4 * entries_per_type);
+    for (size_t e = 0; e < entries_per_type; e++) {
+      *at<uint32_t>(out, offsets_start + 4 * e) =
+          out.size() - type_start - type.entriesStart;
+      android::Res_value value{};
+      value.size = sizeof(value);
+      auto kind = t + 1 == num_types ? 1 : rng() % 4;
+      if (external_reference != 0 && t == 0 && e == 0) {
+        kind = 2;
+      }
+      if (kind == 0) {
+        android::ResTable_map_entry entry{};
+        entry.size = sizeof(entry);
+        entry.flags = android::ResTable_entry::FLAG_COMPLEX;
+        entry.key.index = e;
+        entry.parent.ident = random_id();
+        entry.count = 2;
+        append(out, entry);
+        for (int i = 0; i < 2; i++) {
+          android::ResTable_map map{};
+          map.name.ident = 0x01010000 + i;
+          map.value.size = sizeof(map.value);
+          map.value.dataType = android::Res_value::TYPE_REFERENCE;
+          map.value.data = random_id();
+          append(out, map);
+        }
+        continue;
+      }
+      android::ResTable_entry entry{};
+      entry.size = sizeof(entry);
+      entry.key.index = e;
+      append(out, entry);
+      if (kind == 1) {
+        value.dataType = android::Res_value::TYPE_STRING;
+        value.data = 0;
+      } else {
+        value.dataType = android::Res_value::TYPE_REFERENCE;
+        value.data = kind == 2 && external_reference != 0 && t == 0 && e == 0
+                         ? external_reference
+                         : random_id();
+      }
+      append(out, value);
+    }
+    at<android::ResChunk_header>(out, type_start)->size =
+        out.size() - type_start;
+  }
+  at<android::ResChunk_header>(out, package_start)->size =
+      out.size() - package_start;
+  at<android::ResChunk_header>(out, 0)->size = out.size();
+  return out;
+}
+
+void expect_same_as_table(android::ResTable& table) {
+  ResourceIndex index(table);
+  android::SortedVector<uint32_t> ids;
+  table.getResourceIds(&ids);
+  ASSERT_EQ(index.ids().size(), ids.size());
+  ASSERT_GT(ids.size(), 0);
+
+  for (size_t i = 0; i < ids.size(); i++) {
+    auto id = ids[i];
+    EXPECT_EQ(index.ids()[i], id);
+    EXPECT_TRUE(index.contains(id));
+
+    android::Vector<android::Res_value> values;
+    table.getAllValuesForResource(id, values);
+    auto indexed = index.values(id);
+    ASSERT_EQ(indexed.size(), values.size());
+    for (size_t j = 0; j < values.size(); j++) {
+      EXPECT_EQ(indexed.begin()[j].dataType, values[j].dataType);
+      EXPECT_EQ(indexed.begin()[j].data, values[j].data);
+    }
+
+    std::unordered_set<uint32_t> visited;
+    std::unordered_set<std::string> strings;
+    walk_references_for_resource(id, visited, strings, &table);
+    std::unordered_set<uint32_t> indexed_visited;
+    std::unordered_set<std::string> indexed_strings;
+    index.walk_references(id, indexed_visited, indexed_strings);
+    EXPECT_EQ(indexed_visited, visited);
+    EXPECT_EQ(indexed_strings, strings);
+    EXPECT_EQ(index.reachable_from({id}), visited);
+
+    for (auto target : index.references(id)) {
+      if (index.contains(target)) {
+        auto referrers = index.referenced_by(target);
+        EXPECT_NE(std::find(referrers.begin(), referrers.end(), id),
+                  referrers.end());
+      }
+    }
+  }
+
+}
+
+} // namespace
+
+TEST(ResourceIndexTest, same_as_table) {
+  LoadedTable loaded(std::getenv("test_arsc_path"));
+  expect_same_as_table(loaded.table);
+
+  ResourceIndex index(loaded.table);
+  EXPECT_EQ(index.type(0x7f010000), "dimen");
+  EXPECT_FALSE(index.name(0x7f010000).empty());
+  EXPECT_EQ(index.name_to_ids()[index.name(0x7f010000)][0], 0x7f010000);
+  EXPECT_FALSE(index.contains(0x7f7f7f7f));
+  EXPECT_TRUE(index.values(0x7f7f7f7f).empty());
+}
+
+TEST(ResourceIndexTest, same_as_synthetic_table) {
+  auto data = make_resource_table(4, 300);
+  android::ResTable table;
+  ASSERT_EQ(table.add(data.data(), data.size()), 0);
+  expect_same_as_table(table);
+}
+
+// A string reached through a reference into another package is looked up in
+// the string pool of that package, not of the resource the walk started at.
+TEST(ResourceIndexTest, strings_of_other_packages) {
+  auto other = make_resource_table(2, 10, 0x80, "other");
+  auto app = make_resource_table(2, 10, 0x7f, "app", 0x80020000);
+  android::ResTable table;
+  ASSERT_EQ(table.add(app.data(), app.size()), 0);
+  ASSERT_EQ(table.add(other.data(), other.size()), 0);
+  expect_same_as_table(table);
+
+  std::unordered_set<uint32_t> visited;
+  std::unordered_set<std::string> strings;
+  walk_references_for_resource(0x7f010000, visited, strings, &table);
+  EXPECT_EQ(visited, (std::unordered_set<uint32_t>{0x7f010000, 0x80020000}));
+  EXPECT_EQ(strings, std::unordered_set<std::string>{"other"});
+}
+
+// Set big_arsc_path to time an app's resources instead of 100k synthetic
+// ones.
+TEST(ResourceIndexTest, DISABLED_walk_all_resources) {
+  std::unique_ptr<LoadedTable> loaded;
+  std::vector<char> synthetic;
+  android::ResTable synthetic_table;
+  android::ResTable* table_ptr = &synthetic_table;
+  if (auto path = std::getenv("big_arsc_path")) {
+    loaded = std::make_unique<LoadedTable>(path);
+    table_ptr = &loaded->table;
+  } else {
+    synthetic = make_resource_table(4, 25000);
+    ASSERT_EQ(synthetic_table.add(synthetic.data(), synthetic.size()), 0);
+  }
+  auto& table = *table_ptr;
+  android::SortedVector<uint32_t> ids;
+  table.getResourceIds(&ids);
+
+  auto start = std::chrono::steady_clock::now();
+  size_t visited_by_table = 0;
+  for (size_t i = 0; i < ids.size(); i++) {
+    std::unordered_set<uint32_t> visited;
+    std::unordered_set<std::string> strings;
+    walk_references_for_resource(ids[i], visited, strings, &table);
+    visited_by_table += visited.size();
+  }
+  auto table_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+  start = std::chrono::steady_clock::now();
+  ResourceIndex index(table);
+  auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  size_t visited_by_index = 0;
+  for (auto id : index.ids()) {
+    std::unordered_set<uint32_t> visited;
+    std::unordered_set<std::string> strings;
+    index.walk_references(id, visited, strings);
+    visited_by_index += visited.size();
+  }
+  auto index_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+  EXPECT_EQ(visited_by_index, visited_by_table);
+  printf("%zu resources: table walks %lldms, index build %lldms, "
+         "build and walks %lldms\n",
+         ids.size(),
+         (long long)table_ms,
+         (long long)build_ms,
+         (long long)index_ms);
+}
@@ -0,0 +1,209 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <gtest/gtest.h>
+
+#include "ClassHierarchy.h"
+#include "DexClass.h"
+#include "ScopeHelper.h"
+#include "TypeHierarchyIndex.h"
+#include "TypeSystem.h"
+
+namespace {
+
+/**
+ * Builds a random forest of `num_classes` classes rooted at
+ * java.lang.Object and at an unknown type, where every class implements one
+ * of `num_intfs` interfaces with some probability. Interfaces extend each
+ * other in a random DAG.
+ */
+Scope create_random_scope(size_t num_classes, size_t num_intfs) {
+  std::mt19937 gen(42);
+  Scope scope = create_empty_scope();
+  auto obj_t = get_object_type();
+  auto unknown_t = DexType::make_type("LUnknown;");
+
+  std::vector<DexType*> intfs;
+  for (size_t i = 0; i < num_intfs; ++i) {
+    auto type = DexType::make_type(
+        DexString::make_string("LIntf" + std::to_string(i) + ";"));
+    std::vector<DexType*> supers;
+    if (i > 0 && gen() % 3 == 0) {
+      supers.push_back(intfs[gen() % i]);
+    }
+    scope.push_back(create_internal_class(
+        type, obj_t, supers, ACC_PUBLIC | ACC_INTERFACE));
+    intfs.push_back(type);
+  }
+
+  std::vector<DexType*> classes;
+  for (size_t i = 0; i < num_classes; ++i) {
+    auto type = DexType::make_type(
+        DexString::make_string("LCls" + std::to_string(i) + ";"));
+    DexType* super;
+    if (classes.empty() || gen() % 16 == 0) {
+      super = gen() % 4 == 0 ? unknown_t : obj_t;
+    } else {
+      super = classes[gen() % classes.size()];
+    }
+    std::vector<DexType*> cls_intfs;
+    if (gen() % 4 == 0) {
+      cls_intfs.push_back(intfs[gen() % intfs.size()]);
+    }
+    scope.push_back(create_internal_class(type, super, cls_intfs));
+    classes.push_back(type);
+  }
+  return scope;
+}
+
+bool walk_is_subtype(const DexType* parent, const DexType* child) {
+  while (child != nullptr) {
+    if (child == parent) return true;
+    auto cls = type_class(child);
+    if (cls == nullptr) return false;
+    child = cls->get_super_class();
+  }
+  return false;
+}
+
+} // namespace
+
+TEST(TypeHierarchyIndex, matches_class_hierarchy) {
+  g_redex = new RedexContext();
+  Scope scope = create_random_scope(2000, 50);
+  auto hierarchy = build_type_hierarchy(scope);
+  auto interfaces = build_interface_map(hierarchy);
+  TypeHierarchyIndex index(hierarchy, interfaces);
+
+  std::vector<const DexType*> classes;
+  std::vector<const DexType*> intfs;
+  for (const auto& cls : scope) {
+    (is_interface(cls) ? intfs : classes).push_back(cls->get_type());
+  }
+  classes.push_back(DexType::get_type("LUnknown;"));
+
+  std::mt19937 gen(7);
+  for (size_t i = 0; i < 100000; ++i) {
+    auto parent = classes[gen() % classes.size()];
+    auto child = classes[gen() % classes.size()];
+    EXPECT_EQ(index.is_subtype(parent, child), walk_is_subtype(parent, child))
+        << SHOW(parent) << " " << SHOW(child);
+    auto intf = intfs[gen() % intfs.size()];
+    EXPECT_EQ(index.implements(child, intf), implements(interfaces, child, intf))
+        << SHOW(child) << " " << SHOW(intf);
+  }
+
+  // Dropping an interface from a class only needs that interface re-encoded.
+  for (const auto& cls : scope) {
+    if (is_interface(cls)) continue;
+    const auto& cls_intfs = cls->get_interfaces()->get_type_list();
+    if (cls_intfs.empty()) continue;
+    auto intf = cls_intfs.front();
+    cls->set_interfaces(DexTypeList::make_type_list({}));
+    interfaces = build_interface_map(hierarchy);
+    index.refresh_implementors(intf, interfaces[intf]);
+    for (const auto& type : classes) {
+      EXPECT_EQ(index.implements(type, intf),
+                implements(interfaces, type, intf));
+    }
+    break;
+  }
+
+  delete g_redex;
+}
+
+// Too slow to run with every test; run it with
+// --gtest_also_run_disabled_tests.
+TEST(TypeHierarchyIndex, DISABLED_benchmark) {
+  g_redex = new RedexContext();
+  Scope scope = create_random_scope(50000, 500);
+  TypeSystem type_system(scope);
+  const auto& class_scopes = type_system.get_class_scopes();
+  const auto& hierarchy = class_scopes.get_class_hierarchy();
+  const auto& interfaces = class_scopes.get_interface_map();
+
+  std::vector<const DexType*> classes;
+  std::vector<const DexType*> intfs;
+  for (const auto& cls : scope) {
+    (is_interface(cls) ? intfs : classes).push_back(cls->get_type());
+  }
+  std::mt19937 gen(7);
+  std::vector<std::pair<const DexType*, const DexType*>> subtype_queries;
+  std::vector<std::pair<const DexType*, const DexType*>> implements_queries;
+  for (size_t i = 0; i < 1000000; ++i) {
+    subtype_queries.emplace_back(classes[gen() % classes.size()],
+                                 classes[gen() % classes.size()]);
+    implements_queries.emplace_back(classes[gen() % classes.size()],
+                                    intfs[gen() % intfs.size()]);
+  }
+
+  auto time = [](const char* what, const std::function<size_t()>& f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    auto result = f();
+    auto end = std::chrono::high_resolution_clock::now();
+    printf("%-40s %8.2f ms (%zu)\n",
+           what,
+           std::chrono::duration<double, std::milli>(end - start).count(),
+           result);
+    return result;
+  };
+
+  time("TypeHierarchyIndex::rebuild", [&]() {
+    TypeHierarchyIndex index(hierarchy, interfaces);
+    return index.size();
+  });
+  TypeHierarchyIndex index(hierarchy, interfaces);
+
+  auto walk_subtypes = time("is_subtype (super chain walk)", [&]() {
+    size_t n = 0;
+    for (const auto& q : subtype_queries) {
+      n += walk_is_subtype(q.first, q.second);
+    }
+    return n;
+  });
+  auto index_subtypes = time("is_subtype (TypeHierarchyIndex)", [&]() {
+    size_t n = 0;
+    for (const auto& q : subtype_queries) {
+      n += index.is_subtype(q.first, q.second);
+    }
+    return n;
+  });
+  EXPECT_EQ(walk_subtypes, index_subtypes);
+  // What TypeSystem::is_subtype did before it used the index.
+  auto table_subtypes = time("is_subtype (instanceof table)", [&]() {
+    size_t n = 0;
+    for (const auto& q : subtype_queries) {
+      const auto& p_chain = type_system.parent_chain(q.first);
+      const auto& c_chain = type_system.parent_chain(q.second);
+      n += !p_chain.empty() && p_chain.size() <= c_chain.size() &&
+           c_chain.at(p_chain.size() - 1) == q.first;
+    }
+    return n;
+  });
+  EXPECT_EQ(table_subtypes, index_subtypes);
+
+  auto set_implements = time("implements (InterfaceMap TypeSet)", [&]() {
+    size_t n = 0;
+    for (const auto& q : implements_queries) {
+      n += implements(interfaces, q.first, q.second);
+    }
+    return n;
+  });
+  auto index_implements = time("implements (TypeHierarchyIndex)", [&]() {
+    size_t n = 0;
+    for (const auto& q : implements_queries) {
+      n += index.implements(q.first, q.second);
+    }
+    return n;
+  });
+  EXPECT_EQ(set_implements, index_implements);
+
+  delete g_redex;
+}
@@ -1622,3 +1622,76 @@ TEST(VitualInterfaceResolutionTest, empty) {
 
   delete g_redex;
 }
+
+TEST(ParallelBuild, same_as_serial) {
+  using ScopeCreator = std::vector<DexClass*> (*)();
+  for (ScopeCreator create_scope : {create_scope_1,
+                                    create_scope_2,
+                                    create_scope_3,
+                                    create_scope_4,
+                                    create_scope_5,
+                                    create_scope_6,
+                                    create_scope_7,
+                                    create_scope_8,
+                                    create_scope_9,
+                                    create_scope_10,
+                                    create_scope_11}) {
+    g_redex = new RedexContext();
+    std::vector<DexClass*> scope = create_scope();
+    ClassHierarchy ch = build_type_hierarchy(scope);
+    SignatureMap serial = build_signature_map(ch, 1);
+    SignatureMap parallel = build_signature_map(ch, 4);
+    ASSERT_EQ(serial.size(), parallel.size());
+    for (const auto& protos_it : serial) {
+      const auto& protos = parallel.at(protos_it.first);
+      ASSERT_EQ(protos_it.second.size(), protos.size());
+      for (const auto& scopes_it : protos_it.second) {
+        const auto& scopes = protos.at(scopes_it.first);
+        ASSERT_EQ(scopes_it.second.size(), scopes.size());
+        for (size_t i = 0; i < scopes.size(); ++i) {
+          EXPECT_EQ(scopes_it.second[i].type, scopes[i].type);
+          EXPECT_EQ(scopes_it.second[i].methods, scopes[i].methods);
+          EXPECT_EQ(scopes_it.second[i].interfaces, scopes[i].interfaces);
+        }
+      }
+    }
+    delete g_redex;
+  }
+}
+
+TEST(CachedSignatureMap, invalidation) {
+  g_redex = new RedexContext();
+  std::vector<DexClass*> scope = create_scope_3();
+  ClassHierarchy ch = build_type_hierarchy(scope);
+  auto sm = get_cached_signature_map(ch);
+  EXPECT_EQ(sm, get_cached_signature_map(ch));
+
+  // Adding a method to a class must not return the stale map.
+  auto cls = scope.back();
+  auto meth = static_cast<DexMethod*>(DexMethod::make_method(
+      cls->get_type(),
+      DexString::make_string("cached_sig_map_test"),
+      DexProto::make_proto(get_void_type(), DexTypeList::make_type_list({}))));
+  meth->make_concrete(ACC_PUBLIC, true);
+  cls->add_method(meth);
+  auto new_sm = get_cached_signature_map(ch);
+  EXPECT_NE(sm, new_sm);
+  EXPECT_EQ(new_sm->count(meth->get_name()), 1);
+  EXPECT_EQ(new_sm, get_cached_signature_map(ch));
+  delete g_redex;
+}
+
+TEST(CachedSignatureMap, not_shared_across_contexts) {
+  g_redex = new RedexContext();
+  std::vector<DexClass*> scope = create_scope_3();
+  auto sm = get_cached_signature_map(build_type_hierarchy(scope));
+  delete g_redex;
+
+  // The same classes in a new context may land at the same addresses, but
+  // must not get the map of the old one.
+  g_redex = new RedexContext();
+  scope = create_scope_3();
+  auto new_sm = get_cached_signature_map(build_type_hierarchy(scope));
+  EXPECT_NE(sm, new_sm);
+  delete g_redex;
+}
@@ -6,6 +6,7 @@
  */
 
 #include "DexCommon.h"
+#include <algorithm>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -122,14 +123,15 @@ char* dex_string_by_type_idx(ddump_data* rd, uint16_t typeidx) {
 }
 
 bool find_typeid_for_idx(ddump_data* rd, uint32_t idx, uint16_t* typeidx) {
+  // Type ids are sorted by the index of their descriptor.
   uint32_t* tptr = (uint32_t*)(rd->dexmmap + rd->dexh->type_ids_off);
-  for (uint32_t i = 0; i < rd->dexh->type_ids_size; i++) {
-    if (*tptr++ == idx) {
-      *typeidx = (uint16_t)i;
-      return true;
-    }
+  uint32_t* end = tptr + rd->dexh->type_ids_size;
+  uint32_t* found = std::lower_bound(tptr, end, idx);
+  if (found == end || *found != idx) {
+    return false;
   }
-  return false;
+  *typeidx = (uint16_t)(found - tptr);
+  return true;
 }
 
 char* find_string_in_dex(ddump_data* rd, const char* string, uint32_t* idx) {
@@ -6,15 +6,33 @@
  */
 
 #include <boost/scope_exit.hpp>
+#include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "PositionMap.h"
 
+namespace {
+
+// Reads a uint32 at p if [p, p + 4) is within [p, end), advancing p.
+bool read_u32(const uint8_t*& p, const uint8_t* end, uint32_t* value) {
+  if (end - p < (ptrdiff_t)sizeof(uint32_t)) {
+    return false;
+  }
+  memcpy(value, p, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  return true;
+}
+
+} // namespace
+
+PositionMap::~PositionMap() { munmap(m_mapping, m_mapping_size); }
+
 std::unique_ptr<PositionMap> read_map(const char* filename) {
   int fd = open(filename, O_RDONLY);
   if (fd == -1) {
@@ -22,61 +40,103 @@ std::unique_ptr<PositionMap> read_map(const char* filename) {
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
+  BOOST_SCOPE_EXIT_ALL(=) { close(fd); };
   struct stat buf;
   if (fstat(fd, &buf)) {
     std::cerr << "Cannot fstat file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  uint8_t* mapping = (uint8_t*)mmap(
-      nullptr, buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
-  uint32_t magic = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
+  void* mapping =
+      mmap(nullptr, buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
   if (mapping == MAP_FAILED) {
     std::cerr << "mmap failed for file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  BOOST_SCOPE_EXIT_ALL(=, &buf) {
-    munmap(mapping, buf.st_size);
-  };
-  if (magic != 0xfaceb000) {
+  std::unique_ptr<PositionMap> map(new PositionMap(mapping, buf.st_size));
+
+  auto begin = (const uint8_t*)mapping;
+  auto end = begin + buf.st_size;
+  auto p = begin;
+  uint32_t magic;
+  if (!read_u32(p, end, &magic) || magic != 0xfaceb000) {
     std::cerr << "Magic number mismatch\n";
     return nullptr;
   }
-  uint32_t version = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  if (version != 2) {
+  uint32_t version;
+  if (!read_u32(p, end, &version) || (version != 2 && version != 3)) {
     std::cerr << "Version mismatch\n";
     return nullptr;
   }
+  auto truncated = [&]() {
+    std::cerr << "Map file (" << filename << ") is truncated\n";
+    return nullptr;
+  };
 
-  std::unique_ptr<PositionMap> map(new PositionMap());
-  std::vector<std::string> string_pool;
-  uint32_t spool_count = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  for (uint32_t i = 0; i < spool_count; ++i) {
-    uint32_t ssize = *(uint32_t*)mapping;
-    mapping += sizeof(uint32_t);
-    map->string_pool.emplace_back((const char*)mapping, ssize);
-    mapping += ssize;
+  uint32_t spool_count;
+  if (!read_u32(p, end, &spool_count)) {
+    return truncated();
+  }
+  uint32_t pos_count;
+  if (version == 3) {
+    if (!read_u32(p, end, &pos_count)) {
+      return truncated();
+    }
+    auto offsets = (const uint32_t*)p;
+    uint64_t offsets_size = (uint64_t(spool_count) + 1) * sizeof(uint32_t);
+    uint64_t positions_size = uint64_t(pos_count) * sizeof(PositionItem);
+    if (uint64_t(end - p) < offsets_size + positions_size) {
+      return truncated();
+    }
+    p += offsets_size;
+    map->m_positions = (const PositionItem*)p;
+    p += positions_size;
+    // The strings are laid out in order, so the offsets can't go back.
+    for (uint32_t i = 0; i < spool_count; ++i) {
+      if (offsets[i] > offsets[i + 1]) {
+        std::cerr << "Map file (" << filename
+                  << ") has a corrupt string offset table\n";
+        return nullptr;
+      }
+    }
+    if (uint64_t(end - p) < offsets[spool_count]) {
+      return truncated();
+    }
+    map->m_string_offsets = offsets;
+    map->m_strings = (const char*)p;
+  } else {
+    map->m_v2_strings.reserve(spool_count);
+    for (uint32_t i = 0; i < spool_count; ++i) {
+      uint32_t ssize;
+      if (!read_u32(p, end, &ssize) || uint64_t(end - p) < ssize) {
+        return truncated();
+      }
+      map->m_v2_strings.emplace_back((const char*)p, ssize);
+      p += ssize;
+    }
+    if (!read_u32(p, end, &pos_count) ||
+        uint64_t(end - p) < uint64_t(pos_count) * sizeof(PositionItem)) {
+      return truncated();
+    }
+    map->m_positions = (const PositionItem*)p;
   }
-  uint32_t pos_count = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  map->positions.reset(new PositionItem[pos_count]);
-  map->positions_size = pos_count;
-  memcpy(map->positions.get(), mapping, pos_count * sizeof(PositionItem));
+  map->m_positions_size = pos_count;
+  map->m_strings_size = spool_count;
   return map;
 }
 
 std::vector<Position> get_stack(const PositionMap& map, int64_t idx) {
   std::vector<Position> stack;
-  while (idx >= 0 && (size_t)idx < map.positions_size) {
-    auto pi = map.positions[idx];
-    stack.push_back(Position(map.string_pool[pi.class_id],
-                             map.string_pool[pi.method_id],
-                             map.string_pool[pi.file_id],
-                             pi.line));
+  // Bounding the walk by the number of positions keeps a corrupt map with a
+  // cycle of parents from hanging the caller.
+  while (idx >= 0 && (size_t)idx < map.positions_size() &&
+         stack.size() < map.positions_size()) {
+    const auto& pi = map.position(idx);
+    stack.emplace_back(map.string(pi.class_id),
+                       map.string(pi.method_id),
+                       map.string(pi.file_id),
+                       pi.line);
     idx = (int64_t)pi.parent - 1;
   }
   return stack;
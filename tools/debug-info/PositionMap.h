@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/utility/string_ref.hpp>
 #include <memory>
 #include <string>
 #include <vector>
@@ -17,22 +18,59 @@ struct __attribute__((packed)) PositionItem {
   uint32_t parent;
 };
 
+// The strings point into the map they were looked up in.
 struct Position {
-  std::string cls;
-  std::string method;
-  std::string filename;
+  boost::string_ref cls;
+  boost::string_ref method;
+  boost::string_ref filename;
   uint32_t line;
-  Position(const std::string& cls,
-           const std::string& method,
-           const std::string& filename,
+  Position(boost::string_ref cls,
+           boost::string_ref method,
+           boost::string_ref filename,
            uint32_t line)
       : cls(cls), method(method), filename(filename), line(line) {}
 };
 
-struct PositionMap {
-  std::vector<std::string> string_pool;
-  std::unique_ptr<PositionItem[]> positions;
-  size_t positions_size;
+/*
+ * A line number map, mapped into memory and read in place. Version 3 maps are
+ * used as they are; version 2 maps need an index of where their strings are,
+ * since those are only length-prefixed.
+ */
+class PositionMap {
+ public:
+  ~PositionMap();
+
+  size_t positions_size() const { return m_positions_size; }
+  const PositionItem& position(size_t idx) const { return m_positions[idx]; }
+
+  // An id out of range, as in a corrupt map, yields an empty string.
+  boost::string_ref string(uint32_t id) const {
+    if (id >= m_strings_size) {
+      return boost::string_ref();
+    }
+    if (m_string_offsets == nullptr) {
+      return m_v2_strings[id];
+    }
+    return boost::string_ref(m_strings + m_string_offsets[id],
+                             m_string_offsets[id + 1] - m_string_offsets[id]);
+  }
+
+ private:
+  friend std::unique_ptr<PositionMap> read_map(const char* filename);
+
+  PositionMap(void* mapping, size_t mapping_size)
+      : m_mapping(mapping), m_mapping_size(mapping_size) {}
+
+  void* m_mapping;
+  size_t m_mapping_size;
+  const PositionItem* m_positions{nullptr};
+  size_t m_positions_size{0};
+  size_t m_strings_size{0};
+  // Version 3
+  const uint32_t* m_string_offsets{nullptr};
+  const char* m_strings{nullptr};
+  // Version 2
+  std::vector<boost::string_ref> m_v2_strings;
 };
 
 std::unique_ptr<PositionMap> read_map(const char* filename);
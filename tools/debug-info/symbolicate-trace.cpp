@@ -5,31 +5,205 @@
  * LICENSE file in the root directory of this source tree.
  */
 
-#include <boost/regex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <getopt.h>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <thread>
 
 #include "PositionMap.h"
 
-boost::regex trace_regex(R"/((\s+at\s+[^(]*)\(:(\d+)\)\s?)/");
+namespace {
 
-int main(int argc, char** argv) {
-  if (argc < 2) {
-    std::cerr << "Usage: cat trace | remap mapping_file\n";
-    abort();
-  }
-  auto map = read_map(argv[1]);
-  for (std::string line; std::getline(std::cin, line);) {
-    boost::smatch matches;
-    if (boost::regex_match(line, matches, trace_regex)) {
-      auto idx = std::stoi(matches[2]) - 1;
-      auto stack = get_stack(*map, idx);
-      for (auto pos : stack) {
-        std::cout << matches[1] << "(" << pos.filename << ":" << pos.line
-                  << ")" << std::endl;
+/*
+ * Matches the stack frames whose line numbers index into the map, i.e. whole
+ * lines of the form
+ *
+ *   \s+at\s+[^(]*\(:(\d+)\)\s?
+ *
+ * Sets *prefix_len to the length of the frame up to the '(' and *line to the
+ * number in it.
+ */
+bool match_frame(const char* begin,
+                 const char* end,
+                 size_t* prefix_len,
+                 uint64_t* line) {
+  auto p = begin;
+  auto skip_space = [&]() {
+    auto start = p;
+    while (p < end && isspace((unsigned char)*p)) {
+      ++p;
+    }
+    return p > start;
+  };
+  if (!skip_space() || end - p < 2 || p[0] != 'a' || p[1] != 't') {
+    return false;
+  }
+  p += 2;
+  if (!skip_space()) {
+    return false;
+  }
+  p = std::find(p, end, '(');
+  if (end - p < 2 || p[1] != ':') {
+    return false;
+  }
+  *prefix_len = p - begin;
+  p += 2;
+  auto digits = p;
+  *line = 0;
+  for (; p < end && isdigit((unsigned char)*p); ++p) {
+    *line = std::min<uint64_t>(*line * 10 + (*p - '0'), UINT32_MAX + 1ull);
+  }
+  if (p == digits || p == end || *p != ')') {
+    return false;
+  }
+  ++p;
+  if (p < end && isspace((unsigned char)*p)) {
+    ++p;
+  }
+  return p == end;
+}
+
+// Symbolicates the lines in [begin, end), appending them to out.
+void symbolicate(const PositionMap& map,
+                 const char* begin,
+                 const char* end,
+                 std::string& out) {
+  while (begin < end) {
+    auto eol = std::find(begin, end, '\n');
+    size_t prefix_len;
+    uint64_t line;
+    if (match_frame(begin, eol, &prefix_len, &line)) {
+      for (const auto& pos : get_stack(map, (int64_t)line - 1)) {
+        out.append(begin, prefix_len);
+        out += '(';
+        out.append(pos.filename.data(), pos.filename.size());
+        out += ':';
+        out += std::to_string(pos.line);
+        out += ")\n";
       }
     } else {
-      std::cout << line << std::endl;
+      out.append(begin, eol);
+      out += '\n';
+    }
+    begin = eol + (eol < end);
+  }
+}
+
+// Runs work(i) for each i in [0, n) on up to `jobs` threads.
+template <typename Work>
+void parallel_for(size_t n, unsigned jobs, const Work& work) {
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      work(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < std::min<size_t>(jobs, n); t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+bool read_file(std::istream& in, std::string* contents) {
+  contents->assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+void print_usage() {
+  std::cerr
+      << "Usage: cat trace | symbolicate-trace [options] mapping_file\n"
+         "       symbolicate-trace [options] mapping_file trace_file...\n"
+         "Trace files are symbolicated into <trace_file>.symbolicated.\n"
+         "  -j, --jobs <n>  number of threads to use\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  static const struct option options[] = {
+      {"jobs", required_argument, nullptr, 'j'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "hj:", &options[0], nullptr)) != -1) {
+    switch (c) {
+    case 'j':
+      jobs = std::max(1, atoi(optarg));
+      break;
+    case 'h':
+      print_usage();
+      return 0;
+    default:
+      print_usage();
+      return 1;
     }
   }
+  if (optind >= argc) {
+    print_usage();
+    return 1;
+  }
+  auto map = read_map(argv[optind]);
+  if (!map) {
+    return 1;
+  }
+
+  std::vector<const char*> trace_files(argv + optind + 1, argv + argc);
+  if (!trace_files.empty()) {
+    std::atomic<bool> failed{false};
+    parallel_for(trace_files.size(), jobs, [&](size_t i) {
+      std::string trace;
+      std::ifstream in(trace_files[i], std::ios::binary);
+      if (!in || !read_file(in, &trace)) {
+        std::cerr << "Cannot read " << trace_files[i] << "\n";
+        failed = true;
+        return;
+      }
+      std::string out;
+      symbolicate(*map, trace.data(), trace.data() + trace.size(), out);
+      auto out_path = std::string(trace_files[i]) + ".symbolicated";
+      std::ofstream ofs(out_path, std::ios::binary | std::ios::trunc);
+      if (!ofs.write(out.data(), out.size())) {
+        std::cerr << "Cannot write " << out_path << "\n";
+        failed = true;
+      }
+    });
+    return failed ? 1 : 0;
+  }
+
+  // A single trace on stdin is cut into chunks of whole lines, which are
+  // symbolicated in parallel and printed in order.
+  std::string trace;
+  if (!read_file(std::cin, &trace)) {
+    std::cerr << "Cannot read stdin\n";
+    return 1;
+  }
+  const size_t kChunkSize = 1 << 20;
+  std::vector<std::pair<const char*, const char*>> chunks;
+  auto end = trace.data() + trace.size();
+  for (auto p = trace.data(); p < end;) {
+    auto chunk_end = std::find(p + std::min<size_t>(kChunkSize, end - p) - 1,
+                               end, '\n');
+    chunk_end += chunk_end < end;
+    chunks.emplace_back(p, chunk_end);
+    p = chunk_end;
+  }
+  std::vector<std::string> outs(chunks.size());
+  parallel_for(chunks.size(), jobs, [&](size_t i) {
+    symbolicate(*map, chunks[i].first, chunks[i].second, outs[i]);
+  });
+  for (const auto& out : outs) {
+    std::cout.write(out.data(), out.size());
+  }
 }
@@ -5,33 +5,374 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <fcntl.h>
 #include <getopt.h>
+#include <memory>
+#include <regex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "DexCommon.h"
 
+/*
+ * Searches dex files for the classes they define, or the descriptors of the
+ * methods, fields and strings they refer to. The files are searched in
+ * parallel, and the matches are printed in the order of the files, and
+ * within a file in the order of its class defs and ids.
+ *
+ * With an index directory, the descriptors of each dex are written there the
+ * first time it is searched, keyed by a hash of its contents, and read back
+ * by later searches instead of being rebuilt from the dex. Exact searches
+ * binary search the sorted order kept in the index.
+ */
+
+namespace {
+
+enum Kind { CLASS, METHOD, FIELD, STRING, NUM_KINDS };
+
+const char* const kind_names[] = {"class", "method", "field", "string"};
+
+struct Query {
+  std::string pattern;
+  std::unique_ptr<std::regex> regex;
+  bool exact{false};
+  bool kinds[NUM_KINDS]{true, false, false, false};
+
+  bool matches(const char* str) const {
+    if (regex) {
+      return std::regex_search(str, *regex);
+    }
+    if (exact) {
+      return pattern == str;
+    }
+    return strstr(str, pattern.c_str()) != nullptr;
+  }
+};
+
+/*
+ * The descriptors of one kind, in the order of the dex, and the positions of
+ * those in sorted order. Either built from a dex or read from an index file,
+ * in which case they point into its mapping.
+ */
+struct Descriptors {
+  std::vector<std::string> owned;
+  std::vector<const char*> strs;
+  std::vector<uint32_t> sorted;
+
+  void sort() {
+    strs.clear();
+    strs.reserve(owned.size());
+    for (const auto& str : owned) {
+      strs.push_back(str.c_str());
+    }
+    sorted.resize(strs.size());
+    for (uint32_t i = 0; i < sorted.size(); i++) {
+      sorted[i] = i;
+    }
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+      return strcmp(strs[a], strs[b]) < 0;
+    });
+  }
+};
+
+/*
+ * A mapped index file, released when it goes out of scope.
+ */
+struct IndexMapping {
+  const char* data{nullptr};
+  size_t size{0};
+
+  IndexMapping() = default;
+  IndexMapping(const IndexMapping&) = delete;
+  IndexMapping& operator=(const IndexMapping&) = delete;
+  ~IndexMapping() {
+    if (data != nullptr) {
+      munmap((void*)data, size);
+    }
+  }
+};
+
+std::string type_list(ddump_data* rd, uint32_t off) {
+  std::string out;
+  if (off == 0) {
+    return out;
+  }
+  auto size = *(uint32_t*)(rd->dexmmap + off);
+  auto types = (uint16_t*)(rd->dexmmap + off + sizeof(uint32_t));
+  for (uint32_t i = 0; i < size; i++) {
+    out += dex_string_by_type_idx(rd, types[i]);
+  }
+  return out;
+}
+
+void build_descriptors(ddump_data* rd, Descriptors* descs) {
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    descs[CLASS].owned.emplace_back(
+        dex_string_by_type_idx(rd, rd->dex_class_defs[i].typeidx));
+  }
+  for (uint32_t i = 0; i < rd->dexh->method_ids_size; i++) {
+    auto& method = rd->dex_method_ids[i];
+    auto& proto = rd->dex_proto_ids[method.protoidx];
+    descs[METHOD].owned.emplace_back(
+        std::string(dex_string_by_type_idx(rd, method.classidx)) + "." +
+        dex_string_by_idx(rd, method.nameidx) + ":(" +
+        type_list(rd, proto.param_off) + ")" +
+        dex_string_by_type_idx(rd, proto.rtypeidx));
+  }
+  for (uint32_t i = 0; i < rd->dexh->field_ids_size; i++) {
+    auto& field = rd->dex_field_ids[i];
+    descs[FIELD].owned.emplace_back(
+        std::string(dex_string_by_type_idx(rd, field.classidx)) + "." +
+        dex_string_by_idx(rd, field.nameidx) + ":" +
+        dex_string_by_type_idx(rd, field.typeidx));
+  }
+  for (uint32_t i = 0; i < rd->dexh->string_ids_size; i++) {
+    descs[STRING].owned.emplace_back(dex_string_by_idx(rd, i));
+  }
+  for (int kind = 0; kind < NUM_KINDS; kind++) {
+    descs[kind].sort();
+  }
+}
+
+/*
+ * Index file layout: "DGI2", then for each kind the number of descriptors,
+ * the descriptors themselves in the order of the dex, NUL-terminated, and
+ * their positions in sorted order, as uint32s.
+ */
+const char kIndexMagic[] = {'D', 'G', 'I', '2'};
+
+/*
+ * Named after an FNV-1a hash of the whole dex rather than the signature in
+ * its header, which nothing checks and which tools may leave stale.
+ */
+std::string index_path(const std::string& index_dir, ddump_data* rd) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (ssize_t i = 0; i < rd->dex_size; i++) {
+    hash ^= (uint8_t)rd->dexmmap[i];
+    hash *= 0x100000001b3ULL;
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "%016llx-%zx.dexgrep",
+           (unsigned long long)hash, (size_t)rd->dex_size);
+  return index_dir + "/" + name;
+}
+
+void write_index(const std::string& path, const Descriptors* descs) {
+  // Identical dex files share an index, and may be searched at the same time.
+  static std::atomic<unsigned> num_written{0};
+  auto tmp_path = path + "." + std::to_string(getpid()) + "." +
+                  std::to_string(num_written++) + ".tmp";
+  FILE* out = fopen(tmp_path.c_str(), "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "Cannot write index %s\n", path.c_str());
+    return;
+  }
+  fwrite(kIndexMagic, sizeof(kIndexMagic), 1, out);
+  for (int kind = 0; kind < NUM_KINDS; kind++) {
+    uint32_t count = descs[kind].strs.size();
+    fwrite(&count, sizeof(count), 1, out);
+    for (auto str : descs[kind].strs) {
+      fwrite(str, strlen(str) + 1, 1, out);
+    }
+    fwrite(descs[kind].sorted.data(), sizeof(uint32_t), count, out);
+  }
+  bool ok = ferror(out) == 0;
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    fprintf(stderr, "Cannot write index %s\n", path.c_str());
+    unlink(tmp_path.c_str());
+  }
+}
+
+/*
+ * Maps the index into :mapping and points the descriptors into it, so they
+ * are only valid while :mapping is.
+ */
+bool read_index(const std::string& path,
+                IndexMapping* mapping,
+                Descriptors* descs) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(kIndexMagic)) {
+    close(fd);
+    return false;
+  }
+  auto data = (const char*)mmap(
+      nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  mapping->data = data;
+  mapping->size = st.st_size;
+  const char* end = data + st.st_size;
+  if (memcmp(data, kIndexMagic, sizeof(kIndexMagic)) != 0) {
+    return false;
+  }
+  const char* cur = data + sizeof(kIndexMagic);
+  for (int kind = 0; kind < NUM_KINDS; kind++) {
+    uint32_t count;
+    if (end - cur < (ptrdiff_t)sizeof(count)) {
+      return false;
+    }
+    memcpy(&count, cur, sizeof(count));
+    cur += sizeof(count);
+    auto& strs = descs[kind].strs;
+    strs.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+      auto nul = (const char*)memchr(cur, '\0', end - cur);
+      if (nul == nullptr) {
+        return false;
+      }
+      strs.push_back(cur);
+      cur = nul + 1;
+    }
+    auto& sorted = descs[kind].sorted;
+    if ((size_t)(end - cur) / sizeof(uint32_t) < count) {
+      return false;
+    }
+    sorted.resize(count);
+    memcpy(sorted.data(), cur, count * sizeof(uint32_t));
+    cur += count * sizeof(uint32_t);
+    for (auto pos : sorted) {
+      if (pos >= count) {
+        return false;
+      }
+    }
+  }
+  return cur == end;
+}
+
+void search(const Query& query,
+            const Descriptors* descs,
+            std::vector<std::string>* matches) {
+  for (int kind = 0; kind < NUM_KINDS; kind++) {
+    if (!query.kinds[kind]) {
+      continue;
+    }
+    const auto& strs = descs[kind].strs;
+    const auto& sorted = descs[kind].sorted;
+    if (query.exact && !query.regex) {
+      auto key = query.pattern.c_str();
+      auto first = std::lower_bound(
+          sorted.begin(), sorted.end(), key,
+          [&](uint32_t a, const char* b) { return strcmp(strs[a], b) < 0; });
+      auto last = std::upper_bound(
+          first, sorted.end(), key,
+          [&](const char* a, uint32_t b) { return strcmp(a, strs[b]) < 0; });
+      std::vector<uint32_t> found(first, last);
+      std::sort(found.begin(), found.end());
+      for (auto pos : found) {
+        matches->emplace_back(strs[pos]);
+      }
+      continue;
+    }
+    for (auto str : strs) {
+      if (query.matches(str)) {
+        matches->emplace_back(str);
+      }
+    }
+  }
+}
+
 void print_usage() {
-  fprintf(stderr, "Usage: dexgrep <classname> <dexfile 1> <dexfile 2> ...\n");
+  fprintf(stderr,
+          "Usage: dexgrep [options] <pattern> <dexfile 1> <dexfile 2> ...\n"
+          "  -l, --files-with-matches  print only the names of the files\n"
+          "  -E, --regex               the pattern is a regular expression\n"
+          "  -x, --exact               match whole descriptors only\n"
+          "  -k, --kinds <kinds>       comma-separated kinds to search: "
+          "class,method,field,string or all (default: class)\n"
+          "  -j, --jobs <n>            number of files to search at once\n"
+          "  -i, --index-dir <dir>     keep and reuse sorted indexes there\n");
+}
+
+bool parse_kinds(const char* arg, Query* query) {
+  std::fill(std::begin(query->kinds), std::end(query->kinds), false);
+  std::string kinds(arg);
+  size_t start = 0;
+  while (start <= kinds.size()) {
+    auto end = kinds.find(',', start);
+    if (end == std::string::npos) {
+      end = kinds.size();
+    }
+    auto kind = kinds.substr(start, end - start);
+    bool found = false;
+    for (int i = 0; i < NUM_KINDS; i++) {
+      if (kind == kind_names[i] || kind == "all") {
+        query->kinds[i] = true;
+        found = true;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "Unknown kind %s\n", kind.c_str());
+      return false;
+    }
+    start = end + 1;
+  }
+  return true;
 }
 
+} // namespace
+
 int main(int argc, char* argv[]) {
   bool files_only = false;
-  char c;
+  bool use_regex = false;
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  std::string index_dir;
+  Query query;
+  int c;
   static const struct option options[] = {
+    { "files-with-matches", no_argument, nullptr, 'l' },
     { "files-without-match", no_argument, nullptr, 'l' },
+    { "regex", no_argument, nullptr, 'E' },
+    { "exact", no_argument, nullptr, 'x' },
+    { "kinds", required_argument, nullptr, 'k' },
+    { "jobs", required_argument, nullptr, 'j' },
+    { "index-dir", required_argument, nullptr, 'i' },
+    { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 },
   };
   while ((c = getopt_long(
             argc,
             argv,
-            "hl",
+            "hlExk:j:i:",
             &options[0],
             nullptr)) != -1) {
     switch (c) {
       case 'l':
         files_only = true;
         break;
+      case 'E':
+        use_regex = true;
+        break;
+      case 'x':
+        query.exact = true;
+        break;
+      case 'k':
+        if (!parse_kinds(optarg, &query)) {
+          print_usage();
+          return 1;
+        }
+        break;
+      case 'j':
+        jobs = std::max(1, atoi(optarg));
+        break;
+      case 'i':
+        index_dir = optarg;
+        break;
       case 'h':
         print_usage();
         return 0;
@@ -41,30 +382,65 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  if (optind == argc) {
+  if (optind + 1 >= argc) {
     fprintf(stderr, "%s: no dex files given\n", argv[0]);
     print_usage();
     return 1;
   }
 
-  const char* search_str = argv[optind];
-
-  for (int i = optind + 1; i < argc; ++i) {
-    const char* dexfile = argv[i];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
+  query.pattern = argv[optind];
+  if (use_regex) {
+    auto pattern = query.exact ? "^(?:" + query.pattern + ")$" : query.pattern;
+    try {
+      query.regex.reset(new std::regex(pattern, std::regex::optimize));
+    } catch (const std::regex_error& e) {
+      fprintf(stderr, "Bad regex %s: %s\n", query.pattern.c_str(), e.what());
+      return 1;
+    }
+  }
 
-    auto size = rd.dexh->class_defs_size;
-    for (uint32_t j = 0; j < size; j++) {
-      dex_class_def* cls_def = rd.dex_class_defs + j;
-      char* name = dex_string_by_type_idx(&rd, cls_def->typeidx);
-      if (strstr(name, search_str) != nullptr) {
-        if (files_only) {
-          printf("%s\n", dexfile);
-        } else {
-          printf("%s: %s\n", dexfile, name);
+  std::vector<const char*> dexfiles(argv + optind + 1, argv + argc);
+  std::vector<std::vector<std::string>> matches(dexfiles.size());
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < dexfiles.size(); i = next++) {
+      ddump_data rd;
+      open_dex_file(dexfiles[i], &rd);
+      Descriptors descs[NUM_KINDS];
+      IndexMapping mapping;
+      auto path = index_dir.empty() ? "" : index_path(index_dir, &rd);
+      if (path.empty() || !read_index(path, &mapping, descs)) {
+        for (auto& desc : descs) {
+          desc.strs.clear();
+          desc.sorted.clear();
+        }
+        build_descriptors(&rd, descs);
+        if (!path.empty()) {
+          write_index(path, descs);
         }
       }
+      search(query, descs, &matches[i]);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < std::min<size_t>(jobs, dexfiles.size()); t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < dexfiles.size(); i++) {
+    if (matches[i].empty()) {
+      continue;
+    }
+    if (files_only) {
+      printf("%s\n", dexfiles[i]);
+      continue;
+    }
+    for (const auto& match : matches[i]) {
+      printf("%s: %s\n", dexfiles[i], match.c_str());
     }
   }
 }
@@ -7,9 +7,41 @@
 
 #include "OatmealUtil.h"
 #include <cerrno>
+#include <cstdarg>
 #include <cstring>
 #include <sys/stat.h>
 
+void appendf(std::string& out, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  va_list args_copy;
+  va_copy(args_copy, args);
+  auto len = vsnprintf(nullptr, 0, fmt, args);
+  va_end(args);
+  if (len > 0) {
+    auto old_size = out.size();
+    out.resize(old_size + len + 1);
+    vsnprintf(&out[old_size], len + 1, fmt, args_copy);
+    out.resize(old_size + len);
+  }
+  va_end(args_copy);
+}
+
+void print_in_order(size_t n,
+                    unsigned num_threads,
+                    const std::function<void(size_t, std::string&)>& format) {
+  num_threads = std::max(1u, num_threads);
+  for (size_t begin = 0; begin < n; begin += num_threads) {
+    auto count = std::min<size_t>(num_threads, n - begin);
+    std::vector<std::string> outs(count);
+    parallel_for(count, num_threads,
+                 [&](size_t i) { format(begin + i, outs[i]); });
+    for (const auto& out : outs) {
+      fwrite(out.data(), 1, out.size(), stdout);
+    }
+  }
+}
+
 void write_buf(FileHandle& fh, ConstBuffer buf) {
   CHECK(fh.fwrite(buf.ptr, sizeof(char), buf.len) == buf.len);
 }
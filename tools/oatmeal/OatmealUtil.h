@@ -11,9 +11,13 @@
 #include "DexOpcodeDefs.h"
 #include "file-utils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <functional>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -54,6 +58,36 @@ static void foreach_pair(const T1& t1, const T2& t2, const L& fn) {
   }
 }
 
+// Runs fn(i) for every i in [0, n) on up to num_threads threads.
+template <typename Fn>
+void parallel_for(size_t n, unsigned num_threads, const Fn& fn) {
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < std::min<size_t>(num_threads, n); t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Appends printf-style formatted text to out.
+void appendf(std::string& out, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Formats the output for items [0, n) on up to num_threads threads and prints
+// it to stdout in order. Only num_threads items' output is held in memory at
+// once.
+void print_in_order(size_t n,
+                    unsigned num_threads,
+                    const std::function<void(size_t, std::string&)>& format);
+
 template <uint32_t Width>
 uint32_t align(uint32_t in) {
   return (in + (Width - 1)) & -Width;
@@ -169,6 +203,26 @@ struct WritableBuffer {
 
 void write_padding(FileHandle& fh, char byte, size_t num);
 
+// A FileHandle that keeps what is written to it in memory, so that a section
+// can be produced on one thread and written to the real file on another.
+class MemoryFileHandle : public FileHandle {
+ public:
+  MemoryFileHandle() : FileHandle(nullptr) {}
+
+  size_t fwrite(const void* p, size_t size, size_t count) override {
+    contents_.append(reinterpret_cast<const char*>(p), size * count);
+    bytes_written_ += size * count;
+    return count;
+  }
+
+  ConstBuffer contents() const {
+    return ConstBuffer{contents_.data(), contents_.size()};
+  }
+
+ private:
+  std::string contents_;
+};
+
 template <typename T>
 void write_obj(FileHandle& fh, const T& obj) {
   write_buf(fh, ConstBuffer{reinterpret_cast<const char*>(&obj), sizeof(T)});
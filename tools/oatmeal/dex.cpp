@@ -653,16 +653,18 @@ void quicken_dex(const char* location,
   }
 }
 
-void print_dex_opcodes(const uint8_t* begin, const size_t size) {
+void print_dex_opcodes(const uint8_t* begin,
+                       const size_t size,
+                       std::string& out) {
   stream::stream_dex(
     begin,
     size,
-    [](DexOpcode opcode, const uint16_t* const insn) {
+    [&out](DexOpcode opcode, const uint16_t* const insn) {
       switch (opcode) {
         case DOPCODE_NOP:
         SWITCH_FORMAT_10
         SWITCH_FORMAT_RETURN_VOID_NO_BARRIER {
-          printf("OPCODE: %02x :: %s :: %04x\n", opcode, ::print(opcode).c_str(), *insn);
+          appendf(out, "OPCODE: %02x :: %s :: %04x\n", opcode, ::print(opcode).c_str(), *insn);
           break;
         }
 
@@ -671,7 +673,7 @@ void print_dex_opcodes(const uint8_t* begin, const size_t size) {
         SWITCH_FORMAT_QUICK_FIELD_REF
         SWITCH_FORMAT_CONST_STRING
         SWITCH_FORMAT_TYPE_REF {
-          printf("OPCODE: %02x :: %s :: %04x%04x\n", opcode, ::print(opcode).c_str(), *insn, *(insn + 1));
+          appendf(out, "OPCODE: %02x :: %s :: %04x%04x\n", opcode, ::print(opcode).c_str(), *insn, *(insn + 1));
           break;
         }
 
@@ -680,12 +682,12 @@ void print_dex_opcodes(const uint8_t* begin, const size_t size) {
         SWITCH_FORMAT_QUICK_METHOD_REF
         SWITCH_FORMAT_CONST_STRING_JUMBO
         SWITCH_FORMAT_FILL_ARRAY {
-          printf("OPCODE: %02x :: %s :: %04x%04x%04x\n", opcode, ::print(opcode).c_str(), *insn, *(insn + 1), *(insn + 2));
+          appendf(out, "OPCODE: %02x :: %s :: %04x%04x%04x\n", opcode, ::print(opcode).c_str(), *insn, *(insn + 1), *(insn + 2));
           break;
         }
 
         SWITCH_FORMAT_50 {
-          printf("OPCODE: %02x :: %s :: %04x%04x%04x%04x%04x\n", opcode, ::print(opcode).c_str(), *insn, *(insn + 1), *(insn + 2), *(insn + 3), *(insn + 4));
+          appendf(out, "OPCODE: %02x :: %s :: %04x%04x%04x%04x%04x\n", opcode, ::print(opcode).c_str(), *insn, *(insn + 1), *(insn + 2), *(insn + 3), *(insn + 4));
           break;
         }
 
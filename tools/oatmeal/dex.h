@@ -95,4 +95,7 @@ class stream {
   static void stream_dex(const uint8_t* begin, const size_t size, InsnWalkerFn walker, CodeItemWalkerFn code_item_walker = nullptr);
 };
 
-void print_dex_opcodes(const uint8_t* begin, const size_t size);
+// Appends a listing of the opcodes in the dex to out.
+void print_dex_opcodes(const uint8_t* begin,
+                       const size_t size,
+                       std::string& out);
@@ -1230,7 +1230,7 @@ class DexFiles {
     }
   }
 
-  void print() {
+  void print(unsigned num_threads) {
     for (const auto& e : headers_) {
       printf("DexFile: { \
       file_size: 0x%08x(%u), \
@@ -1240,11 +1240,12 @@ class DexFiles {
       e.class_defs_size,
       e.class_defs_size);
     }
-    size_t index = 0;
-    for (const auto& e : dexes_) {
-      print_dex_opcodes(reinterpret_cast<const uint8_t*>(e.ptr), headers_[index].file_size);
-      index++;
-    }
+    print_in_order(
+        dexes_.size(), num_threads, [&](size_t index, std::string& out) {
+          print_dex_opcodes(reinterpret_cast<const uint8_t*>(dexes_[index].ptr),
+                            headers_[index].file_size,
+                            out);
+        });
   }
 
   const std::vector<DexFileHeader>& headers() const { return headers_; }
@@ -1266,13 +1267,14 @@ class OatClasses_079 : public OatClasses {
 
   OatClasses_079(const DexFileListing_079& dex_file_listing,
                  const DexFiles& dex_files,
-                 ConstBuffer oat_buf);
+                 ConstBuffer oat_buf,
+                 unsigned num_threads);
 
   MOVABLE(OatClasses_079);
 
-  void print();
+  void print(unsigned num_threads);
 
-  void print_unverified_classes();
+  void print_unverified_classes(unsigned num_threads);
 
   template<typename DexFileType>
   static void write(
@@ -1280,6 +1282,15 @@ class OatClasses_079 : public OatClasses {
       FileHandle& cksum_fh);
 
  protected:
+  // Parses the classes of up to num_threads dex files at once. dex_buf holds
+  // the dex files, oat_buf the class tables.
+  void parse(const DexFileListing_079& dex_file_listing,
+             const DexFiles& dex_files,
+             ConstBuffer oat_buf,
+             ConstBuffer dex_buf,
+             bool allow_compiled_classes,
+             unsigned num_threads);
+
   std::vector<DexClasses> classes_;
 };
 
@@ -1289,46 +1300,23 @@ class OatClasses_124 : public OatClasses_079 {
   OatClasses_124(const DexFileListing_079& dex_file_listing,
                  const DexFiles& dex_files,
                  ConstBuffer oat_buf,
-                 ConstBuffer dex_buf);
+                 ConstBuffer dex_buf,
+                 unsigned num_threads);
 };
 
 OatClasses_124::OatClasses_124(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
                                ConstBuffer oat_buf,
-                               ConstBuffer dex_buf) {
-  foreach_pair(dex_file_listing.dex_files(),
-               dex_files.headers(),
-               [&](const DexFileListing_079::DexFile_079& listing,
-                   const DexFileHeader& header) {
-
-                 auto classes_offset = listing.classes_offset;
-
-                 DexClasses dex_classes;
-                 dex_classes.dex_file = listing.location;
-
-                 DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
-
-                 // classes_offset points to an array of pointers (offsets) to
-                 // ClassInfo
-                 for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-                   ClassInfo info;
-                   uint32_t info_offset;
-                   cur_ma()->memcpyAndMark(
-                       &info_offset,
-                       oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-                       sizeof(uint32_t));
-                   cur_ma()->memcpyAndMark(&info,
-                                           oat_buf.slice(info_offset).ptr,
-                                           sizeof(ClassInfo));
-
-                   // TODO: Handle compiled classes. Need to read method bitmap
-                   // size, and method bitmap.
-                   dex_classes.class_info.push_back(info);
-                   dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-                 }
-                 classes_.push_back(dex_classes);
-               });
+                               ConstBuffer dex_buf,
+                               unsigned num_threads) {
+  // TODO: Handle compiled classes. Need to read method bitmap size, and method
+  // bitmap.
+  parse(dex_file_listing,
+        dex_files,
+        oat_buf,
+        dex_buf,
+        /* allow_compiled_classes */ true,
+        num_threads);
 }
 
 class OatClasses_064 : public OatClasses {
@@ -1351,82 +1339,106 @@ class OatClasses_064 : public OatClasses {
 
 OatClasses_079::OatClasses_079(const DexFileListing_079& dex_file_listing,
                                const DexFiles& dex_files,
-                               ConstBuffer oat_buf) {
-  foreach_pair(
-      dex_file_listing.dex_files(),
-      dex_files.headers(),
-      [&](const DexFileListing_079::DexFile_079& listing,
-          const DexFileHeader& header) {
-
-        auto classes_offset = listing.classes_offset;
-
-        DexClasses dex_classes;
-        dex_classes.dex_file = listing.location;
-
-        DexIdBufs id_bufs(oat_buf, listing.file_offset, header);
-
-        // classes_offset points to an array of pointers (offsets) to
-        // ClassInfo
-        for (unsigned int i = 0; i < header.class_defs_size; i++) {
-
-          ClassInfo info;
-          uint32_t info_offset;
-          cur_ma()->memcpyAndMark(
-              &info_offset,
-              oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
-              sizeof(uint32_t));
-          cur_ma()->memcpyAndMark(
-              &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
+                               ConstBuffer oat_buf,
+                               unsigned num_threads) {
+  parse(dex_file_listing,
+        dex_files,
+        oat_buf,
+        oat_buf,
+        /* allow_compiled_classes */ false,
+        num_threads);
+}
 
-          // TODO: Handle compiled classes. Need to read method bitmap size,
-          // and method bitmap.
-          CHECK(info.type == static_cast<uint16_t>(Type::kOatClassNoneCompiled),
-                "Parsing for compiled classes not implemented");
+void OatClasses_079::parse(const DexFileListing_079& dex_file_listing,
+                           const DexFiles& dex_files,
+                           ConstBuffer oat_buf,
+                           ConstBuffer dex_buf,
+                           bool allow_compiled_classes,
+                           unsigned num_threads) {
+  const auto& listings = dex_file_listing.dex_files();
+  const auto& headers = dex_files.headers();
+  CHECK(listings.size() == headers.size());
+  classes_.resize(listings.size());
+  parallel_for(listings.size(), num_threads, [&](size_t dex_idx) {
+    const auto& listing = listings[dex_idx];
+    const auto& header = headers[dex_idx];
+
+    auto classes_offset = listing.classes_offset;
+
+    auto& dex_classes = classes_[dex_idx];
+    dex_classes.dex_file = listing.location;
+    dex_classes.class_info.reserve(header.class_defs_size);
+    dex_classes.class_names.reserve(header.class_defs_size);
+
+    DexIdBufs id_bufs(dex_buf, listing.file_offset, header);
+
+    // classes_offset points to an array of pointers (offsets) to ClassInfo
+    for (unsigned int i = 0; i < header.class_defs_size; i++) {
+
+      ClassInfo info;
+      uint32_t info_offset;
+      cur_ma()->memcpyAndMark(
+          &info_offset,
+          oat_buf.slice(classes_offset + i * sizeof(uint32_t)).ptr,
+          sizeof(uint32_t));
+      cur_ma()->memcpyAndMark(
+          &info, oat_buf.slice(info_offset).ptr, sizeof(ClassInfo));
+
+      // TODO: Handle compiled classes. Need to read method bitmap size,
+      // and method bitmap.
+      if (!allow_compiled_classes) {
+        CHECK(info.type ==
+                  static_cast<uint16_t>(Type::kOatClassNoneCompiled),
+              "Parsing for compiled classes not implemented");
+      }
 
-          dex_classes.class_info.push_back(info);
-          dex_classes.class_names.push_back(id_bufs.get_class_name(i));
-        }
-        classes_.push_back(dex_classes);
-      });
+      dex_classes.class_info.push_back(info);
+      dex_classes.class_names.push_back(id_bufs.get_class_name(i));
+    }
+  });
 }
 
-void OatClasses_079::print() {
-  for (const auto& e : classes_) {
-    printf("  { Classes for dex %s\n", e.dex_file.c_str());
+void OatClasses_079::print(unsigned num_threads) {
+  print_in_order(classes_.size(), num_threads, [&](size_t i, std::string& out) {
+    const auto& e = classes_[i];
+    appendf(out, "  { Classes for dex %s\n", e.dex_file.c_str());
 
     int count = 0;
     for (const auto& info : e.class_info) {
       if (count == 0) {
-        printf("    ");
+        out += "    ";
       }
-      printf("%s%s ",
-             shortStatusStr(static_cast<Status>(info.status)),
-             shortTypeStr(static_cast<Type>(info.type)));
+      appendf(out,
+              "%s%s ",
+              shortStatusStr(static_cast<Status>(info.status)),
+              shortTypeStr(static_cast<Type>(info.type)));
       count++;
       if (count >= 32) {
-        printf("\n");
+        out += "\n";
         count = 0;
       }
     }
-    printf("  }\n");
-  }
+    out += "  }\n";
+  });
 }
 
-void OatClasses_079::print_unverified_classes() {
+void OatClasses_079::print_unverified_classes(unsigned num_threads) {
   printf("unverified classes:\n");
-  for (const auto& e : classes_) {
-    printf("  %s\n", e.dex_file.c_str());
+  print_in_order(classes_.size(), num_threads, [&](size_t i, std::string& out) {
+    const auto& e = classes_[i];
+    appendf(out, "  %s\n", e.dex_file.c_str());
     foreach_pair(e.class_info,
                  e.class_names,
                  [&](const ClassInfo& info, const std::string& name) {
                    if (info.status <
                        static_cast<int>(Status::kStatusVerified)) {
-                     printf("    %s unverified (status: %s)\n",
-                            name.c_str(),
-                            statusStr(info.status));
+                     appendf(out,
+                             "    %s unverified (status: %s)\n",
+                             name.c_str(),
+                             statusStr(info.status));
                    }
                  });
-  }
+  });
 }
 
 template<typename DexFileType>
@@ -1729,9 +1741,10 @@ class LookupTables {
     }
   }
 
-  void print() {
-    for (const auto& e : tables_) {
-      printf("Type_lookup_table[%s]: { \
+  void print(unsigned num_threads) {
+    print_in_order(tables_.size(), num_threads, [&](size_t t, std::string& out) {
+      const auto& e = tables_[t];
+      appendf(out, "Type_lookup_table[%s]: { \
         num_entries: %u, \
         entries: [",
         e.dex_file.c_str(),
@@ -1739,44 +1752,44 @@ class LookupTables {
       for (unsigned int i = 0; i < e.num_entries; i++) {
         const auto& entry = e.entries[i];
         if (entry.str_offset != 0) {
-          printf("{str: %s, \
+          appendf(out, "{str: %s, \
             str offset: 0x%08x}",
             oat_buf_.slice(e.dex_file_offset + entry.str_offset).ptr,
             entry.str_offset);
         }
       }
-      printf("]}\n");
-    }
+      out += "]}\n";
+    });
   }
 
   static uint32_t numEntries(uint32_t num_classes) {
     return supportedSize(num_classes) ? nextPowerOfTwo(num_classes) : 0u;
   }
 
+  // The tables of up to num_threads dex files are built at once, and written
+  // in the order of dex_files.
   template<typename DexFileType>
   static void write(
       const std::vector<DexInput>& dex_input_vec,
       const std::vector<DexFileType>& dex_files,
-      FileHandle& cksum_fh) {
-    foreach_pair(
-        dex_input_vec,
-        dex_files,
-        [&](const DexInput& dex_input,
-            const DexFileListing_079::DexFile_079& dex_file) {
-          CHECK(dex_file.lookup_table_offset == cksum_fh.bytes_written());
-          const auto num_classes = dex_file.num_classes;
-
-          const auto lookup_table_size = numEntries(num_classes);
-          const auto lookup_table_byte_size =
-              lookup_table_size * sizeof(LookupTableEntry);
-
-          auto lookup_table_buf =
-              build_lookup_table(dex_input.filename, lookup_table_size);
-          auto buf =
-              ConstBuffer{reinterpret_cast<const char*>(lookup_table_buf.get()),
-                          lookup_table_byte_size};
-          write_buf(cksum_fh, buf);
-        });
+      FileHandle& cksum_fh,
+      unsigned num_threads = 1) {
+    CHECK(dex_input_vec.size() == dex_files.size());
+    std::vector<std::unique_ptr<LookupTableEntry[]>> tables(dex_files.size());
+    parallel_for(dex_files.size(), num_threads, [&](size_t i) {
+      tables[i] = build_lookup_table(dex_input_vec[i].filename,
+                                     numEntries(dex_files[i].num_classes));
+    });
+    for (size_t i = 0; i < dex_files.size(); i++) {
+      const auto& dex_file = dex_files[i];
+      CHECK(dex_file.lookup_table_offset == cksum_fh.bytes_written());
+      const auto lookup_table_byte_size =
+          numEntries(dex_file.num_classes) * sizeof(LookupTableEntry);
+      auto buf =
+          ConstBuffer{reinterpret_cast<const char*>(tables[i].get()),
+                      lookup_table_byte_size};
+      write_buf(cksum_fh, buf);
+    }
   }
 
  private:
@@ -1949,7 +1962,8 @@ class LookupTables_Nil : public LookupTables {
   template <typename DexFileListingType>
   static void write(const std::vector<DexInput>&,
                     const DexFileListingType&,
-                    FileHandle&) {}
+                    FileHandle&,
+                    unsigned) {}
 };
 
 // Handles version 064 and 045.
@@ -1983,7 +1997,8 @@ class OatFile_064 : public OatFile {
 
   void print(bool dump_classes,
              bool dump_tables,
-             bool print_unverified_classes) override {
+             bool print_unverified_classes,
+             unsigned num_threads) override {
     printf("Header:\n");
     header_.print();
     printf("Key/Value store:\n");
@@ -1991,7 +2006,7 @@ class OatFile_064 : public OatFile {
     printf("Dex File Listing:\n");
     dex_file_listing_.print();
     printf("Dex Files:\n");
-    dex_files_.print();
+    dex_files_.print(num_threads);
     if (dump_classes) {
       printf("Classes:\n");
       dex_file_listing_.print_classes();
@@ -2046,7 +2061,8 @@ class OatFile_064 : public OatFile {
                       bool write_elf,
                       const std::string& art_image_location,
                       bool samsung_mode,
-                      const QuickData* quick_data);
+                      const QuickData* quick_data,
+                      unsigned num_threads);
 
  private:
   OatFile_064(OatHeader h,
@@ -2076,7 +2092,8 @@ class OatFile_079 : public OatFile {
 
   static std::unique_ptr<OatFile> parse(bool dex_files_only,
                                         ConstBuffer buf,
-                                        size_t oat_offset) {
+                                        size_t oat_offset,
+                                        unsigned num_threads) {
     auto header = OatHeader::parse(buf);
     auto key_value_store = KeyValueStore(
         buf.slice(header.size()).truncate(header.key_value_store_size));
@@ -2096,7 +2113,7 @@ class OatFile_079 : public OatFile {
 
     LookupTables lookup_tables(dfl, dex_files, buf);
 
-    OatClasses_079 oat_classes(dfl, dex_files, buf);
+    OatClasses_079 oat_classes(dfl, dex_files, buf, num_threads);
 
     return std::unique_ptr<OatFile>(new OatFile_079(header,
                                                     key_value_store,
@@ -2109,7 +2126,8 @@ class OatFile_079 : public OatFile {
 
   void print(bool dump_classes,
              bool dump_tables,
-             bool print_unverified_classes) override {
+             bool print_unverified_classes,
+             unsigned num_threads) override {
     printf("Header:\n");
     header_.print();
     printf("Key/Value store:\n");
@@ -2117,18 +2135,18 @@ class OatFile_079 : public OatFile {
     printf("Dex File Listing:\n");
     dex_file_listing_.print();
     printf("Dex Files:\n");
-    dex_files_.print();
+    dex_files_.print(num_threads);
 
     if (dump_tables) {
       printf("LookupTables:\n");
-      lookup_tables_.print();
+      lookup_tables_.print(num_threads);
     }
     if (dump_classes) {
       printf("Classes:\n");
-      oat_classes_.print();
+      oat_classes_.print(num_threads);
     }
     if (print_unverified_classes) {
-      oat_classes_.print_unverified_classes();
+      oat_classes_.print_unverified_classes(num_threads);
     }
   }
 
@@ -2141,7 +2159,8 @@ class OatFile_079 : public OatFile {
                       bool write_elf,
                       const std::string& art_image_location,
                       bool samsung_mode,
-                      const QuickData* quick_data);
+                      const QuickData* quick_data,
+                      unsigned num_threads);
 
   std::vector<OatDexFile> get_oat_dexfiles() override {
     std::vector<OatDexFile> ret;
@@ -2225,7 +2244,8 @@ class OatFile_124 : public OatFile {
   static std::unique_ptr<OatFile> oatfile_124_131_parse(bool dex_files_only,
                                         ConstBuffer buf,
                                         size_t oat_offset,
-                                        const std::vector<DexInput>& dexes) {
+                                        const std::vector<DexInput>& dexes,
+                                        unsigned num_threads) {
     if (dexes.size() != 1) {
       fprintf(stderr,
               "V124/V131 odex files must come accompained with one and only "
@@ -2278,7 +2298,8 @@ class OatFile_124 : public OatFile {
     }
 
     LookupTables lookup_tables(dfl, dex_files, buf);
-    OatClasses_124 oat_classes(dfl, dex_files, buf, dex_file_buf);
+    OatClasses_124 oat_classes(
+        dfl, dex_files, buf, dex_file_buf, num_threads);
 
     return std::unique_ptr<OatFile>(new OatFileType(header,
                                                     key_value_store,
@@ -2292,14 +2313,16 @@ class OatFile_124 : public OatFile {
   static std::unique_ptr<OatFile> parse(bool dex_files_only,
                                         ConstBuffer buf,
                                         size_t oat_offset,
-                                        const std::vector<DexInput>& dexes) {
+                                        const std::vector<DexInput>& dexes,
+                                        unsigned num_threads) {
 
-    return oatfile_124_131_parse<DexFileListing_124, OatFile_124>(dex_files_only, buf, oat_offset, dexes);
+    return oatfile_124_131_parse<DexFileListing_124, OatFile_124>(dex_files_only, buf, oat_offset, dexes, num_threads);
   }
 
   void print(bool dump_classes,
              bool dump_tables,
-             bool print_unverified_classes) override {
+             bool print_unverified_classes,
+             unsigned num_threads) override {
     printf("Header:\n");
     header_.print();
     printf("Key/Value store:\n");
@@ -2307,18 +2330,18 @@ class OatFile_124 : public OatFile {
     printf("Dex File Listing:\n");
     dex_file_listing_->print();
     printf("Dex Files:\n");
-    dex_files_.print();
+    dex_files_.print(num_threads);
 
     if (dump_tables) {
       printf("LookupTables:\n");
-      lookup_tables_.print();
+      lookup_tables_.print(num_threads);
     }
     if (dump_classes) {
       printf("Classes:\n");
-      oat_classes_.print();
+      oat_classes_.print(num_threads);
     }
     if (print_unverified_classes) {
-      oat_classes_.print_unverified_classes();
+      oat_classes_.print_unverified_classes(num_threads);
     }
   }
 
@@ -2333,7 +2356,9 @@ class OatFile_124 : public OatFile {
                       bool write_elf,
                       const std::string& art_image_location,
                       bool samsung_mode,
-                      const QuickData* quick_data);
+                      const QuickData* quick_data,
+                      unsigned num_threads,
+                      std::string& log);
 
   std::vector<OatDexFile> get_oat_dexfiles() override {
     std::vector<OatDexFile> ret;
@@ -2435,7 +2460,8 @@ class OatFile_131 : public OatFile_124 {
 
   void print(bool dump_classes,
              bool dump_tables,
-             bool print_unverified_classes) override {
+             bool print_unverified_classes,
+             unsigned num_threads) override {
     printf("Header:\n");
     header_.print();
     printf("Key/Value store:\n");
@@ -2443,18 +2469,18 @@ class OatFile_131 : public OatFile_124 {
     printf("Dex File Listing:\n");
     dex_file_listing_.print();
     printf("Dex Files:\n");
-    dex_files_.print();
+    dex_files_.print(num_threads);
 
     if (dump_tables) {
       printf("LookupTables:\n");
-      lookup_tables_.print();
+      lookup_tables_.print(num_threads);
     }
     if (dump_classes) {
       printf("Classes:\n");
-      oat_classes_.print();
+      oat_classes_.print(num_threads);
     }
     if (print_unverified_classes) {
-      oat_classes_.print_unverified_classes();
+      oat_classes_.print_unverified_classes(num_threads);
     }
   }
 
@@ -2469,7 +2495,9 @@ class OatFile_131 : public OatFile_124 {
                       bool write_elf,
                       const std::string& art_image_location,
                       bool samsung_mode,
-                      const QuickData* quick_data);
+                      const QuickData* quick_data,
+                      unsigned num_threads,
+                      std::string& log);
 
   std::vector<OatDexFile> get_oat_dexfiles() override {
     std::vector<OatDexFile> ret;
@@ -2535,7 +2563,8 @@ class OatFile_Unknown : public OatFile {
  public:
   void print(bool dump_classes,
              bool dump_tables,
-             bool print_unverified_classes) override {
+             bool print_unverified_classes,
+             unsigned num_threads) override {
     printf("Unknown OAT file version!\n");
     header_.print();
   }
@@ -2574,7 +2603,8 @@ class OatFile_Bad : public OatFile {
  public:
   void print(bool dump_classes,
              bool dump_tables,
-             bool print_unverified_classes) override {
+             bool print_unverified_classes,
+             unsigned num_threads) override {
     printf("Bad magic number:\n");
     header_.print();
   }
@@ -2616,7 +2646,8 @@ OatFile::~OatFile() = default;
 static std::unique_ptr<OatFile> parse_oatfile_impl(
     bool dex_files_only,
     ConstBuffer oatfile_buffer,
-    const std::vector<DexInput>& dexes) {
+    const std::vector<DexInput>& dexes,
+    unsigned num_threads) {
   constexpr size_t kOatElfOffset = 0x1000;
 
   size_t oat_offset = 0;
@@ -2654,11 +2685,12 @@ static std::unique_ptr<OatFile> parse_oatfile_impl(
   case OatVersion::V_079:
   case OatVersion::V_088:
     // 079 and 088 are the same as far as I can tell.
-    return OatFile_079::parse(dex_files_only, oatfile_buffer, oat_offset);
+    return OatFile_079::parse(
+        dex_files_only, oatfile_buffer, oat_offset, num_threads);
   case OatVersion::V_124:
   case OatVersion::V_131:
     return OatFile_124::parse(
-        dex_files_only, oatfile_buffer, oat_offset, dexes);
+        dex_files_only, oatfile_buffer, oat_offset, dexes, num_threads);
   case OatVersion::UNKNOWN:
     return OatFile_Unknown::parse(oatfile_buffer);
   }
@@ -2668,12 +2700,14 @@ static std::unique_ptr<OatFile> parse_oatfile_impl(
 
 std::unique_ptr<OatFile> OatFile::parse(ConstBuffer oatfile_buffer,
                                         const std::vector<DexInput>& dex_files,
-                                        bool dex_files_only) {
-  return parse_oatfile_impl(dex_files_only, oatfile_buffer, dex_files);
+                                        bool dex_files_only,
+                                        unsigned num_threads) {
+  return parse_oatfile_impl(
+      dex_files_only, oatfile_buffer, dex_files, num_threads);
 }
 
 std::unique_ptr<OatFile> OatFile::parse_dex_files_only(ConstBuffer buf) {
-  return parse_oatfile_impl(true, buf, std::vector<DexInput>());
+  return parse_oatfile_impl(true, buf, std::vector<DexInput>(), 1);
 }
 
 std::unique_ptr<OatFile> OatFile::parse_dex_files_only(void* ptr, size_t len) {
@@ -3021,13 +3055,33 @@ template <typename DexFileListingType>
 void write_dex_files(const std::vector<DexInput>& dex_input,
                      const std::vector<DexFileListingType>& dex_files,
                      const QuickData* quick_data,
-                     FileHandle& cksum_fh) {
-  foreach_pair(dex_input,
-               dex_files,
-               [&](const DexInput& input, const DexFileListingType& dex_file) {
-                 CHECK(dex_file.file_offset == cksum_fh.bytes_written());
-                 write_dex_file(input, quick_data, cksum_fh);
-               });
+                     FileHandle& cksum_fh,
+                     unsigned num_threads) {
+  if (quick_data == nullptr || num_threads <= 1) {
+    foreach_pair(
+        dex_input,
+        dex_files,
+        [&](const DexInput& input, const DexFileListingType& dex_file) {
+          CHECK(dex_file.file_offset == cksum_fh.bytes_written());
+          write_dex_file(input, quick_data, cksum_fh);
+        });
+    return;
+  }
+
+  // Quickening is CPU bound, so up to num_threads dex files are quickened
+  // into memory at once, then written out in order.
+  CHECK(dex_input.size() == dex_files.size());
+  for (size_t begin = 0; begin < dex_input.size(); begin += num_threads) {
+    auto count = std::min<size_t>(num_threads, dex_input.size() - begin);
+    std::vector<MemoryFileHandle> quickened(count);
+    parallel_for(count, num_threads, [&](size_t i) {
+      write_dex_file(dex_input[begin + i], quick_data, quickened[i]);
+    });
+    for (size_t i = 0; i < count; i++) {
+      CHECK(dex_files[begin + i].file_offset == cksum_fh.bytes_written());
+      write_buf(cksum_fh, quickened[i].contents());
+    }
+  }
 }
 
 // We only ship to 32 bit platforms so this is always 4.
@@ -3110,7 +3164,8 @@ OatFile::Status build_oatfile(const std::string& oat_file_name,
                               bool write_elf,
                               const std::string& art_image_location,
                               bool samsung_mode,
-                              const QuickData* quick_data) {
+                              const QuickData* quick_data,
+                              unsigned num_threads) {
 
   const std::vector<KeyValueStore::KeyValue> key_value = {
       {"classpath", ""},
@@ -3182,10 +3237,10 @@ OatFile::Status build_oatfile(const std::string& oat_file_name,
     SamsungLookupTablesType::write(dex_input, dex_files, oat_fh);
   }
 
-  write_dex_files(dex_input, dex_files, quick_data, oat_fh);
+  write_dex_files(dex_input, dex_files, quick_data, oat_fh, num_threads);
   OatClassesType::write(dex_files, oat_fh);
 
-  LookupTablesType::write(dex_input, dex_files, oat_fh);
+  LookupTablesType::write(dex_input, dex_files, oat_fh, num_threads);
 
   // Pad with 0s up to oat_size
   write_padding(oat_fh, 0, oat_size - oat_fh.bytes_written());
@@ -3240,7 +3295,8 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
                                       bool write_elf,
                                       const std::string& art_image_location,
                                       bool samsung_mode,
-                                      const QuickData* quick_data) {
+                                      const QuickData* quick_data,
+                                      std::string& log) {
   const std::vector<KeyValueStore::KeyValue> key_value = {
       {"classpath", ""},
       {"compiler-filter", "assume-verified"},
@@ -3276,7 +3332,7 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
   auto header = build_header(
       oat_version, single_dex_input, isa, keyvalue_size, oat_size, nullptr);
 
-  printf("Oat Size: %u\n", oat_size);
+  appendf(log, "Oat Size: %u\n", oat_size);
 
   ////////// Write the file.
 
@@ -3316,7 +3372,7 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
   auto vdex_file_name =
       oat_file_name.substr(0, oat_file_name.size() - 4) + std::string("vdex");
 
-  printf("VDEX output file: %s\n", vdex_file_name.c_str());
+  appendf(log, "VDEX output file: %s\n", vdex_file_name.c_str());
 
   const auto& dex_input_filename = dex_input.filename;
 
@@ -3369,6 +3425,8 @@ OatFile::Status build_vdex_odex_pairs(const std::string& oat_file_name,
   return OatFile::Status::BUILD_SUCCESS;
 }
 
+// The pairs are independent, so up to num_threads of them are built at once.
+// What each build reports is appended to log in the order of dex_input.
 template <typename DexFileListinType>
 OatFile::Status build_oatfile_after_v124(
     const std::string& oat_file_name,
@@ -3378,22 +3436,25 @@ OatFile::Status build_oatfile_after_v124(
     bool write_elf,
     const std::string& art_image_location,
     bool samsung_mode,
-    const QuickData* quick_data) {
+    const QuickData* quick_data,
+    unsigned num_threads,
+    std::string& log) {
   // Make sure the output is a directory where we will place ODEX and VDEX files
   CHECK(oat_file_name[oat_file_name.size() - 1] == '/');
-  OatFile::Status result = OatFile::Status::BUILD_SUCCESS;
+  CHECK(oat_version == OatVersion::V_124 || oat_version == OatVersion::V_131,
+        "must not build vdex/odex pairs for non-Oreo builds");
 
-  for (const auto& dex : dex_input) {
+  std::vector<OatFile::Status> results(dex_input.size());
+  std::vector<std::string> logs(dex_input.size());
+  parallel_for(dex_input.size(), num_threads, [&](size_t i) {
+    const auto& dex = dex_input[i];
     size_t found = dex.filename.find_last_of("/") + 1;
     CHECK(found >= 0);
     auto odex_file_name = dex.filename.substr(found);
     odex_file_name.erase(odex_file_name.size() - 3);
     odex_file_name = oat_file_name + odex_file_name + std::string("odex");
 
-    CHECK(oat_version == OatVersion::V_124 || oat_version == OatVersion::V_131,
-          "must not build vdex/odex pairs for non-Oreo builds");
-
-    auto partial_result = build_vdex_odex_pairs<DexFileListinType>(
+    results[i] = build_vdex_odex_pairs<DexFileListinType>(
           odex_file_name,
           oat_version,
           dex,
@@ -3401,15 +3462,20 @@ OatFile::Status build_oatfile_after_v124(
           write_elf,
           art_image_location,
           samsung_mode,
-          quick_data);
+          quick_data,
+          logs[i]);
+  });
 
-    if (partial_result != OatFile::Status::BUILD_SUCCESS) {
+  OatFile::Status result = OatFile::Status::BUILD_SUCCESS;
+  for (size_t i = 0; i < dex_input.size(); i++) {
+    log += logs[i];
+    if (results[i] != OatFile::Status::BUILD_SUCCESS) {
       fprintf(stderr,
               "Building V124/V131 ODEX/VDEX pair failed for DEX input: %s, "
               "Result: %d\n",
-              dex.filename.c_str(),
-              static_cast<int>(partial_result));
-      result = partial_result;
+              dex_input[i].filename.c_str(),
+              static_cast<int>(results[i]));
+      result = results[i];
     }
   }
   return result;
@@ -3422,7 +3488,8 @@ OatFile::Status OatFile_064::build(const std::string& oat_file_name,
                                    bool write_elf,
                                    const std::string& art_image_location,
                                    bool samsung_mode,
-                                   const QuickData* quick_data) {
+                                   const QuickData* quick_data,
+                                   unsigned num_threads) {
   return build_oatfile<DexFileListing_064,
                        OatClasses_064,
                        LookupTables_Nil,
@@ -3433,7 +3500,8 @@ OatFile::Status OatFile_064::build(const std::string& oat_file_name,
                                             write_elf,
                                             art_image_location,
                                             samsung_mode,
-                                            quick_data);
+                                            quick_data,
+                                            num_threads);
 }
 
 OatFile::Status OatFile_079::build(const std::string& oat_file_name,
@@ -3443,7 +3511,8 @@ OatFile::Status OatFile_079::build(const std::string& oat_file_name,
                                    bool write_elf,
                                    const std::string& art_image_location,
                                    bool samsung_mode,
-                                   const QuickData* quick_data) {
+                                   const QuickData* quick_data,
+                                   unsigned num_threads) {
   return build_oatfile<DexFileListing_079,
                        OatClasses_079,
                        LookupTables,
@@ -3454,7 +3523,8 @@ OatFile::Status OatFile_079::build(const std::string& oat_file_name,
                                                write_elf,
                                                art_image_location,
                                                samsung_mode,
-                                               quick_data);
+                                               quick_data,
+                                               num_threads);
 }
 
 OatFile::Status OatFile_124::build(const std::string& oat_file_name,
@@ -3464,7 +3534,9 @@ OatFile::Status OatFile_124::build(const std::string& oat_file_name,
                                    bool write_elf,
                                    const std::string& art_image_location,
                                    bool samsung_mode,
-                                   const QuickData* quick_data) {
+                                   const QuickData* quick_data,
+                                   unsigned num_threads,
+                                   std::string& log) {
   return build_oatfile_after_v124<DexFileListing_124>(oat_file_name,
                                                dex_input,
                                                oat_version,
@@ -3472,7 +3544,9 @@ OatFile::Status OatFile_124::build(const std::string& oat_file_name,
                                                write_elf,
                                                art_image_location,
                                                samsung_mode,
-                                               quick_data);
+                                               quick_data,
+                                               num_threads,
+                                               log);
 }
 
 OatFile::Status OatFile_131::build(const std::string& oat_file_name,
@@ -3482,7 +3556,9 @@ OatFile::Status OatFile_131::build(const std::string& oat_file_name,
                                    bool write_elf,
                                    const std::string& art_image_location,
                                    bool samsung_mode,
-                                   const QuickData* quick_data) {
+                                   const QuickData* quick_data,
+                                   unsigned num_threads,
+                                   std::string& log) {
   return build_oatfile_after_v124<DexFileListing_131>(oat_file_name,
                                                dex_input,
                                                oat_version,
@@ -3490,7 +3566,9 @@ OatFile::Status OatFile_131::build(const std::string& oat_file_name,
                                                write_elf,
                                                art_image_location,
                                                samsung_mode,
-                                               quick_data);
+                                               quick_data,
+                                               num_threads,
+                                               log);
 }
 
 OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
@@ -3500,11 +3578,14 @@ OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
                                bool write_elf,
                                const std::string& art_image_location,
                                bool samsung_mode,
-                               const std::string& quick_data_location) {
+                               const std::string& quick_data_location,
+                               unsigned num_threads) {
   std::unique_ptr<QuickData> quick_metadata =
       read_quick_data(quick_data_location);
   auto build_fn = [&](const std::string& oat_file_name,
-                      const std::vector<DexInput>& dexes) {
+                      const std::vector<DexInput>& dexes,
+                      unsigned build_threads,
+                      std::string& log) {
     auto version = versionInt(oat_version);
     auto isa = instruction_set(arch);
     switch (version) {
@@ -3517,7 +3598,8 @@ OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
                                 write_elf,
                                 art_image_location,
                                 samsung_mode,
-                                quick_metadata.get());
+                                quick_metadata.get(),
+                                build_threads);
 
     case OatVersion::V_039:
     case OatVersion::V_045:
@@ -3530,7 +3612,8 @@ OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
                                 write_elf,
                                 art_image_location,
                                 samsung_mode,
-                                quick_metadata.get());
+                                quick_metadata.get(),
+                                build_threads);
     case OatVersion::V_124:
       return OatFile_124::build(oat_file_name,
                                 dexes,
@@ -3539,7 +3622,9 @@ OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
                                 write_elf,
                                 art_image_location,
                                 samsung_mode,
-                                quick_metadata.get());
+                                quick_metadata.get(),
+                                build_threads,
+                                log);
     case OatVersion::V_131:
       return OatFile_131::build(oat_file_name,
                                 dexes,
@@ -3548,7 +3633,9 @@ OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
                                 write_elf,
                                 art_image_location,
                                 samsung_mode,
-                                quick_metadata.get());
+                                quick_metadata.get(),
+                                build_threads,
+                                log);
 
     default:
       fprintf(stderr, "version 0x%08x unknown\n", static_cast<int>(version));
@@ -3560,17 +3647,26 @@ OatFile::Status OatFile::build(const std::vector<std::string>& oat_file_names,
     fprintf(stderr, "At least one oat file name required\n");
     return Status::BUILD_ARG_ERROR;
   } else if (oat_file_names.size() == 1) {
-    return build_fn(oat_file_names[0], dex_files);
+    std::string log;
+    auto status = build_fn(oat_file_names[0], dex_files, num_threads, log);
+    fputs(log.c_str(), stdout);
+    return status;
   } else {
     if (oat_file_names.size() != dex_files.size()) {
       fprintf(stderr, "One oat file per dex file required.\n");
       return Status::BUILD_ARG_ERROR;
     }
 
-    for (unsigned int i = 0; i < oat_file_names.size(); i++) {
-      std::vector<DexInput> dex_file;
-      dex_file.push_back(dex_files[i]);
-      auto status = build_fn(oat_file_names[i], dex_file);
+    // Each oat file holds one dex, so the oat files are what is built in
+    // parallel. Their output is printed in order.
+    std::vector<Status> statuses(oat_file_names.size());
+    print_in_order(
+        oat_file_names.size(), num_threads, [&](size_t i, std::string& log) {
+          std::vector<DexInput> dex_file;
+          dex_file.push_back(dex_files[i]);
+          statuses[i] = build_fn(oat_file_names[i], dex_file, 1, log);
+        });
+    for (auto status : statuses) {
       if (status != Status::BUILD_SUCCESS) {
         return status;
       }
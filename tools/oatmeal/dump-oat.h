@@ -68,10 +68,12 @@ class OatFile {
   UNCOPYABLE(OatFile);
   virtual ~OatFile();
 
-  // Reads magic number, returns correct oat file implementation.
+  // Reads magic number, returns correct oat file implementation. The class
+  // tables of up to num_threads dex files are parsed at once.
   static std::unique_ptr<OatFile> parse(ConstBuffer oatfile_buffer,
                                         const std::vector<DexInput>& dexes,
-                                        bool dex_files_only);
+                                        bool dex_files_only,
+                                        unsigned num_threads = 1);
 
   // Like parse, but stops after parsing the dex file listing and dex headers.
   static std::unique_ptr<OatFile> parse_dex_files_only(ConstBuffer buf);
@@ -79,9 +81,12 @@ class OatFile {
 
   virtual std::vector<OatDexFile> get_oat_dexfiles() = 0;
 
+  // Formats up to num_threads dex files at once; the output is the same
+  // whatever the number of threads.
   virtual void print(bool dump_classes,
                      bool dump_tables,
-                     bool print_unverified_classes) = 0;
+                     bool print_unverified_classes,
+                     unsigned num_threads = 1) = 0;
 
   virtual Status status() = 0;
 
@@ -102,6 +107,8 @@ class OatFile {
   // Return the location of the art boot image, or null if there is none.
   virtual std::unique_ptr<std::string> get_art_image_loc() const = 0;
 
+  // Up to num_threads dex files are processed at once. The files written do
+  // not depend on num_threads.
   static Status build(const std::vector<std::string>& oat_files,
                       const std::vector<DexInput>& dex_files,
                       const std::string& oat_version,
@@ -109,7 +116,8 @@ class OatFile {
                       bool write_elf,
                       const std::string& art_image_location,
                       bool samsung_mode,
-                      const std::string& quick_data_location);
+                      const std::string& quick_data_location,
+                      unsigned num_threads = 1);
 };
 
 enum class InstructionSet {
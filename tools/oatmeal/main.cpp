@@ -16,6 +16,7 @@
 #include <wordexp.h>
 #endif
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
@@ -23,6 +24,7 @@
 #include <memory>
 
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -51,6 +53,9 @@ struct Arguments {
 
   bool print_unverified_classes = false;
 
+  // Number of dex files processed at once.
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+
   std::string arch;
 
   std::string art_image_location;
@@ -101,6 +106,7 @@ Arguments parse_args(int argc, char* argv[]) {
       {"samsung-oatformat", no_argument, nullptr, 2},
       {"one-oat-per-dex", no_argument, nullptr, 3},
       {"quickening-data", required_argument, nullptr, 'q'},
+      {"jobs", required_argument, nullptr, 'j'},
       {nullptr, 0, nullptr, 0}};
 
   Arguments ret;
@@ -109,7 +115,7 @@ Arguments parse_args(int argc, char* argv[]) {
 
   int c;
   while ((c = getopt_long(
-              argc, argv, "cetmpdbx:l:o:v:a:", &options[0], nullptr)) != -1) {
+              argc, argv, "cetmpdbx:l:o:v:a:j:", &options[0], nullptr)) != -1) {
     switch (c) {
     case 'd':
       if (ret.action != Action::DUMP && ret.action != Action::NONE) {
@@ -191,6 +197,10 @@ Arguments parse_args(int argc, char* argv[]) {
       ret.quick_data_location = expand(optarg);
       break;
 
+    case 'j':
+      ret.jobs = std::max(1, atoi(optarg));
+      break;
+
     case ':':
       fprintf(stderr, "ERROR: %s requires an argument\n", argv[optind - 1]);
       exit(1);
@@ -268,11 +278,12 @@ int dump(const Arguments& args) {
   CHECK(oatfile_buffer.len > 4);
   if (*(reinterpret_cast<const uint32_t*>(oatfile_buffer.ptr)) == kVdexMagicNum) {
     auto vdexfile = VdexFile::parse(oatfile_buffer);
-    vdexfile->print();
+    vdexfile->print(args.jobs);
     return 0;
   }
   auto oatfile =
-      OatFile::parse(oatfile_buffer, args.dex_files, args.test_is_oatmeal);
+      OatFile::parse(
+          oatfile_buffer, args.dex_files, args.test_is_oatmeal, args.jobs);
 
   if (!oatfile) {
     fprintf(stderr, "Cannot open .oat file %s\n", oat_file_name.c_str());
@@ -283,8 +294,10 @@ int dump(const Arguments& args) {
     return oatfile->created_by_oatmeal();
   }
 
-  oatfile->print(
-      args.dump_classes, args.dump_tables, args.print_unverified_classes);
+  oatfile->print(args.dump_classes,
+                 args.dump_tables,
+                 args.print_unverified_classes,
+                 args.jobs);
 
   if (args.dump_memory_usage) {
     cur_ma()->print();
@@ -326,7 +339,8 @@ int build(const Arguments& args) {
                  args.write_elf,
                  args.art_image_location,
                  args.samsung_mode,
-                 args.quick_data_location);
+                 args.quick_data_location,
+                 args.jobs);
 
   return 0;
 }
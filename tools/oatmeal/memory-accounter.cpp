@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <cstring>
+#include <mutex>
 #include <vector>
 
 namespace {
@@ -153,15 +154,17 @@ class MultiBufferMemoryAccounter : public MemoryAccounter {
 
  private:
   std::vector<MemoryAccounterImpl> accounters_;
+  // Parsing may mark ranges from several threads at once.
+  std::mutex mutex_;
 };
 
 void MultiBufferMemoryAccounter::memcpyAndMark(void* dest,
                                                const char* src,
                                                size_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
   for (auto& a : accounters_) {
-    auto ptr = a.buf_.ptr;
-    char* dst_ptr = reinterpret_cast<char*>(dest);
-    if (ptr <= dest && dest <= dst_ptr + count) {
+    auto base_ptr = a.buf_.ptr;
+    if (base_ptr <= src && src + count <= base_ptr + a.buf_.len) {
       a.memcpyAndMark(dest, src, count);
       return;
     }
@@ -171,6 +174,7 @@ void MultiBufferMemoryAccounter::memcpyAndMark(void* dest,
 
 void MultiBufferMemoryAccounter::markRangeConsumed(const char* ptr,
                                                    uint32_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
   for (auto& a : accounters_) {
     auto base_ptr = a.buf_.ptr;
     if (base_ptr <= ptr && ptr + count <= base_ptr + a.buf_.len) {
@@ -182,6 +186,7 @@ void MultiBufferMemoryAccounter::markRangeConsumed(const char* ptr,
 }
 
 void MultiBufferMemoryAccounter::markBufferConsumed(ConstBuffer subBuffer) {
+  std::lock_guard<std::mutex> lock(mutex_);
   for (auto& a : accounters_) {
     auto base_ptr = a.buf_.ptr;
     auto base_len = a.buf_.len;
@@ -199,12 +204,14 @@ void MultiBufferMemoryAccounter::markBufferConsumed(ConstBuffer subBuffer) {
 }
 
 void MultiBufferMemoryAccounter::print() {
+  std::lock_guard<std::mutex> lock(mutex_);
   for (auto& a : accounters_) {
     a.print();
   }
 }
 
 void MultiBufferMemoryAccounter::addBuffer(ConstBuffer buf) {
+  std::lock_guard<std::mutex> lock(mutex_);
   // Make sure this is no-ones sub-buffer in the currently accounted set.
   for (const auto& a : accounters_) {
     auto a_end = a.buf_.ptr + a.buf_.len;
@@ -117,6 +117,17 @@ for d in $dex_dirs; do
         diff $actual $expected | head -50
         exit 1
       fi
+
+      # The build above used every core; the serial builder must produce the
+      # same bytes.
+      serial_oat=`mktemp`
+      $oatmeal_binary $samsung_flag -v ${version_arg} -a x86 -b -e -j 1 -o $serial_oat $dex_files_arg $dex_locations_args > $serial_oat.output 2>&1 || \
+        echo -e "==============\nExit status $?" >> $serial_oat.output 2>&1
+      if ! cmp $serial_oat $tmp_oat > /dev/null || \
+         ! diff $serial_oat.output $tmp_oat.output > /dev/null; then
+        echo "Parallel build differed from serial build for $d ($version)"
+        exit 1
+      fi
     else
       echo "Updating expected output for $f"
 
@@ -40,7 +40,7 @@ std::unique_ptr<VdexFile> VdexFile::parse(ConstBuffer buf) {
   return std::unique_ptr<VdexFile>(new VdexFile(header, buf));
 }
 
-void VdexFile::print() const {
+void VdexFile::print(unsigned num_threads) const {
   header_.print();
   for (const auto& e : dex_headers_) {
     printf("DexFile: { \
@@ -51,9 +51,9 @@ void VdexFile::print() const {
     e.class_defs_size,
     e.class_defs_size);
   }
-  size_t index = 0;
-  for (const auto& e : dexes_) {
-    print_dex_opcodes(reinterpret_cast<const uint8_t*>(e.ptr), dex_headers_[index].file_size);
-    index++;
-  }
+  print_in_order(dexes_.size(), num_threads, [&](size_t index, std::string& out) {
+    print_dex_opcodes(reinterpret_cast<const uint8_t*>(dexes_[index].ptr),
+                      dex_headers_[index].file_size,
+                      out);
+  });
 }
@@ -65,7 +65,8 @@ class VdexFile {
   MOVABLE(VdexFile);
 
   static std::unique_ptr<VdexFile> parse(ConstBuffer buf);
-  void print() const;
+  // The dex files are formatted on up to num_threads threads.
+  void print(unsigned num_threads = 1) const;
 
  private:
   VdexFile(VdexFileHeader& header, ConstBuffer buf);
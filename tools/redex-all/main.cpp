@@ -45,6 +45,7 @@
 #include "JarLoader.h"
 #include "PassManager.h"
 #include "PassRegistry.h"
+#include "ProgramSnapshot.h"
 #include "ProguardConfiguration.h" // New ProGuard configuration
 #include "ProguardParser.h" // New ProGuard Parser
 #include "ReachableClasses.h"
@@ -376,6 +377,22 @@ Json::Value get_stats(const dex_stats_t& stats) {
   val["num_annotations"] = stats.num_annotations;
   val["num_bytes"] = stats.num_bytes;
   val["num_instructions"] = stats.num_instructions;
+  if (stats.num_coldstart_code_pages_default > 0 ||
+      stats.num_coldstart_string_pages_default > 0) {
+    val["num_coldstart_code_pages"] = stats.num_coldstart_code_pages;
+    val["num_coldstart_code_pages_default"] =
+        stats.num_coldstart_code_pages_default;
+    val["num_coldstart_string_pages"] = stats.num_coldstart_string_pages;
+    val["num_coldstart_string_pages_default"] =
+        stats.num_coldstart_string_pages_default;
+  }
+  if (!stats.section_bytes.empty()) {
+    Json::Value sections(Json::objectValue);
+    for (const auto& it : stats.section_bytes) {
+      sections[it.first] = it.second;
+    }
+    val["section_bytes"] = sections;
+  }
   return val;
 }
 
@@ -477,6 +494,37 @@ void output_moved_methods_map(const char* path, ConfigFiles& cfg) {
 }
 } // namespace
 
+/**
+ * The files whose contents determine the state of the program after any
+ * given pass, for keying program snapshots.
+ */
+std::vector<std::string> get_snapshot_inputs(
+    const char* argv0,
+    const Arguments& args,
+    const std::set<std::string>& library_jars) {
+  std::vector<std::string> inputs;
+  // A snapshot is only valid for the build of redex that wrote it.
+  boost::system::error_code ec;
+  auto self = boost::filesystem::read_symlink("/proc/self/exe", ec);
+  inputs.push_back(ec ? std::string(argv0) : self.string());
+  for (const auto& filename : args.dex_files) {
+    inputs.push_back(filename);
+    if (filename.size() < 5 ||
+        filename.compare(filename.size() - 4, 4, ".dex") != 0) {
+      DexMetadata store_metadata;
+      store_metadata.parse(filename);
+      for (const auto& file_path : store_metadata.get_files()) {
+        inputs.push_back(file_path);
+      }
+    }
+  }
+  inputs.insert(inputs.end(),
+                args.proguard_config_paths.begin(),
+                args.proguard_config_paths.end());
+  inputs.insert(inputs.end(), library_jars.begin(), library_jars.end());
+  return inputs;
+}
+
 int main(int argc, char* argv[]) {
   signal(SIGSEGV, crash_backtrace_handler);
   signal(SIGABRT, crash_backtrace_handler);
@@ -534,14 +582,43 @@ int main(int argc, char* argv[]) {
       }
     }
 
-    DexStore root_store("classes");
+    // With a "snapshot" config, the state of the program after the pass
+    // "after_pass" is written to a snapshot in "dir", or read from there
+    // instead of rerunning the passes if the inputs and the config up to that
+    // pass have not changed.
+    std::string snapshot_pass;
+    std::string snapshot_path;
+    bool resume_from_snapshot = false;
+    const auto& snapshot_config = args.config["snapshot"];
+    if (snapshot_config.isObject()) {
+      snapshot_pass = snapshot_config["after_pass"].asString();
+      auto key =
+          program_snapshot_key(get_snapshot_inputs(argv[0], args, library_jars),
+                               args.config,
+                               snapshot_pass);
+      snapshot_path =
+          snapshot_config["dir"].asString() + "/" + key + ".snapshot";
+      resume_from_snapshot = boost::filesystem::exists(snapshot_path);
+    }
+
     DexStoresVector stores;
-    stores.emplace_back(std::move(root_store));
+    Json::Value input_stats;
+    Json::Value snapshot_metadata;
+
+    if (resume_from_snapshot) {
+      Timer t("Load program snapshot " + snapshot_path);
+      std::ifstream snapshot(snapshot_path, std::ios::binary);
+      std::string metadata;
+      stores = read_program_snapshot(snapshot, &metadata);
+      Json::Reader().parse(metadata, snapshot_metadata);
+      input_stats = snapshot_metadata["input_stats"];
+    } else {
+      DexStore root_store("classes");
+      stores.emplace_back(std::move(root_store));
 
-    dex_stats_t input_totals;
-    std::vector<dex_stats_t> input_dexes_stats;
+      dex_stats_t input_totals;
+      std::vector<dex_stats_t> input_dexes_stats;
 
-    {
       Timer t("Load classes from dexes");
       for (const auto& filename : args.dex_files) {
         if (filename.size() >= 5 &&
@@ -567,6 +644,7 @@ int main(int argc, char* argv[]) {
           stores.emplace_back(std::move(store));
         }
       }
+      input_stats = get_input_stats(input_totals, input_dexes_stats);
     }
 
     Scope external_classes;
@@ -574,21 +652,37 @@ int main(int argc, char* argv[]) {
       Timer t("Load library jars");
       for (const auto& library_jar : library_jars) {
         TRACE(MAIN, 1, "LIBRARY JAR: %s\n", library_jar.c_str());
-        if (!load_jar_file(library_jar.c_str(), &external_classes)) {
-          // Try again with the basedir
-          std::string basedir_path =
-              pg_config.basedirectory + "/" + library_jar.c_str();
-          if (!load_jar_file(basedir_path.c_str())) {
-            std::cerr << "error: library jar could not be loaded: "
-                      << library_jar << std::endl;
-            exit(EXIT_FAILURE);
-          }
-        }
+      }
+      // With a "library_jar_cache_dir", the classes of each library jar are
+      // read from a cache entry there once it has been loaded before.
+      std::vector<std::string> jar_paths;
+      for (const auto& library_jar : library_jars) {
+        // Fall back to the basedir in place, so that the jars keep their
+        // order and the same duplicate classes win.
+        std::string basedir_path =
+            pg_config.basedirectory + "/" + library_jar.c_str();
+        jar_paths.push_back(!boost::filesystem::exists(library_jar) &&
+                                    boost::filesystem::exists(basedir_path)
+                                ? basedir_path
+                                : library_jar);
+      }
+      std::vector<std::string> failed_jars;
+      load_jar_files(jar_paths,
+                     &external_classes,
+                     nullptr,
+                     &failed_jars,
+                     args.config.get("library_jar_cache_dir", "").asString());
+      for (const auto& library_jar : failed_jars) {
+        std::cerr << "error: library jar could not be loaded: " << library_jar
+                  << std::endl;
+      }
+      if (!failed_jars.empty()) {
+        exit(EXIT_FAILURE);
       }
     }
 
     ConfigFiles cfg(args.config);
-    {
+    if (!resume_from_snapshot) {
       Timer t("Deobfuscating dex elements");
       for (auto& store : stores) {
         apply_deobfuscated_names(store.get_dexen(), cfg.get_proguard_map());
@@ -599,6 +693,12 @@ int main(int argc, char* argv[]) {
     auto const& passes = PassRegistry::get().get_passes();
     PassManager manager(passes, pg_config, args.config, args.verify_none_mode,
                         args.art_build);
+    if (resume_from_snapshot) {
+      manager.resume_after(snapshot_pass, snapshot_metadata);
+    } else if (!snapshot_path.empty()) {
+      snapshot_metadata["input_stats"] = input_stats;
+      manager.snapshot_after(snapshot_pass, snapshot_path, snapshot_metadata);
+    }
     instruction_lowering::Stats instruction_lowering_stats;
     {
       Timer t("Running optimization passes");
@@ -623,8 +723,10 @@ int main(int argc, char* argv[]) {
         cfg.metafile(args.config.get("line_number_map", "").asString());
     auto pos_output_v2 =
         cfg.metafile(args.config.get("line_number_map_v2", "").asString());
+    auto pos_output_v3 =
+        cfg.metafile(args.config.get("line_number_map_v3", "").asString());
     std::unique_ptr<PositionMapper> pos_mapper(
-        PositionMapper::make(pos_output, pos_output_v2));
+        PositionMapper::make(pos_output, pos_output_v2, pos_output_v3));
     for (auto& store : stores) {
       Timer t("Writing optimized dexes");
       for (size_t i = 0; i < store.get_dexen().size(); i++) {
@@ -661,7 +763,7 @@ int main(int argc, char* argv[]) {
       auto method_move_map =
           cfg.metafile(args.config.get("method_move_map", "").asString());
       pos_mapper->write_map();
-      stats["input_stats"] = get_input_stats(input_totals, input_dexes_stats);
+      stats["input_stats"] = input_stats;
       stats["output_stats"] = get_output_stats(output_totals,
                                                output_dexes_stats,
                                                manager,
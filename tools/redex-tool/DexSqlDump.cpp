@@ -19,9 +19,25 @@ $ sqlite3 dex.db "SELECT COUNT(*) FROM dex;"   # verify sane-looking value
 $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 <..enter queries..>
 
+For large apps, --format csv writes one CSV file per table into the --output
+directory, plus an import.sql that creates the tables and bulk-loads them:
+
+$ buck run  //native/redex:redex-tool -- dex-sql-dump  \
+      --apkdir <APKDIR> --dexendir <DEXEN_DIR> \
+      --jars <ANDROID_JAR> --proguard-map <RENAME_MAP> \
+      --format csv --output dex_csv
+$ sqlite3 dex.db < dex_csv/import.sql
+
+The CSV files carry explicit ids and no header row, so other databases can
+load them as well (e.g. PostgreSQL's COPY ... WITH (FORMAT csv)).
+
 */
 
-#include <boost/algorithm/string/replace.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <queue>
 #include <vector>
 #include <unordered_map>
@@ -34,6 +50,7 @@ $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 #include "Show.h"
 #include "Tool.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -42,157 +59,37 @@ static std::unordered_map<DexMethod*, int> method_ids;
 static std::unordered_map<DexField*, int> field_ids;
 static std::unordered_map<DexString*, int> string_ids;
 
-void dump_field_refs(FILE* fdout, const char* prefix, DexField* field, int field_id) {
-  static int next_string_ref = 0;
-  auto* static_value = field->get_static_value();
-  if (!static_value || (static_value->evtype() != DEVT_STRING)) return;
-  auto* static_string_value = static_cast<DexEncodedValueString*>(static_value);
-  auto string_id = string_ids[static_string_value->string()];
-  fprintf(
-    fdout,
-    "INSERT INTO %sfield_string_refs VALUES (%d, %d, %d);\n",
-    prefix,
-    next_string_ref++,
-    field_id,
-    string_id);
+// Lookups that are safe while other threads read the same map.
+template <typename Key>
+int find_id(const std::unordered_map<Key*, int>& ids, Key* key) {
+  auto it = ids.find(key);
+  return it == ids.end() ? -1 : it->second;
 }
 
-void dump_method_refs(FILE* fdout, const char* prefix, DexMethod* method, int method_id) {
-  auto code = method->get_code();
-  if (!code) return;
+enum class Format { SQL, CSV };
 
-  static int next_string_ref = 0;
-  static int next_class_ref = 0;
-  static int next_field_ref = 0;
-  static int next_method_ref = 0;
-
-  for (auto& mie : InstructionIterable(code)) {
-    auto insn = mie.insn;
-    if (insn->has_string()) {
-      if (string_ids.count(insn->get_string())) {
-        auto string_id = string_ids[insn->get_string()];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_string_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_string_ref++,
-          method_id,
-          string_id,
-          insn->opcode());
-      }
-    }
-    if (insn->has_type()) {
-      auto cls = type_class(insn->get_type());
-      if (cls && class_ids.count(cls)) {
-        auto class_id = class_ids[cls];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_class_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_class_ref++,
-          method_id,
-          class_id,
-          insn->opcode());
-      }
-    }
-    if (insn->has_field()) {
-      auto field = resolve_field(insn->get_field());
-      if (field != nullptr && field_ids.count(field)) {
-        auto field_id = field_ids[field];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_field_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_field_ref++,
-          method_id,
-          field_id,
-          insn->opcode());
-      }
-    }
-    if (insn->has_method()) {
-      auto meth = resolve_method(insn->get_method(), opcode_to_search(insn));
-      if (meth != nullptr && method_ids.count(meth)) {
-        auto method_ref_id = method_ids[meth];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_method_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_method_ref++,
-          method_id,
-          method_ref_id,
-          insn->opcode());
-      }
-    }
-  }
-}
-
-void dump_class(FILE* fdout, const char* prefix, const char* dex_id, DexClass* cls, int class_id) {
-  // TODO: annotations?
-  // TODO: inheritance?
-  // TODO: string usage
-  // TODO: size estimate
-  auto deobfuscated_name = cls->get_deobfuscated_name();
-  fprintf(
-    fdout,
-    "INSERT INTO %sclasses VALUES (%d,'%s','%s','%s',%u);\n",
-    prefix,
-    class_id,
-    dex_id,
-    deobfuscated_name.c_str(),
-    cls->get_name()->c_str(),
-    cls->get_access()
-  );
-}
-
-void dump_field(FILE* fdout, const char* prefix, int class_id, DexField* field, int field_id) {
-  // TODO: more fixup here on this crapped up name/signature
-  // TODO: break down signature
-  // TODO: annotations?
-  // TODO: string usage (encoded_value for static fields)
-  auto deobfuscated_name = field->get_deobfuscated_name();
-  auto field_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %sfields VALUES(%d, %d, '%s', '%s', %u);\n",
-    prefix,
-    field_id,
-    class_id,
-    field_name,
-    field->get_name()->c_str(),
-    field->get_access()
-  );
-}
+enum Table {
+  CLASSES,
+  METHODS,
+  IS_A,
+  STRINGS,
+  FIELDS,
+  FIELD_STRING_REFS,
+  METHOD_CLASS_REFS,
+  METHOD_METHOD_REFS,
+  METHOD_FIELD_REFS,
+  METHOD_STRING_REFS,
+  NUM_TABLES
+};
 
-void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* method, int method_id) {
-  // TODO: more fixup here on this crapped up name/signature
-  // TODO: break down signature
-  // TODO: throws?
-  // TODO: annotations?
-  // TODO: string usage
-  // TODO: size estimate
-  auto deobfuscated_name = method->get_deobfuscated_name();
-  auto method_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %smethods VALUES (%d,%d,'%s','%s',%d,%lu);\n",
-    prefix,
-    method_id,
-    class_id,
-    method_name,
-    method->get_name()->c_str(),
-    method->get_access(),
-    method->get_code() ? method->get_code()->sum_opcode_sizes() : 0
-  );
-}
+const char* const s_table_names[NUM_TABLES] = {
+    "classes",           "methods",           "is_a",
+    "strings",           "fields",            "field_string_refs",
+    "method_class_refs", "method_method_refs", "method_field_refs",
+    "method_string_refs",
+};
 
-void dump_sql(
-  FILE* fdout,
-  DexStoresVector& stores,
-  ProguardMap& pg_map,
-  const char* prefix) {
-  fprintf(
-    fdout,
-R"___(
+const char* const s_schema = R"___(
 DROP TABLE IF EXISTS %1$sfield_string_refs;
 DROP TABLE IF EXISTS %1$smethod_string_refs;
 DROP TABLE IF EXISTS %1$smethod_field_refs;
@@ -263,114 +160,457 @@ CREATE TABLE %1$smethod_string_refs (
   ref_string_id INTEGER NOT NULL, -- fk:strings.id
   opcode INTEGER NOT NULL
 );
-)___",
-    prefix
-  );
+)___";
+
+/*
+ * The rows of one table that one task produced, formatted but without their
+ * ids. Every table's ids are just its row numbers, so the tasks can run in
+ * any order and the rows get numbered as the chunks are written out in order.
+ */
+class Chunk {
+ public:
+  Chunk& integer(int64_t value) {
+    separate();
+    m_rows += std::to_string(value);
+    return *this;
+  }
+
+  Chunk& text(const char* value, Format format) {
+    separate();
+    if (format == Format::SQL) {
+      m_rows += '\'';
+      for (auto p = value; *p; ++p) {
+        if (*p == '\'') m_rows += '\'';
+        m_rows += *p;
+      }
+      m_rows += '\'';
+    } else if (strpbrk(value, ",\"\r\n") == nullptr) {
+      m_rows += value;
+    } else {
+      m_rows += '"';
+      for (auto p = value; *p; ++p) {
+        if (*p == '"') m_rows += '"';
+        m_rows += *p;
+      }
+      m_rows += '"';
+    }
+    return *this;
+  }
+
+  void end_row() {
+    m_ends.push_back(m_rows.size());
+    m_in_row = false;
+  }
+
+  size_t size() const { return m_ends.size(); }
+
+  // The columns of row i after the id, separated by commas.
+  std::pair<const char*, size_t> row(size_t i) const {
+    auto begin = i == 0 ? 0 : m_ends[i - 1];
+    return {m_rows.data() + begin, m_ends[i] - begin};
+  }
+
+ private:
+  void separate() {
+    if (m_in_row) m_rows += ',';
+    m_in_row = true;
+  }
+
+  std::string m_rows;
+  std::vector<size_t> m_ends;
+  bool m_in_row{false};
+};
+
+struct Dex {
+  DexClasses* classes;
+  std::string id; // "<store>/<dex_id>"
+  std::vector<DexString*> strings;
+};
+
+void dump_field_refs(Chunk& string_refs, DexField* field, int field_id) {
+  auto* static_value = field->get_static_value();
+  if (!static_value || (static_value->evtype() != DEVT_STRING)) return;
+  auto* static_string_value = static_cast<DexEncodedValueString*>(static_value);
+  auto string_id = find_id(string_ids, static_string_value->string());
+  if (string_id < 0) return;
+  string_refs.integer(field_id).integer(string_id).end_row();
+}
+
+void dump_method_refs(Chunk* refs, DexMethod* method, int method_id) {
+  auto code = method->get_code();
+  if (!code) return;
+
+  for (auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    if (insn->has_string()) {
+      auto string_id = find_id(string_ids, insn->get_string());
+      if (string_id >= 0) {
+        refs[METHOD_STRING_REFS]
+            .integer(method_id)
+            .integer(string_id)
+            .integer(insn->opcode())
+            .end_row();
+      }
+    }
+    if (insn->has_type()) {
+      auto cls = type_class(insn->get_type());
+      auto class_id = cls ? find_id(class_ids, cls) : -1;
+      if (class_id >= 0) {
+        refs[METHOD_CLASS_REFS]
+            .integer(method_id)
+            .integer(class_id)
+            .integer(insn->opcode())
+            .end_row();
+      }
+    }
+    if (insn->has_field()) {
+      auto field = resolve_field(insn->get_field());
+      auto field_id = field ? find_id(field_ids, field) : -1;
+      if (field_id >= 0) {
+        refs[METHOD_FIELD_REFS]
+            .integer(method_id)
+            .integer(field_id)
+            .integer(insn->opcode())
+            .end_row();
+      }
+    }
+    if (insn->has_method()) {
+      auto meth = resolve_method(insn->get_method(), opcode_to_search(insn));
+      auto method_ref_id = meth ? find_id(method_ids, meth) : -1;
+      if (method_ref_id >= 0) {
+        refs[METHOD_METHOD_REFS]
+            .integer(method_id)
+            .integer(method_ref_id)
+            .integer(insn->opcode())
+            .end_row();
+      }
+    }
+  }
+}
+
+void dump_class(Chunk& classes, Format format, const char* dex_id, DexClass* cls) {
+  // TODO: annotations?
+  // TODO: inheritance?
+  // TODO: string usage
+  // TODO: size estimate
+  auto deobfuscated_name = cls->get_deobfuscated_name();
+  classes.text(dex_id, format)
+      .text(deobfuscated_name.c_str(), format)
+      .text(cls->get_name()->c_str(), format)
+      .integer(cls->get_access())
+      .end_row();
+}
+
+// Deobfuscated member names look like "Lcls;.name:type"; keep what follows
+// the class.
+std::string member_name(const std::string& deobfuscated_name) {
+  auto pos = deobfuscated_name.find(';');
+  return pos == std::string::npos ? "" : deobfuscated_name.substr(pos);
+}
+
+void dump_field(Chunk& fields, Format format, int class_id, DexField* field) {
+  // TODO: more fixup here on this crapped up name/signature
+  // TODO: break down signature
+  // TODO: annotations?
+  // TODO: string usage (encoded_value for static fields)
+  auto field_name = member_name(field->get_deobfuscated_name());
+  fields.integer(class_id)
+      .text(field_name.c_str(), format)
+      .text(field->get_name()->c_str(), format)
+      .integer(field->get_access())
+      .end_row();
+}
+
+void dump_method(Chunk& methods, Format format, int class_id, DexMethod* method) {
+  // TODO: more fixup here on this crapped up name/signature
+  // TODO: break down signature
+  // TODO: throws?
+  // TODO: annotations?
+  // TODO: string usage
+  // TODO: size estimate
+  auto method_name = member_name(method->get_deobfuscated_name());
+  methods.integer(class_id)
+      .text(method_name.c_str(), format)
+      .text(method->get_name()->c_str(), format)
+      .integer(method->get_access())
+      .integer(method->get_code() ? method->get_code()->sum_opcode_sizes() : 0)
+      .end_row();
+}
+
+/*
+ * Ids are handed out serially, in the order the rows are written, so the dump
+ * is the same whatever the number of threads.
+ */
+void assign_ids(std::vector<Dex>& dexes) {
   int next_class_id = 0;
   int next_method_id = 0;
   int next_field_id = 0;
   int next_string_id = 0;
+  for (auto& dex : dexes) {
+    for (auto dexstr : dex.strings) {
+      string_ids[dexstr] = next_string_id++;
+    }
+    for (const auto& cls : *dex.classes) {
+      class_ids[cls] = next_class_id++;
+      for (auto field : cls->get_ifields()) {
+        field_ids[field] = next_field_id++;
+      }
+      for (auto field : cls->get_sfields()) {
+        field_ids[field] = next_field_id++;
+      }
+      for (const auto& meth : cls->get_dmethods()) {
+        method_ids[meth] = next_method_id++;
+      }
+      for (auto& meth : cls->get_vmethods()) {
+        method_ids[meth] = next_method_id++;
+      }
+    }
+  }
+}
 
-  // Dump all dex items
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
-  for (auto& store : stores) {
-    auto store_name = store.get_name();
-    auto& dexen = store.get_dexen();
-    apply_deobfuscated_names(dexen, pg_map);
-    for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
-      auto& dex = dexen[dex_idx];
-      GatheredTypes gtypes(&dex);
-      auto strings = gtypes.get_cls_order_dexstring_emitlist();
-      for (auto dexstr : strings) {
-        int id = next_string_id++;
-        string_ids[dexstr] = id;
-        // Escape string before inserting. ' -> ''
-        std::string esc(dexstr->c_str());
-        boost::replace_all(esc, "'", "''");
-        fprintf(fdout, "INSERT INTO %sstrings VALUES(%d, '%s');\n", prefix, id, esc.c_str());
+void dump_dex_table(const Dex& dex, Table table, Format format, Chunk* out) {
+  switch (table) {
+  case STRINGS:
+    for (auto dexstr : dex.strings) {
+      out[STRINGS].text(dexstr->c_str(), format).end_row();
+    }
+    break;
+  case CLASSES:
+    for (const auto& cls : *dex.classes) {
+      dump_class(out[CLASSES], format, dex.id.c_str(), cls);
+    }
+    break;
+  case FIELDS:
+    for (const auto& cls : *dex.classes) {
+      int class_id = class_ids.at(cls);
+      for (auto field : cls->get_ifields()) {
+        dump_field(out[FIELDS], format, class_id, field);
       }
-      std::string dex_id_str(store_name + "/" + std::to_string(dex_idx));
-      const char* dex_id = dex_id_str.c_str();
-      for (const auto& cls : dex) {
-        int class_id = next_class_id++;
-        dump_class(fdout, prefix, dex_id, cls, class_id);
-        class_ids[cls] = class_id;
-        for (auto field : cls->get_ifields()) {
-          int field_id = next_field_id++;
-          field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
-        }
-        for (auto field : cls->get_sfields()) {
-          int field_id = next_field_id++;
-          field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
-        }
-        for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = next_method_id++;
-          method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
-        }
-        for (auto& meth : cls->get_vmethods()) {
-          int meth_id = next_method_id++;
-          method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
-        }
+      for (auto field : cls->get_sfields()) {
+        dump_field(out[FIELDS], format, class_id, field);
+      }
+    }
+    break;
+  case METHODS:
+    for (const auto& cls : *dex.classes) {
+      int class_id = class_ids.at(cls);
+      for (const auto& meth : cls->get_dmethods()) {
+        dump_method(out[METHODS], format, class_id, meth);
+      }
+      for (auto& meth : cls->get_vmethods()) {
+        dump_method(out[METHODS], format, class_id, meth);
       }
     }
+    break;
+  default:
+    // All the reference tables come out of one walk over the code.
+    for (const auto& cls : *dex.classes) {
+      for (const auto& meth : cls->get_dmethods()) {
+        dump_method_refs(out, meth, method_ids.at(meth));
+      }
+      for (auto& meth : cls->get_vmethods()) {
+        dump_method_refs(out, meth, method_ids.at(meth));
+      }
+      for (const auto& field : cls->get_sfields()) {
+        dump_field_refs(out[FIELD_STRING_REFS], field, field_ids.at(field));
+      }
+      for (const auto& field : cls->get_ifields()) {
+        dump_field_refs(out[FIELD_STRING_REFS], field, field_ids.at(field));
+      }
+    }
+    break;
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+}
 
-  // Dump references
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
+void dump_is_a(const ClassHierarchy& ch,
+               const Scope& scope,
+               size_t begin,
+               size_t end,
+               Chunk& is_a) {
+  for (size_t i = begin; i < end; ++i) {
+    auto cls = scope[i];
+    TypeSet results;
+    get_all_children_or_implementors(ch, scope, cls, results);
+    for (auto type : results) {
+      auto type_cls = type_class(type);
+      auto type_cls_id = type_cls ? find_id(class_ids, type_cls) : -1;
+      if (type_cls_id >= 0) {
+        is_a.integer(type_cls_id).integer(class_ids.at(cls)).end_row();
+      }
+    }
+  }
+}
+
+// SQLite's default limit on the number of rows in a VALUES clause.
+constexpr size_t kRowsPerInsert = 500;
+
+/*
+ * Writes the rows of a chunk, numbering them from :first_id. With Format::SQL
+ * they go into INSERTs of their own, so that the chunks of different tables
+ * can be interleaved in one script.
+ */
+void write_rows(FILE* fdout,
+                Format format,
+                const char* prefix,
+                const char* table,
+                const Chunk& chunk,
+                size_t first_id) {
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    auto row = chunk.row(i);
+    auto id = first_id + i;
+    if (format == Format::CSV) {
+      fprintf(fdout, "%zu,", id);
+      fwrite(row.first, 1, row.second, fdout);
+      fputc('\n', fdout);
+      continue;
+    }
+    if (i % kRowsPerInsert == 0) {
+      fprintf(fdout, "%sINSERT INTO %s%s VALUES\n", i ? ";\n" : "", prefix,
+              table);
+    } else {
+      fputs(",\n", fdout);
+    }
+    fprintf(fdout, "(%zu,", id);
+    fwrite(row.first, 1, row.second, fdout);
+    fputc(')', fdout);
+  }
+  if (format == Format::SQL && chunk.size()) {
+    fputs(";\n", fdout);
+  }
+}
+
+/*
+ * With Format::SQL everything goes to fdout as one script of multi-row
+ * INSERTs. With Format::CSV fdout only gets the sqlite3 script that creates
+ * the tables and imports the per-table CSV files written into csv_dir.
+ */
+void dump_sql(
+  FILE* fdout,
+  DexStoresVector& stores,
+  ProguardMap& pg_map,
+  const char* prefix,
+  Format format,
+  const std::string& csv_dir,
+  unsigned num_threads) {
+  auto start = std::chrono::steady_clock::now();
+  fprintf(fdout, s_schema, prefix);
+
+  std::vector<Dex> dexes;
   for (auto& store : stores) {
+    auto store_name = store.get_name();
     auto& dexen = store.get_dexen();
+    apply_deobfuscated_names(dexen, pg_map);
     for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
-      auto& dex = dexen[dex_idx];
-      for (const auto& cls : dex) {
-        for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
-        }
-        for (auto& meth : cls->get_vmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
-        }
-        for (const auto& field : cls->get_sfields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
-        }
-        for (const auto& field : cls->get_ifields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
-        }
-      }
+      dexes.push_back(
+          {&dexen[dex_idx], store_name + "/" + std::to_string(dex_idx), {}});
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+  auto gather_wq = workqueue_foreach<Dex*>(
+      [](Dex* dex) {
+        GatheredTypes gtypes(dex->classes);
+        dex->strings = gtypes.get_cls_order_dexstring_emitlist();
+      },
+      num_threads);
+  for (auto& dex : dexes) {
+    gather_wq.add_item(&dex);
+  }
+  gather_wq.run_all();
+  assign_ids(dexes);
 
-  // Dump hierarchy
+  // The tasks of a slot fill the rows of its tables, in id order. The dex
+  // slots come first, then the hierarchy in slices of the scope. Slots are
+  // dumped a window at a time and written out in order before the next
+  // window starts, so only the rows of one window are held at once.
   auto scope = build_class_scope(stores);
   ClassHierarchy ch = build_type_hierarchy(scope);
-  int next_is_a_id = 0;
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
-  for (auto& cls : scope) {
-    TypeSet results;
-    get_all_children_or_implementors(ch, scope, cls, results);
-    for(auto type : results) {
-      auto type_cls = type_class(type);
-      if (type_cls) {
-        fprintf(
-          fdout,
-          "INSERT INTO %sis_a VALUES(%d, %d, %d);\n",
-          prefix,
-          next_is_a_id++,
-          class_ids[type_cls],
-          class_ids[cls]
-        );
+  const size_t kClassesPerSlice = 1000;
+  size_t num_slices = (scope.size() + kClassesPerSlice - 1) / kClassesPerSlice;
+  size_t num_slots = dexes.size() + num_slices;
+  size_t window = std::max(1u, num_threads) * 4;
+
+  FILE* outs[NUM_TABLES];
+  std::string csv_paths[NUM_TABLES];
+  if (format == Format::SQL) {
+    fprintf(fdout, "BEGIN TRANSACTION;\n");
+    std::fill(std::begin(outs), std::end(outs), fdout);
+  } else {
+    fprintf(fdout, ".mode csv\n");
+    for (size_t table = 0; table < NUM_TABLES; ++table) {
+      csv_paths[table] =
+          (boost::filesystem::path(csv_dir) /
+           (std::string(prefix) + s_table_names[table] + ".csv"))
+              .string();
+      outs[table] = fopen(csv_paths[table].c_str(), "w");
+      if (!outs[table]) {
+        fprintf(stderr, "Could not open %s for writing; terminating\n",
+                csv_paths[table].c_str());
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  size_t rows[NUM_TABLES] = {};
+  for (size_t first = 0; first < num_slots; first += window) {
+    size_t last = std::min(first + window, num_slots);
+    // chunks[slot - first][table] holds the rows of the slot's table.
+    std::vector<std::array<Chunk, NUM_TABLES>> chunks(last - first);
+    auto dump_wq = workqueue_foreach<std::pair<size_t, Table>>(
+        [&](std::pair<size_t, Table> task) {
+          size_t slot = task.first;
+          auto& out = chunks[slot - first];
+          if (task.second == IS_A) {
+            size_t begin = (slot - dexes.size()) * kClassesPerSlice;
+            dump_is_a(ch, scope, begin,
+                      std::min(begin + kClassesPerSlice, scope.size()),
+                      out[IS_A]);
+          } else {
+            // The tasks of a dex slot fill disjoint tables.
+            dump_dex_table(dexes[slot], task.second, format, out.data());
+          }
+        },
+        num_threads);
+    for (size_t slot = first; slot < last; ++slot) {
+      if (slot < dexes.size()) {
+        // METHOD_CLASS_REFS stands for all the reference tables.
+        for (auto table :
+             {STRINGS, CLASSES, FIELDS, METHODS, METHOD_CLASS_REFS}) {
+          dump_wq.add_item(std::make_pair(slot, table));
+        }
+      } else {
+        dump_wq.add_item(std::make_pair(slot, IS_A));
       }
     }
+    dump_wq.run_all();
+
+    for (const auto& slot_chunks : chunks) {
+      for (size_t table = 0; table < NUM_TABLES; ++table) {
+        write_rows(outs[table], format, prefix, s_table_names[table],
+                   slot_chunks[table], rows[table]);
+        rows[table] += slot_chunks[table].size();
+      }
+    }
+  }
+
+  size_t total_rows = 0;
+  for (size_t table = 0; table < NUM_TABLES; ++table) {
+    if (format == Format::CSV) {
+      fclose(outs[table]);
+      fprintf(fdout, ".import \"%s\" %s%s\n", csv_paths[table].c_str(),
+              prefix, s_table_names[table]);
+    }
+    fprintf(stderr, "%s%s: %zu rows\n", prefix, s_table_names[table],
+            rows[table]);
+    total_rows += rows[table];
+  }
+  if (format == Format::SQL) {
+    fprintf(fdout, "END TRANSACTION;\n");
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+
+  std::chrono::duration<double> seconds =
+      std::chrono::steady_clock::now() - start;
+  fprintf(stderr, "Dumped %zu rows in %.2fs (%.0f rows/s)\n", total_rows,
+          seconds.count(),
+          seconds.count() > 0 ? total_rows / seconds.count() : 0.0);
 }
 
 class DexSqlDump : public Tool {
@@ -385,10 +625,19 @@ class DexSqlDump : public Tool {
        "path to a rename map")
       ("output,o",
        po::value<std::string>()->value_name("dex.sql"),
-       "path to output sql dump file (defaults to stdout)")
+       "path to output sql dump file (defaults to stdout); with --format csv, "
+       "the directory to write the csv files and import.sql into")
       ("table-prefix,t",
        po::value<std::string>()->value_name("pre_"),
        "prefix to use on all table names")
+      ("format,f",
+       po::value<std::string>()->value_name("sql|csv"),
+       "sql: one script of INSERT statements (the default); csv: one csv "
+       "file per table and an import.sql script for sqlite3 to bulk-load "
+       "them")
+      ("jobs",
+       po::value<unsigned>()->value_name("N"),
+       "number of threads generating rows (defaults to the number of cores)")
     ;
   }
 
@@ -399,19 +648,45 @@ class DexSqlDump : public Tool {
       options["dexendir"].as<std::string>());
     ProguardMap pgmap(options.count("proguard-map") ?
       options["proguard-map"].as<std::string>() : "/dev/null");
-    const std::string& filename = options["output"].as<std::string>();
-    FILE* fdout = options.count("output") ?
-      fopen(filename.c_str(), "w") : stdout;
     std::string prefix = options.count("table-prefix") ?
       options["table-prefix"].as<std::string>() : "";
+    auto format_name =
+        options.count("format") ? options["format"].as<std::string>() : "sql";
+    if (format_name != "sql" && format_name != "csv") {
+      fprintf(stderr, "Unknown format %s; terminating\n", format_name.c_str());
+      exit(EXIT_FAILURE);
+    }
+    auto format = format_name == "csv" ? Format::CSV : Format::SQL;
+    unsigned num_threads =
+        options.count("jobs")
+            ? std::max(1u, options["jobs"].as<unsigned>())
+            : std::max(1u, boost::thread::hardware_concurrency());
+
+    std::string filename;
+    std::string csv_dir;
+    if (format == Format::CSV) {
+      if (!options.count("output")) {
+        fprintf(stderr, "--format csv needs an --output directory\n");
+        exit(EXIT_FAILURE);
+      }
+      // import.sql names the csv files by absolute path, so sqlite3 can run
+      // it from anywhere.
+      csv_dir = boost::filesystem::absolute(options["output"].as<std::string>())
+                    .string();
+      boost::filesystem::create_directories(csv_dir);
+      filename = (boost::filesystem::path(csv_dir) / "import.sql").string();
+    } else if (options.count("output")) {
+      filename = options["output"].as<std::string>();
+    }
+    FILE* fdout = filename.empty() ? stdout : fopen(filename.c_str(), "w");
     if (!fdout) {
       fprintf(stderr,
               "Could not open %s for writing; terminating\n",
               filename.c_str());
       exit(EXIT_FAILURE);
     }
-    auto* pfx_cstr = prefix.c_str();
-    dump_sql(fdout, stores, pgmap, pfx_cstr);
+    dump_sql(fdout, stores, pgmap, prefix.c_str(), format, csv_dir,
+             num_threads);
     fclose(fdout);
   }
 };
@@ -12,6 +12,7 @@
 #include "RedexDump.h"
 #include "utils/Unicode.h"
 
+#include <algorithm>
 #include <sstream>
 #include <vector>
 #include <string.h>
@@ -762,3 +763,361 @@ void dump_enarr(ddump_data* rd) {
     }
   }
 }
+
+//
+// Targeted queries...
+//
+// These look up single items through the sorted id tables and decode only
+// what was asked for, so they stay cheap on large dex files.
+//
+
+struct EncodedMember {
+  uint32_t idx;
+  uint32_t access_flags;
+  uint32_t code_off;
+};
+
+struct ClassData {
+  std::vector<EncodedMember> sfields;
+  std::vector<EncodedMember> ifields;
+  std::vector<EncodedMember> dmethods;
+  std::vector<EncodedMember> vmethods;
+};
+
+static ClassData read_class_data(ddump_data* rd, const dex_class_def* cls_def) {
+  ClassData data;
+  if (!cls_def->class_data_offset) {
+    return data;
+  }
+  const uint8_t* class_data =
+      reinterpret_cast<const uint8_t*>(rd->dexmmap +
+                                       cls_def->class_data_offset);
+  uint32_t sfield_count = read_uleb128(&class_data);
+  uint32_t ifield_count = read_uleb128(&class_data);
+  uint32_t dmethod_count = read_uleb128(&class_data);
+  uint32_t vmethod_count = read_uleb128(&class_data);
+  auto read_members = [&](uint32_t count,
+                          bool methods,
+                          std::vector<EncodedMember>& members) {
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      idx += read_uleb128(&class_data);
+      auto flags = read_uleb128(&class_data);
+      auto code = methods ? read_uleb128(&class_data) : 0;
+      members.push_back({idx, flags, code});
+    }
+  };
+  read_members(sfield_count, false, data.sfields);
+  read_members(ifield_count, false, data.ifields);
+  read_members(dmethod_count, true, data.dmethods);
+  read_members(vmethod_count, true, data.vmethods);
+  return data;
+}
+
+// Parses a query that is an index into a table of the given size.
+static bool parse_index(const char* query, uint32_t size, uint32_t* idx) {
+  if (!isdigit((unsigned char)*query)) {
+    return false;
+  }
+  char* end;
+  auto value = strtoul(query, &end, 10);
+  if (*end != '\0' || value >= size) {
+    return false;
+  }
+  *idx = (uint32_t)value;
+  return true;
+}
+
+static bool find_type(ddump_data* rd,
+                      const std::string& descriptor,
+                      uint16_t* typeidx) {
+  uint32_t stridx;
+  return find_string_in_dex(rd, descriptor.c_str(), &stridx) != nullptr &&
+         find_typeid_for_idx(rd, stridx, typeidx);
+}
+
+// Class defs are ordered so that superclasses come first, not by type, so
+// this is the one lookup that has to scan. It only compares type indices.
+static const dex_class_def* find_class_def(ddump_data* rd, uint16_t typeidx) {
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    if (rd->dex_class_defs[i].typeidx == typeidx) {
+      return rd->dex_class_defs + i;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * Return a proto descriptor in the form
+ * (argTypes)returnType
+ */
+static std::string get_proto_descriptor(ddump_data* rd, uint32_t idx) {
+  dex_proto_id* proto = rd->dex_proto_ids + idx;
+  std::string desc = "(";
+  if (proto->param_off) {
+    uint32_t* tl = (uint32_t*)(rd->dexmmap + proto->param_off);
+    uint32_t count = *tl++;
+    uint16_t* types = (uint16_t*)tl;
+    for (uint32_t i = 0; i < count; i++) {
+      desc += dex_string_by_type_idx(rd, *types++);
+    }
+  }
+  desc += ")";
+  desc += dex_string_by_type_idx(rd, proto->rtypeidx);
+  return desc;
+}
+
+/**
+ * Return a method descriptor in the form
+ * class.name:(argTypes)returnType
+ */
+static std::string get_method_descriptor(ddump_data* rd, uint32_t idx) {
+  dex_method_id* method = rd->dex_method_ids + idx;
+  std::string desc = dex_string_by_type_idx(rd, method->classidx);
+  desc += ".";
+  desc += dex_string_by_idx(rd, method->nameidx);
+  desc += ":";
+  desc += get_proto_descriptor(rd, method->protoidx);
+  return desc;
+}
+
+// A class query is a type descriptor or a class def index.
+static bool find_class(ddump_data* rd, const char* query, uint32_t* idx) {
+  if (parse_index(query, rd->dexh->class_defs_size, idx)) {
+    return true;
+  }
+  uint16_t typeidx;
+  if (!find_type(rd, query, &typeidx)) {
+    return false;
+  }
+  auto cls_def = find_class_def(rd, typeidx);
+  if (cls_def == nullptr) {
+    return false;
+  }
+  *idx = cls_def - rd->dex_class_defs;
+  return true;
+}
+
+// A method query is a method id index or a descriptor
+// Lcom/Foo;.bar:(I)V. Leaving out the proto matches every overload.
+static std::vector<uint32_t> find_methods(ddump_data* rd, const char* query) {
+  std::vector<uint32_t> found;
+  uint32_t idx;
+  if (parse_index(query, rd->dexh->method_ids_size, &idx)) {
+    found.push_back(idx);
+    return found;
+  }
+  std::string descriptor(query);
+  auto name_pos = descriptor.find(";.");
+  if (name_pos == std::string::npos) {
+    return found;
+  }
+  auto proto_pos = descriptor.find(':', name_pos);
+  auto cls = descriptor.substr(0, name_pos + 1);
+  auto name = descriptor.substr(name_pos + 2, proto_pos - (name_pos + 2));
+  uint16_t typeidx;
+  uint32_t nameidx;
+  if (!find_type(rd, cls, &typeidx) ||
+      find_string_in_dex(rd, name.c_str(), &nameidx) == nullptr) {
+    return found;
+  }
+  // Method ids are sorted by class, then name, then proto.
+  auto begin = rd->dex_method_ids;
+  auto end = begin + rd->dexh->method_ids_size;
+  auto less = [](const dex_method_id& m,
+                 const std::pair<uint16_t, uint32_t>& key) {
+    return m.classidx < key.first ||
+           (m.classidx == key.first && m.nameidx < key.second);
+  };
+  auto key = std::make_pair(typeidx, nameidx);
+  for (auto it = std::lower_bound(begin, end, key, less);
+       it != end && it->classidx == typeidx && it->nameidx == nameidx;
+       ++it) {
+    if (proto_pos == std::string::npos ||
+        get_proto_descriptor(rd, it->protoidx) ==
+            descriptor.substr(proto_pos + 1)) {
+      found.push_back(it - begin);
+    }
+  }
+  return found;
+}
+
+// Finds method idx in the data of the class that defines it, if that class
+// is in this dex.
+static bool find_encoded_method(ddump_data* rd,
+                                uint32_t idx,
+                                EncodedMember* member) {
+  auto cls_def = find_class_def(rd, rd->dex_method_ids[idx].classidx);
+  if (cls_def == nullptr) {
+    return false;
+  }
+  auto data = read_class_data(rd, cls_def);
+  for (const auto* methods : {&data.dmethods, &data.vmethods}) {
+    for (const auto& m : *methods) {
+      if (m.idx == idx) {
+        *member = m;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static Json::Value members_json(ddump_data* rd,
+                         const std::vector<EncodedMember>& members,
+                         bool methods) {
+  Json::Value array(Json::arrayValue);
+  for (const auto& m : members) {
+    Json::Value member(Json::objectValue);
+    member["index"] = m.idx;
+    member["access_flags"] = m.access_flags;
+    if (methods) {
+      member["descriptor"] = get_method_descriptor(rd, m.idx);
+      member["code_off"] = m.code_off;
+    } else {
+      dex_field_id* field = rd->dex_field_ids + m.idx;
+      std::string desc = dex_string_by_type_idx(rd, field->classidx);
+      desc += ".";
+      desc += dex_string_by_idx(rd, field->nameidx);
+      desc += ":";
+      desc += dex_string_by_type_idx(rd, field->typeidx);
+      member["descriptor"] = desc;
+    }
+    array.append(member);
+  }
+  return array;
+}
+
+static Json::Value class_json(ddump_data* rd, uint32_t idx) {
+  const dex_class_def* cls_def = rd->dex_class_defs + idx;
+  Json::Value cls(Json::objectValue);
+  cls["index"] = idx;
+  cls["descriptor"] = dex_string_by_type_idx(rd, cls_def->typeidx);
+  cls["access_flags"] = cls_def->access_flags;
+  cls["superclass"] = cls_def->super_idx != DEX_NO_INDEX
+                          ? Json::Value(dex_string_by_type_idx(
+                                rd, cls_def->super_idx))
+                          : Json::Value();
+  Json::Value interfaces(Json::arrayValue);
+  if (cls_def->interfaces_off) {
+    auto tl = (uint32_t*)(rd->dexmmap + cls_def->interfaces_off);
+    auto size = *tl++;
+    auto types = (uint16_t*)tl;
+    for (uint32_t i = 0; i < size; i++) {
+      interfaces.append(dex_string_by_type_idx(rd, *types++));
+    }
+  }
+  cls["interfaces"] = interfaces;
+  cls["source_file"] = cls_def->source_file_idx != DEX_NO_INDEX
+                           ? Json::Value(dex_string_by_idx(
+                                 rd, cls_def->source_file_idx))
+                           : Json::Value();
+  cls["annotations_off"] = cls_def->annotations_off;
+  cls["class_data_off"] = cls_def->class_data_offset;
+  cls["static_values_off"] = cls_def->static_values_off;
+  auto data = read_class_data(rd, cls_def);
+  cls["static_fields"] = members_json(rd, data.sfields, false);
+  cls["instance_fields"] = members_json(rd, data.ifields, false);
+  cls["direct_methods"] = members_json(rd, data.dmethods, true);
+  cls["virtual_methods"] = members_json(rd, data.vmethods, true);
+  return cls;
+}
+
+static Json::Value method_json(ddump_data* rd, uint32_t idx) {
+  Json::Value method(Json::objectValue);
+  method["index"] = idx;
+  method["descriptor"] = get_method_descriptor(rd, idx);
+  EncodedMember member;
+  if (!find_encoded_method(rd, idx, &member)) {
+    return method;
+  }
+  method["access_flags"] = member.access_flags;
+  method["code_off"] = member.code_off;
+  if (!member.code_off) {
+    return method;
+  }
+  auto code_item = (const dex_code_item*)(rd->dexmmap + member.code_off);
+  Json::Value code(Json::objectValue);
+  code["registers_size"] = code_item->registers_size;
+  code["ins_size"] = code_item->ins_size;
+  code["outs_size"] = code_item->outs_size;
+  code["tries_size"] = code_item->tries_size;
+  code["debug_info_off"] = code_item->debug_info_off;
+  code["insns_size"] = code_item->insns_size;
+  Json::Value tries(Json::arrayValue);
+  const uint16_t* insns_end =
+      (const uint16_t*)(code_item + 1) + code_item->insns_size;
+  if (code_item->tries_size) {
+    if (code_item->insns_size & 1) insns_end++; // padding before tries
+    auto try_item = (const dex_tries_item*)insns_end;
+    for (uint32_t i = 0; i < code_item->tries_size; i++, try_item++) {
+      Json::Value t(Json::objectValue);
+      t["start_addr"] = try_item->start_addr;
+      t["insn_count"] = try_item->insn_count;
+      t["handler_off"] = try_item->handler_off;
+      tries.append(t);
+    }
+  }
+  code["tries"] = tries;
+  if (code_item->debug_info_off) {
+    auto debug_item = (const uint8_t*)(rd->dexmmap + code_item->debug_info_off);
+    Json::Value debug(Json::objectValue);
+    debug["line_start"] = read_uleb128(&debug_item);
+    auto parameters_size = read_uleb128(&debug_item);
+    debug["parameters_size"] = parameters_size;
+    for (uint32_t i = 0; i < parameters_size; ++i) {
+      read_uleb128(&debug_item);
+    }
+    debug["num_opcodes"] = count_debug_instructions(debug_item);
+    code["debug_info"] = debug;
+  }
+  method["code"] = code;
+  return method;
+}
+
+bool dump_class(ddump_data* rd, const char* query, Json::Value* json) {
+  uint32_t idx;
+  if (!find_class(rd, query, &idx)) {
+    return false;
+  }
+  if (json != nullptr) {
+    json->append(class_json(rd, idx));
+    return true;
+  }
+  redump(idx, "%s\n", get_class_def(rd, idx).c_str());
+  redump(rd->dex_class_defs[idx].class_data_offset,
+         "%s",
+         get_class_data_item(rd, idx).c_str());
+  return true;
+}
+
+bool dump_method(ddump_data* rd, const char* query, Json::Value* json) {
+  auto found = find_methods(rd, query);
+  for (auto idx : found) {
+    if (json != nullptr) {
+      json->append(method_json(rd, idx));
+      continue;
+    }
+    EncodedMember member;
+    if (!find_encoded_method(rd, idx, &member)) {
+      redump(idx, "%s\n", get_method(rd, idx).c_str());
+      continue;
+    }
+    redump(idx,
+           "%s- %s - 0x%x\n",
+           get_flags(member.access_flags, false, true).c_str(),
+           get_method(rd, idx).c_str(),
+           member.code_off);
+    if (!member.code_off) {
+      continue;
+    }
+    auto code_item = (dex_code_item*)(rd->dexmmap + member.code_off);
+    auto debug_info_off = code_item->debug_info_off;
+    redump(member.code_off, "%s", get_code_item(&code_item).c_str());
+    if (debug_info_off) {
+      auto debug_item = (const uint8_t*)(rd->dexmmap + debug_info_off);
+      redump(debug_info_off, "%s", get_debug_item(&debug_item).c_str());
+    }
+  }
+  return !found.empty();
+}
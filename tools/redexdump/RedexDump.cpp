@@ -10,6 +10,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <iostream>
+#include <vector>
 
 #include "PrintUtil.h"
 #include "Formatters.h"
@@ -22,7 +24,7 @@ static const char ddump_usage_string[] =
     "Usage:\n"
     "\tredump [-h | --all | [[-string] [-type] [-proto] [-field] [-meth] "
     "[-clsdef] [-clsdata] [-code] [-enarr] [-anno]] [-clean]"
-    " <classes.dex>...\n"
+    " [--class=<query>] [--method=<query>] [--json] <classes.dex>...\n"
     "\n<classes.dex>: path to a dex file (not an APK!)\n"
     "\noptions:\n"
     "--h: help summary\n"
@@ -41,6 +43,13 @@ static const char ddump_usage_string[] =
     "-A, --anno: print items in the annotation section\n"
     "-d, --debug: print debug info items in the data section\n"
     "-D, --ddebug=<addr>: disassemble debug info item at <addr>\n"
+    "\nqueries:\n"
+    "--class=<query>: print the class def and class data of one class, given\n"
+    "  as a descriptor (Lcom/Foo;) or a class def index\n"
+    "--method=<query>: print the method id, code item and debug info of a\n"
+    "  method, given as Lcom/Foo;.bar:(I)V or a method id index; leave out\n"
+    "  the proto to match every overload\n"
+    "--json: print only the query results, as one JSON object per dex file\n"
     "\n"
     "printing options:\n"
     "--clean: suppress indices and offsets\n"
@@ -65,6 +74,9 @@ int main(int argc, char* argv[]) {
   bool redexdump_debug = false;
   uint32_t ddebug_offset = 0;
   int no_headers = 0;
+  int json = 0;
+  std::vector<const char*> class_queries;
+  std::vector<const char*> method_queries;
 
   char c;
   static const struct option options[] = {
@@ -86,6 +98,9 @@ int main(int argc, char* argv[]) {
     { "raw", no_argument, (int*)&raw, 1 },
     { "escape", no_argument, (int*)&escape, 1 },
     { "no-headers", no_argument, &no_headers, 1 },
+    { "class", required_argument, nullptr, 'K' },
+    { "method", required_argument, nullptr, 'M' },
+    { "json", no_argument, &json, 1 },
     { "help", no_argument, nullptr, 'h' },
     { nullptr, 0, nullptr, 0 },
   };
@@ -139,6 +154,12 @@ int main(int argc, char* argv[]) {
       case 'D':
         sscanf(optarg, "%x", &ddebug_offset);
         break;
+      case 'K':
+        class_queries.push_back(optarg);
+        break;
+      case 'M':
+        method_queries.push_back(optarg);
+        break;
       case 'h':
         puts(ddump_usage_string);
         return 0;
@@ -157,10 +178,37 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  int status = 0;
+  auto not_found = [&](const char* dexfile,
+                       const char* kind,
+                       const char* query) {
+    fprintf(stderr, "%s: no %s matches %s\n", dexfile, kind, query);
+    status = 1;
+  };
+
   while (optind < argc) {
     const char* dexfile = argv[optind++];
     ddump_data rd;
     open_dex_file(dexfile, &rd);
+    if (json) {
+      Json::Value root(Json::objectValue);
+      root["dex"] = dexfile;
+      root["classes"] = Json::Value(Json::arrayValue);
+      root["methods"] = Json::Value(Json::arrayValue);
+      for (auto query : class_queries) {
+        if (!dump_class(&rd, query, &root["classes"])) {
+          not_found(dexfile, "class", query);
+        }
+      }
+      for (auto query : method_queries) {
+        if (!dump_method(&rd, query, &root["methods"])) {
+          not_found(dexfile, "method", query);
+        }
+      }
+      Json::StyledStreamWriter().write(std::cout, root);
+      std::cout.flush();
+      continue;
+    }
     if (!no_headers) {
       redump(format_map(&rd).c_str());
     }
@@ -203,9 +251,25 @@ int main(int argc, char* argv[]) {
     if (ddebug_offset != 0) {
       disassemble_debug(&rd, ddebug_offset);
     }
+    for (auto query : class_queries) {
+      if (!no_headers) {
+        redump("\nCLASS %s\n", query);
+      }
+      if (!dump_class(&rd, query)) {
+        not_found(dexfile, "class", query);
+      }
+    }
+    for (auto query : method_queries) {
+      if (!no_headers) {
+        redump("\nMETHOD %s\n", query);
+      }
+      if (!dump_method(&rd, query)) {
+        not_found(dexfile, "method", query);
+      }
+    }
     fprintf(stdout, "\n");
     fflush(stdout);
   }
 
-  return 0;
+  return status;
 }
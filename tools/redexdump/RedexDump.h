@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <json/json.h>
+
 #include "DexCommon.h"
 
 void dump_strings(ddump_data* rd, bool print_headers);
@@ -22,3 +24,12 @@ void dump_enarr(ddump_data* rd);
 void dump_anno(ddump_data* rd);
 void dump_debug(ddump_data* rd);
 void disassemble_debug(ddump_data* rd, uint32_t offset);
+
+// Print the class or methods matching a query: a descriptor (Lcom/Foo; or
+// Lcom/Foo;.bar:(I)V, where leaving out the proto matches every overload) or
+// an index into the class def or method id table. With a non-null json the
+// matches are appended to it instead. Returns false if nothing matched.
+bool dump_class(ddump_data* rd, const char* query, Json::Value* json = nullptr);
+bool dump_method(ddump_data* rd,
+                 const char* query,
+                 Json::Value* json = nullptr);
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Adler32.h"
+
+#include <algorithm>
+#include <zlib.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ADLER32_HW_ACCEL 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define ADLER32_HW_ACCEL 0
+#endif
+
+namespace {
+
+constexpr uint32_t kBase = 65521;
+// The largest n such that 255n(n+1)/2 + (n+1)(kBase-1) fits in 32 bits.
+constexpr size_t kNMax = 5552;
+
+uint32_t adler32_zlib(uint32_t adler, const uint8_t* data, size_t len) {
+  // zlib takes the length as a uInt.
+  constexpr size_t kChunk = 1u << 30;
+  while (len > kChunk) {
+    adler = (uint32_t)adler32(adler, data, kChunk);
+    data += kChunk;
+    len -= kChunk;
+  }
+  return (uint32_t)adler32(adler, data, (uInt)len);
+}
+
+#if ADLER32_HW_ACCEL
+/*
+ * For a block of 32 bytes b[0..31], s1 grows by the sum of the bytes and s2
+ * by 32 * s1 plus the sum of (32 - i) * b[i]. The blocks are processed in
+ * runs short enough that the 32-bit lanes cannot overflow before the sums
+ * are reduced modulo kBase.
+ */
+__attribute__((target("ssse3"))) uint32_t adler32_ssse3(uint32_t adler,
+                                                       const uint8_t* data,
+                                                       size_t len) {
+  constexpr size_t kBlock = 32;
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  size_t blocks = len / kBlock;
+  len -= blocks * kBlock;
+
+  const __m128i tap1 = _mm_setr_epi8(
+      32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i tap2 =
+      _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  while (blocks > 0) {
+    size_t n = std::min(kNMax / kBlock, blocks);
+    blocks -= n;
+
+    // v_ps accumulates s1 before each block, to be multiplied by 32.
+    __m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * n);
+    __m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+    __m128i v_s1 = zero;
+    for (; n > 0; --n, data += kBlock) {
+      const __m128i bytes1 = _mm_loadu_si128((const __m128i*)data);
+      const __m128i bytes2 = _mm_loadu_si128((const __m128i*)(data + 16));
+      v_ps = _mm_add_epi32(v_ps, v_s1);
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+      v_s2 = _mm_add_epi32(
+          v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+      v_s2 = _mm_add_epi32(
+          v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+    }
+    v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+    v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+    v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 += _mm_cvtsi128_si32(v_s1);
+    v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+    v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2 = _mm_cvtsi128_si32(v_s2);
+
+    s1 %= kBase;
+    s2 %= kBase;
+  }
+  return adler32_zlib(s2 << 16 | s1, data, len);
+}
+
+bool cpu_has_ssse3() {
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3);
+}
+
+bool s_use_ssse3 = cpu_has_ssse3();
+#endif
+
+} // namespace
+
+uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t len) {
+#if ADLER32_HW_ACCEL
+  if (s_use_ssse3) {
+    return adler32_ssse3(adler, data, len);
+  }
+#endif
+  return adler32_zlib(adler, data, len);
+}
+
+bool adler32_hw_accel_supported() {
+#if ADLER32_HW_ACCEL
+  return cpu_has_ssse3();
+#else
+  return false;
+#endif
+}
+
+void adler32_set_hw_accel(bool enabled) {
+#if ADLER32_HW_ACCEL
+  s_use_ssse3 = enabled && cpu_has_ssse3();
+#endif
+}
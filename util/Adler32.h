@@ -0,0 +1,25 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Adler-32 as computed by zlib's adler32(), which it falls back to. On x86
+ * CPUs with SSSE3, 32-byte blocks are summed with vector instructions, along
+ * the lines of Chromium's adler32_simd.
+ */
+uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t len);
+
+/*
+ * Whether the CPU has SSSE3. adler32_update uses it if it does, unless it is
+ * turned off with adler32_set_hw_accel(false), e.g. to compare against zlib.
+ */
+bool adler32_hw_accel_supported();
+void adler32_set_hw_accel(bool enabled);
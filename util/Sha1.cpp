@@ -14,6 +14,14 @@
 
 #include <cstring>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA1_HW_ACCEL 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define SHA1_HW_ACCEL 0
+#endif
+
 static const unsigned char PADDING[128] = {
   0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -208,6 +216,150 @@ static void sha1_transform(
   memset((unsigned char*) x, 0, sizeof(x));
 }
 
+/*
+ * The SHA extensions compute four rounds per instruction. This follows the
+ * reference implementation in Intel's "New Instructions Supporting the Secure
+ * Hash Algorithm on Intel Architecture Processors".
+ */
+#if SHA1_HW_ACCEL
+__attribute__((target("sha,sse4.1"))) static void sha1_transform_shani(
+    unsigned int state[5], const unsigned char* data, size_t blocks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_loadu_si128((const __m128i*)state);
+  __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+  __m128i e1;
+  abcd = _mm_shuffle_epi32(abcd, 0x1B);
+
+  for (; blocks > 0; --blocks, data += 64) {
+    __m128i abcd_save = abcd;
+    __m128i e0_save = e0;
+    __m128i msg0, msg1, msg2, msg3;
+
+    /* Rounds 0-3 */
+    msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), mask);
+    e0 = _mm_add_epi32(e0, msg0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    /* Rounds 4-7 */
+    msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), mask);
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+    /* Rounds 8-11 */
+    msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), mask);
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    /* Rounds 12-15 */
+    msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), mask);
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+/*
+ * Four rounds that consume the schedule word m0 and advance the schedule of
+ * the three others.
+ */
+#define SHANI_ROUNDS(ecur, eoth, m0, m1, m2, m3, f) \
+  ecur = _mm_sha1nexte_epu32(ecur, m0);             \
+  eoth = abcd;                                      \
+  m1 = _mm_sha1msg2_epu32(m1, m0);                  \
+  abcd = _mm_sha1rnds4_epu32(abcd, ecur, f);        \
+  m3 = _mm_sha1msg1_epu32(m3, m0);                  \
+  m2 = _mm_xor_si128(m2, m0);
+
+    SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 0) /* 16-19 */
+    SHANI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 1) /* 20-23 */
+    SHANI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 1) /* 24-27 */
+    SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 1) /* 28-31 */
+    SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 1) /* 32-35 */
+    SHANI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 1) /* 36-39 */
+    SHANI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 2) /* 40-43 */
+    SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 2) /* 44-47 */
+    SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 2) /* 48-51 */
+    SHANI_ROUNDS(e1, e0, msg1, msg2, msg3, msg0, 2) /* 52-55 */
+    SHANI_ROUNDS(e0, e1, msg2, msg3, msg0, msg1, 2) /* 56-59 */
+    SHANI_ROUNDS(e1, e0, msg3, msg0, msg1, msg2, 3) /* 60-63 */
+    SHANI_ROUNDS(e0, e1, msg0, msg1, msg2, msg3, 3) /* 64-67 */
+#undef SHANI_ROUNDS
+
+    /* Rounds 68-71 */
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    /* Rounds 72-75 */
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+    /* Rounds 76-79 */
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1B);
+  _mm_storeu_si128((__m128i*)state, abcd);
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+static bool cpu_has_sha() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+    return false;
+  }
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+static bool s_use_shani = cpu_has_sha();
+#endif
+
+static void sha1_transform_blocks(
+    unsigned int state[5],
+    const unsigned char* data,
+    size_t blocks) {
+#if SHA1_HW_ACCEL
+  if (s_use_shani) {
+    sha1_transform_shani(state, data, blocks);
+    return;
+  }
+#endif
+  for (; blocks > 0; --blocks, data += 64) {
+    sha1_transform(state, data);
+  }
+}
+
+bool sha1_hw_accel_supported() {
+#if SHA1_HW_ACCEL
+  return cpu_has_sha();
+#else
+  return false;
+#endif
+}
+
+void sha1_set_hw_accel(bool enabled) {
+#if SHA1_HW_ACCEL
+  s_use_shani = enabled && cpu_has_sha();
+#endif
+}
+
 /*
  * SHA1 initialization. Begins an SHA1 operation, writing a new context.
  */
@@ -250,8 +402,9 @@ void sha1_update(
            partLen);
     sha1_transform(context->state, context->buffer);
 
-    for (i = partLen; i + 63 < inputLen; i += 64)
-      sha1_transform(context->state, &input[i]);
+    unsigned int blocks = (inputLen - partLen) / 64;
+    sha1_transform_blocks(context->state, &input[partLen], blocks);
+    i = partLen + blocks * 64;
 
     index = 0;
   } else
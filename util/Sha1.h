@@ -10,6 +10,9 @@
 /*
  * This implementation of SHA1 is taken from HHVM with minor style edits:
  *   https://github.com/facebook/hhvm
+ *
+ * On x86 CPUs with the SHA extensions, the blocks are transformed with those
+ * instead.
  */
 
 /*
@@ -40,3 +43,11 @@ void sha1_update(
  * message digest and zeroizing the context.
  */
 void sha1_final(unsigned char* digest, Sha1Context* context);
+
+/*
+ * Whether the CPU has the SHA extensions. sha1_update uses them if it does,
+ * unless they are turned off with sha1_set_hw_accel(false), e.g. to compare
+ * against the portable implementation.
+ */
+bool sha1_hw_accel_supported();
+void sha1_set_hw_accel(bool enabled);